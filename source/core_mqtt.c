@@ -60,6 +60,115 @@
     #define MQTT_POST_STATE_UPDATE_HOOK( pContext )
 #endif /* !MQTT_POST_STATE_UPDATE_HOOK */
 
+/*
+ * Lock hierarchy of the hooks:
+ *
+ * - The state update hooks guard the state records, the connection status
+ *   and packet ID allocation. The library never holds them across a call to
+ *   the transport interface.
+ * - The send hooks serialize complete packets on the transport send
+ *   function and guard the transmit timestamps. They are never nested with
+ *   the state update hooks in either order, which lets them default to the
+ *   state update hooks for applications using a single mutex.
+ * - The receive hooks guard the network buffer while a packet is read and
+ *   dispatched. The send and state update hooks may be taken while they are
+ *   held, so when defined they must map to a distinct lock which is always
+ *   taken first.
+ * - The publish queue hooks are only held while the queue indices are
+ *   updated and never while any other hook is taken.
+ *
+ * With distinct locks for all three, one thread may run #MQTT_ProcessLoop
+ * while another publishes, without either stalling on the other's network
+ * I/O except when both send at the same time.
+ */
+
+#ifndef MQTT_PRE_SEND_HOOK
+
+/**
+ * @brief Hook called just before a packet is written to the transport.
+ */
+    #define MQTT_PRE_SEND_HOOK( pContext )    MQTT_PRE_STATE_UPDATE_HOOK( pContext )
+#endif /* !MQTT_PRE_SEND_HOOK */
+
+#ifndef MQTT_POST_SEND_HOOK
+
+/**
+ * @brief Hook called just after a packet has been written to the transport.
+ */
+    #define MQTT_POST_SEND_HOOK( pContext )    MQTT_POST_STATE_UPDATE_HOOK( pContext )
+#endif /* !MQTT_POST_SEND_HOOK */
+
+#ifndef MQTT_PRE_RECEIVE_HOOK
+
+/**
+ * @brief Hook called just before a packet is read from the transport into
+ * the network buffer.
+ */
+    #define MQTT_PRE_RECEIVE_HOOK( pContext )
+#endif /* !MQTT_PRE_RECEIVE_HOOK */
+
+#ifndef MQTT_POST_RECEIVE_HOOK
+
+/**
+ * @brief Hook called just after a packet read from the transport has been
+ * processed and the network buffer is released.
+ */
+    #define MQTT_POST_RECEIVE_HOOK( pContext )
+#endif /* !MQTT_POST_RECEIVE_HOOK */
+
+#ifndef MQTT_PRE_PUBLISH_QUEUE_HOOK
+
+/**
+ * @brief Hook called just before the publish queue of a context is accessed.
+ */
+    #define MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext )
+#endif /* !MQTT_PRE_PUBLISH_QUEUE_HOOK */
+
+#ifndef MQTT_POST_PUBLISH_QUEUE_HOOK
+
+/**
+ * @brief Hook called just after the publish queue of a context has been
+ * accessed.
+ */
+    #define MQTT_POST_PUBLISH_QUEUE_HOOK( pContext )
+#endif /* !MQTT_POST_PUBLISH_QUEUE_HOOK */
+
+#ifndef MQTT_PRE_RECORD_POOL_HOOK
+
+/**
+ * @brief Hook called just before a block is taken from or returned to a
+ * shared record pool.
+ */
+    #define MQTT_PRE_RECORD_POOL_HOOK( pPool )
+#endif /* !MQTT_PRE_RECORD_POOL_HOOK */
+
+#ifndef MQTT_POST_RECORD_POOL_HOOK
+
+/**
+ * @brief Hook called just after a block has been taken from or returned to a
+ * shared record pool.
+ */
+    #define MQTT_POST_RECORD_POOL_HOOK( pPool )
+#endif /* !MQTT_POST_RECORD_POOL_HOOK */
+
+#ifndef MQTT_PRE_BUFFER_POOL_HOOK
+
+/**
+ * @brief Hook called just before a buffer is taken from or returned to a
+ * shared receive buffer pool.
+ */
+    #define MQTT_PRE_BUFFER_POOL_HOOK( pPool )
+#endif /* !MQTT_PRE_BUFFER_POOL_HOOK */
+
+#ifndef MQTT_POST_BUFFER_POOL_HOOK
+
+/**
+ * @brief Hook called just after a buffer has been taken from or returned to a
+ * shared receive buffer pool.
+ */
+    #define MQTT_POST_BUFFER_POOL_HOOK( pPool )
+#endif /* !MQTT_POST_BUFFER_POOL_HOOK */
+
 /**
  * @brief Bytes required to encode any string length in an MQTT packet header.
  * Length is always encoded in two bytes according to the MQTT specification.
@@ -74,18 +183,36 @@
  */
 #define CORE_MQTT_SUBSCRIBE_PER_TOPIC_VECTOR_LENGTH      ( 3U )
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @brief Number of vectors required to encode one topic filter in an
  * unsubscribe request. Two vectors are required as there are two fields in the
  * unsubscribe request namely:
  * 1. Topic filter length; and 2. Topic filter in this order.
  */
-#define CORE_MQTT_UNSUBSCRIBE_PER_TOPIC_VECTOR_LENGTH    ( 2U )
+    #define CORE_MQTT_UNSUBSCRIBE_PER_TOPIC_VECTOR_LENGTH    ( 2U )
+#endif
+
+/**
+ * @brief The largest fixed header of an MQTT packet: one byte of packet type
+ * and flags, and up to four bytes of remaining length.
+ */
+#define MQTT_FIXED_HEADER_MAX_SIZE              ( 5U )
+
+/**
+ * @brief Highest rate accepted by #MQTT_InitRateLimit, so that a rate
+ * multiplied by a number of milliseconds below one second fits in a uint32_t.
+ */
+#define MQTT_RATE_LIMIT_MAX_BYTES_PER_SECOND    ( UINT32_MAX / 1000U )
+
+#if ( MQTT_ENABLE_RETRANSMIT != 0 )
 
 /**
  * @brief Set flag in the packet ID just beyond the actual packet ID.
  */
-#define SET_INCOMING_PUB_FLAG( packetID )    ( ( uint32_t ) ( ( ( uint32_t ) packetID ) | ( ( ( uint32_t ) 1U ) << 16U ) ) )
+    #define SET_INCOMING_PUB_FLAG( packetID )    ( ( uint32_t ) ( ( ( uint32_t ) packetID ) | ( ( ( uint32_t ) 1U ) << 16U ) ) )
+#endif
 
 struct MQTTVec
 {
@@ -172,6 +299,64 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
                                   TransportOutVector_t * pIoVec,
                                   size_t ioVecCount );
 
+/**
+ * @brief Flush the transport after a packet has been sent, or note that it
+ * must be flushed at the end of the current batch if the packet belongs to it.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return The value returned by the transport flush function, or 0 if it was
+ * not called.
+ */
+static int32_t flushSentPacket( MQTTContext_t * pContext );
+
+/**
+ * @brief Start sending several packets in a row, so that the transport is
+ * flushed only after the last one.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ */
+static void beginSendBatch( MQTTContext_t * pContext );
+
+/**
+ * @brief End a batch started with #beginSendBatch, and flush the transport if
+ * it was the outermost one and packets were sent.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return #MQTTSendFailed if the transport flush function failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t endSendBatch( MQTTContext_t * pContext );
+
+/**
+ * @brief Release the send hook, then mark the connection for disconnection
+ * under the state update hook if a transport call failed while it was held.
+ *
+ * @param[in] pContext Initialized MQTT context whose send hook is held.
+ */
+static void releaseSendHook( MQTTContext_t * pContext );
+
+#if ( MQTT_SEND_COALESCE_BUFFER_SIZE > 0U )
+
+/**
+ * @brief Send the leading parts of a vector array with one call to the
+ * transport send function, copying them into a stack buffer if more than one
+ * of them fits in #MQTT_SEND_COALESCE_BUFFER_SIZE bytes.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pIoVec The vector array to be sent.
+ * @param[in] ioVecCount The number of elements in the array.
+ *
+ * @return The number of bytes sent or the error code as received from the
+ * transport interface.
+ */
+static int32_t sendCoalesced( const MQTTContext_t * pContext,
+                              const TransportOutVector_t * pIoVec,
+                              size_t ioVecCount );
+
+#endif /* if ( MQTT_SEND_COALESCE_BUFFER_SIZE > 0U ) */
+
 /**
  * @brief Add a string and its length after serializing it in a manner outlined by
  * the MQTT specification.
@@ -221,6 +406,8 @@ static MQTTStatus_t sendSubscribeWithoutCopy( MQTTContext_t * pContext,
                                               uint32_t remainingLength,
                                               const MQTTPropBuilder_t * pPropertyBuilder );
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @brief Send Unsubscribe without copying the users data into any buffer.
  *
@@ -248,6 +435,164 @@ static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
                                                 uint32_t remainingLength,
                                                 const MQTTPropBuilder_t * pPropertyBuilder );
 
+#endif
+
+/**
+ * @brief Send the publishes waiting in the publish queue of a context.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ *
+ * @return #MQTTSuccess if all queued publishes were sent, otherwise the
+ * status of the publish that stopped the queue from being drained, or of the
+ * first publish dropped for its own parameters.
+ */
+static MQTTStatus_t processPublishQueue( MQTTContext_t * pContext );
+
+/**
+ * @brief Find the next publish to send from the publish queue.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ * @param[in] pendingCount Number of elements from the head to look at.
+ * @param[in] minPriority Lowest priority class that may be selected.
+ *
+ * @return Offset from the queue head of the oldest publish of the highest
+ * class, or @p pendingCount if no publish of at least @p minPriority is queued.
+ */
+static size_t selectQueuedPublish( const MQTTContext_t * pContext,
+                                   size_t pendingCount,
+                                   MQTTPublishPriority_t minPriority );
+
+/**
+ * @brief Remove a publish from the publish queue, keeping the order of the
+ * others.
+ *
+ * Must be called with the publish queue hook held.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ * @param[in] offset Offset of the publish from the queue head.
+ */
+static void removeQueuedPublish( MQTTContext_t * pContext,
+                                 size_t offset );
+
+/**
+ * @brief Put a publish taken out of the publish queue back where it was,
+ * keeping the order of the others.
+ *
+ * Must be called with the publish queue hook held.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ * @param[in] offset Offset from the queue head the publish was taken from.
+ * @param[in] pRequest The publish to put back.
+ */
+static void restoreQueuedPublish( MQTTContext_t * pContext,
+                                  size_t offset,
+                                  const MQTTPublishRequest_t * pRequest );
+
+/**
+ * @brief Drop a queued publish to make room for a new one, as set by the
+ * publish queue policy.
+ *
+ * Must be called with the publish queue hook held.
+ *
+ * @param[in] pContext Initialized MQTT context with a full publish queue.
+ * @param[in] qos QoS of the new publish.
+ *
+ * @return true if a publish was dropped; false if the new publish is to be
+ * refused.
+ */
+static bool evictQueuedPublish( MQTTContext_t * pContext,
+                                MQTTQoS_t qos );
+
+/**
+ * @brief Refill the token bucket of a context and take the bytes of a PUBLISH
+ * from it.
+ *
+ * Must be called with the state update hook held.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] packetSize Size of the PUBLISH packet.
+ *
+ * @return #MQTTRateLimited if the bucket does not hold enough bytes, in which
+ * case the time to wait is saved in the context; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t admitPublish( MQTTContext_t * pContext,
+                                  uint32_t packetSize );
+
+/**
+ * @brief Borrow a block of records from the record pool of a context, if it
+ * uses one and does not hold a block for that direction yet.
+ *
+ * Must be called with the state update hook held.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] outgoing Whether the block is for outgoing or incoming publishes.
+ *
+ * @return #MQTTNoMemory if the pool has no free block; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t borrowRecords( MQTTContext_t * pContext,
+                                   bool outgoing );
+
+/**
+ * @brief Return the blocks of a context whose records are all free to its
+ * record pool.
+ *
+ * Must be called with the state update hook held.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ */
+static void releaseIdleRecords( MQTTContext_t * pContext );
+
+/**
+ * @brief Return a block to a record pool if all of its records are free.
+ *
+ * @param[in] pPool The pool the block was borrowed from.
+ * @param[in,out] ppRecords The records of the block, set to NULL when returned.
+ * @param[in,out] pMaxCount The number of records in use, set to zero when
+ * returned.
+ */
+static void releaseBlock( MQTTRecordPool_t * pPool,
+                          MQTTPubAckInfo_t ** ppRecords,
+                          size_t * pMaxCount );
+
+/**
+ * @brief Lease a buffer from the buffer pool of a context and move the bytes
+ * received so far into it, unless one is leased already.
+ *
+ * @param[in] pContext Initialized MQTT context with a buffer pool.
+ *
+ * @return #MQTTNoMemory if the pool has no free buffer; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t leaseNetworkBuffer( MQTTContext_t * pContext );
+
+/**
+ * @brief Return the leased network buffer of a context to its pool once it
+ * holds no received bytes.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ */
+static void releaseNetworkBuffer( MQTTContext_t * pContext );
+
+/**
+ * @brief Discard the bytes in the network buffer of a context and return a
+ * leased network buffer to its pool.
+ *
+ * The receive hook must be held, as the network buffer is only changed under
+ * it.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ */
+static void resetNetworkBuffer( MQTTContext_t * pContext );
+
+/**
+ * @brief Get the size of the largest packet a context can receive.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return The size of the network buffer, or of the buffers of the pool set
+ * with #MQTT_InitNetworkBufferPool.
+ */
+static size_t getReceiveBufferSize( const MQTTContext_t * pContext );
+
 /**
  * @brief Calculate the interval between two millisecond timestamps, including
  * when the later value has overflowed.
@@ -315,6 +660,8 @@ static MQTTStatus_t receiveConnackPacket( MQTTContext_t * pContext,
  */
 static uint8_t getAckTypeToSend( MQTTPublishState_t state );
 
+#if ( MQTT_ENABLE_QOS2 != 0 )
+
 /**
  * @brief Send acks for received QoS 1/2 publishes.
  *
@@ -328,6 +675,8 @@ static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
                                      uint16_t packetId,
                                      MQTTPublishState_t publishState );
 
+#endif
+
 /**
  * @brief Send a keep alive PINGREQ if the keep alive interval has elapsed.
  *
@@ -338,16 +687,40 @@ static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
  */
 static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext );
 
+/**
+ * @brief Get the period after which an idle connection must send a PINGREQ.
+ *
+ * @param[in] pContext Initialized MQTT Context.
+ *
+ * @return The keep alive interval in milliseconds, capped at
+ * #PACKET_TX_TIMEOUT_MS, or 0 if keep alive is disabled.
+ */
+static uint32_t getPacketTxTimeoutMs( const MQTTContext_t * pContext );
+
+/**
+ * @brief Get the time remaining until a timeout expires.
+ *
+ * @param[in] elapsedMs Time elapsed since the timeout was started.
+ * @param[in] timeoutMs Duration of the timeout.
+ *
+ * @return timeoutMs - elapsedMs, or 0 if the timeout has already expired.
+ */
+static uint32_t calculateRemainingTime( uint32_t elapsedMs,
+                                        uint32_t timeoutMs );
+
 /**
  * @brief Handle received MQTT PUBLISH packet.
  *
  * @param[in] pContext MQTT Connection context.
  * @param[in] pIncomingPacket Incoming packet.
+ * @param[out] pBufferTaken Set to true if the application took the buffer
+ * holding the packet.
  *
  * @return MQTTSuccess, MQTTIllegalState or deserialization error.
  */
 static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
-                                           MQTTPacketInfo_t * pIncomingPacket );
+                                           MQTTPacketInfo_t * pIncomingPacket,
+                                           bool * pBufferTaken );
 
 /**
  * @brief Handle received MQTT publish acks.
@@ -410,6 +783,31 @@ static MQTTStatus_t validateSubscribeUnsubscribeParams( const MQTTContext_t * pC
                                                         uint16_t packetId,
                                                         MQTTSubscriptionType_t subscriptionType );
 
+/**
+ * @brief Serialize a complete SUBSCRIBE or UNSUBSCRIBE packet into the
+ * subscribe buffer of the context and send it with a single transport call.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pSubscriptionList List of MQTT subscription info.
+ * @param[in] subscriptionCount The number of elements in pSubscriptionList.
+ * @param[in] packetId Packet identifier.
+ * @param[in] remainingLength Remaining length of the packet.
+ * @param[in] packetSize Size of the complete packet, which must fit in the
+ * subscribe buffer.
+ * @param[in] pPropertyBuilder Properties of the packet, or NULL.
+ * @param[in] subscriptionType Either #MQTT_TYPE_SUBSCRIBE or #MQTT_TYPE_UNSUBSCRIBE.
+ *
+ * @return #MQTTSuccess, #MQTTSendFailed or the error returned by the serializer.
+ */
+static MQTTStatus_t sendSerializedSubscribeUnsubscribe( MQTTContext_t * pContext,
+                                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                                        size_t subscriptionCount,
+                                                        uint16_t packetId,
+                                                        uint32_t remainingLength,
+                                                        uint32_t packetSize,
+                                                        const MQTTPropBuilder_t * pPropertyBuilder,
+                                                        MQTTSubscriptionType_t subscriptionType );
+
 /**
  * @brief Receives a CONNACK MQTT packet.
  *
@@ -431,6 +829,26 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
                                     MQTTPacketInfo_t * pIncomingPacket,
                                     bool * pSessionPresent );
 
+/**
+ * @brief Receive the rest of a CONNACK whose type and length have been read,
+ * deserialize it and hand it to the application callback.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] cleanSession Whether a clean session was requested.
+ * @param[in,out] pIncomingPacket Type and length of the incoming packet.
+ * @param[out] pSessionPresent Whether a previous session was present.
+ *
+ * @return #MQTTBadResponse if a bad response is received;
+ * #MQTTRecvFailed if transport recv failed;
+ * #MQTTServerRefused if the server refused the connection;
+ * #MQTTEventCallbackFailed if the application callback failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t processConnack( MQTTContext_t * pContext,
+                                    bool cleanSession,
+                                    MQTTPacketInfo_t * pIncomingPacket,
+                                    bool * pSessionPresent );
+
 /**
  * @brief Resends pending acks for a re-established MQTT session
  *
@@ -450,6 +868,52 @@ static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext );
  */
 static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext );
 
+/**
+ * @brief Validate the CONNECT parameters and send the CONNECT packet.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pConnectInfo MQTT CONNECT packet parameters.
+ * @param[in] pWillInfo Last Will and Testament. Pass NULL if not used.
+ * @param[in] pPropertyBuilder Properties to be sent in the CONNECT packet.
+ * @param[in] pWillPropertyBuilder Will properties to be sent in the CONNECT packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTStatusConnected if the connection is already established;
+ * #MQTTStatusDisconnectPending if MQTT_Disconnect must be called first;
+ * #MQTTSendFailed if transport send failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t sendConnect( MQTTContext_t * pContext,
+                                 const MQTTConnectInfo_t * pConnectInfo,
+                                 const MQTTPublishInfo_t * pWillInfo,
+                                 MQTTPropBuilder_t * pPropertyBuilder,
+                                 const MQTTPropBuilder_t * pWillPropertyBuilder );
+
+/**
+ * @brief Mark the connection as established after a successful CONNACK and
+ * restore or clean up the session state.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] sessionPresent Session present flag of the CONNACK.
+ *
+ * @return #MQTTSendFailed if resending session state failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t completeConnect( MQTTContext_t * pContext,
+                                     bool sessionPresent );
+
+/**
+ * @brief Check whether a packet ID is held by an outgoing publish record
+ * still awaiting its acknowledgement.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] packetId Packet ID to look up.
+ *
+ * @return true if the packet ID is in use; false otherwise.
+ */
+static bool isOutgoingPacketIdInUse( const MQTTContext_t * pContext,
+                                     uint16_t packetId );
+
 /**
  * @brief Send the publish packet without copying the topic string and payload in
  * the buffer.
@@ -461,6 +925,12 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext );
  * @param[in] headerSize Size of the serialized PUBLISH header.
  * @param[in] packetId Packet Id of the publish packet.
  * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] pPayloadFragments Fragments making up the payload, or NULL to
+ * send the payload of @p pPublishInfo.
+ * @param[in] fragmentCount Number of entries in @p pPayloadFragments.
+ * @param[in] pPayloadSource Source given to the transport sendPayload function
+ * to send the payload, or NULL.
+ * @param[in] payloadOffset Offset of the payload in @p pPayloadSource.
  *
  * @return #MQTTSendFailed if transport send during resend failed;
  * #MQTTPublishStoreFailed if storing the outgoing publish failed in the case of QoS 1/2
@@ -471,49 +941,183 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
                                             uint8_t * pMqttHeader,
                                             size_t headerSize,
                                             uint16_t packetId,
-                                            const MQTTPropBuilder_t * pPropertyBuilder );
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            const TransportOutVector_t * pPayloadFragments,
+                                            size_t fragmentCount,
+                                            const void * pPayloadSource,
+                                            size_t payloadOffset );
 
 /**
- * @brief Function to validate #MQTT_Publish parameters.
+ * @brief Send a payload with the transport sendPayload function, calling it
+ * repeatedly until every byte is sent, an error occurs or
+ * #MQTT_SEND_TIMEOUT_MS milliseconds have passed.
  *
  * @param[in] pContext Initialized MQTT context.
- * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
- * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[in] pPayloadSource Source of the payload.
+ * @param[in] payloadOffset Offset of the payload in @p pPayloadSource.
+ * @param[in] payloadLength Length of the payload.
  *
- * @return #MQTTBadParameter if invalid parameters are passed;
- * #MQTTSuccess otherwise.
+ * @return The total number of bytes sent or the error code as received from the
+ * transport interface.
  */
-static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
-                                           const MQTTPublishInfo_t * pPublishInfo,
-                                           uint16_t packetId );
+static int32_t sendPayloadFromSource( MQTTContext_t * pContext,
+                                      const void * pPayloadSource,
+                                      size_t payloadOffset,
+                                      size_t payloadLength );
 
 /**
- * @brief Performs matching for special cases when a topic filter ends
- * with a wildcard character.
- *
- * When the topic name has been consumed but there are remaining characters to
- * to match in topic filter, this function handles the following 2 cases:
- * - When the topic filter ends with "/+" or "/#" characters, but the topic
- * name only ends with '/'.
- * - When the topic filter ends with "/#" characters, but the topic name
- * ends at the parent level.
- *
- * @note This function ASSUMES that the topic name been consumed in linear
- * matching with the topic filer, but the topic filter has remaining characters
- * to be matched.
+ * @brief Validate, record and send a PUBLISH packet. Common to #MQTT_Publish,
+ * #MQTT_PublishFragments and #MQTT_PublishFromSource.
  *
- * @param[in] pTopicFilter The topic filter containing the wildcard.
- * @param[in] topicFilterLength Length of the topic filter being examined.
- * @param[in] filterIndex Index of the topic filter being examined.
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters. Its payload length is
+ * the total length of the payload.
+ * @param[in] packetId Packet Id of the publish packet.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] pPayloadFragments Fragments making up the payload, or NULL to
+ * send the payload of @p pPublishInfo.
+ * @param[in] fragmentCount Number of entries in @p pPayloadFragments.
+ * @param[in] pPayloadSource Source given to the transport sendPayload function
+ * to send the payload, or NULL.
+ * @param[in] payloadOffset Offset of the payload in @p pPayloadSource.
+ * @param[in] batched Whether the PUBLISH is part of the send batch of the
+ * calling thread, and may be flushed when the batch ends.
  *
- * @return Returns whether the topic filter and the topic name match.
+ * @return The status codes of #MQTT_Publish.
  */
-static bool matchEndWildcardsSpecialCases( const char * pTopicFilter,
-                                           uint16_t topicFilterLength,
-                                           uint16_t filterIndex );
+static MQTTStatus_t publishPacket( MQTTContext_t * pContext,
+                                   const MQTTPublishInfo_t * pPublishInfo,
+                                   uint16_t packetId,
+                                   const MQTTPropBuilder_t * pPropertyBuilder,
+                                   const TransportOutVector_t * pPayloadFragments,
+                                   size_t fragmentCount,
+                                   const void * pPayloadSource,
+                                   size_t payloadOffset,
+                                   bool batched );
 
 /**
- * @brief Attempt to match topic name with a topic filter starting with a wildcard.
+ * @brief Record and send a validated PUBLISH whose fixed header has been
+ * serialized. Common to #publishPacket and #MQTT_PublishPrepared.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id of the publish packet.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] pMqttHeader The serialized fixed header, including the topic
+ * length.
+ * @param[in] headerSize Size of @p pMqttHeader.
+ * @param[in] packetSize Size of the whole PUBLISH packet.
+ * @param[in] pPayloadFragments Fragments making up the payload, or NULL to
+ * send the payload of @p pPublishInfo.
+ * @param[in] fragmentCount Number of entries in @p pPayloadFragments.
+ * @param[in] pPayloadSource Source given to the transport sendPayload function
+ * to send the payload, or NULL.
+ * @param[in] payloadOffset Offset of the payload in @p pPayloadSource.
+ * @param[in] batched Whether the PUBLISH is part of the send batch of the
+ * calling thread.
+ *
+ * @return The status codes of #MQTT_Publish.
+ */
+static MQTTStatus_t sendValidatedPublish( MQTTContext_t * pContext,
+                                          const MQTTPublishInfo_t * pPublishInfo,
+                                          uint16_t packetId,
+                                          const MQTTPropBuilder_t * pPropertyBuilder,
+                                          uint8_t * pMqttHeader,
+                                          size_t headerSize,
+                                          uint32_t packetSize,
+                                          const TransportOutVector_t * pPayloadFragments,
+                                          size_t fragmentCount,
+                                          const void * pPayloadSource,
+                                          size_t payloadOffset,
+                                          bool batched );
+
+#if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
+/**
+ * @brief Get the Message Expiry Interval added to a PUBLISH property builder.
+ *
+ * @param[in] pPropertyBuilder MQTT Publish property builder, or NULL.
+ *
+ * @return The Message Expiry Interval in seconds, or 0 if the PUBLISH does not
+ * expire.
+ */
+static uint32_t getMessageExpiry( const MQTTPropBuilder_t * pPropertyBuilder );
+
+/**
+ * @brief Drop an expired PUBLISH retrieved for resending, or rewrite its
+ * Message Expiry Interval to the lifetime it has left.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] packetId Packet ID of the PUBLISH.
+ * @param[in,out] pMqttPacket The PUBLISH returned by the retrieve callback.
+ * @param[in] packetSize Size of @p pMqttPacket.
+ * @param[out] pExpired Set to true if the PUBLISH has expired and must not be
+ * resent.
+ *
+ * @return #MQTTSuccess, or the status of the failing state or serializer call.
+ */
+static MQTTStatus_t refreshMessageExpiry( MQTTContext_t * pContext,
+                                          uint16_t packetId,
+                                          uint8_t * pMqttPacket,
+                                          size_t packetSize,
+                                          bool * pExpired );
+
+#endif /* if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
+/**
+ * @brief Function to validate #MQTT_Publish parameters.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
+                                           const MQTTPublishInfo_t * pPublishInfo,
+                                           uint16_t packetId );
+
+/**
+ * @brief Validate the #MQTT_Publish parameters that do not depend on the
+ * state of the context.
+ *
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t validatePublishInfo( const MQTTPublishInfo_t * pPublishInfo,
+                                         uint16_t packetId );
+
+/**
+ * @brief Performs matching for special cases when a topic filter ends
+ * with a wildcard character.
+ *
+ * When the topic name has been consumed but there are remaining characters to
+ * to match in topic filter, this function handles the following 2 cases:
+ * - When the topic filter ends with "/+" or "/#" characters, but the topic
+ * name only ends with '/'.
+ * - When the topic filter ends with "/#" characters, but the topic name
+ * ends at the parent level.
+ *
+ * @note This function ASSUMES that the topic name been consumed in linear
+ * matching with the topic filer, but the topic filter has remaining characters
+ * to be matched.
+ *
+ * @param[in] pTopicFilter The topic filter containing the wildcard.
+ * @param[in] topicFilterLength Length of the topic filter being examined.
+ * @param[in] filterIndex Index of the topic filter being examined.
+ *
+ * @return Returns whether the topic filter and the topic name match.
+ */
+static bool matchEndWildcardsSpecialCases( const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           uint16_t filterIndex );
+
+/**
+ * @brief Attempt to match topic name with a topic filter starting with a wildcard.
  *
  * If the topic filter starts with a '+' (single-level) wildcard, the function
  * advances the @a pNameIndex by a level in the topic name.
@@ -633,6 +1237,83 @@ static void addSubscriptionOptions( const MQTTSubscribeInfo_t subscriptionInfo,
 static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
                                        MQTTPacketInfo_t * pIncomingPacket );
 
+/**
+ * @brief Find the subscription registry record of a topic filter.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pSubscribeInfo Subscription holding the topic filter to look up.
+ *
+ * @return Index of the record, or #MQTTContext_t.subscriptionRecordCount if
+ * the topic filter is not registered.
+ */
+static size_t findSubscriptionRecord( const MQTTContext_t * pContext,
+                                      const MQTTSubscribeInfo_t * pSubscribeInfo );
+
+/**
+ * @brief Record the topic filters of a SUBSCRIBE in the subscription registry
+ * as awaiting their SUBACK.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pSubscriptionList List of MQTT subscription info.
+ * @param[in] subscriptionCount The number of elements in pSubscriptionList.
+ * @param[in] packetId Packet identifier of the SUBSCRIBE.
+ *
+ * @return #MQTTNoMemory if the registry cannot hold the new topic filters, in
+ * which case it is left unchanged; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t recordSubscriptions( MQTTContext_t * pContext,
+                                         const MQTTSubscribeInfo_t * pSubscriptionList,
+                                         size_t subscriptionCount,
+                                         uint16_t packetId );
+
+/**
+ * @brief Remove a record from the subscription registry.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] index Index of the record to remove.
+ */
+static void removeSubscriptionRecord( MQTTContext_t * pContext,
+                                      size_t index );
+
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
+/**
+ * @brief Remove the topic filters of an UNSUBSCRIBE from the subscription
+ * registry.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pSubscriptionList List of MQTT subscription info.
+ * @param[in] subscriptionCount The number of elements in pSubscriptionList.
+ */
+static void removeSubscriptions( MQTTContext_t * pContext,
+                                 const MQTTSubscribeInfo_t * pSubscriptionList,
+                                 size_t subscriptionCount );
+
+#endif
+
+/**
+ * @brief Apply the reason codes of a SUBACK to the subscription registry.
+ *
+ * Records granted by the server are marked as granted and refused ones are
+ * removed.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] packetId Packet identifier of the SUBACK.
+ * @param[in] pReasonCodes Reason codes of the SUBACK.
+ */
+static void updateSubscriptionRecords( MQTTContext_t * pContext,
+                                       uint16_t packetId,
+                                       const MQTTReasonCodeInfo_t * pReasonCodes );
+
+/**
+ * @brief Re-issue all subscriptions of the registry after a session was lost.
+ *
+ * @param[in] pContext MQTT Connection context.
+ *
+ * @return #MQTTSuccess, or the error returned by #MQTT_Subscribe.
+ */
+static MQTTStatus_t resubscribeRegisteredSubscriptions( MQTTContext_t * pContext );
+
 /**
  * @brief Send acks for received QoS 1/2 publishes. This function is used to send
  *        Publish Acks without any properties or reason codes.
@@ -647,6 +1328,8 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
                                                     uint16_t packetId,
                                                     MQTTPublishState_t publishState );
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Send acks for received QoS 1/2 publishes with properties.
  *
@@ -674,6 +1357,8 @@ static MQTTStatus_t sendPublishAcksWithProperty( MQTTContext_t * pContext,
 static MQTTStatus_t validatePublishAckReasonCode( MQTTSuccessFailReasonCode_t reasonCode,
                                                   uint8_t packetType );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @brief Send the disconnect packet without copying the reason code and properties in
  * the buffer.
@@ -693,6 +1378,47 @@ static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
                                                uint32_t remainingLength,
                                                const MQTTPropBuilder_t * pPropertyBuilder );
 
+/**
+ * @brief Handle an incoming AUTH packet by handing it to the application
+ * callback, which may continue the exchange with #MQTT_Auth.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pIncomingPacket Information of incoming packet
+ *
+ * @return #MQTTSuccess, #MQTTBadResponse, #MQTTBadParameter, #MQTTEventCallbackFailed.
+ */
+static MQTTStatus_t handleIncomingAuth( MQTTContext_t * pContext,
+                                        MQTTPacketInfo_t * pIncomingPacket );
+
+/**
+ * @brief Receive and handle an AUTH packet sent by the server before the
+ * CONNACK.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pIncomingPacket Type and length of the incoming AUTH packet.
+ *
+ * @return #MQTTSuccess, #MQTTRecvFailed, #MQTTBadResponse, #MQTTBadParameter,
+ * #MQTTEventCallbackFailed.
+ */
+static MQTTStatus_t receiveConnectAuth( MQTTContext_t * pContext,
+                                        MQTTPacketInfo_t * pIncomingPacket );
+
+/**
+ * @brief Send an AUTH packet.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] reasonCode Reason code of the AUTH packet.
+ * @param[in] remainingLength Remaining length of the packet.
+ * @param[in] pPropertyBuilder Properties of the AUTH packet.
+ *
+ * @return #MQTTSendFailed if transport send failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t sendAuthWithoutCopy( MQTTContext_t * pContext,
+                                         MQTTSuccessFailReasonCode_t reasonCode,
+                                         uint32_t remainingLength,
+                                         const MQTTPropBuilder_t * pPropertyBuilder );
+
 /**
  * @brief Handle Incoming Disconnect
  *
@@ -968,9 +1694,13 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
         }
         else
         {
-            sendResult = pContext->transportInterface.send( pContext->transportInterface.pNetworkContext,
-                                                            pIoVectIterator->iov_base,
-                                                            pIoVectIterator->iov_len );
+            #if ( MQTT_SEND_COALESCE_BUFFER_SIZE > 0U )
+                sendResult = sendCoalesced( pContext, pIoVectIterator, vectorsToBeSent );
+            #else
+                sendResult = pContext->transportInterface.send( pContext->transportInterface.pNetworkContext,
+                                                                pIoVectIterator->iov_base,
+                                                                pIoVectIterator->iov_len );
+            #endif
         }
 
         if( sendResult > 0 )
@@ -993,10 +1723,7 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
             bytesSentOrError = sendResult;
             LogError( ( "sendMessageVector: Unable to send packet: Network Error." ) );
 
-            if( pContext->connectStatus == MQTTConnected )
-            {
-                pContext->connectStatus = MQTTDisconnectPending;
-            }
+            pContext->sendFailed = true;
         }
         else
         {
@@ -1039,9 +1766,68 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
         }
     }
 
+    if( ( bytesSentOrError == ( int32_t ) bytesToSend ) &&
+        ( flushSentPacket( pContext ) < 0 ) )
+    {
+        bytesSentOrError = -1;
+    }
+
     return bytesSentOrError;
 }
 
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_SEND_COALESCE_BUFFER_SIZE > 0U )
+
+static int32_t sendCoalesced( const MQTTContext_t * pContext,
+                              const TransportOutVector_t * pIoVec,
+                              size_t ioVecCount )
+{
+    int32_t sendResult;
+    uint8_t buffer[ MQTT_SEND_COALESCE_BUFFER_SIZE ];
+    size_t bufferLength = 0U;
+    size_t vectorCount = 0U;
+    size_t vector;
+
+    assert( pContext != NULL );
+    assert( pIoVec != NULL );
+    assert( ioVecCount > 0U );
+
+    /* Count the leading vectors that fit in the buffer together. */
+    while( ( vectorCount < ioVecCount ) &&
+           ( pIoVec[ vectorCount ].iov_len <= ( sizeof( buffer ) - bufferLength ) ) )
+    {
+        bufferLength += pIoVec[ vectorCount ].iov_len;
+        vectorCount++;
+    }
+
+    if( vectorCount > 1U )
+    {
+        bufferLength = 0U;
+
+        for( vector = 0U; vector < vectorCount; vector++ )
+        {
+            ( void ) memcpy( &( buffer[ bufferLength ] ), pIoVec[ vector ].iov_base, pIoVec[ vector ].iov_len );
+            bufferLength += pIoVec[ vector ].iov_len;
+        }
+
+        sendResult = pContext->transportInterface.send( pContext->transportInterface.pNetworkContext,
+                                                        buffer,
+                                                        bufferLength );
+    }
+    else
+    {
+        /* Copying a single vector saves no send call. */
+        sendResult = pContext->transportInterface.send( pContext->transportInterface.pNetworkContext,
+                                                        pIoVec->iov_base,
+                                                        pIoVec->iov_len );
+    }
+
+    return sendResult;
+}
+
+#endif /* if ( MQTT_SEND_COALESCE_BUFFER_SIZE > 0U ) */
+
 static int32_t sendBuffer( MQTTContext_t * pContext,
                            const uint8_t * pBufferToSend,
                            size_t bytesToSend )
@@ -1112,10 +1898,7 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
             bytesSentOrError = sendResult;
             LogError( ( "sendBuffer: Unable to send packet: Network Error." ) );
 
-            if( pContext->connectStatus == MQTTConnected )
-            {
-                pContext->connectStatus = MQTTDisconnectPending;
-            }
+            pContext->sendFailed = true;
         }
         else
         {
@@ -1130,94 +1913,210 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
         }
     }
 
+    if( ( bytesSentOrError == localCopyBytesToSend ) &&
+        ( flushSentPacket( pContext ) < 0 ) )
+    {
+        bytesSentOrError = -1;
+    }
+
     return bytesSentOrError;
 }
 
 /*-----------------------------------------------------------*/
 
-static uint32_t calculateElapsedTime( uint32_t later,
-                                      uint32_t start )
+static int32_t flushSentPacket( MQTTContext_t * pContext )
 {
-    return later - start;
+    int32_t flushResult = 0;
+
+    assert( pContext != NULL );
+
+    if( pContext->transportInterface.flush == NULL )
+    {
+        /* The transport sends every byte right away. */
+    }
+    else if( ( pContext->sendBatched == true ) && ( pContext->sendBatchDepth > 0U ) )
+    {
+        /* More packets of this batch follow; flush once the batch ends. */
+        pContext->flushPending = true;
+    }
+    else
+    {
+        /* Packets sent by other callers, such as another thread publishing
+         * while the receive loop runs the event callback, are not held back
+         * by the batch. The flush also covers any bytes the batch held. */
+        pContext->flushPending = false;
+        flushResult = pContext->transportInterface.flush( pContext->transportInterface.pNetworkContext );
+
+        if( flushResult < 0 )
+        {
+            LogError( ( "Unable to flush the transport: Network Error." ) );
+
+            pContext->sendFailed = true;
+        }
+    }
+
+    return flushResult;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTPubAckType_t getAckFromPacketType( uint8_t packetType )
+static void beginSendBatch( MQTTContext_t * pContext )
 {
-    MQTTPubAckType_t ackType = MQTTPuback;
+    assert( pContext != NULL );
 
-    switch( packetType )
-    {
-        case MQTT_PACKET_TYPE_PUBACK:
-            ackType = MQTTPuback;
-            break;
+    MQTT_PRE_SEND_HOOK( pContext );
+    pContext->sendBatchDepth++;
+    MQTT_POST_SEND_HOOK( pContext );
+}
 
-        case MQTT_PACKET_TYPE_PUBREC:
-            ackType = MQTTPubrec;
-            break;
+/*-----------------------------------------------------------*/
 
-        case MQTT_PACKET_TYPE_PUBREL:
-            ackType = MQTTPubrel;
-            break;
+static MQTTStatus_t endSendBatch( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
 
-        default:
+    assert( pContext != NULL );
 
-            /* This function is only called after checking the type is one of
-             * the above four values, so packet type must be PUBCOMP here. */
-            assert( packetType == MQTT_PACKET_TYPE_PUBCOMP );
-            ackType = MQTTPubcomp;
-            break;
+    MQTT_PRE_SEND_HOOK( pContext );
+
+    assert( pContext->sendBatchDepth > 0U );
+    pContext->sendBatchDepth--;
+
+    if( ( pContext->sendBatchDepth == 0U ) && ( pContext->flushPending == true ) )
+    {
+        pContext->flushPending = false;
+
+        if( flushSentPacket( pContext ) < 0 )
+        {
+            status = MQTTSendFailed;
+        }
     }
 
-    return ackType;
+    releaseSendHook( pContext );
+
+    return status;
 }
 
 /*-----------------------------------------------------------*/
 
-static int32_t recvExact( MQTTContext_t * pContext,
-                          size_t bytesToRecv )
+static void releaseSendHook( MQTTContext_t * pContext )
 {
-    uint8_t * pIndex = NULL;
-    size_t bytesRemaining = bytesToRecv;
-    int32_t totalBytesRecvd = 0, bytesRecvd;
-    uint32_t lastDataRecvTimeMs = 0U, timeSinceLastRecvMs = 0U;
-    TransportRecv_t recvFunc = NULL;
-    MQTTGetCurrentTimeFunc_t getTimeStampMs = NULL;
-    bool receiveError = false;
+    bool sendFailed;
 
     assert( pContext != NULL );
-    assert( bytesToRecv <= pContext->networkBuffer.size );
-    assert( pContext->getTime != NULL );
-    assert( pContext->transportInterface.recv != NULL );
-    assert( pContext->networkBuffer.pBuffer != NULL );
 
-    pIndex = pContext->networkBuffer.pBuffer;
-    recvFunc = pContext->transportInterface.recv;
-    getTimeStampMs = pContext->getTime;
+    /* The failure flag is guarded by the send hook, the connection status by
+     * the state update hook. The two are never held together. */
+    sendFailed = pContext->sendFailed;
+    pContext->sendFailed = false;
+    pContext->sendBatched = false;
 
-    /* Part of the MQTT packet has been read before calling this function. */
-    lastDataRecvTimeMs = getTimeStampMs();
+    MQTT_POST_SEND_HOOK( pContext );
 
-    while( ( bytesRemaining > 0U ) && ( receiveError == false ) )
+    if( sendFailed == true )
     {
-        bytesRecvd = recvFunc( pContext->transportInterface.pNetworkContext,
-                               pIndex,
-                               bytesRemaining );
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
-        if( bytesRecvd < 0 )
+        if( pContext->connectStatus == MQTTConnected )
         {
-            LogError( ( "Network error while receiving packet: ReturnCode=%ld.",
-                        ( long int ) bytesRecvd ) );
-            totalBytesRecvd = bytesRecvd;
-            receiveError = true;
+            pContext->connectStatus = MQTTDisconnectPending;
+        }
 
-            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+}
 
-            if( pContext->connectStatus == MQTTConnected )
-            {
-                pContext->connectStatus = MQTTDisconnectPending;
-            }
+/*-----------------------------------------------------------*/
+
+static uint32_t calculateElapsedTime( uint32_t later,
+                                      uint32_t start )
+{
+    return later - start;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTPubAckType_t getAckFromPacketType( uint8_t packetType )
+{
+    MQTTPubAckType_t ackType = MQTTPuback;
+
+    #if ( MQTT_ENABLE_QOS2 == 0 )
+        /* PUBACK is the only publish ack accepted without QoS 2. */
+        assert( packetType == MQTT_PACKET_TYPE_PUBACK );
+        ( void ) packetType;
+    #else
+        switch( packetType )
+        {
+            case MQTT_PACKET_TYPE_PUBACK:
+                ackType = MQTTPuback;
+                break;
+
+            case MQTT_PACKET_TYPE_PUBREC:
+                ackType = MQTTPubrec;
+                break;
+
+            case MQTT_PACKET_TYPE_PUBREL:
+                ackType = MQTTPubrel;
+                break;
+
+            default:
+
+                /* This function is only called after checking the type is one of
+                 * the above four values, so packet type must be PUBCOMP here. */
+                assert( packetType == MQTT_PACKET_TYPE_PUBCOMP );
+                ackType = MQTTPubcomp;
+                break;
+        }
+    #endif /* if ( MQTT_ENABLE_QOS2 == 0 ) */
+
+    return ackType;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t recvExact( MQTTContext_t * pContext,
+                          size_t bytesToRecv )
+{
+    uint8_t * pIndex = NULL;
+    size_t bytesRemaining = bytesToRecv;
+    int32_t totalBytesRecvd = 0, bytesRecvd;
+    uint32_t lastDataRecvTimeMs = 0U, timeSinceLastRecvMs = 0U;
+    TransportRecv_t recvFunc = NULL;
+    MQTTGetCurrentTimeFunc_t getTimeStampMs = NULL;
+    bool receiveError = false;
+
+    assert( pContext != NULL );
+    assert( bytesToRecv <= pContext->networkBuffer.size );
+    assert( pContext->getTime != NULL );
+    assert( pContext->transportInterface.recv != NULL );
+    assert( pContext->networkBuffer.pBuffer != NULL );
+
+    pIndex = pContext->networkBuffer.pBuffer;
+    recvFunc = pContext->transportInterface.recv;
+    getTimeStampMs = pContext->getTime;
+
+    /* Part of the MQTT packet has been read before calling this function. */
+    lastDataRecvTimeMs = getTimeStampMs();
+
+    while( ( bytesRemaining > 0U ) && ( receiveError == false ) )
+    {
+        bytesRecvd = recvFunc( pContext->transportInterface.pNetworkContext,
+                               pIndex,
+                               bytesRemaining );
+
+        if( bytesRecvd < 0 )
+        {
+            LogError( ( "Network error while receiving packet: ReturnCode=%ld.",
+                        ( long int ) bytesRecvd ) );
+            totalBytesRecvd = bytesRecvd;
+            receiveError = true;
+
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+            if( pContext->connectStatus == MQTTConnected )
+            {
+                pContext->connectStatus = MQTTDisconnectPending;
+            }
 
             MQTT_POST_STATE_UPDATE_HOOK( pContext );
         }
@@ -1270,11 +2169,22 @@ static MQTTStatus_t receiveConnackPacket( MQTTContext_t * pContext,
 
     assert( pContext != NULL );
     assert( pContext->networkBuffer.pBuffer != NULL );
-    assert( incomingPacket.type == MQTT_PACKET_TYPE_CONNACK );
+    assert( ( incomingPacket.type == MQTT_PACKET_TYPE_CONNACK ) ||
+            ( incomingPacket.type == MQTT_PACKET_TYPE_AUTH ) );
     assert( incomingPacket.remainingLength < MQTT_REMAINING_LENGTH_INVALID );
     assert( !CHECK_U32T_OVERFLOWS_SIZE_T( incomingPacket.remainingLength ) );
 
-    if( incomingPacket.remainingLength > pContext->networkBuffer.size )
+    if( ( incomingPacket.remainingLength > pContext->networkBuffer.size ) &&
+        ( pContext->pBufferPool != NULL ) )
+    {
+        status = leaseNetworkBuffer( pContext );
+    }
+
+    if( status != MQTTSuccess )
+    {
+        /* No buffer could be leased. */
+    }
+    else if( incomingPacket.remainingLength > pContext->networkBuffer.size )
     {
         LogError( ( "Incoming packet bigger than the application provided network buffer. Cannot "
                     "handle this packet as MQTT spec doesn't allow 'dropping' packets. Application "
@@ -1317,17 +2227,19 @@ static uint8_t getAckTypeToSend( MQTTPublishState_t state )
             packetTypeByte = MQTT_PACKET_TYPE_PUBACK;
             break;
 
-        case MQTTPubRecSend:
-            packetTypeByte = MQTT_PACKET_TYPE_PUBREC;
-            break;
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTTPubRecSend:
+                packetTypeByte = MQTT_PACKET_TYPE_PUBREC;
+                break;
 
-        case MQTTPubRelSend:
-            packetTypeByte = MQTT_PACKET_TYPE_PUBREL;
-            break;
+            case MQTTPubRelSend:
+                packetTypeByte = MQTT_PACKET_TYPE_PUBREL;
+                break;
 
-        case MQTTPubCompSend:
-            packetTypeByte = MQTT_PACKET_TYPE_PUBCOMP;
-            break;
+            case MQTTPubCompSend:
+                packetTypeByte = MQTT_PACKET_TYPE_PUBCOMP;
+                break;
+        #endif
 
         default:
             /* Take no action for states that do not require sending an ack. */
@@ -1339,6 +2251,8 @@ static uint8_t getAckTypeToSend( MQTTPublishState_t state )
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_QOS2 != 0 )
+
 static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
                                      uint16_t packetId,
                                      MQTTPublishState_t publishState )
@@ -1376,26 +2290,32 @@ static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
 
             connectStatus = pContext->connectStatus;
 
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
             if( connectStatus != MQTTConnected )
             {
                 status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
             }
+        }
 
-            if( status == MQTTSuccess )
-            {
-                /* Here, we are not using the vector approach for efficiency. There is just one buffer
-                 * to be sent which can be achieved with a normal send call. */
-                sendResult = sendBuffer( pContext,
-                                         localBuffer.pBuffer,
-                                         MQTT_PUBLISH_ACK_PACKET_SIZE );
+        if( status == MQTTSuccess )
+        {
+            MQTT_PRE_SEND_HOOK( pContext );
 
-                if( sendResult < ( int32_t ) MQTT_PUBLISH_ACK_PACKET_SIZE )
-                {
-                    status = MQTTSendFailed;
-                }
-            }
+            pContext->sendBatched = true;
 
-            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+            /* Here, we are not using the vector approach for efficiency. There is just one buffer
+             * to be sent which can be achieved with a normal send call. */
+            sendResult = sendBuffer( pContext,
+                                     localBuffer.pBuffer,
+                                     MQTT_PUBLISH_ACK_PACKET_SIZE );
+
+            releaseSendHook( pContext );
+
+            if( sendResult < ( int32_t ) MQTT_PUBLISH_ACK_PACKET_SIZE )
+            {
+                status = MQTTSendFailed;
+            }
         }
 
         if( status == MQTTSuccess )
@@ -1430,6 +2350,41 @@ static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static uint32_t getPacketTxTimeoutMs( const MQTTContext_t * pContext )
+{
+    uint32_t packetTxTimeoutMs = 0U;
+
+    assert( pContext != NULL );
+
+    packetTxTimeoutMs = 1000U * ( uint32_t ) pContext->keepAliveIntervalSec;
+
+    if( PACKET_TX_TIMEOUT_MS < packetTxTimeoutMs )
+    {
+        packetTxTimeoutMs = PACKET_TX_TIMEOUT_MS;
+    }
+
+    return packetTxTimeoutMs;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t calculateRemainingTime( uint32_t elapsedMs,
+                                        uint32_t timeoutMs )
+{
+    uint32_t remainingMs = 0U;
+
+    if( elapsedMs < timeoutMs )
+    {
+        remainingMs = timeoutMs - elapsedMs;
+    }
+
+    return remainingMs;
+}
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext )
@@ -1438,24 +2393,29 @@ static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext )
     uint32_t now = 0U;
     uint32_t packetTxTimeoutMs = 0U;
     uint32_t lastPacketTxTime = 0U;
+    uint32_t pingReqSendTimeMs = 0U;
+    bool waitingForPingResp = false;
 
     assert( pContext != NULL );
     assert( pContext->getTime != NULL );
 
     now = pContext->getTime();
 
-    packetTxTimeoutMs = 1000U * ( uint32_t ) pContext->keepAliveIntervalSec;
+    packetTxTimeoutMs = getPacketTxTimeoutMs( pContext );
 
-    if( PACKET_TX_TIMEOUT_MS < packetTxTimeoutMs )
-    {
-        packetTxTimeoutMs = PACKET_TX_TIMEOUT_MS;
-    }
+    /* The PINGREQ state is written along with the transmit timestamp when a
+     * PINGREQ is sent. */
+    MQTT_PRE_SEND_HOOK( pContext );
+    lastPacketTxTime = pContext->lastPacketTxTime;
+    waitingForPingResp = pContext->waitingForPingResp;
+    pingReqSendTimeMs = pContext->pingReqSendTimeMs;
+    MQTT_POST_SEND_HOOK( pContext );
 
     /* If keep alive interval is 0, it is disabled. */
-    if( pContext->waitingForPingResp == true )
+    if( waitingForPingResp == true )
     {
         /* Has time expired? */
-        if( calculateElapsedTime( now, pContext->pingReqSendTimeMs ) >
+        if( calculateElapsedTime( now, pingReqSendTimeMs ) >
             MQTT_PINGRESP_TIMEOUT_MS )
         {
             status = MQTTKeepAliveTimeout;
@@ -1463,10 +2423,6 @@ static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext )
     }
     else
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-        lastPacketTxTime = pContext->lastPacketTxTime;
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
-
         if( ( packetTxTimeoutMs != 0U ) && ( calculateElapsedTime( now, lastPacketTxTime ) >= packetTxTimeoutMs ) )
         {
             status = MQTT_Ping( pContext );
@@ -1531,35 +2487,45 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
         if( status == MQTTSuccess )
         {
             MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-            {
-                TransportOutVector_t vector;
-                MQTTVec_t mqttVec;
-                vector.iov_base = localBuffer.pBuffer;
-                vector.iov_len = MQTT_PUBLISH_ACK_PACKET_SIZE;
-                mqttVec.pVector = &vector;
-                mqttVec.vectorLen = 1U;
 
-                connectStatus = pContext->connectStatus;
+            connectStatus = pContext->connectStatus;
 
-                if( connectStatus != MQTTConnected )
-                {
-                    status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
-                }
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
 
-                if( ( status == MQTTSuccess ) &&
-                    ( packetTypeByte != MQTT_PACKET_TYPE_PUBACK ) &&
-                    ( packetTypeByte != MQTT_PACKET_TYPE_PUBCOMP ) &&
-                    ( pContext->storeFunction != NULL ) &&
-                    ( pContext->storeFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &mqttVec ) != true ) )
-                {
-                    status = MQTTPublishStoreFailed;
-                }
+            if( connectStatus != MQTTConnected )
+            {
+                status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+            }
+        }
+
+        if( status == MQTTSuccess )
+        {
+            MQTT_PRE_SEND_HOOK( pContext );
+            {
+                #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+                    TransportOutVector_t vector;
+                    MQTTVec_t mqttVec;
+                    vector.iov_base = localBuffer.pBuffer;
+                    vector.iov_len = MQTT_PUBLISH_ACK_PACKET_SIZE;
+                    mqttVec.pVector = &vector;
+                    mqttVec.vectorLen = 1U;
+
+                    if( ( packetTypeByte != MQTT_PACKET_TYPE_PUBACK ) &&
+                        ( packetTypeByte != MQTT_PACKET_TYPE_PUBCOMP ) &&
+                        ( pContext->storeFunction != NULL ) &&
+                        ( pContext->storeFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &mqttVec ) != true ) )
+                    {
+                        status = MQTTPublishStoreFailed;
+                    }
+                #endif
 
                 if( status == MQTTSuccess )
                 {
                     LogDebug( ( "Sending ACK packet: PacketType=%02x, PacketID=%hu.",
                                 ( unsigned int ) packetTypeByte, ( unsigned short ) packetId ) );
 
+                    pContext->sendBatched = true;
+
                     /* Here, we are not using the vector approach for efficiency. There is just one buffer
                      * to be sent which can be achieved with a normal send call. */
                     sendResult = sendBuffer( pContext,
@@ -1572,7 +2538,7 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
                     }
                 }
             }
-            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+            releaseSendHook( pContext );
         }
 
         if( status == MQTTSuccess )
@@ -1609,6 +2575,8 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Build the IO vector for a publish ACK with properties and send it.
  * Returns MQTTSuccess, MQTTSendFailed, MQTTBadParameter, or MQTTPublishStoreFailed.
@@ -1673,28 +2641,31 @@ static MQTTStatus_t buildAndSendAckWithProps( MQTTContext_t * pContext,
     }
     else
     {
-        MQTTVec_t mqttVec;
-        mqttVec.pVector = pIoVector;
-        mqttVec.vectorLen = ioVectorLength;
+        #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+            MQTTVec_t mqttVec;
+            mqttVec.pVector = pIoVector;
+            mqttVec.vectorLen = ioVectorLength;
 
-        if( ( pContext->storeFunction != NULL ) &&
-            ( packetTypeByte != MQTT_PACKET_TYPE_PUBACK ) &&
-            ( packetTypeByte != MQTT_PACKET_TYPE_PUBCOMP ) &&
-            ( pContext->storeFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &mqttVec ) != true ) )
-        {
-            status = MQTTPublishStoreFailed;
-        }
+            if( ( pContext->storeFunction != NULL ) &&
+                ( packetTypeByte != MQTT_PACKET_TYPE_PUBACK ) &&
+                ( packetTypeByte != MQTT_PACKET_TYPE_PUBCOMP ) &&
+                ( pContext->storeFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &mqttVec ) != true ) )
+            {
+                status = MQTTPublishStoreFailed;
+            }
+        #endif
     }
 
     if( status == MQTTSuccess )
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        MQTT_PRE_SEND_HOOK( pContext );
         {
             LogDebug( ( "Sending ACK packet: PacketType=%02x, PacketID=%hu.",
                         ( unsigned int ) packetTypeByte, ( unsigned short ) packetId ) );
+            pContext->sendBatched = true;
             bytesSentOrError = sendMessageVector( pContext, pIoVector, ioVectorLength );
         }
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        releaseSendHook( pContext );
 
         if( bytesSentOrError != ( int32_t ) totalMessageLength )
         {
@@ -1845,25 +2816,35 @@ static MQTTStatus_t validatePublishAckReasonCode( MQTTSuccessFailReasonCode_t re
     return status;
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
-                                           MQTTPacketInfo_t * pIncomingPacket )
+                                           MQTTPacketInfo_t * pIncomingPacket,
+                                           bool * pBufferTaken )
 {
     MQTTStatus_t status;
     MQTTPublishState_t publishRecordState = MQTTStateNull;
     uint16_t packetIdentifier = 0U;
     MQTTPublishInfo_t publishInfo = { 0 };
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    size_t packetLength;
     bool duplicatePublish = false;
     MQTTPropBuilder_t propBuffer = { 0 };
-    MQTTSuccessFailReasonCode_t reasonCode = MQTT_INVALID_REASON_CODE;
-    bool ackPropsAdded = false;
+
+    #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        MQTTSuccessFailReasonCode_t reasonCode = MQTT_INVALID_REASON_CODE;
+        bool ackPropsAdded = false;
+    #endif
 
     assert( pContext != NULL );
     assert( pIncomingPacket != NULL );
+    assert( pBufferTaken != NULL );
     assert( pContext->appCallback != NULL );
 
+    *pBufferTaken = false;
+
     status = MQTT_DeserializePublish( pIncomingPacket,
                                       &packetIdentifier,
                                       &publishInfo,
@@ -1876,6 +2857,7 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
 
     if( ( status == MQTTSuccess ) &&
         ( pContext->incomingPublishRecords == NULL ) &&
+        ( pContext->incomingPublishRecordQuota == 0U ) &&
         ( publishInfo.qos > MQTTQoS0 ) )
     {
         LogError( ( "Incoming publish has QoS > MQTTQoS0 but incoming "
@@ -1889,11 +2871,19 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
     {
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
-        status = MQTT_UpdateStatePublish( pContext,
-                                          packetIdentifier,
-                                          MQTT_RECEIVE,
-                                          publishInfo.qos,
-                                          &publishRecordState );
+        if( publishInfo.qos > MQTTQoS0 )
+        {
+            status = borrowRecords( pContext, false );
+        }
+
+        if( status == MQTTSuccess )
+        {
+            status = MQTT_UpdateStatePublish( pContext,
+                                              packetIdentifier,
+                                              MQTT_RECEIVE,
+                                              publishInfo.qos,
+                                              &publishRecordState );
+        }
 
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
 
@@ -1962,9 +2952,22 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
         deserializedInfo.pPublishInfo = &publishInfo;
         deserializedInfo.deserializationResult = status;
 
+        /* A packet in a leased buffer can be taken by the application as long
+         * as the bytes received after it fit in the staging buffer. */
+        packetLength = ( size_t ) pIncomingPacket->remainingLength + pIncomingPacket->headerLength;
+
+        if( ( pContext->pBufferPool != NULL ) &&
+            ( pContext->networkBuffer.pBuffer != pContext->stagingBuffer.pBuffer ) &&
+            ( ( pContext->index - packetLength ) <= pContext->stagingBuffer.size ) )
+        {
+            deserializedInfo.pPacketBuffer = pContext->networkBuffer.pBuffer;
+        }
+
         /* Invoke application callback to hand the buffer over to application
          * before sending acks. */
-        reasonCode = MQTT_INVALID_REASON_CODE;
+        #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+            reasonCode = MQTT_INVALID_REASON_CODE;
+        #endif
 
         if( ( duplicatePublish == false ) ||
             ( publishInfo.qos == MQTTQoS1 ) ) /* Even a duplicate QoS1 packet must be forwarded to the application [MQTT-4.3.2-5]. */
@@ -1972,11 +2975,14 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
             MQTTPropBuilder_t * pTempPropBuffer = NULL;
             MQTTSuccessFailReasonCode_t * pTempReasonCode = NULL;
 
-            if( publishInfo.qos > MQTTQoS0 )
-            {
-                pTempPropBuffer = &( pContext->ackPropsBuffer );
-                pTempReasonCode = &reasonCode;
-            }
+            /* MQTT 3.1.1 acks carry no reason code or properties. */
+            #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+                if( publishInfo.qos > MQTTQoS0 )
+                {
+                    pTempPropBuffer = &( pContext->ackPropsBuffer );
+                    pTempReasonCode = &reasonCode;
+                }
+            #endif
 
             if( pContext->appCallback( pContext, pIncomingPacket, &deserializedInfo,
                                        pTempReasonCode, pTempPropBuffer, &propBuffer ) == false )
@@ -1985,45 +2991,63 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
                  * from processing any more packets. */
                 status = MQTTEventCallbackFailed;
             }
-            else if( publishInfo.qos > MQTTQoS0 )
+
+            /* The buffer belongs to the application from here on, even if
+             * sending the ack fails. */
+            *pBufferTaken = ( deserializedInfo.pPacketBuffer != NULL ) &&
+                            ( deserializedInfo.takePacketBuffer == true );
+
+            if( status != MQTTSuccess )
             {
-                if( ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
-                    ( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->ackPropsBuffer.currentIndex ) ||
-                      ( pContext->ackPropsBuffer.currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) ) )
+                /* The callback failed. */
+            }
+            #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+                else if( publishInfo.qos > MQTTQoS0 )
                 {
-                    status = MQTTSendFailed;
-                    LogError( ( "Length of properties to be sent must be less than 268435456." ) );
+                    if( ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
+                        ( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->ackPropsBuffer.currentIndex ) ||
+                          ( pContext->ackPropsBuffer.currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) ) )
+                    {
+                        status = MQTTSendFailed;
+                        LogError( ( "Length of properties to be sent must be less than 268435456." ) );
+                    }
+                    else
+                    {
+                        /* Send PUBREC or PUBCOMP if necessary. */
+                        ackPropsAdded = ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
+                                        ( pContext->ackPropsBuffer.currentIndex > 0U );
+                    }
                 }
                 else
                 {
-                    /* Send PUBREC or PUBCOMP if necessary. */
-                    ackPropsAdded = ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
-                                    ( pContext->ackPropsBuffer.currentIndex > 0U );
+                    /* Nothing to be done. QoS0 incoming publish handled successfully. */
                 }
-            }
-            else
-            {
-                /* Nothing to be done. QoS0 incoming publish handled successfully. */
-            }
+            #endif
         }
 
         if( ( status == MQTTSuccess ) && ( publishInfo.qos > MQTTQoS0 ) )
         {
-            if( ( ackPropsAdded == false ) && ( reasonCode == MQTT_INVALID_REASON_CODE ) )
-            {
-                LogTrace( ( "No reason code provided by application. Sending default reason code." ) );
+            #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
                 status = sendPublishAcksWithoutProperty( pContext,
                                                          packetIdentifier,
                                                          publishRecordState );
-            }
-            else
-            {
-                LogTrace( ( "Reason code provided by application. Sending reason code." ) );
-                status = sendPublishAcksWithProperty( pContext,
-                                                      packetIdentifier,
-                                                      publishRecordState,
-                                                      reasonCode );
-            }
+            #else
+                if( ( ackPropsAdded == false ) && ( reasonCode == MQTT_INVALID_REASON_CODE ) )
+                {
+                    LogTrace( ( "No reason code provided by application. Sending default reason code." ) );
+                    status = sendPublishAcksWithoutProperty( pContext,
+                                                             packetIdentifier,
+                                                             publishRecordState );
+                }
+                else
+                {
+                    LogTrace( ( "Reason code provided by application. Sending reason code." ) );
+                    status = sendPublishAcksWithProperty( pContext,
+                                                          packetIdentifier,
+                                                          publishRecordState,
+                                                          reasonCode );
+                }
+            #endif
         }
     }
 
@@ -2040,15 +3064,17 @@ static MQTTStatus_t handlePublishAcks( MQTTContext_t * pContext,
     uint16_t packetIdentifier;
     MQTTPubAckType_t ackType;
     MQTTEventCallback_t appCallback;
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
     MQTTPropBuilder_t propBuffer = { 0 };
     MQTTPropBuilder_t * pSendProps;
     MQTTSuccessFailReasonCode_t * pSendReasonCode;
-    MQTTSuccessFailReasonCode_t reasonCode = MQTT_INVALID_REASON_CODE;
-    bool ackPropsAdded;
-
     MQTTReasonCodeInfo_t incomingReasonCode = { 0 };
 
+    #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        MQTTSuccessFailReasonCode_t reasonCode = MQTT_INVALID_REASON_CODE;
+        bool ackPropsAdded;
+    #endif
+
     assert( pContext != NULL );
     assert( pIncomingPacket != NULL );
     assert( pContext->appCallback != NULL );
@@ -2094,46 +3120,50 @@ static MQTTStatus_t handlePublishAcks( MQTTContext_t * pContext,
         }
     }
 
-    if( ( status == MQTTSuccess ) &&
-        ( pContext->clearFunction != NULL ) )
-    {
-        /* Outgoing publish QoS1: (Tx) PUBLISH -> (Rx) PUBACK. On receiving PubAck, the packet is acked and can be cleared. */
-        if( ackType == MQTTPuback )
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        if( ( status == MQTTSuccess ) &&
+            ( pContext->clearFunction != NULL ) )
         {
-            /* Clear the stored publish. */
-            pContext->clearFunction( pContext, ( uint32_t ) packetIdentifier );
-        }
+            /* Outgoing publish QoS1: (Tx) PUBLISH -> (Rx) PUBACK. On receiving PubAck, the packet is acked and can be cleared. */
+            if( ackType == MQTTPuback )
+            {
+                /* Clear the stored publish. */
+                pContext->clearFunction( pContext, ( uint32_t ) packetIdentifier );
+            }
 
-        /* Outgoing publish QoS2: (Tx) PUBLISH -> (Rx) PUBREC -> (Tx) PUBREL -> (Rx) PUBCOMP. Sender MUST treat the PUBLISH
-         * packet as “unacknowledged” until it has received the corresponding PUBREC packet from the receiver [MQTT-4.3.3-3] */
-        else if( ackType == MQTTPubrec )
-        {
-            /* Clear the stored publish. */
-            pContext->clearFunction( pContext, ( uint32_t ) packetIdentifier );
-        }
+            #if ( MQTT_ENABLE_QOS2 != 0 )
+                /* Outgoing publish QoS2: (Tx) PUBLISH -> (Rx) PUBREC -> (Tx) PUBREL -> (Rx) PUBCOMP. Sender MUST treat the PUBLISH
+                 * packet as “unacknowledged” until it has received the corresponding PUBREC packet from the receiver [MQTT-4.3.3-3] */
+                else if( ackType == MQTTPubrec )
+                {
+                    /* Clear the stored publish. */
+                    pContext->clearFunction( pContext, ( uint32_t ) packetIdentifier );
+                }
 
-        /* Outgoing publish QoS2: Sender MUST treat the PUBREL packet as “unacknowledged” until it has received the corresponding
-         * PUBCOMP packet from the receiver [MQTT-4.3.3-5]. */
-        else if( ackType == MQTTPubcomp )
-        {
-            /* Clear the stored PUBREL. */
-            pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetIdentifier ) );
-        }
+                /* Outgoing publish QoS2: Sender MUST treat the PUBREL packet as “unacknowledged” until it has received the corresponding
+                 * PUBCOMP packet from the receiver [MQTT-4.3.3-5]. */
+                else if( ackType == MQTTPubcomp )
+                {
+                    /* Clear the stored PUBREL. */
+                    pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetIdentifier ) );
+                }
 
-        /* Incoming Publish QoS2: (Rx) PUBLISH -> (Tx) PUBREC -> (Rx) PUBREL -> (Tx) PUBCOMP. Once we receive PUBREL, it means that
-         * the broker received and processed the PUBREC packet [MQTT-4.3.3-10]. */
-        else if( ackType == MQTTPubrel )
-        {
-            /* Clear the stored PUBREC. */
-            pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetIdentifier ) );
-        }
-        /* The following should never happen. The ACK type must be one of the above. */
-        else
-        {
-            assert( false );
-            status = MQTTBadResponse;
+                /* Incoming Publish QoS2: (Rx) PUBLISH -> (Tx) PUBREC -> (Rx) PUBREL -> (Tx) PUBCOMP. Once we receive PUBREL, it means that
+                 * the broker received and processed the PUBREC packet [MQTT-4.3.3-10]. */
+                else if( ackType == MQTTPubrel )
+                {
+                    /* Clear the stored PUBREC. */
+                    pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetIdentifier ) );
+                }
+            #endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
+            /* The following should never happen. The ACK type must be one of the above. */
+            else
+            {
+                assert( false );
+                status = MQTTBadResponse;
+            }
         }
-    }
+    #endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
 
     if( status == MQTTSuccess )
     {
@@ -2151,10 +3181,17 @@ static MQTTStatus_t handlePublishAcks( MQTTContext_t * pContext,
         }
         else
         {
-            /* We need to send a response back to the server. Provide application with
-             * space to add data. */
-            pSendProps = &pContext->ackPropsBuffer;
-            pSendReasonCode = &reasonCode;
+            #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+                /* MQTT 3.1.1 acks carry no reason code or properties. */
+                pSendProps = NULL;
+                pSendReasonCode = NULL;
+            #else
+
+                /* We need to send a response back to the server. Provide application with
+                 * space to add data. */
+                pSendProps = &pContext->ackPropsBuffer;
+                pSendReasonCode = &reasonCode;
+            #endif
         }
 
         /* Invoke application callback to hand the buffer over to application
@@ -2165,38 +3202,46 @@ static MQTTStatus_t handlePublishAcks( MQTTContext_t * pContext,
             /* TODO: verify whether this should block the recv thread? */
             status = MQTTEventCallbackFailed;
         }
-        else if( ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
-                 ( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->ackPropsBuffer.currentIndex ) ||
-                   ( pContext->ackPropsBuffer.currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) ) )
-        {
-            status = MQTTSendFailed;
-            LogError( ( "Length of properties to be sent must be less than 268435456." ) );
-        }
-        else
-        {
-            /* Send PUBREC or PUBCOMP if necessary. */
-            ackPropsAdded = ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
-                            ( pContext->ackPropsBuffer.currentIndex > 0U );
-        }
+        #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+            else if( ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
+                     ( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->ackPropsBuffer.currentIndex ) ||
+                       ( pContext->ackPropsBuffer.currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) ) )
+            {
+                status = MQTTSendFailed;
+                LogError( ( "Length of properties to be sent must be less than 268435456." ) );
+            }
+            else
+            {
+                /* Send PUBREC or PUBCOMP if necessary. */
+                ackPropsAdded = ( pContext->ackPropsBuffer.pBuffer != NULL ) &&
+                                ( pContext->ackPropsBuffer.currentIndex > 0U );
+            }
+        #endif
 
         /* No need to call the following functions if the packet that was received was PUBACK or PUBCOMP. */
         if( ( status == MQTTSuccess ) && ( ackType != MQTTPuback ) && ( ackType != MQTTPubcomp ) )
         {
-            if( ( ackPropsAdded == false ) && ( reasonCode == MQTT_INVALID_REASON_CODE ) )
-            {
-                LogTrace( ( "No reason code provided by application. Sending default reason code." ) );
+            #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
                 status = sendPublishAcksWithoutProperty( pContext,
                                                          packetIdentifier,
                                                          publishRecordState );
-            }
-            else
-            {
-                LogTrace( ( "Reason code provided by application. Sending reason code." ) );
-                status = sendPublishAcksWithProperty( pContext,
-                                                      packetIdentifier,
-                                                      publishRecordState,
-                                                      reasonCode );
-            }
+            #else
+                if( ( ackPropsAdded == false ) && ( reasonCode == MQTT_INVALID_REASON_CODE ) )
+                {
+                    LogTrace( ( "No reason code provided by application. Sending default reason code." ) );
+                    status = sendPublishAcksWithoutProperty( pContext,
+                                                             packetIdentifier,
+                                                             publishRecordState );
+                }
+                else
+                {
+                    LogTrace( ( "Reason code provided by application. Sending reason code." ) );
+                    status = sendPublishAcksWithProperty( pContext,
+                                                          packetIdentifier,
+                                                          publishRecordState,
+                                                          reasonCode );
+                }
+            #endif
         }
     }
 
@@ -2211,7 +3256,7 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
 {
     MQTTStatus_t status = MQTTBadResponse;
     uint16_t packetIdentifier = MQTT_PACKET_ID_INVALID;
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
 
     MQTTEventCallback_t appCallback;
 
@@ -2227,9 +3272,11 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
     switch( pIncomingPacket->type )
     {
         case MQTT_PACKET_TYPE_PUBACK:
-        case MQTT_PACKET_TYPE_PUBREC:
-        case MQTT_PACKET_TYPE_PUBREL:
-        case MQTT_PACKET_TYPE_PUBCOMP:
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTT_PACKET_TYPE_PUBREC:
+            case MQTT_PACKET_TYPE_PUBREL:
+            case MQTT_PACKET_TYPE_PUBCOMP:
+        #endif
 
             /* Handle all the publish acks. The app callback is invoked here. */
             status = handlePublishAcks( pContext, pIncomingPacket );
@@ -2248,7 +3295,9 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
             {
                 if( manageKeepAlive == true )
                 {
+                    MQTT_PRE_SEND_HOOK( pContext );
                     pContext->waitingForPingResp = false;
+                    MQTT_POST_SEND_HOOK( pContext );
                 }
                 else
                 {
@@ -2268,11 +3317,18 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
             break;
 
         case MQTT_PACKET_TYPE_SUBACK:
-        case MQTT_PACKET_TYPE_UNSUBACK:
+        #if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+            case MQTT_PACKET_TYPE_UNSUBACK:
+        #endif
             /* Deserialize and give these to the app provided callback. */
             status = handleSubUnsubAck( pContext, pIncomingPacket );
             break;
 
+        case MQTT_PACKET_TYPE_AUTH:
+            /* A step of a re-authentication started with MQTT_Auth. */
+            status = handleIncomingAuth( pContext, pIncomingPacket );
+            break;
+
         default:
             /* Bad response from the server. */
             LogError( ( "Unexpected packet type from server: PacketType=%02x.",
@@ -2319,13 +3375,77 @@ static MQTTStatus_t handleIncomingDisconnect( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static MQTTStatus_t handleIncomingAuth( MQTTContext_t * pContext,
+                                        MQTTPacketInfo_t * pIncomingPacket )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTReasonCodeInfo_t reasonCode = { 0 };
+
+    assert( pContext != NULL );
+    assert( pContext->appCallback != NULL );
+    assert( pIncomingPacket != NULL );
+
+    status = MQTT_DeserializeAuth( pIncomingPacket,
+                                   pContext->connectionProperties.maxPacketSize,
+                                   &reasonCode,
+                                   &propBuffer );
+
+    if( status == MQTTSuccess )
+    {
+        deserializedInfo.deserializationResult = status;
+        deserializedInfo.pReasonCode = &reasonCode;
+
+        if( pContext->appCallback( pContext, pIncomingPacket, &deserializedInfo,
+                                   NULL, NULL, &propBuffer ) == false )
+        {
+            status = MQTTEventCallbackFailed;
+        }
+    }
+    else
+    {
+        LogError( ( "AUTH packet deserialization failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t receiveConnectAuth( MQTTContext_t * pContext,
+                                        MQTTPacketInfo_t * pIncomingPacket )
+{
+    MQTTStatus_t status;
+
+    assert( pContext != NULL );
+    assert( pIncomingPacket != NULL );
+
+    status = receiveConnackPacket( pContext, *pIncomingPacket );
+
+    if( status == MQTTSuccess )
+    {
+        pIncomingPacket->pRemainingData = pContext->networkBuffer.pBuffer;
+        status = handleIncomingAuth( pContext, pIncomingPacket );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                                             bool manageKeepAlive )
 {
     MQTTStatus_t status = MQTTSuccess;
+    MQTTStatus_t flushStatus;
     MQTTPacketInfo_t incomingPacket = { 0 };
     int32_t recvBytes;
     uint32_t totalMQTTPacketLength = 0;
+    size_t bytesToRecv;
+    bool bufferTaken = false;
+    bool disconnected = false;
 
     assert( pContext != NULL );
     assert( pContext->networkBuffer.pBuffer != NULL );
@@ -2335,10 +3455,31 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
      * be enough. */
     assert( pContext->networkBuffer.size < 0x7FFFFFFF );
 
-    /* Read as many bytes as possible into the network buffer. */
+    /* A kept header is stale once the buffer has been emptied. */
+    if( pContext->index == 0U )
+    {
+        pContext->pendingPacketLength = 0U;
+    }
+
+    /* Once the fixed header of a packet has been decoded, read only the bytes
+     * still missing from it. Otherwise read as many bytes as possible. */
+    if( ( pContext->pendingPacketLength > pContext->index ) &&
+        ( pContext->pendingPacketLength <= pContext->networkBuffer.size ) )
+    {
+        bytesToRecv = pContext->pendingPacketLength - pContext->index;
+    }
+    else
+    {
+        bytesToRecv = pContext->networkBuffer.size - pContext->index;
+    }
+
     recvBytes = pContext->transportInterface.recv( pContext->transportInterface.pNetworkContext,
                                                    &( pContext->networkBuffer.pBuffer[ pContext->index ] ),
-                                                   pContext->networkBuffer.size - pContext->index );
+                                                   bytesToRecv );
+
+    /* The acks and PINGREQ sent for the packets in the buffer are flushed
+     * together. */
+    beginSendBatch( pContext );
 
     LogTrace( ( "Received %ld bytes from network.",
                 ( long int ) recvBytes ) );
@@ -2385,14 +3526,31 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
              * requested. */
             pContext->index += ( size_t ) recvBytes;
 
-            status = MQTT_ProcessIncomingPacketTypeAndLength( pContext->networkBuffer.pBuffer,
-                                                              &( pContext->index ),
-                                                              &incomingPacket );
+            if( pContext->pendingPacketLength != 0U )
+            {
+                incomingPacket = pContext->pendingPacket;
+                status = MQTTSuccess;
+            }
+            else
+            {
+                status = MQTT_ProcessIncomingPacketTypeAndLength( pContext->networkBuffer.pBuffer,
+                                                                  &( pContext->index ),
+                                                                  &incomingPacket );
+            }
 
             /* Remaining length can be in the range of 0 -> MQTT_MAX_REMAINING_LENGTH.
              * Header length will be in range of 1 -> 5.
              * Thus, the addition will not overflow when the status is MQTTSuccess. */
             totalMQTTPacketLength = incomingPacket.remainingLength + ( uint32_t ) incomingPacket.headerLength;
+
+            /* A packet that does not fit in the staging buffer is received
+             * into a buffer leased from the pool. */
+            if( ( status == MQTTSuccess ) &&
+                ( totalMQTTPacketLength > pContext->networkBuffer.size ) &&
+                ( pContext->pBufferPool != NULL ) )
+            {
+                status = leaseNetworkBuffer( pContext );
+            }
         }
 
         /* No data was received, check for keep alive timeout. */
@@ -2450,6 +3608,10 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         else if( totalMQTTPacketLength > pContext->index )
         {
             status = MQTTNeedMoreBytes;
+
+            /* Keep the decoded header for the next call. */
+            pContext->pendingPacket = incomingPacket;
+            pContext->pendingPacketLength = totalMQTTPacketLength;
         }
         else
         {
@@ -2459,13 +3621,14 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         /* Handle received packet. If incomplete data was read then this will not execute. */
         if( status == MQTTSuccess )
         {
+            pContext->pendingPacketLength = 0U;
             incomingPacket.pRemainingData = &pContext->networkBuffer.pBuffer[ incomingPacket.headerLength ];
 
             /* PUBLISH packets allow flags in the lower four bits. For other
              * packet types, they are reserved. */
             if( ( incomingPacket.type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
             {
-                status = handleIncomingPublish( pContext, &incomingPacket );
+                status = handleIncomingPublish( pContext, &incomingPacket, &bufferTaken );
             }
             else if( incomingPacket.type == MQTT_PACKET_TYPE_DISCONNECT )
             {
@@ -2500,6 +3663,8 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                 MQTT_PRE_STATE_UPDATE_HOOK( pContext );
                 pContext->connectStatus = MQTTNotConnected;
                 MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+                disconnected = true;
             }
             else
             {
@@ -2509,7 +3674,18 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                  * Should the packet be re-sent to the app? */
             }
 
-            if( status == MQTTSuccess )
+            if( bufferTaken == true )
+            {
+                /* The application owns the leased buffer now. Keep the bytes
+                 * received after this packet in the staging buffer. */
+                pContext->index -= totalMQTTPacketLength;
+                ( void ) memcpy( pContext->stagingBuffer.pBuffer,
+                                 &( pContext->networkBuffer.pBuffer[ totalMQTTPacketLength ] ),
+                                 pContext->index );
+                pContext->networkBuffer = pContext->stagingBuffer;
+                bufferTaken = false;
+            }
+            else if( status == MQTTSuccess )
             {
                 /* Update the index to reflect the remaining bytes in the buffer.  */
                 pContext->index -= totalMQTTPacketLength;
@@ -2518,12 +3694,29 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                 ( void ) memmove( pContext->networkBuffer.pBuffer,
                                   &( pContext->networkBuffer.pBuffer[ totalMQTTPacketLength ] ),
                                   pContext->index );
+            }
+            else
+            {
+                /* MISRA else. */
+            }
 
+            if( status == MQTTSuccess )
+            {
                 pContext->lastPacketRxTime = pContext->getTime();
             }
         }
     } while( ( pContext->index > 0U ) && ( status == MQTTSuccess ) );
 
+    if( disconnected == true )
+    {
+        /* Bytes received after a DISCONNECT belong to no connection. */
+        resetNetworkBuffer( pContext );
+    }
+    else
+    {
+        releaseNetworkBuffer( pContext );
+    }
+
     if( status == MQTTNoDataAvailable )
     {
         /* No data available is not an error. Reset to MQTTSuccess so the
@@ -2531,6 +3724,13 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         status = MQTTSuccess;
     }
 
+    flushStatus = endSendBatch( pContext );
+
+    if( status == MQTTSuccess )
+    {
+        status = flushStatus;
+    }
+
     return status;
 }
 
@@ -2566,7 +3766,8 @@ static MQTTStatus_t validateSubscribeUnsubscribeParams( const MQTTContext_t * pC
     }
     else
     {
-        if( pContext->incomingPublishRecords == NULL )
+        if( ( pContext->incomingPublishRecords == NULL ) &&
+            ( pContext->incomingPublishRecordQuota == 0U ) )
         {
             for( iterator = 0U; iterator < subscriptionCount; iterator++ )
             {
@@ -2706,7 +3907,7 @@ static MQTTStatus_t sendSubscribeWithoutCopy( MQTTContext_t * pContext,
         subscribePropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
     }
 
-    pIndex = encodeVariableLength( propertyLength, subscribePropLen );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( propertyLength, subscribePropLen );
     pIterator->iov_base = propertyLength;
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
@@ -2826,6 +4027,8 @@ static MQTTStatus_t sendSubscribeWithoutCopy( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
                                                 const MQTTSubscribeInfo_t * pSubscriptionList,
                                                 size_t subscriptionCount,
@@ -2889,7 +4092,7 @@ static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
         unsubscribePropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
     }
 
-    pIndex = encodeVariableLength( propertyLength, unsubscribePropLen );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( propertyLength, unsubscribePropLen );
     pIterator->iov_base = propertyLength;
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
@@ -2983,6 +4186,62 @@ static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendSerializedSubscribeUnsubscribe( MQTTContext_t * pContext,
+                                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                                        size_t subscriptionCount,
+                                                        uint16_t packetId,
+                                                        uint32_t remainingLength,
+                                                        uint32_t packetSize,
+                                                        const MQTTPropBuilder_t * pPropertyBuilder,
+                                                        MQTTSubscriptionType_t subscriptionType )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    assert( pContext != NULL );
+    assert( pContext->subscribeBuffer.pBuffer != NULL );
+    assert( packetSize <= pContext->subscribeBuffer.size );
+
+    if( subscriptionType == MQTT_TYPE_SUBSCRIBE )
+    {
+        status = MQTT_SerializeSubscribe( pSubscriptionList,
+                                          subscriptionCount,
+                                          pPropertyBuilder,
+                                          packetId,
+                                          remainingLength,
+                                          &( pContext->subscribeBuffer ) );
+    }
+
+    #if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+        else
+        {
+            status = MQTT_SerializeUnsubscribe( pSubscriptionList,
+                                                subscriptionCount,
+                                                pPropertyBuilder,
+                                                packetId,
+                                                remainingLength,
+                                                &( pContext->subscribeBuffer ) );
+        }
+    #endif
+
+    if( status == MQTTSuccess )
+    {
+        if( sendBuffer( pContext,
+                        pContext->subscribeBuffer.pBuffer,
+                        packetSize ) != ( int32_t ) packetSize )
+        {
+            LogError( ( "Error in sending %s packet.",
+                        ( subscriptionType == MQTT_TYPE_SUBSCRIBE ) ? "SUBSCRIBE" : "UNSUBSCRIBE" ) );
+            status = MQTTSendFailed;
+        }
+    }
+
+    return status;
+}
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
@@ -2990,13 +4249,22 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
                                             uint8_t * pMqttHeader,
                                             size_t headerSize,
                                             uint16_t packetId,
-                                            const MQTTPropBuilder_t * pPropertyBuilder )
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            const TransportOutVector_t * pPayloadFragments,
+                                            size_t fragmentCount,
+                                            const void * pPayloadSource,
+                                            size_t payloadOffset )
 {
     MQTTStatus_t status = MQTTSuccess;
     size_t ioVectorLength;
+    size_t i;
     uint32_t totalMessageLength;
     uint32_t publishPropLength = 0U;
-    bool dupFlagChanged = false;
+    bool callerBatched;
+
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        bool dupFlagChanged = false;
+    #endif
 
     /* Bytes required to encode the packet ID in an MQTT header according to
      * the MQTT specification. */
@@ -3015,9 +4283,9 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
      * Packet ID (only when QoS > QoS0)                    + 1 = 3
      * Property Length                                     + 1 = 4
      * Optional Properties                                 + 1 = 5
-     * Payload                                             + 1 = 6  */
+     * Payload fragments              + MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS */
 
-    TransportOutVector_t pIoVector[ 6U ];
+    TransportOutVector_t pIoVector[ 5U + MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS ];
     uint8_t * pIndex;
     TransportOutVector_t * iterator;
 
@@ -3026,6 +4294,7 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
     assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pPublishInfo->topicNameLength ) );
     assert( !CHECK_SIZE_T_OVERFLOWS_32BIT( pPublishInfo->payloadLength ) );
     assert( headerSize <= 7U );
+    assert( fragmentCount <= MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS );
 
     /* The header is sent first. */
     pIoVector[ 0U ].iov_base = pMqttHeader;
@@ -3064,7 +4333,7 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
 
     iterator = &pIoVector[ ioVectorLength ];
     pIndex = propertyLength;
-    pIndex = encodeVariableLength( pIndex, publishPropLength );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, publishPropLength );
     iterator->iov_base = propertyLength;
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
@@ -3099,69 +4368,185 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
     /* Publish packets are allowed to contain no payload. */
     if( ( status == MQTTSuccess ) && ( pPublishInfo->payloadLength > 0U ) )
     {
-        pIoVector[ ioVectorLength ].iov_base = pPublishInfo->pPayload;
-        pIoVector[ ioVectorLength ].iov_len = pPublishInfo->payloadLength;
-
         if( ADDITION_WILL_OVERFLOW_U32( totalMessageLength, pPublishInfo->payloadLength ) ||
             ( ( totalMessageLength + pPublishInfo->payloadLength ) > MQTT_MAX_PACKET_SIZE ) )
         {
             LogError( ( "Total MQTT packet size must be less than 268435461." ) );
             status = MQTTBadParameter;
         }
-        else
+        else if( pPayloadSource != NULL )
+        {
+            /* The payload is sent by the transport after the vectors. */
+            totalMessageLength += ( uint32_t ) pPublishInfo->payloadLength;
+        }
+        else if( pPayloadFragments == NULL )
         {
+            pIoVector[ ioVectorLength ].iov_base = pPublishInfo->pPayload;
+            pIoVector[ ioVectorLength ].iov_len = pPublishInfo->payloadLength;
             ioVectorLength++;
             totalMessageLength += ( uint32_t ) pPublishInfo->payloadLength;
         }
-    }
-
-    /* Store a copy of the publish for retransmission purposes. */
-    if( ( status == MQTTSuccess ) &&
-        ( pPublishInfo->qos > MQTTQoS0 ) &&
-        ( pContext->storeFunction != NULL ) )
-    {
-        /* If not already set, set the dup flag before storing a copy of the publish
-         * this is because on retrieving back this copy we will get it in the form of an
-         * array of TransportOutVector_t that holds the data in a const pointer which cannot be
-         * changed after retrieving. */
-        if( pPublishInfo->dup != true )
+        else
         {
-            status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, true );
+            /* Each fragment is sent from where the application keeps it. The
+             * fragment lengths add up to the payload length. */
+            for( i = 0U; i < fragmentCount; i++ )
+            {
+                if( pPayloadFragments[ i ].iov_len > 0U )
+                {
+                    pIoVector[ ioVectorLength ] = pPayloadFragments[ i ];
+                    ioVectorLength++;
+                }
+            }
 
-            dupFlagChanged = ( status == MQTTSuccess );
+            totalMessageLength += ( uint32_t ) pPublishInfo->payloadLength;
         }
+    }
 
-        if( status == MQTTSuccess )
-        {
-            MQTTVec_t mqttVec;
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        /* Store a copy of the publish for retransmission purposes. */
+        if( ( status == MQTTSuccess ) &&
+            ( pPublishInfo->qos > MQTTQoS0 ) &&
+            ( pContext->storeFunction != NULL ) )
+        {
+            /* If not already set, set the dup flag before storing a copy of the publish
+             * this is because on retrieving back this copy we will get it in the form of an
+             * array of TransportOutVector_t that holds the data in a const pointer which cannot be
+             * changed after retrieving. */
+            if( pPublishInfo->dup != true )
+            {
+                status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, true );
 
-            mqttVec.pVector = pIoVector;
-            mqttVec.vectorLen = ioVectorLength;
+                dupFlagChanged = ( status == MQTTSuccess );
+            }
 
-            if( pContext->storeFunction( pContext, ( uint32_t ) packetId, &mqttVec ) != true )
+            if( status == MQTTSuccess )
             {
-                status = MQTTPublishStoreFailed;
+                MQTTVec_t mqttVec;
+
+                mqttVec.pVector = pIoVector;
+                mqttVec.vectorLen = ioVectorLength;
+
+                if( pContext->storeFunction( pContext, ( uint32_t ) packetId, &mqttVec ) != true )
+                {
+                    status = MQTTPublishStoreFailed;
+                }
+            }
+
+            /* change the value of the dup flag to its original, if it was changed */
+            if( ( status == MQTTSuccess ) && ( dupFlagChanged == true ) )
+            {
+                status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, false );
             }
         }
+    #endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
 
-        /* change the value of the dup flag to its original, if it was changed */
-        if( ( status == MQTTSuccess ) && ( dupFlagChanged == true ) )
+    if( ( status == MQTTSuccess ) && ( pPayloadSource != NULL ) )
+    {
+        /* Flush the transport once, after the payload. The send hook is held,
+         * so the batch state is updated directly. */
+        callerBatched = pContext->sendBatched;
+        pContext->sendBatched = true;
+        pContext->sendBatchDepth++;
+
+        if( ( sendMessageVector( pContext, pIoVector, ioVectorLength ) !=
+              ( int32_t ) ( totalMessageLength - ( uint32_t ) pPublishInfo->payloadLength ) ) ||
+            ( sendPayloadFromSource( pContext,
+                                     pPayloadSource,
+                                     payloadOffset,
+                                     pPublishInfo->payloadLength ) != ( int32_t ) pPublishInfo->payloadLength ) )
         {
-            status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, false );
+            status = MQTTSendFailed;
         }
-    }
 
-    if( ( status == MQTTSuccess ) &&
-        ( sendMessageVector( pContext, pIoVector, ioVectorLength ) != ( int32_t ) totalMessageLength ) )
+        pContext->sendBatchDepth--;
+        pContext->sendBatched = callerBatched;
+
+        if( pContext->sendBatchDepth == 0U )
+        {
+            pContext->flushPending = false;
+        }
+
+        if( ( status == MQTTSuccess ) && ( flushSentPacket( pContext ) < 0 ) )
+        {
+            status = MQTTSendFailed;
+        }
+    }
+    else if( ( status == MQTTSuccess ) &&
+             ( sendMessageVector( pContext, pIoVector, ioVectorLength ) != ( int32_t ) totalMessageLength ) )
     {
         status = MQTTSendFailed;
     }
+    else
+    {
+        /* MISRA else. */
+    }
 
     return status;
 }
 
 /*-----------------------------------------------------------*/
 
+static int32_t sendPayloadFromSource( MQTTContext_t * pContext,
+                                      const void * pPayloadSource,
+                                      size_t payloadOffset,
+                                      size_t payloadLength )
+{
+    int32_t sendResult;
+    uint32_t startTime;
+    int32_t bytesSentOrError = 0;
+
+    assert( pContext != NULL );
+    assert( pContext->transportInterface.sendPayload != NULL );
+    assert( payloadLength <= MQTT_MAX_PACKET_SIZE );
+
+    startTime = pContext->getTime();
+
+    while( ( bytesSentOrError < ( int32_t ) payloadLength ) && ( bytesSentOrError >= 0 ) )
+    {
+        sendResult = pContext->transportInterface.sendPayload( pContext->transportInterface.pNetworkContext,
+                                                               pPayloadSource,
+                                                               payloadOffset + ( size_t ) bytesSentOrError,
+                                                               payloadLength - ( size_t ) bytesSentOrError );
+
+        if( sendResult > 0 )
+        {
+            /* It is a bug in the application's transport implementation if
+             * more bytes than expected are sent. */
+            assert( sendResult <= ( ( int32_t ) payloadLength - bytesSentOrError ) );
+
+            bytesSentOrError += sendResult;
+
+            /* Set last transmission time. */
+            pContext->lastPacketTxTime = pContext->getTime();
+        }
+        else if( sendResult < 0 )
+        {
+            bytesSentOrError = sendResult;
+            LogError( ( "sendPayloadFromSource: Unable to send payload: Network Error." ) );
+
+            pContext->sendFailed = true;
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+
+        /* Check for timeout. */
+        if( ( bytesSentOrError < ( int32_t ) payloadLength ) &&
+            ( bytesSentOrError >= 0 ) &&
+            ( calculateElapsedTime( pContext->getTime(), startTime ) > MQTT_SEND_TIMEOUT_MS ) )
+        {
+            LogError( ( "sendPayloadFromSource: Unable to send payload: Timed out." ) );
+            break;
+        }
+    }
+
+    return bytesSentOrError;
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Tracks the state of building a scatter-gather IO vector list.
  *
@@ -3205,6 +4590,8 @@ static MQTTStatus_t addStringToVectorChecked( uint8_t * pLenBuf,
     return status;
 }
 
+#if ( MQTT_ENABLE_WILL != 0 )
+
 /**
  * @brief Append will properties, topic, and payload vectors to the IO vector.
  */
@@ -3226,7 +4613,7 @@ static MQTTStatus_t appendWillVectors( const MQTTPublishInfo_t * pWillInfo,
     pVecState->pIterator->iov_base = pWillPropertyLength;
     /* coverity[misra_c_2012_rule_18_2_violation] */
     /* coverity[misra_c_2012_rule_10_8_violation] */
-    pVecState->pIterator->iov_len = ( size_t ) ( encodeVariableLength( pWillPropertyLength, willPropsLen ) - pWillPropertyLength );
+    pVecState->pIterator->iov_len = ( size_t ) ( MQTT_ENCODE_PROPERTY_LENGTH( pWillPropertyLength, willPropsLen ) - pWillPropertyLength );
 
     if( ADDITION_WILL_OVERFLOW_U32( pVecState->totalMessageLength, pVecState->pIterator->iov_len ) ||
         ( ( pVecState->totalMessageLength + pVecState->pIterator->iov_len ) > MQTT_MAX_PACKET_SIZE ) )
@@ -3280,6 +4667,8 @@ static MQTTStatus_t appendWillVectors( const MQTTPublishInfo_t * pWillInfo,
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_WILL != 0 ) */
+
 static MQTTStatus_t sendConnectWithoutCopy( MQTTContext_t * pContext,
                                             const MQTTConnectInfo_t * pConnectInfo,
                                             const MQTTPublishInfo_t * pWillInfo,
@@ -3295,15 +4684,18 @@ static MQTTStatus_t sendConnectWithoutCopy( MQTTContext_t * pContext,
     uint8_t serializedClientIDLength[ 2U ];
     uint8_t serializedUsernameLength[ 2U ];
     uint8_t serializedPasswordLength[ 2U ];
-    uint8_t serializedWillTopicLength[ 2U ];
-    uint8_t serializedWillPayloadLength[ 2U ];
 
     /**
      * Maximum number of bytes to send the Property Length.
      * Property Length  0 + 4 = 4
      */
     uint8_t propertyLength[ 4U ];
-    uint8_t willPropertyLength[ 4U ];
+
+    #if ( MQTT_ENABLE_WILL != 0 )
+        uint8_t serializedWillTopicLength[ 2U ];
+        uint8_t serializedWillPayloadLength[ 2U ];
+        uint8_t willPropertyLength[ 4U ];
+    #endif
 
     /* Maximum number of bytes required by the fixed part of the CONNECT
      * packet header according to the MQTT specification.
@@ -3371,7 +4763,7 @@ static MQTTStatus_t sendConnectWithoutCopy( MQTTContext_t * pContext,
             connectPropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
         }
 
-        pIndex = encodeVariableLength( propertyLength, connectPropLen );
+        pIndex = MQTT_ENCODE_PROPERTY_LENGTH( propertyLength, connectPropLen );
         vecState.pIterator->iov_base = propertyLength;
         /* coverity[misra_c_2012_rule_18_2_violation] */
         /* coverity[misra_c_2012_rule_10_8_violation] */
@@ -3410,14 +4802,18 @@ static MQTTStatus_t sendConnectWithoutCopy( MQTTContext_t * pContext,
                                                &vecState );
         }
 
-        /* Serialize will properties, topic, and payload. */
-        if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) )
-        {
-            status = appendWillVectors( pWillInfo, pWillPropertyBuilder,
-                                        &vecState, willPropertyLength,
-                                        serializedWillTopicLength,
-                                        serializedWillPayloadLength );
-        }
+        #if ( MQTT_ENABLE_WILL != 0 )
+            /* Serialize will properties, topic, and payload. */
+            if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) )
+            {
+                status = appendWillVectors( pWillInfo, pWillPropertyBuilder,
+                                            &vecState, willPropertyLength,
+                                            serializedWillTopicLength,
+                                            serializedWillPayloadLength );
+            }
+        #else
+            ( void ) pWillPropertyBuilder;
+        #endif
 
         /* Serialize username. */
         if( ( status == MQTTSuccess ) && ( pConnectInfo->pUserName != NULL ) )
@@ -3463,9 +4859,8 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
     MQTTGetCurrentTimeFunc_t getTimeStamp = NULL;
     uint32_t entryTimeMs = 0U;
     bool breakFromLoop = false;
+    bool authReceived;
     uint16_t loopCount = 0U;
-    MQTTDeserializedInfo_t deserializedInfo = { 0 };
-    MQTTPropBuilder_t propBuffer = { 0 };
 
     assert( pContext != NULL );
     assert( pIncomingPacket != NULL );
@@ -3485,6 +4880,19 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
         status = MQTT_GetIncomingPacketTypeAndLength( pContext->transportInterface.recv,
                                                       pContext->transportInterface.pNetworkContext,
                                                       pIncomingPacket );
+        authReceived = false;
+
+        if( ( status == MQTTSuccess ) && ( pIncomingPacket->type == MQTT_PACKET_TYPE_AUTH ) )
+        {
+            status = receiveConnectAuth( pContext, pIncomingPacket );
+
+            if( status == MQTTSuccess )
+            {
+                /* Keep waiting for the CONNACK. */
+                status = MQTTNoDataAvailable;
+                authReceived = true;
+            }
+        }
 
         /* The loop times out based on 2 conditions.
          * 1. If timeoutMs is greater than 0:
@@ -3499,6 +4907,11 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
         {
             breakFromLoop = calculateElapsedTime( getTimeStamp(), entryTimeMs ) >= timeoutMs;
         }
+        else if( authReceived == true )
+        {
+            /* An authentication step is not a failed read attempt. */
+            loopCount = 0U;
+        }
         else
         {
             breakFromLoop = ( loopCount >= MQTT_MAX_CONNACK_RECEIVE_RETRY_COUNT );
@@ -3510,24 +4923,50 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
 
     if( status == MQTTSuccess )
     {
-        /* Reading the remainder of the packet by transport recv.
-         * Attempt to read once even if the timeout has expired.
-         * Invoking receiveConnackPacket with remainingTime as 0 would attempt to
-         * recv from network once. */
-        if( pIncomingPacket->type == MQTT_PACKET_TYPE_CONNACK )
-        {
-            status = receiveConnackPacket( pContext,
-                                           *pIncomingPacket );
-        }
-        /* TODO: Handle AUTH packets here as well. */
-        else
-        {
-            LogError( ( "Incorrect packet type %X received while expecting"
-                        " CONNACK(%X).",
-                        ( unsigned int ) pIncomingPacket->type,
-                        MQTT_PACKET_TYPE_CONNACK ) );
-            status = MQTTBadResponse;
-        }
+        status = processConnack( pContext,
+                                 cleanSession,
+                                 pIncomingPacket,
+                                 pSessionPresent );
+    }
+    else
+    {
+        LogError( ( "CONNACK recv failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t processConnack( MQTTContext_t * pContext,
+                                    bool cleanSession,
+                                    MQTTPacketInfo_t * pIncomingPacket,
+                                    bool * pSessionPresent )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+
+    assert( pContext != NULL );
+    assert( pIncomingPacket != NULL );
+
+    /* Reading the remainder of the packet by transport recv.
+     * Attempt to read once even if the timeout has expired.
+     * Invoking receiveConnackPacket with remainingTime as 0 would attempt to
+     * recv from network once. */
+    if( pIncomingPacket->type == MQTT_PACKET_TYPE_CONNACK )
+    {
+        status = receiveConnackPacket( pContext,
+                                       *pIncomingPacket );
+    }
+    else
+    {
+        LogError( ( "Incorrect packet type %X received while expecting"
+                    " CONNACK(%X).",
+                    ( unsigned int ) pIncomingPacket->type,
+                    MQTT_PACKET_TYPE_CONNACK ) );
+        status = MQTTBadResponse;
     }
 
     if( status == MQTTSuccess )
@@ -3583,133 +5022,260 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
 static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext )
 {
     MQTTStatus_t status = MQTTSuccess;
-    MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
-    uint16_t packetId = MQTT_PACKET_ID_INVALID;
-    MQTTPublishState_t state = MQTTStateNull;
-    size_t totalMessageLength = 0;
-    uint8_t * pMqttPacket = NULL;
+
+    #if ( ( MQTT_ENABLE_QOS2 != 0 ) || ( MQTT_ENABLE_RETRANSMIT != 0 ) )
+        MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
+        uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    #endif
+
+    #if ( MQTT_ENABLE_QOS2 != 0 )
+        MQTTPublishState_t state = MQTTStateNull;
+    #endif
+
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        size_t totalMessageLength = 0;
+        uint8_t * pMqttPacket = NULL;
+        bool expired = false;
+    #endif
 
     assert( pContext != NULL );
 
-    do
-    {
-        /* Get the next packet ID for which a PUBREL need to be resent. */
-        packetId = MQTT_PubrelToResend( pContext, &cursor, &state );
+    #if ( MQTT_ENABLE_QOS2 != 0 )
+        do
+        {
+            /* Get the next packet ID for which a PUBREL need to be resent. */
+            packetId = MQTT_PubrelToResend( pContext, &cursor, &state );
+
+            /* Resend all the PUBREL acks after session is reestablished. */
+            if( packetId != MQTT_PACKET_ID_INVALID )
+            {
+                #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+                    /* If we have the stored data, then we just need to send it. */
+                    if( pContext->retrieveFunction != NULL )
+                    {
+                        if( pContext->retrieveFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &pMqttPacket, &totalMessageLength ) != true )
+                        {
+                            LogError( ( "Failed to retrieve PUBREL with packet ID %u", packetId ) );
+                            status = MQTTPublishRetrieveFailed;
+                        }
+                        else if( CHECK_SIZE_T_OVERFLOWS_32BIT( totalMessageLength ) ||
+                                 ( totalMessageLength > MQTT_MAX_PACKET_SIZE ) )
+                        {
+                            LogError( ( "Total packet size returned by the retrieve function exceeds the MQTT Max packet size." ) );
+                            status = MQTTBadParameter;
+                        }
+                        else
+                        {
+                            MQTT_PRE_SEND_HOOK( pContext );
+
+                            pContext->sendBatched = true;
+
+                            if( sendBuffer( pContext, pMqttPacket, totalMessageLength ) != ( int32_t ) totalMessageLength )
+                            {
+                                status = MQTTSendFailed;
+                            }
+
+                            releaseSendHook( pContext );
+                        }
+                    }
+                    /* Otherwise, send default ACKs. */
+                    else
+                    {
+                        LogWarn( ( "No Application provided retransmission storage callbacks, sending 'default' PUBRECs." ) );
+                        status = sendPublishAcks( pContext, packetId, state );
+                    }
+                #else
+                    status = sendPublishAcks( pContext, packetId, state );
+                #endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
+            }
+        }
+        while( ( packetId != MQTT_PACKET_ID_INVALID ) &&
+               ( status == MQTTSuccess ) );
+    #endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
 
-        /* Resend all the PUBREL acks after session is reestablished. */
-        if( packetId != MQTT_PACKET_ID_INVALID )
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        if( ( status == MQTTSuccess ) &&
+            ( pContext->retrieveFunction != NULL ) )
         {
-            /* If we have the stored data, then we just need to send it. */
-            if( pContext->retrieveFunction != NULL )
+            cursor = MQTT_STATE_CURSOR_INITIALIZER;
+
+            /* Resend all the PUBLISH for which PUBACK/PUBREC is not received
+             * after session is reestablished. */
+            do
             {
-                if( pContext->retrieveFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ), &pMqttPacket, &totalMessageLength ) != true )
-                {
-                    LogError( ( "Failed to retrieve PUBREL with packet ID %u", packetId ) );
-                    status = MQTTPublishRetrieveFailed;
-                }
-                else if( CHECK_SIZE_T_OVERFLOWS_32BIT( totalMessageLength ) ||
-                         ( totalMessageLength > MQTT_MAX_PACKET_SIZE ) )
-                {
-                    LogError( ( "Total packet size returned by the retrieve function exceeds the MQTT Max packet size." ) );
-                    status = MQTTBadParameter;
-                }
-                else
-                {
-                    MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+                packetId = MQTT_PublishToResend( pContext, &cursor );
 
-                    if( sendBuffer( pContext, pMqttPacket, totalMessageLength ) != ( int32_t ) totalMessageLength )
+                if( packetId != MQTT_PACKET_ID_INVALID )
+                {
+                    if( pContext->retrieveFunction( pContext, ( uint32_t ) packetId, &pMqttPacket, &totalMessageLength ) != true )
                     {
-                        status = MQTTSendFailed;
+                        LogError( ( "Failed to retrieve publish with packet ID %u", packetId ) );
+                        status = MQTTPublishRetrieveFailed;
+                    }
+                    else if( CHECK_SIZE_T_OVERFLOWS_32BIT( totalMessageLength ) ||
+                             ( totalMessageLength > MQTT_MAX_PACKET_SIZE ) )
+                    {
+                        LogError( ( "Total packet size returned by the retrieve function exceeds the MQTT Max packet size." ) );
+                        status = MQTTBadParameter;
                     }
+                    else
+                    {
+                        #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+                            status = refreshMessageExpiry( pContext, packetId, pMqttPacket,
+                                                           totalMessageLength, &expired );
+                        #endif
+
+                        if( ( status == MQTTSuccess ) && ( expired == false ) )
+                        {
+                            MQTT_PRE_SEND_HOOK( pContext );
 
-                    MQTT_POST_STATE_UPDATE_HOOK( pContext );
+                            pContext->sendBatched = true;
+
+                            if( sendBuffer( pContext, pMqttPacket, totalMessageLength ) != ( int32_t ) totalMessageLength )
+                            {
+                                status = MQTTSendFailed;
+                            }
+
+                            releaseSendHook( pContext );
+                        }
+                    }
                 }
-            }
-            /* Otherwise, send default ACKs. */
-            else
+            } while( ( packetId != MQTT_PACKET_ID_INVALID ) &&
+                     ( status == MQTTSuccess ) );
+        }
+    #endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
+static uint32_t getMessageExpiry( const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t messageExpiry = 0U;
+    size_t currentIndex = 0U;
+    uint8_t propertyId = 0U;
+
+    if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) &&
+        UINT32_CHECK_BIT( pPropertyBuilder->fieldSet, MQTT_MESSAGE_EXPIRY_INTERVAL_POS ) )
+    {
+        status = MQTT_GetNextPropertyType( pPropertyBuilder, &currentIndex, &propertyId );
+
+        while( ( status == MQTTSuccess ) && ( propertyId != MQTT_MSG_EXPIRY_ID ) )
+        {
+            status = MQTT_SkipNextProperty( pPropertyBuilder, &currentIndex );
+
+            if( status == MQTTSuccess )
             {
-                LogWarn( ( "No Application provided retransmission storage callbacks, sending 'default' PUBRECs." ) );
-                status = sendPublishAcks( pContext, packetId, state );
+                status = MQTT_GetNextPropertyType( pPropertyBuilder, &currentIndex, &propertyId );
             }
         }
+
+        if( ( status == MQTTSuccess ) &&
+            ( MQTTPropGet_MessageExpiryInterval( pPropertyBuilder, &currentIndex, &messageExpiry ) != MQTTSuccess ) )
+        {
+            messageExpiry = 0U;
+        }
     }
-    while( ( packetId != MQTT_PACKET_ID_INVALID ) &&
-           ( status == MQTTSuccess ) );
 
-    if( ( status == MQTTSuccess ) &&
-        ( pContext->retrieveFunction != NULL ) )
+    return messageExpiry;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t refreshMessageExpiry( MQTTContext_t * pContext,
+                                          uint16_t packetId,
+                                          uint8_t * pMqttPacket,
+                                          size_t packetSize,
+                                          bool * pExpired )
+{
+    MQTTStatus_t status;
+    uint32_t messageExpiry = 0U;
+    uint32_t publishTimeMs = 0U;
+    uint32_t elapsedSeconds = 0U;
+
+    assert( pContext != NULL );
+    assert( pExpired != NULL );
+
+    *pExpired = false;
+
+    MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+    status = MQTT_GetPublishExpiry( pContext, packetId, &messageExpiry, &publishTimeMs );
+
+    MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+    if( ( status == MQTTSuccess ) && ( messageExpiry > 0U ) )
     {
-        cursor = MQTT_STATE_CURSOR_INITIALIZER;
+        elapsedSeconds = calculateElapsedTime( pContext->getTime(), publishTimeMs ) / 1000U;
 
-        /* Resend all the PUBLISH for which PUBACK/PUBREC is not received
-         * after session is reestablished. */
-        do
+        if( elapsedSeconds >= messageExpiry )
         {
-            packetId = MQTT_PublishToResend( pContext, &cursor );
+            LogInfo( ( "Dropping expired publish with packet ID %u.",
+                       ( unsigned int ) packetId ) );
 
-            if( packetId != MQTT_PACKET_ID_INVALID )
-            {
-                if( pContext->retrieveFunction( pContext, ( uint32_t ) packetId, &pMqttPacket, &totalMessageLength ) != true )
-                {
-                    LogError( ( "Failed to retrieve publish with packet ID %u", packetId ) );
-                    status = MQTTPublishRetrieveFailed;
-                }
-                else if( CHECK_SIZE_T_OVERFLOWS_32BIT( totalMessageLength ) ||
-                         ( totalMessageLength > MQTT_MAX_PACKET_SIZE ) )
-                {
-                    LogError( ( "Total packet size returned by the retrieve function exceeds the MQTT Max packet size." ) );
-                    status = MQTTBadParameter;
-                }
-                else
-                {
-                    MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            *pExpired = true;
 
-                    if( sendBuffer( pContext, pMqttPacket, totalMessageLength ) != ( int32_t ) totalMessageLength )
-                    {
-                        status = MQTTSendFailed;
-                    }
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
-                    MQTT_POST_STATE_UPDATE_HOOK( pContext );
-                }
+            status = MQTT_RemoveStateRecord( pContext, packetId );
+
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+            if( pContext->clearFunction != NULL )
+            {
+                pContext->clearFunction( pContext, ( uint32_t ) packetId );
             }
-        } while( ( packetId != MQTT_PACKET_ID_INVALID ) &&
-                 ( status == MQTTSuccess ) );
+        }
+        else
+        {
+            /* The receiver must see the lifetime the message has left. */
+            status = MQTT_UpdatePublishMessageExpiry( pMqttPacket,
+                                                      packetSize,
+                                                      messageExpiry - elapsedSeconds );
+        }
     }
 
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
 {
     MQTTStatus_t status = MQTTSuccess;
-    MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
-    uint16_t packetId = MQTT_PACKET_ID_INVALID;
 
-    assert( pContext != NULL );
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
+        uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    #endif
 
-    /* Reset the index and clear the buffer when a new session is established. */
-    pContext->index = 0;
-    ( void ) memset( pContext->networkBuffer.pBuffer, 0, pContext->networkBuffer.size );
+    assert( pContext != NULL );
 
     if( pContext->outgoingPublishRecordMaxCount > 0U )
     {
-        if( pContext->clearFunction != NULL )
-        {
-            cursor = MQTT_STATE_CURSOR_INITIALIZER;
-
-            /* Clear the stored packets on clean session. */
-            do
+        #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+            if( pContext->clearFunction != NULL )
             {
-                packetId = MQTT_PublishToResend( pContext, &cursor );
+                cursor = MQTT_STATE_CURSOR_INITIALIZER;
 
-                if( packetId != MQTT_PACKET_ID_INVALID )
+                /* Clear the stored packets on clean session. */
+                do
                 {
-                    pContext->clearFunction( pContext, ( uint32_t ) packetId );
-                }
-            } while( packetId != MQTT_PACKET_ID_INVALID );
-        }
+                    packetId = MQTT_PublishToResend( pContext, &cursor );
+
+                    if( packetId != MQTT_PACKET_ID_INVALID )
+                    {
+                        pContext->clearFunction( pContext, ( uint32_t ) packetId );
+                    }
+                } while( packetId != MQTT_PACKET_ID_INVALID );
+            }
+        #endif
 
         /* Clear any existing records if a new session is established. */
         ( void ) memset( pContext->outgoingPublishRecords,
@@ -3719,34 +5285,64 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
 
     if( pContext->incomingPublishRecordMaxCount > 0U )
     {
-        if( pContext->clearFunction != NULL )
-        {
-            MQTTPublishState_t state;
-            cursor = MQTT_STATE_CURSOR_INITIALIZER;
-
-            /* Clear the stored PUBRELs on clean session. */
-            do
+        #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+            if( pContext->clearFunction != NULL )
             {
-                state = MQTTStateNull;
-                packetId = MQTT_PubrelToResend( pContext, &cursor, &state );
+                MQTTPublishState_t state;
+                cursor = MQTT_STATE_CURSOR_INITIALIZER;
 
-                if( packetId != MQTT_PACKET_ID_INVALID )
+                /* Clear the stored PUBRELs on clean session. */
+                do
                 {
-                    pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ) );
-                }
-            } while( packetId != MQTT_PACKET_ID_INVALID );
-        }
+                    state = MQTTStateNull;
+                    packetId = MQTT_PubrelToResend( pContext, &cursor, &state );
+
+                    if( packetId != MQTT_PACKET_ID_INVALID )
+                    {
+                        pContext->clearFunction( pContext, SET_INCOMING_PUB_FLAG( packetId ) );
+                    }
+                } while( packetId != MQTT_PACKET_ID_INVALID );
+            }
+        #endif
 
         ( void ) memset( pContext->incomingPublishRecords,
                          0x00,
                          pContext->incomingPublishRecordMaxCount * sizeof( *pContext->incomingPublishRecords ) );
     }
 
+    /* The records cleared above no longer need to be held. */
+    releaseIdleRecords( pContext );
+
     return status;
 }
 
 /*-----------------------------------------------------------*/
 
+static bool isOutgoingPacketIdInUse( const MQTTContext_t * pContext,
+                                     uint16_t packetId )
+{
+    bool inUse = false;
+    size_t index = 0U;
+
+    assert( pContext != NULL );
+
+    if( pContext->outgoingPublishRecords != NULL )
+    {
+        for( index = 0U; index < pContext->outgoingPublishRecordMaxCount; index++ )
+        {
+            if( pContext->outgoingPublishRecords[ index ].packetId == packetId )
+            {
+                inUse = true;
+                break;
+            }
+        }
+    }
+
+    return inUse;
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
                                            const MQTTPublishInfo_t * pPublishInfo,
                                            uint16_t packetId )
@@ -3762,7 +5358,35 @@ static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
                     ( const void * ) pPublishInfo ) );
         status = MQTTBadParameter;
     }
-    else if( ( pPublishInfo->qos != MQTTQoS0 ) && ( packetId == 0U ) )
+    else
+    {
+        status = validatePublishInfo( pPublishInfo, packetId );
+    }
+
+    if( ( status == MQTTSuccess ) &&
+        ( pContext->outgoingPublishRecords == NULL ) &&
+        ( pContext->outgoingPublishRecordQuota == 0U ) &&
+        ( pPublishInfo->qos > MQTTQoS0 ) )
+    {
+        LogError( ( "Trying to publish a QoS > MQTTQoS0 packet when outgoing publishes "
+                    "for QoS1/QoS2 have not been enabled. Please, call MQTT_InitStatefulQoS "
+                    "to initialize and enable the use of QoS1/QoS2 publishes." ) );
+        status = MQTTBadParameter;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t validatePublishInfo( const MQTTPublishInfo_t * pPublishInfo,
+                                         uint16_t packetId )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    assert( pPublishInfo != NULL );
+
+    if( ( pPublishInfo->qos != MQTTQoS0 ) && ( packetId == 0U ) )
     {
         LogError( ( "Packet Id is 0 for PUBLISH with QoS=%u.",
                     ( unsigned int ) pPublishInfo->qos ) );
@@ -3787,13 +5411,14 @@ static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
         LogError( ( "pPublishInfo->payloadLength must be less than %" PRIu32, MQTT_REMAINING_LENGTH_INVALID ) );
         status = MQTTBadParameter;
     }
-    else if( ( pContext->outgoingPublishRecords == NULL ) && ( pPublishInfo->qos > MQTTQoS0 ) )
-    {
-        LogError( ( "Trying to publish a QoS > MQTTQoS0 packet when outgoing publishes "
-                    "for QoS1/QoS2 have not been enabled. Please, call MQTT_InitStatefulQoS "
-                    "to initialize and enable the use of QoS1/QoS2 publishes." ) );
-        status = MQTTBadParameter;
-    }
+
+    #if ( MQTT_ENABLE_QOS2 == 0 )
+        else if( pPublishInfo->qos == MQTTQoS2 )
+        {
+            LogError( ( "QoS 2 publishes are disabled by MQTT_ENABLE_QOS2." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
     else
     {
         /* MISRA else */
@@ -3833,6 +5458,14 @@ static MQTTStatus_t validateTopicFilter( const MQTTContext_t * pContext,
             LogError( ( "Protocol Error : QoS cannot be greater than 2" ) );
             status = MQTTBadParameter;
         }
+
+        #if ( MQTT_ENABLE_QOS2 == 0 )
+            else if( pSubscriptionList[ iterator ].qos == MQTTQoS2 )
+            {
+                LogError( ( "QoS 2 subscriptions are disabled by MQTT_ENABLE_QOS2." ) );
+                status = MQTTBadParameter;
+            }
+        #endif
         else if( checkWildcardSubscriptions( pContext->connectionProperties.isWildcardAvailable,
                                              pSubscriptionList,
                                              iterator ) )
@@ -3845,6 +5478,16 @@ static MQTTStatus_t validateTopicFilter( const MQTTContext_t * pContext,
             LogError( ( "Protocol Error : retainHandlingOption cannot be greater than 2" ) );
             status = MQTTBadParameter;
         }
+
+        #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+            else if( ( pSubscriptionList[ iterator ].noLocalOption == true ) ||
+                     ( pSubscriptionList[ iterator ].retainAsPublishedOption == true ) ||
+                     ( pSubscriptionList[ iterator ].retainHandlingOption != retainSendOnSub ) )
+            {
+                LogError( ( "MQTT 3.1.1 SUBSCRIBE has no subscription options other than QoS." ) );
+                status = MQTTBadParameter;
+            }
+        #endif
         else
         {
             status = validateSharedSubscriptions( pContext,
@@ -3885,8 +5528,11 @@ static MQTTStatus_t validateSharedSubscriptions( const MQTTContext_t * pContext,
     MQTTStatus_t status = MQTTSuccess;
     uint16_t topicFilterLength;
     bool isSharedSub;
-    const char * shareNameEnd;
-    const char * shareNameStart;
+
+    #if ( MQTT_ENABLE_SHARED_SUBSCRIPTIONS != 0 )
+        const char * shareNameEnd;
+        const char * shareNameStart;
+    #endif
 
     assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pSubscriptionList[ iterator ].topicFilterLength ) );
 
@@ -3901,51 +5547,57 @@ static MQTTStatus_t validateSharedSubscriptions( const MQTTContext_t * pContext,
 
     if( isSharedSub )
     {
-        shareNameStart = &( pSubscriptionList[ iterator ].pTopicFilter[ 7U ] );
-        shareNameEnd = memchr( shareNameStart, ( int32_t ) '/', ( size_t ) topicFilterLength - 7U );
-
-        if( ( shareNameEnd == NULL ) ||
-            ( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ 7 ] ) ) )
-        {
-            LogError( ( "Protocol Error : ShareName is not present , missing or empty" ) );
-            status = MQTTBadParameter;
-        }
-        else if( pSubscriptionList[ iterator ].noLocalOption )
-        {
-            LogError( ( "Protocol Error : noLocalOption cannot be 1 for shared subscriptions" ) );
-            status = MQTTBadParameter;
-        }
-        else if( pContext->connectionProperties.isSharedAvailable == 0U )
-        {
-            LogError( ( "Protocol Error : Shared Subscriptions not allowed" ) );
-            status = MQTTBadParameter;
-        }
-        else if( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ topicFilterLength - 1U ] ) )
-        {
-            LogError( ( "Protocol Error : Topic filter after share name is missing" ) );
+        #if ( MQTT_ENABLE_SHARED_SUBSCRIPTIONS == 0 )
+            ( void ) pContext;
+            LogError( ( "Shared subscriptions are disabled by MQTT_ENABLE_SHARED_SUBSCRIPTIONS." ) );
             status = MQTTBadParameter;
-        }
-        else
-        {
-            const char * ptr;
+        #else
+            shareNameStart = &( pSubscriptionList[ iterator ].pTopicFilter[ 7U ] );
+            shareNameEnd = memchr( shareNameStart, ( int32_t ) '/', ( size_t ) topicFilterLength - 7U );
 
-            for( ptr = shareNameStart; ptr < shareNameEnd; ptr++ )
+            if( ( shareNameEnd == NULL ) ||
+                ( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ 7 ] ) ) )
             {
-                if( ( *ptr == '#' ) || ( *ptr == '+' ) )
-                {
-                    status = MQTTBadParameter;
-                    break; /* Invalid share name */
-                }
+                LogError( ( "Protocol Error : ShareName is not present , missing or empty" ) );
+                status = MQTTBadParameter;
             }
-        }
-    }
-
-    return status;
-}
-
-/*-----------------------------------------------------------*/
-
-static void addSubscriptionOptions( const MQTTSubscribeInfo_t subscriptionInfo,
+            else if( pSubscriptionList[ iterator ].noLocalOption )
+            {
+                LogError( ( "Protocol Error : noLocalOption cannot be 1 for shared subscriptions" ) );
+                status = MQTTBadParameter;
+            }
+            else if( pContext->connectionProperties.isSharedAvailable == 0U )
+            {
+                LogError( ( "Protocol Error : Shared Subscriptions not allowed" ) );
+                status = MQTTBadParameter;
+            }
+            else if( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ topicFilterLength - 1U ] ) )
+            {
+                LogError( ( "Protocol Error : Topic filter after share name is missing" ) );
+                status = MQTTBadParameter;
+            }
+            else
+            {
+                const char * ptr;
+
+                for( ptr = shareNameStart; ptr < shareNameEnd; ptr++ )
+                {
+                    if( ( *ptr == '#' ) || ( *ptr == '+' ) )
+                    {
+                        status = MQTTBadParameter;
+                        break; /* Invalid share name */
+                    }
+                }
+            }
+        #endif /* if ( MQTT_ENABLE_SHARED_SUBSCRIPTIONS == 0 ) */
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void addSubscriptionOptions( const MQTTSubscribeInfo_t subscriptionInfo,
                                     uint8_t * pSubscriptionOptionsArray,
                                     size_t currentOptionIndex )
 {
@@ -4012,7 +5664,7 @@ static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
     MQTTStatus_t status = MQTTSuccess;
     uint16_t packetIdentifier;
     MQTTEventCallback_t appCallback;
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
     MQTTPropBuilder_t propBuffer = { 0 };
 
     MQTTReasonCodeInfo_t ackInfo = { 0 };
@@ -4032,6 +5684,15 @@ static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
     LogInfo( ( "Ack packet deserialized with result: %s.",
                MQTT_Status_strerror( status ) ) );
 
+    if( ( status == MQTTSuccess ) &&
+        ( pIncomingPacket->type == MQTT_PACKET_TYPE_SUBACK ) &&
+        ( pContext->pSubscriptionRecords != NULL ) )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        updateSubscriptionRecords( pContext, packetIdentifier, &ackInfo );
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
     if( status == MQTTSuccess )
     {
         deserializedInfo.packetIdentifier = packetIdentifier;
@@ -4052,6 +5713,219 @@ static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static size_t findSubscriptionRecord( const MQTTContext_t * pContext,
+                                      const MQTTSubscribeInfo_t * pSubscribeInfo )
+{
+    size_t index = 0U;
+    const MQTTSubscribeInfo_t * pRecordInfo = NULL;
+
+    assert( pContext != NULL );
+    assert( pSubscribeInfo != NULL );
+
+    for( index = 0U; index < pContext->subscriptionRecordCount; index++ )
+    {
+        pRecordInfo = &( pContext->pSubscriptionRecords[ index ].subscribeInfo );
+
+        if( ( pRecordInfo->topicFilterLength == pSubscribeInfo->topicFilterLength ) &&
+            ( memcmp( pRecordInfo->pTopicFilter,
+                      pSubscribeInfo->pTopicFilter,
+                      pSubscribeInfo->topicFilterLength ) == 0 ) )
+        {
+            break;
+        }
+    }
+
+    return index;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t recordSubscriptions( MQTTContext_t * pContext,
+                                         const MQTTSubscribeInfo_t * pSubscriptionList,
+                                         size_t subscriptionCount,
+                                         uint16_t packetId )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t i = 0U;
+    size_t index = 0U;
+    size_t newRecords = 0U;
+    MQTTSubscriptionRecord_t * pRecord = NULL;
+
+    assert( pContext != NULL );
+    assert( pContext->pSubscriptionRecords != NULL );
+
+    /* Check that all new topic filters fit before changing any record. */
+    for( i = 0U; i < subscriptionCount; i++ )
+    {
+        if( findSubscriptionRecord( pContext, &pSubscriptionList[ i ] ) == pContext->subscriptionRecordCount )
+        {
+            newRecords++;
+        }
+    }
+
+    if( newRecords > ( pContext->subscriptionRecordMaxCount - pContext->subscriptionRecordCount ) )
+    {
+        LogError( ( "Subscription registry is full: Registered=%lu, New=%lu, Max=%lu.",
+                    ( unsigned long ) pContext->subscriptionRecordCount,
+                    ( unsigned long ) newRecords,
+                    ( unsigned long ) pContext->subscriptionRecordMaxCount ) );
+        status = MQTTNoMemory;
+    }
+    else
+    {
+        for( i = 0U; i < subscriptionCount; i++ )
+        {
+            index = findSubscriptionRecord( pContext, &pSubscriptionList[ i ] );
+
+            if( index == pContext->subscriptionRecordCount )
+            {
+                pContext->subscriptionRecordCount++;
+            }
+
+            pRecord = &( pContext->pSubscriptionRecords[ index ] );
+            pRecord->subscribeInfo = pSubscriptionList[ i ];
+            pRecord->packetId = packetId;
+            pRecord->subackIndex = i;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void removeSubscriptionRecord( MQTTContext_t * pContext,
+                                      size_t index )
+{
+    assert( pContext != NULL );
+    assert( index < pContext->subscriptionRecordCount );
+
+    /* The order of the records does not matter, so fill the gap with the
+     * last record. */
+    pContext->subscriptionRecordCount--;
+    pContext->pSubscriptionRecords[ index ] = pContext->pSubscriptionRecords[ pContext->subscriptionRecordCount ];
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
+static void removeSubscriptions( MQTTContext_t * pContext,
+                                 const MQTTSubscribeInfo_t * pSubscriptionList,
+                                 size_t subscriptionCount )
+{
+    size_t i = 0U;
+    size_t index = 0U;
+
+    assert( pContext != NULL );
+
+    for( i = 0U; i < subscriptionCount; i++ )
+    {
+        index = findSubscriptionRecord( pContext, &pSubscriptionList[ i ] );
+
+        if( index < pContext->subscriptionRecordCount )
+        {
+            removeSubscriptionRecord( pContext, index );
+        }
+    }
+}
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void updateSubscriptionRecords( MQTTContext_t * pContext,
+                                       uint16_t packetId,
+                                       const MQTTReasonCodeInfo_t * pReasonCodes )
+{
+    size_t index = 0U;
+    const MQTTSubscriptionRecord_t * pRecord = NULL;
+
+    assert( pContext != NULL );
+    assert( pReasonCodes != NULL );
+
+    while( index < pContext->subscriptionRecordCount )
+    {
+        pRecord = &( pContext->pSubscriptionRecords[ index ] );
+
+        if( pRecord->packetId != packetId )
+        {
+            index++;
+        }
+        else if( ( pRecord->subackIndex < pReasonCodes->reasonCodeLength ) &&
+                 ( pReasonCodes->reasonCode[ pRecord->subackIndex ] < 0x80U ) )
+        {
+            pContext->pSubscriptionRecords[ index ].packetId = MQTT_PACKET_ID_INVALID;
+            index++;
+        }
+        else
+        {
+            LogWarn( ( "Topic filter %.*s was refused by the server and is removed "
+                       "from the subscription registry.",
+                       ( int ) pRecord->subscribeInfo.topicFilterLength,
+                       pRecord->subscribeInfo.pTopicFilter ) );
+
+            /* The last record is moved to this index, so check it next. */
+            removeSubscriptionRecord( pContext, index );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t resubscribeRegisteredSubscriptions( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTSubscribeInfo_t batch[ MQTT_RESUBSCRIBE_BATCH_SIZE ];
+    size_t batchLength = 0U;
+    size_t recordIndex = 0U;
+    size_t recordCount = 0U;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+
+    assert( pContext != NULL );
+
+    MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+    recordCount = pContext->subscriptionRecordCount;
+    MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+    if( recordCount > 0U )
+    {
+        LogInfo( ( "Session not present. Re-issuing %lu registered subscriptions.",
+                   ( unsigned long ) recordCount ) );
+    }
+
+    /* Re-subscribing a registered topic filter only updates its record, so
+     * the number and order of the records is unchanged by the loop below. */
+    while( ( status == MQTTSuccess ) && ( recordIndex < recordCount ) )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        for( batchLength = 0U;
+             ( batchLength < MQTT_RESUBSCRIBE_BATCH_SIZE ) && ( recordIndex < recordCount );
+             batchLength++ )
+        {
+            batch[ batchLength ] = pContext->pSubscriptionRecords[ recordIndex ].subscribeInfo;
+            recordIndex++;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        packetId = MQTT_GetPacketId( pContext );
+
+        /* The SUBACKs are not waited for, so that all the SUBSCRIBE packets
+         * are sent back to back. */
+        status = MQTT_Subscribe( pContext,
+                                 batch,
+                                 batchLength,
+                                 packetId,
+                                 NULL );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
                                                const MQTTSuccessFailReasonCode_t * pReasonCode,
                                                uint32_t remainingLength,
@@ -4118,7 +5992,7 @@ static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
         disconnectPropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
     }
 
-    pIndex = encodeVariableLength( propertyLength, disconnectPropLen );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( propertyLength, disconnectPropLen );
     iterator->iov_base = propertyLength;
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
@@ -4164,6 +6038,74 @@ static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static MQTTStatus_t sendAuthWithoutCopy( MQTTContext_t * pContext,
+                                         MQTTSuccessFailReasonCode_t reasonCode,
+                                         uint32_t remainingLength,
+                                         const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    int32_t bytesSentOrError;
+    size_t ioVectorLength = 0U;
+    uint32_t totalMessageLength = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+
+    /* Maximum number of bytes required by the fixed size part of the AUTH
+     * packet header.
+     * MQTT Control Byte      0 + 1 = 1
+     * Remaining length (max)   + 4 = 5
+     * Reason Code              + 1 = 6
+     * Property length (max)    + 4 = 10
+     */
+    uint8_t fixedHeader[ 10U ];
+
+    /* The AUTH header and the properties. */
+    TransportOutVector_t pIoVector[ 2U ];
+
+    uint8_t * pIndex = fixedHeader;
+
+    assert( pContext != NULL );
+    assert( pPropertyBuilder != NULL );
+    assert( pPropertyBuilder->pBuffer != NULL );
+    assert( remainingLength < MQTT_REMAINING_LENGTH_INVALID );
+
+    pIndex = serializeAuthFixed( pIndex, reasonCode, remainingLength );
+    pIndex = encodeVariableLength( pIndex, ( uint32_t ) pPropertyBuilder->currentIndex );
+
+    pIoVector[ 0 ].iov_base = fixedHeader;
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+    /* coverity[misra_c_2012_rule_18_2_violation] */
+    /* coverity[misra_c_2012_rule_10_8_violation] */
+    pIoVector[ 0 ].iov_len = ( size_t ) ( pIndex - fixedHeader );
+    assert( pIoVector[ 0 ].iov_len <= sizeof( fixedHeader ) );
+    totalMessageLength += ( uint32_t ) pIoVector[ 0 ].iov_len;
+    ioVectorLength++;
+
+    if( pPropertyBuilder->currentIndex > 0U )
+    {
+        pIoVector[ 1 ].iov_base = pPropertyBuilder->pBuffer;
+        pIoVector[ 1 ].iov_len = pPropertyBuilder->currentIndex;
+        totalMessageLength += ( uint32_t ) pIoVector[ 1 ].iov_len;
+        ioVectorLength++;
+    }
+
+    bytesSentOrError = sendMessageVector( pContext, pIoVector, ioVectorLength );
+
+    if( bytesSentOrError != ( int32_t ) totalMessageLength )
+    {
+        LogError( ( "Transport send failed for AUTH packet." ) );
+        status = MQTTSendFailed;
+    }
+    else
+    {
+        LogDebug( ( "Sent %ld bytes of AUTH packet.",
+                    ( long int ) bytesSentOrError ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
                         const TransportInterface_t * pTransportInterface,
                         MQTTGetCurrentTimeFunc_t getTimeFunction,
@@ -4213,7 +6155,9 @@ MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
         pContext->getTime = getTimeFunction;
         pContext->appCallback = userCallback;
         pContext->networkBuffer = *pNetworkBuffer;
-        pContext->ackPropsBuffer.pBuffer = NULL;
+        #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+            pContext->ackPropsBuffer.pBuffer = NULL;
+        #endif
 
         /* Zero is not a valid packet ID per MQTT spec. Start from 1. */
         pContext->nextPacketId = 1;
@@ -4280,15 +6224,21 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
         pContext->outgoingPublishRecordMaxCount = outgoingPublishCount;
         pContext->outgoingPublishRecords = pOutgoingPublishRecords;
 
-        if( ( pAckPropsBuf != NULL ) && ( ackPropsBufLength != 0U ) )
-        {
-            status = MQTTPropertyBuilder_Init( &pContext->ackPropsBuffer, pAckPropsBuf, ackPropsBufLength );
-        }
-        else
-        {
-            pContext->ackPropsBuffer.pBuffer = NULL;
-            pContext->ackPropsBuffer.bufferLength = 0;
-        }
+        #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+            /* Acks never carry properties in MQTT 3.1.1. */
+            ( void ) pAckPropsBuf;
+            ( void ) ackPropsBufLength;
+        #else
+            if( ( pAckPropsBuf != NULL ) && ( ackPropsBufLength != 0U ) )
+            {
+                status = MQTTPropertyBuilder_Init( &pContext->ackPropsBuffer, pAckPropsBuf, ackPropsBufLength );
+            }
+            else
+            {
+                pContext->ackPropsBuffer.pBuffer = NULL;
+                pContext->ackPropsBuffer.bufferLength = 0;
+            }
+        #endif
     }
 
     return status;
@@ -4296,39 +6246,46 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
-                                   MQTTStorePacketForRetransmit storeFunction,
-                                   MQTTRetrievePacketForRetransmit retrieveFunction,
-                                   MQTTClearPacketForRetransmit clearFunction )
+MQTTStatus_t MQTT_InitRecordPool( MQTTRecordPool_t * pPool,
+                                  MQTTPubAckInfo_t * pRecords,
+                                  size_t recordsPerBlock,
+                                  size_t blockCount,
+                                  size_t * pFreeBlocks )
 {
     MQTTStatus_t status = MQTTSuccess;
+    size_t block;
 
-    if( pContext == NULL )
-    {
-        LogError( ( "Argument cannot be NULL: pContext=%p\n",
-                    ( void * ) pContext ) );
-        status = MQTTBadParameter;
-    }
-    else if( storeFunction == NULL )
-    {
-        LogError( ( "Invalid parameter: storeFunction is NULL" ) );
-        status = MQTTBadParameter;
-    }
-    else if( retrieveFunction == NULL )
+    if( ( pPool == NULL ) || ( pRecords == NULL ) || ( pFreeBlocks == NULL ) )
     {
-        LogError( ( "Invalid parameter: retrieveFunction is NULL" ) );
+        LogError( ( "Argument cannot be NULL: pPool=%p, pRecords=%p, pFreeBlocks=%p",
+                    ( void * ) pPool,
+                    ( void * ) pRecords,
+                    ( void * ) pFreeBlocks ) );
         status = MQTTBadParameter;
     }
-    else if( clearFunction == NULL )
+    else if( ( recordsPerBlock == 0U ) || ( blockCount == 0U ) ||
+             ( blockCount > ( SIZE_MAX / sizeof( MQTTPubAckInfo_t ) / recordsPerBlock ) ) )
     {
-        LogError( ( "Invalid parameter: clearFunction is NULL" ) );
+        LogError( ( "Invalid pool size: recordsPerBlock=%lu, blockCount=%lu",
+                    ( unsigned long ) recordsPerBlock,
+                    ( unsigned long ) blockCount ) );
         status = MQTTBadParameter;
     }
     else
     {
-        pContext->storeFunction = storeFunction;
-        pContext->retrieveFunction = retrieveFunction;
-        pContext->clearFunction = clearFunction;
+        ( void ) memset( pRecords, 0x00, recordsPerBlock * blockCount * sizeof( MQTTPubAckInfo_t ) );
+
+        /* Every block starts free. */
+        for( block = 0U; block < blockCount; block++ )
+        {
+            pFreeBlocks[ block ] = block;
+        }
+
+        pPool->pRecords = pRecords;
+        pPool->recordsPerBlock = recordsPerBlock;
+        pPool->blockCount = blockCount;
+        pPool->pFreeBlocks = pFreeBlocks;
+        pPool->freeBlockCount = blockCount;
     }
 
     return status;
@@ -4336,31 +6293,44 @@ MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
-                                  uint16_t packetId )
+MQTTStatus_t MQTT_InitBufferPool( MQTTBufferPool_t * pPool,
+                                  uint8_t * pBuffers,
+                                  size_t bufferSize,
+                                  size_t bufferCount,
+                                  size_t * pFreeBuffers )
 {
     MQTTStatus_t status = MQTTSuccess;
+    size_t buffer;
 
-    if( pContext == NULL )
+    if( ( pPool == NULL ) || ( pBuffers == NULL ) || ( pFreeBuffers == NULL ) )
     {
-        LogWarn( ( "pContext is NULL\n" ) );
+        LogError( ( "Argument cannot be NULL: pPool=%p, pBuffers=%p, pFreeBuffers=%p",
+                    ( void * ) pPool,
+                    ( void * ) pBuffers,
+                    ( void * ) pFreeBuffers ) );
         status = MQTTBadParameter;
     }
-    else if( pContext->outgoingPublishRecords == NULL )
+    else if( ( bufferSize < MQTT_FIXED_HEADER_MAX_SIZE ) || ( bufferCount == 0U ) ||
+             ( bufferCount > ( SIZE_MAX / bufferSize ) ) )
     {
-        LogError( ( "QoS1/QoS2 is not initialized for use. Please "
-                    "call MQTT_InitStatefulQoS to enable QoS1 and QoS2 "
-                    "publishes.\n" ) );
+        LogError( ( "Invalid pool size: bufferSize=%lu, bufferCount=%lu",
+                    ( unsigned long ) bufferSize,
+                    ( unsigned long ) bufferCount ) );
         status = MQTTBadParameter;
     }
     else
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-
-        status = MQTT_RemoveStateRecord( pContext,
-                                         packetId );
+        /* Every buffer starts free. */
+        for( buffer = 0U; buffer < bufferCount; buffer++ )
+        {
+            pFreeBuffers[ buffer ] = buffer;
+        }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        pPool->pBuffers = pBuffers;
+        pPool->bufferSize = bufferSize;
+        pPool->bufferCount = bufferCount;
+        pPool->pFreeBuffers = pFreeBuffers;
+        pPool->freeBufferCount = bufferCount;
     }
 
     return status;
@@ -4368,339 +6338,2079 @@ MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext )
+MQTTStatus_t MQTT_InitNetworkBufferPool( MQTTContext_t * pContext,
+                                         MQTTBufferPool_t * pPool )
 {
-    MQTTConnectionStatus_t connectStatus;
     MQTTStatus_t status = MQTTSuccess;
 
-    if( pContext == NULL )
+    if( ( pContext == NULL ) || ( pPool == NULL ) )
     {
-        LogError( ( "Argument cannot be NULL: pContext=%p",
-                    ( const void * ) pContext ) );
+        LogError( ( "Argument cannot be NULL: pContext=%p, pPool=%p",
+                    ( void * ) pContext,
+                    ( void * ) pPool ) );
         status = MQTTBadParameter;
     }
-
-    if( status == MQTTSuccess )
+    else if( ( pContext->networkBuffer.pBuffer == NULL ) ||
+             ( pContext->networkBuffer.size < MQTT_FIXED_HEADER_MAX_SIZE ) ||
+             ( pContext->networkBuffer.size > pPool->bufferSize ) )
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        LogError( ( "The network buffer must hold a fixed header and be no larger "
+                    "than the pool buffers: size=%lu, bufferSize=%lu",
+                    ( unsigned long ) pContext->networkBuffer.size,
+                    ( unsigned long ) pPool->bufferSize ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pContext->index > 0U ) || ( pContext->pBufferPool != NULL ) )
+    {
+        LogError( ( "The buffer pool cannot be changed while a packet is received "
+                    "or after it has been set." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pBufferPool = pPool;
+        pContext->stagingBuffer = pContext->networkBuffer;
+    }
 
-        connectStatus = pContext->connectStatus;
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ReturnPoolBuffer( MQTTBufferPool_t * pPool,
+                                    uint8_t * pBuffer )
+{
+    MQTTStatus_t status = MQTTBadParameter;
+    size_t offset;
+
+    if( ( pPool == NULL ) || ( pBuffer == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pPool=%p, pBuffer=%p",
+                    ( void * ) pPool,
+                    ( void * ) pBuffer ) );
+    }
+    else if( ( pBuffer < pPool->pBuffers ) ||
+             ( ( size_t ) ( pBuffer - pPool->pBuffers ) >= ( pPool->bufferSize * pPool->bufferCount ) ) ||
+             ( ( ( size_t ) ( pBuffer - pPool->pBuffers ) % pPool->bufferSize ) != 0U ) )
+    {
+        LogError( ( "The buffer does not belong to the pool." ) );
+    }
+    else
+    {
+        offset = ( size_t ) ( pBuffer - pPool->pBuffers );
+
+        MQTT_PRE_BUFFER_POOL_HOOK( pPool );
+
+        if( pPool->freeBufferCount < pPool->bufferCount )
+        {
+            pPool->pFreeBuffers[ pPool->freeBufferCount ] = offset / pPool->bufferSize;
+            pPool->freeBufferCount++;
+            status = MQTTSuccess;
+        }
+
+        MQTT_POST_BUFFER_POOL_HOOK( pPool );
+
+        if( status != MQTTSuccess )
+        {
+            LogError( ( "Every buffer of the pool is already free." ) );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitStatefulQoSPool( MQTTContext_t * pContext,
+                                       MQTTRecordPool_t * pPool,
+                                       size_t outgoingQuota,
+                                       size_t incomingQuota )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pPool == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pPool=%p",
+                    ( void * ) pContext,
+                    ( void * ) pPool ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( outgoingQuota > pPool->recordsPerBlock ) ||
+             ( incomingQuota > pPool->recordsPerBlock ) )
+    {
+        LogError( ( "Quotas cannot be larger than a block: outgoingQuota=%lu, "
+                    "incomingQuota=%lu, recordsPerBlock=%lu",
+                    ( unsigned long ) outgoingQuota,
+                    ( unsigned long ) incomingQuota,
+                    ( unsigned long ) pPool->recordsPerBlock ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pContext->outgoingPublishRecords != NULL ) ||
+             ( pContext->incomingPublishRecords != NULL ) )
+    {
+        LogError( ( "The context already has publish record arrays." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->appCallback == NULL )
+    {
+        LogError( ( "MQTT_InitStatefulQoSPool must be called only after MQTT_Init has"
+                    " been called successfully.\n" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->pRecordPool = pPool;
+        pContext->outgoingPublishRecordQuota = outgoingQuota;
+        pContext->incomingPublishRecordQuota = incomingQuota;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_ENABLE_RETRANSMIT != 0 )
+
+MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
+                                   MQTTStorePacketForRetransmit storeFunction,
+                                   MQTTRetrievePacketForRetransmit retrieveFunction,
+                                   MQTTClearPacketForRetransmit clearFunction )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( storeFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: storeFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( retrieveFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: retrieveFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( clearFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: clearFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->storeFunction = storeFunction;
+        pContext->retrieveFunction = retrieveFunction;
+        pContext->clearFunction = clearFunction;
+    }
+
+    return status;
+}
+
+#endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitPublishQueue( MQTTContext_t * pContext,
+                                    MQTTPublishRequest_t * pPublishQueue,
+                                    size_t publishQueueLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pPublishQueue == NULL ) || ( publishQueueLength == 0U ) )
+    {
+        LogError( ( "Arguments do not match: pPublishQueue=%p, "
+                    "publishQueueLength=%lu",
+                    ( void * ) pPublishQueue,
+                    ( unsigned long ) publishQueueLength ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
+        pContext->pPublishQueue = pPublishQueue;
+        pContext->publishQueueLength = publishQueueLength;
+        pContext->publishQueueHead = 0U;
+        pContext->publishQueueCount = 0U;
+        pContext->publishQueueSending = false;
+        MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_SetPublishQueuePolicy( MQTTContext_t * pContext,
+                                         MQTTPublishQueuePolicy_t policy )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( policy != MQTTPublishQueueDropNewest ) &&
+             ( policy != MQTTPublishQueueDropOldest ) &&
+             ( policy != MQTTPublishQueueDropLowestQoS ) )
+    {
+        LogError( ( "Invalid publish queue policy: %d.", ( int ) policy ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
+        pContext->publishQueuePolicy = policy;
+        MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRateLimit( MQTTContext_t * pContext,
+                                 uint32_t bytesPerSecond,
+                                 uint32_t burstBytes )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( bytesPerSecond == 0U )
+    {
+        /* Zero removes the limit; the burst size is not used. */
+    }
+    else if( ( bytesPerSecond > MQTT_RATE_LIMIT_MAX_BYTES_PER_SECOND ) ||
+             ( burstBytes == 0U ) ||
+             ( burstBytes > MQTT_MAX_PACKET_SIZE ) ||
+             ( ( burstBytes / bytesPerSecond ) >= ( UINT32_MAX / 1000U ) ) )
+    {
+        LogError( ( "Invalid rate limit: bytesPerSecond=%lu, burstBytes=%lu",
+                    ( unsigned long ) bytesPerSecond,
+                    ( unsigned long ) burstBytes ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* MISRA Empty body */
+    }
+
+    if( ( status == MQTTSuccess ) && ( pContext->getTime == NULL ) )
+    {
+        LogError( ( "Invalid input parameter: MQTT Context must have valid getTime." ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->rateLimitBytesPerSecond = bytesPerSecond;
+        pContext->rateLimitBurstBytes = ( bytesPerSecond == 0U ) ? 0U : burstBytes;
+        pContext->rateLimitTokens = pContext->rateLimitBurstBytes;
+        pContext->rateLimitRefillTime = pContext->getTime();
+        pContext->rateLimitDelayMs = 0U;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitSubscribeBuffer( MQTTContext_t * pContext,
+                                       const MQTTFixedBuffer_t * pSubscribeBuffer )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pSubscribeBuffer == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pSubscribeBuffer=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pSubscribeBuffer ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pSubscribeBuffer->pBuffer == NULL ) || ( pSubscribeBuffer->size == 0U ) )
+    {
+        LogError( ( "Subscribe buffer cannot be empty: pBuffer=%p, size=%lu.",
+                    ( void * ) pSubscribeBuffer->pBuffer,
+                    ( unsigned long ) pSubscribeBuffer->size ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_SEND_HOOK( pContext );
+        pContext->subscribeBuffer = *pSubscribeBuffer;
+        MQTT_POST_SEND_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitSubscriptionRegistry( MQTTContext_t * pContext,
+                                            MQTTSubscriptionRecord_t * pSubscriptionRecords,
+                                            size_t subscriptionRecordMaxCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pSubscriptionRecords == NULL ) || ( subscriptionRecordMaxCount == 0U ) )
+    {
+        LogError( ( "Arguments do not match: pSubscriptionRecords=%p, "
+                    "subscriptionRecordMaxCount=%lu",
+                    ( void * ) pSubscriptionRecords,
+                    ( unsigned long ) subscriptionRecordMaxCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->pSubscriptionRecords = pSubscriptionRecords;
+        pContext->subscriptionRecordMaxCount = subscriptionRecordMaxCount;
+        pContext->subscriptionRecordCount = 0U;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
+                                  uint16_t packetId )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogWarn( ( "pContext is NULL\n" ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->outgoingPublishRecords == NULL )
+    {
+        LogError( ( "QoS1/QoS2 is not initialized for use. Please "
+                    "call MQTT_InitStatefulQoS to enable QoS1 and QoS2 "
+                    "publishes.\n" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        status = MQTT_RemoveStateRecord( pContext,
+                                         packetId );
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext )
+{
+    MQTTConnectionStatus_t connectStatus;
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p",
+                    ( const void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        switch( connectStatus )
+        {
+            case MQTTConnected:
+                status = MQTTStatusConnected;
+                break;
+
+            case MQTTDisconnectPending:
+                status = MQTTStatusDisconnectPending;
+                break;
+
+            default:
+                status = MQTTStatusNotConnected;
+                break;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendConnect( MQTTContext_t * pContext,
+                                 const MQTTConnectInfo_t * pConnectInfo,
+                                 const MQTTPublishInfo_t * pWillInfo,
+                                 MQTTPropBuilder_t * pPropertyBuilder,
+                                 const MQTTPropBuilder_t * pWillPropertyBuilder )
+{
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTConnectionStatus_t connectStatus;
+    uint8_t backupPropBuffer[ 5 ];
+    MQTTPropBuilder_t backupPropBuilder = { 0 };
+    MQTTPropBuilder_t * pBackupPropBuilder = pPropertyBuilder;
+
+    assert( pContext != NULL );
+    assert( pConnectInfo != NULL );
+
+    if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) && ( pWillPropertyBuilder != NULL ) )
+    {
+        status = MQTT_ValidateWillProperties( pWillPropertyBuilder );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        if( pBackupPropBuilder != NULL )
+        {
+            bool isRequestProblemInfoSet = false;
+            uint32_t packetMaxSize = UINT32_MAX;
+            status = MQTT_ValidateConnectProperties( pBackupPropBuilder,
+                                                     &isRequestProblemInfoSet,
+                                                     &packetMaxSize );
+
+            /* Update the field in the context so that it can be gated on. Note that we
+             * did not intentionally check the result of the above API call as it will be
+             * checked later. Even if the call fails, we will set the variable in the
+             * context incorrectly which is fine. */
+            pContext->connectionProperties.requestProblemInfo = isRequestProblemInfoSet;
+
+            if( packetMaxSize > getReceiveBufferSize( pContext ) )
+            {
+                LogError( ( "Properties have packet maximum set to %" PRIu32
+                            " whereas the buffer length is %" PRIu32
+                            ". Please make sure that buffer is at least as big as %" PRIu32
+                            " otherwise the server can send a bigger packet which cannot be processed by the coreMQTT library.",
+                            packetMaxSize,
+                            ( uint32_t ) getReceiveBufferSize( pContext ),
+                            packetMaxSize ) );
+                status = MQTTBadParameter;
+            }
+        }
+        else
+        {
+            uint32_t maxPacketSize;
+            backupPropBuilder.pBuffer = backupPropBuffer;
+            backupPropBuilder.bufferLength = sizeof( backupPropBuffer );
+
+            pBackupPropBuilder = &backupPropBuilder;
+
+            if( CHECK_SIZE_T_OVERFLOWS_32BIT( getReceiveBufferSize( pContext ) ) )
+            {
+                maxPacketSize = 0xFFFFFFFFU;
+            }
+            else
+            {
+                maxPacketSize = ( uint32_t ) getReceiveBufferSize( pContext );
+            }
+
+            LogInfo( ( "Application has not set any properties. Adding a property to set the maximum "
+                       "packet size received from the server for the client to be %" PRIu32 ".",
+                       maxPacketSize ) );
+            status = MQTTPropAdd_MaxPacketSize( pBackupPropBuilder,
+                                                maxPacketSize,
+                                                NULL );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Get MQTT connect packet size and remaining length. */
+        status = MQTT_GetConnectPacketSize( pConnectInfo,
+                                            pWillInfo,
+                                            pBackupPropBuilder,
+                                            pWillPropertyBuilder,
+                                            &remainingLength,
+                                            &packetSize );
+        /* coverity[sensitive_data_leak] */
+        LogDebug( ( "CONNECT packet size is %lu and remaining length is %lu.",
+                    ( unsigned long ) packetSize,
+                    ( unsigned long ) remainingLength ) );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        /* A new CONNECT replaces one still waiting for its CONNACK. */
+        pContext->connectPending = false;
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        if( connectStatus != MQTTNotConnected )
+        {
+            status = ( connectStatus == MQTTConnected ) ? MQTTStatusConnected : MQTTStatusDisconnectPending;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        status = sendConnectWithoutCopy( pContext,
+                                         pConnectInfo,
+                                         pWillInfo,
+                                         remainingLength,
+                                         pBackupPropBuilder,
+                                         pWillPropertyBuilder );
+
+        releaseSendHook( pContext );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Until the CONNACK arrives, AUTH packets may be exchanged. */
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->connectPending = true;
+        pContext->connectCleanSession = pConnectInfo->cleanSession;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t completeConnect( MQTTContext_t * pContext,
+                                     bool sessionPresent )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTStatus_t flushStatus;
+
+    assert( pContext != NULL );
+
+    MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+    /**
+     * Update the maximum number of concurrent incoming and outgoing PUBLISH records
+     * based on MQTT 5.0 Receive Maximum property :
+     *
+     * - For incoming publishes: Use the minimum between the client's configured receive maximum
+     *   (In the MQTT_Init function) and the receive maximum value sent in CONNECT properties
+     *
+     * - For outgoing publishes: Use the minimum between the client's configured maximum
+     *   (In the MQTT_Init function) and the server's receive maximum value received in CONNACK properties
+     **/
+    if( pContext->connectionProperties.receiveMax < pContext->incomingPublishRecordMaxCount )
+    {
+        pContext->incomingPublishRecordMaxCount = pContext->connectionProperties.receiveMax;
+    }
+
+    if( pContext->connectionProperties.serverReceiveMax < pContext->outgoingPublishRecordMaxCount )
+    {
+        pContext->outgoingPublishRecordMaxCount = pContext->connectionProperties.serverReceiveMax;
+    }
+
+    /* Blocks borrowed from a record pool later on are limited the same way. */
+    if( pContext->connectionProperties.receiveMax < pContext->incomingPublishRecordQuota )
+    {
+        pContext->incomingPublishRecordQuota = pContext->connectionProperties.receiveMax;
+    }
+
+    if( pContext->connectionProperties.serverReceiveMax < pContext->outgoingPublishRecordQuota )
+    {
+        pContext->outgoingPublishRecordQuota = pContext->connectionProperties.serverReceiveMax;
+    }
+
+    if( sessionPresent != true )
+    {
+        status = handleCleanSession( pContext );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        pContext->connectStatus = MQTTConnected;
+
+        /**
+         * Initialize the client's keep-alive timer using the Server Keep Alive value
+         * received in the CONNACK.
+         * This value overrides the client's original keep-alive setting,
+         * as per MQTT v5 specification.
+         */
+        pContext->keepAliveIntervalSec = pContext->connectionProperties.serverKeepAlive;
+        pContext->waitingForPingResp = false;
+        pContext->pingReqSendTimeMs = 0U;
+    }
+
+    MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+    beginSendBatch( pContext );
+
+    if( ( status == MQTTSuccess ) && ( sessionPresent == true ) )
+    {
+        /* Resend PUBRELs and PUBLISHES when reestablishing a session */
+        status = handleUncleanSessionResumption( pContext );
+    }
+    else if( ( status == MQTTSuccess ) && ( pContext->pSubscriptionRecords != NULL ) )
+    {
+        /* The server has discarded the subscriptions along with the session. */
+        status = resubscribeRegisteredSubscriptions( pContext );
+    }
+    else
+    {
+        /* Nothing to restore. */
+    }
+
+    /* Publishes queued while the connection was down follow. Those that
+     * cannot be sent yet stay queued for MQTT_ProcessLoop, and a publish
+     * refused for its own parameters does not fail the connection. */
+    if( ( status == MQTTSuccess ) && ( pContext->pPublishQueue != NULL ) )
+    {
+        status = processPublishQueue( pContext );
+
+        if( status != MQTTSendFailed )
+        {
+            if( status != MQTTSuccess )
+            {
+                LogWarn( ( "Publish queue not drained after connecting: %s.",
+                           MQTT_Status_strerror( status ) ) );
+            }
+
+            status = MQTTSuccess;
+        }
+    }
+
+    flushStatus = endSendBatch( pContext );
+
+    if( status == MQTTSuccess )
+    {
+        status = flushStatus;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
+                           const MQTTConnectInfo_t * pConnectInfo,
+                           const MQTTPublishInfo_t * pWillInfo,
+                           uint32_t timeoutMs,
+                           bool * pSessionPresent,
+                           MQTTPropBuilder_t * pPropertyBuilder,
+                           const MQTTPropBuilder_t * pWillPropertyBuilder )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    if( ( pContext == NULL ) || ( pConnectInfo == NULL ) || ( pSessionPresent == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pConnectInfo=%p, pSessionPresent=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pConnectInfo,
+                    ( void * ) pSessionPresent ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = sendConnect( pContext,
+                              pConnectInfo,
+                              pWillInfo,
+                              pPropertyBuilder,
+                              pWillPropertyBuilder );
+    }
+
+    /* Read CONNACK from transport layer. */
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_RECEIVE_HOOK( pContext );
+
+        /* Drop what is left of the previous connection. */
+        resetNetworkBuffer( pContext );
+
+        status = receiveConnack( pContext,
+                                 timeoutMs,
+                                 pConnectInfo->cleanSession,
+                                 &incomingPacket,
+                                 pSessionPresent );
+
+        releaseNetworkBuffer( pContext );
+
+        MQTT_POST_RECEIVE_HOOK( pContext );
+
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->connectPending = false;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = completeConnect( pContext, *pSessionPresent );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        LogInfo( ( "MQTT connection established with the broker." ) );
+    }
+    else if( ( status == MQTTStatusConnected ) || ( status == MQTTStatusDisconnectPending ) )
+    {
+        LogInfo( ( "MQTT Connection is either already established or a disconnect is pending, return status = %s.",
+                   MQTT_Status_strerror( status ) ) );
+    }
+    else if( pContext == NULL )
+    {
+        LogError( ( "MQTT connection failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+    else
+    {
+        LogError( ( "MQTT connection failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        if( pContext->connectStatus == MQTTConnected )
+        {
+            /* This will only be executed if after the connack is received
+             * the retransmits fail for some reason on an unclean session
+             * connection. In this case we need to retry the re-transmits
+             * which can only be done using the connect API and that can only
+             * be done once we are disconnected, hence we ask the user to
+             * call disconnect here */
+            pContext->connectStatus = MQTTDisconnectPending;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ConnectStart( MQTTContext_t * pContext,
+                                const MQTTConnectInfo_t * pConnectInfo,
+                                const MQTTPublishInfo_t * pWillInfo,
+                                MQTTPropBuilder_t * pPropertyBuilder,
+                                const MQTTPropBuilder_t * pWillPropertyBuilder )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pConnectInfo == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pConnectInfo=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pConnectInfo ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = sendConnect( pContext,
+                              pConnectInfo,
+                              pWillInfo,
+                              pPropertyBuilder,
+                              pWillPropertyBuilder );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Drop what is left of the previous connection. */
+        MQTT_PRE_RECEIVE_HOOK( pContext );
+        resetNetworkBuffer( pContext );
+        MQTT_POST_RECEIVE_HOOK( pContext );
+
+        LogDebug( ( "CONNECT sent, waiting for the CONNACK." ) );
+    }
+    else
+    {
+        LogError( ( "Failed to start MQTT connection with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ConnectPoll( MQTTContext_t * pContext,
+                               bool * pSessionPresent )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    bool connectPending = false;
+    bool cleanSession = false;
+
+    if( ( pContext == NULL ) || ( pSessionPresent == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pSessionPresent=%p.",
+                    ( void * ) pContext,
+                    ( void * ) pSessionPresent ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        connectPending = pContext->connectPending;
+        cleanSession = pContext->connectCleanSession;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        if( connectPending == false )
+        {
+            LogError( ( "No CONNECT is waiting for a CONNACK. Call MQTT_ConnectStart first." ) );
+            status = MQTTStatusNotConnected;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_RECEIVE_HOOK( pContext );
+
+        /* A single read attempt, so that the call returns at once if the
+         * CONNACK has not arrived yet. */
+        status = MQTT_GetIncomingPacketTypeAndLength( pContext->transportInterface.recv,
+                                                      pContext->transportInterface.pNetworkContext,
+                                                      &incomingPacket );
+
+        if( ( status == MQTTSuccess ) && ( incomingPacket.type == MQTT_PACKET_TYPE_AUTH ) )
+        {
+            status = receiveConnectAuth( pContext, &incomingPacket );
+
+            if( status == MQTTSuccess )
+            {
+                /* The CONNACK is still to come. */
+                status = MQTTNoDataAvailable;
+            }
+        }
+        else if( status == MQTTSuccess )
+        {
+            status = processConnack( pContext,
+                                     cleanSession,
+                                     &incomingPacket,
+                                     pSessionPresent );
+        }
+        else
+        {
+            /* Nothing was received. */
+        }
+
+        releaseNetworkBuffer( pContext );
+
+        MQTT_POST_RECEIVE_HOOK( pContext );
+
+        /* Anything but an empty read ends the handshake. */
+        if( status != MQTTNoDataAvailable )
+        {
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            pContext->connectPending = false;
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = completeConnect( pContext, *pSessionPresent );
+
+        if( status == MQTTSuccess )
+        {
+            LogInfo( ( "MQTT connection established with the broker." ) );
+        }
+        else
+        {
+            LogError( ( "Restoring the session failed with status = %s.",
+                        MQTT_Status_strerror( status ) ) );
+
+            /* As in MQTT_Connect, a failed resend can only be retried with a new
+             * connection. */
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+            if( pContext->connectStatus == MQTTConnected )
+            {
+                pContext->connectStatus = MQTTDisconnectPending;
+            }
+
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
+                             const MQTTSubscribeInfo_t * pSubscriptionList,
+                             size_t subscriptionCount,
+                             uint16_t packetId,
+                             const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    MQTTConnectionStatus_t connectStatus;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+
+    status = validateSubscribeUnsubscribeParams( pContext,
+                                                 pSubscriptionList,
+                                                 subscriptionCount,
+                                                 packetId,
+                                                 MQTT_TYPE_SUBSCRIBE );
+
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    {
+        bool isSubscriptionIdAvailable;
+        assert( ( pContext->connectionProperties.isSubscriptionIdAvailable == 0U ) ||
+                ( pContext->connectionProperties.isSubscriptionIdAvailable == 1U ) );
+
+        isSubscriptionIdAvailable = ( pContext->connectionProperties.isSubscriptionIdAvailable != 0U );
+        status = MQTT_ValidateSubscribeProperties( isSubscriptionIdAvailable,
+                                                   pPropertyBuilder );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Get the remaining length and packet size. */
+        status = MQTT_GetSubscribePacketSize( pSubscriptionList,
+                                              subscriptionCount,
+                                              pPropertyBuilder,
+                                              &remainingLength,
+                                              &packetSize,
+                                              pContext->connectionProperties.serverMaxPacketSize );
+        LogDebug( ( "SUBSCRIBE packet size is %lu and remaining length is %lu.",
+                    ( unsigned long ) packetSize,
+                    ( unsigned long ) remainingLength ) );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+
+        /* Record the topic filters before sending, so that the SUBACK cannot
+         * be processed before they are registered. */
+        if( ( status == MQTTSuccess ) && ( pContext->pSubscriptionRecords != NULL ) )
+        {
+            status = recordSubscriptions( pContext,
+                                          pSubscriptionList,
+                                          subscriptionCount,
+                                          packetId );
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Send MQTT SUBSCRIBE packet. */
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        if( ( pContext->subscribeBuffer.pBuffer != NULL ) &&
+            ( packetSize <= pContext->subscribeBuffer.size ) )
+        {
+            status = sendSerializedSubscribeUnsubscribe( pContext,
+                                                         pSubscriptionList,
+                                                         subscriptionCount,
+                                                         packetId,
+                                                         remainingLength,
+                                                         packetSize,
+                                                         pPropertyBuilder,
+                                                         MQTT_TYPE_SUBSCRIBE );
+        }
+        else
+        {
+            status = sendSubscribeWithoutCopy( pContext,
+                                               pSubscriptionList,
+                                               subscriptionCount,
+                                               packetId,
+                                               remainingLength,
+                                               pPropertyBuilder );
+        }
+
+        releaseSendHook( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
+                           const MQTTPublishInfo_t * pPublishInfo,
+                           uint16_t packetId,
+                           const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    return publishPacket( pContext, pPublishInfo, packetId, pPropertyBuilder, NULL, 0U, NULL, 0U, false );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PublishFragments( MQTTContext_t * pContext,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    uint16_t packetId,
+                                    const MQTTPropBuilder_t * pPropertyBuilder,
+                                    const TransportOutVector_t * pPayloadFragments,
+                                    size_t fragmentCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
+    size_t payloadLength = 0U;
+    size_t i;
+
+    if( ( pPublishInfo == NULL ) || ( ( pPayloadFragments == NULL ) && ( fragmentCount > 0U ) ) )
+    {
+        LogError( ( "Argument cannot be NULL: pPublishInfo=%p, pPayloadFragments=%p.",
+                    ( const void * ) pPublishInfo,
+                    ( const void * ) pPayloadFragments ) );
+        status = MQTTBadParameter;
+    }
+    else if( fragmentCount > MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS )
+    {
+        LogError( ( "A payload can have at most %lu fragments: fragmentCount=%lu.",
+                    ( unsigned long ) MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS,
+                    ( unsigned long ) fragmentCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        publishInfo = *pPublishInfo;
+        publishInfo.pPayload = NULL;
+
+        for( i = 0U; ( i < fragmentCount ) && ( status == MQTTSuccess ); i++ )
+        {
+            if( pPayloadFragments[ i ].iov_len == 0U )
+            {
+                /* Empty fragments are skipped. */
+            }
+            else if( pPayloadFragments[ i ].iov_base == NULL )
+            {
+                LogError( ( "Payload fragment %lu has a length but no data.",
+                            ( unsigned long ) i ) );
+                status = MQTTBadParameter;
+            }
+            else if( ADDITION_WILL_OVERFLOW_SIZE_T( payloadLength, pPayloadFragments[ i ].iov_len ) )
+            {
+                LogError( ( "The payload fragments are too long to publish." ) );
+                status = MQTTBadParameter;
+            }
+            else
+            {
+                /* The payload starts with the first non-empty fragment. The
+                 * total is checked against the packet limits like any other
+                 * payload length. */
+                if( publishInfo.pPayload == NULL )
+                {
+                    publishInfo.pPayload = pPayloadFragments[ i ].iov_base;
+                }
+
+                payloadLength += pPayloadFragments[ i ].iov_len;
+            }
+        }
+
+        publishInfo.payloadLength = payloadLength;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = publishPacket( pContext,
+                                &publishInfo,
+                                packetId,
+                                pPropertyBuilder,
+                                pPayloadFragments,
+                                fragmentCount,
+                                NULL,
+                                0U,
+                                false );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PublishFromSource( MQTTContext_t * pContext,
+                                     const MQTTPublishInfo_t * pPublishInfo,
+                                     uint16_t packetId,
+                                     const MQTTPropBuilder_t * pPropertyBuilder,
+                                     const void * pPayloadSource,
+                                     size_t payloadOffset )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
+
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) || ( pPayloadSource == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pPublishInfo=%p, pPayloadSource=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pPublishInfo,
+                    pPayloadSource ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->transportInterface.sendPayload == NULL )
+    {
+        LogError( ( "The transport interface has no sendPayload function." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* MISRA else. */
+    }
+
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+        if( ( status == MQTTSuccess ) &&
+            ( pPublishInfo->qos > MQTTQoS0 ) &&
+            ( pContext->storeFunction != NULL ) )
+        {
+            LogError( ( "A payload sent by the transport cannot be stored for retransmission." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
+
+    if( status == MQTTSuccess )
+    {
+        /* The payload is never read by the library. The source stands in for
+         * it so that a payload length without data is not refused. */
+        publishInfo = *pPublishInfo;
+        publishInfo.pPayload = pPayloadSource;
+
+        status = publishPacket( pContext,
+                                &publishInfo,
+                                packetId,
+                                pPropertyBuilder,
+                                NULL,
+                                0U,
+                                pPayloadSource,
+                                payloadOffset,
+                                false );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t publishPacket( MQTTContext_t * pContext,
+                                   const MQTTPublishInfo_t * pPublishInfo,
+                                   uint16_t packetId,
+                                   const MQTTPropBuilder_t * pPropertyBuilder,
+                                   const TransportOutVector_t * pPayloadFragments,
+                                   size_t fragmentCount,
+                                   const void * pPayloadSource,
+                                   size_t payloadOffset,
+                                   bool batched )
+{
+    size_t headerSize = 0U;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    uint16_t topicAlias = 0U;
+
+    /* Maximum number of bytes required by the 'fixed' part of the PUBLISH
+     * packet header according to the MQTT specifications.
+     * Header byte           0 + 1 = 1
+     * Length (max)            + 4 = 5
+     * Topic string length     + 2 = 7
+     *
+     * Note that since publish is one of the most common operations in MQTT
+     * connection, we have moved the topic string length to the 'fixed' part of
+     * the header so efficiency. Otherwise, we would need an extra vector and
+     * an extra call to 'send' (in case writev is not defined) to send the
+     * topic length.    */
+    uint8_t mqttHeader[ 7U ];
+    MQTTStatus_t status = MQTTSuccess;
+
+    /* Validate arguments. */
+    status = validatePublishParams( pContext, pPublishInfo, packetId );
+
+    /* Validate Publish Properties and extract Topic Alias from the properties. */
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    {
+        status = MQTT_ValidatePublishProperties( pContext->connectionProperties.serverTopicAliasMax,
+                                                 pPropertyBuilder, &topicAlias );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Validate Publish Properties with the persistent Connection Properties. */
+        status = MQTT_ValidatePublishParams( pPublishInfo,
+                                             pContext->connectionProperties.retainAvailable,
+                                             pContext->connectionProperties.serverMaxQos,
+                                             topicAlias,
+                                             pContext->connectionProperties.serverMaxPacketSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Get the remaining length and packet size. */
+        status = MQTT_GetPublishPacketSize( pPublishInfo,
+                                            pPropertyBuilder,
+                                            &remainingLength,
+                                            &packetSize,
+                                            pContext->connectionProperties.serverMaxPacketSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_SerializePublishHeaderWithoutTopic( pPublishInfo,
+                                                          remainingLength,
+                                                          mqttHeader,
+                                                          &headerSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = sendValidatedPublish( pContext,
+                                       pPublishInfo,
+                                       packetId,
+                                       pPropertyBuilder,
+                                       mqttHeader,
+                                       headerSize,
+                                       packetSize,
+                                       pPayloadFragments,
+                                       fragmentCount,
+                                       pPayloadSource,
+                                       payloadOffset,
+                                       batched );
+    }
+
+    if( status != MQTTSuccess )
+    {
+        LogError( ( "MQTT PUBLISH failed with status %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendValidatedPublish( MQTTContext_t * pContext,
+                                          const MQTTPublishInfo_t * pPublishInfo,
+                                          uint16_t packetId,
+                                          const MQTTPropBuilder_t * pPropertyBuilder,
+                                          uint8_t * pMqttHeader,
+                                          size_t headerSize,
+                                          uint32_t packetSize,
+                                          const TransportOutVector_t * pPayloadFragments,
+                                          size_t fragmentCount,
+                                          const void * pPayloadSource,
+                                          size_t payloadOffset,
+                                          bool batched )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishState_t publishStatus = MQTTStateNull;
+    MQTTConnectionStatus_t connectStatus;
+
+    #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        uint32_t messageExpiry = 0U;
+    #endif
+
+    assert( pContext != NULL );
+    assert( pPublishInfo != NULL );
+    assert( headerSize <= 7U );
+
+    #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        /* The expiry only matters to a PUBLISH stored for resending. */
+        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) &&
+            ( pContext->storeFunction != NULL ) )
+        {
+            messageExpiry = getMessageExpiry( pPropertyBuilder );
+        }
+    #endif
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+
+        /* Refuse the PUBLISH before a state record is reserved for it. */
+        if( status == MQTTSuccess )
+        {
+            status = admitPublish( pContext, packetSize );
+        }
+
+        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        {
+            status = borrowRecords( pContext, true );
+        }
+
+        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        {
+            /* Set the flag so that the corresponding hook can be called later. */
+
+            status = MQTT_ReserveState( pContext,
+                                        packetId,
+                                        pPublishInfo->qos );
+
+            /* State already exists for a duplicate packet.
+             * If a state doesn't exist, it will be handled as a new publish in
+             * state engine. */
+            if( ( status == MQTTStateCollision ) && ( pPublishInfo->dup == true ) )
+            {
+                status = MQTTSuccess;
+            }
+
+            /* Move the record to the ack pending state before the PUBLISH is
+             * sent, so that the state update hook need not be held across the
+             * send while the receive loop may already be processing the ack
+             * for this packet. Should the send fail, the record is still
+             * picked up for retransmission when the session is resumed. */
+            if( status == MQTTSuccess )
+            {
+                status = MQTT_UpdateStatePublish( pContext,
+                                                  packetId,
+                                                  MQTT_SEND,
+                                                  pPublishInfo->qos,
+                                                  &publishStatus );
+
+                if( status != MQTTSuccess )
+                {
+                    LogError( ( "Update state for publish failed with status %s.",
+                                MQTT_Status_strerror( status ) ) );
+                }
+            }
+
+            #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+                if( ( status == MQTTSuccess ) && ( messageExpiry > 0U ) )
+                {
+                    status = MQTT_SetPublishExpiry( pContext,
+                                                    packetId,
+                                                    messageExpiry,
+                                                    pContext->getTime() );
+                }
+            #endif
+        }
 
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Take the mutex as multiple send calls are required for sending this
+         * packet. */
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        pContext->sendBatched = batched;
+
+        status = sendPublishWithoutCopy( pContext,
+                                         pPublishInfo,
+                                         pMqttHeader,
+                                         headerSize,
+                                         packetId,
+                                         pPropertyBuilder,
+                                         pPayloadFragments,
+                                         fragmentCount,
+                                         pPayloadSource,
+                                         payloadOffset );
+
+        releaseSendHook( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PreparePublish( MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  const MQTTPropBuilder_t * pPropertyBuilder,
+                                  MQTTPreparedPublish_t * pPreparedPublish )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
+    uint32_t packetSize = 0U;
+    uint16_t topicAlias = 0U;
+    size_t headerSize = 0U;
+    uint8_t mqttHeader[ 7U ];
+
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) || ( pPreparedPublish == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pPublishInfo=%p, "
+                    "pPreparedPublish=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pPublishInfo,
+                    ( void * ) pPreparedPublish ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* The packet is prepared without a payload. Any packet ID passes the
+         * checks, as it is given with each message. */
+        publishInfo = *pPublishInfo;
+        publishInfo.pPayload = NULL;
+        publishInfo.payloadLength = 0U;
+        publishInfo.dup = false;
+
+        status = validatePublishParams( pContext, &publishInfo, 1U );
+    }
+
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    {
+        status = MQTT_ValidatePublishProperties( pContext->connectionProperties.serverTopicAliasMax,
+                                                 pPropertyBuilder, &topicAlias );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_ValidatePublishParams( &publishInfo,
+                                             pContext->connectionProperties.retainAvailable,
+                                             pContext->connectionProperties.serverMaxQos,
+                                             topicAlias,
+                                             pContext->connectionProperties.serverMaxPacketSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_GetPublishPacketSize( &publishInfo,
+                                            pPropertyBuilder,
+                                            &pPreparedPublish->remainingLength,
+                                            &packetSize,
+                                            pContext->connectionProperties.serverMaxPacketSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Only the first byte is kept. The remaining length that follows it
+         * depends on the payload. */
+        status = MQTT_SerializePublishHeaderWithoutTopic( &publishInfo,
+                                                          pPreparedPublish->remainingLength,
+                                                          mqttHeader,
+                                                          &headerSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        pPreparedPublish->publishInfo = publishInfo;
+        pPreparedPublish->pPropertyBuilder = pPropertyBuilder;
+        pPreparedPublish->topicAlias = topicAlias;
+        pPreparedPublish->firstByte = mqttHeader[ 0 ];
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PublishPrepared( MQTTContext_t * pContext,
+                                   const MQTTPreparedPublish_t * pPreparedPublish,
+                                   const void * pPayload,
+                                   size_t payloadLength,
+                                   uint16_t packetId,
+                                   bool dup )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    size_t headerSize = 0U;
+    uint8_t * pIndex;
+    uint8_t mqttHeader[ 7U ];
+
+    if( pPreparedPublish == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pPreparedPublish=%p.",
+                    ( const void * ) pPreparedPublish ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        publishInfo = pPreparedPublish->publishInfo;
+        publishInfo.pPayload = pPayload;
+        publishInfo.payloadLength = payloadLength;
+        publishInfo.dup = dup;
+
+        status = validatePublishParams( pContext, &publishInfo, packetId );
+    }
+
+    /* The publish may have been prepared for an earlier connection, so the
+     * limits it was checked against are checked again. */
+    if( ( status == MQTTSuccess ) &&
+        ( pPreparedPublish->topicAlias > pContext->connectionProperties.serverTopicAliasMax ) )
+    {
+        LogError( ( "Topic alias %hu is larger than the server accepts.",
+                    ( unsigned short ) pPreparedPublish->topicAlias ) );
+        status = MQTTBadParameter;
+    }
 
-        switch( connectStatus )
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_ValidatePublishParams( &publishInfo,
+                                             pContext->connectionProperties.retainAvailable,
+                                             pContext->connectionProperties.serverMaxQos,
+                                             pPreparedPublish->topicAlias,
+                                             pContext->connectionProperties.serverMaxPacketSize );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* The payload length is below MQTT_REMAINING_LENGTH_INVALID, so the
+         * sum cannot overflow. */
+        remainingLength = pPreparedPublish->remainingLength + ( uint32_t ) payloadLength;
+
+        if( remainingLength > MQTT_MAX_REMAINING_LENGTH )
         {
-            case MQTTConnected:
-                status = MQTTStatusConnected;
-                break;
+            LogError( ( "Total MQTT packet size must be less than 268435461." ) );
+            status = MQTTBadParameter;
+        }
+    }
 
-            case MQTTDisconnectPending:
-                status = MQTTStatusDisconnectPending;
-                break;
+    if( status == MQTTSuccess )
+    {
+        /* Patch the DUP flag and the remaining length into the header that
+         * was serialized when the publish was prepared. */
+        mqttHeader[ 0 ] = pPreparedPublish->firstByte;
+        pIndex = encodeVariableLength( &mqttHeader[ 1 ], remainingLength );
+        *pIndex = UINT16_HIGH_BYTE( publishInfo.topicNameLength );
+        pIndex++;
+        *pIndex = UINT16_LOW_BYTE( publishInfo.topicNameLength );
+        pIndex++;
 
-            default:
-                status = MQTTStatusNotConnected;
-                break;
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+        /* coverity[misra_c_2012_rule_18_2_violation] */
+        headerSize = ( size_t ) ( pIndex - mqttHeader );
+
+        /* The topic length is not part of the packet size on top of the
+         * remaining length. */
+        packetSize = remainingLength + ( uint32_t ) headerSize - 2U;
+
+        if( packetSize > pContext->connectionProperties.serverMaxPacketSize )
+        {
+            LogError( ( "Packet size %lu is larger than the server accepts.",
+                        ( unsigned long ) packetSize ) );
+            status = MQTTBadParameter;
+        }
+        else if( dup == true )
+        {
+            status = MQTT_UpdateDuplicatePublishFlag( mqttHeader, true );
+        }
+        else
+        {
+            /* MISRA else. */
         }
     }
 
+    if( status == MQTTSuccess )
+    {
+        status = sendValidatedPublish( pContext,
+                                       &publishInfo,
+                                       packetId,
+                                       pPreparedPublish->pPropertyBuilder,
+                                       mqttHeader,
+                                       headerSize,
+                                       packetSize,
+                                       NULL,
+                                       0U,
+                                       NULL,
+                                       0U,
+                                       false );
+    }
+
+    if( status != MQTTSuccess )
+    {
+        LogError( ( "MQTT PUBLISH failed with status %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
     return status;
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
-                           const MQTTConnectInfo_t * pConnectInfo,
-                           const MQTTPublishInfo_t * pWillInfo,
-                           uint32_t timeoutMs,
-                           bool * pSessionPresent,
-                           MQTTPropBuilder_t * pPropertyBuilder,
-                           const MQTTPropBuilder_t * pWillPropertyBuilder )
+MQTTStatus_t MQTT_EnqueuePublish( MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  uint16_t packetId,
+                                  const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    return MQTT_EnqueuePublishWithPriority( pContext,
+                                            pPublishInfo,
+                                            packetId,
+                                            pPropertyBuilder,
+                                            MQTTPublishPriorityNormal );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_EnqueuePublishWithPriority( MQTTContext_t * pContext,
+                                              const MQTTPublishInfo_t * pPublishInfo,
+                                              uint16_t packetId,
+                                              const MQTTPropBuilder_t * pPropertyBuilder,
+                                              MQTTPublishPriority_t priority )
 {
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
     MQTTStatus_t status = MQTTSuccess;
-    MQTTPacketInfo_t incomingPacket = { 0 };
-    MQTTConnectionStatus_t connectStatus;
-    uint8_t backupPropBuffer[ 5 ];
-    MQTTPropBuilder_t backupPropBuilder = { 0 };
-    MQTTPropBuilder_t * pBackupPropBuilder = pPropertyBuilder;
+    size_t tail = 0U;
+    uint16_t checkedPacketId = packetId;
 
-    if( ( pContext == NULL ) || ( pConnectInfo == NULL ) || ( pSessionPresent == NULL ) )
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) )
     {
         LogError( ( "Argument cannot be NULL: pContext=%p, "
-                    "pConnectInfo=%p, pSessionPresent=%p.",
+                    "pPublishInfo=%p.",
                     ( void * ) pContext,
-                    ( const void * ) pConnectInfo,
-                    ( void * ) pSessionPresent ) );
+                    ( const void * ) pPublishInfo ) );
         status = MQTTBadParameter;
     }
-
-    if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) && ( pWillPropertyBuilder != NULL ) )
+    else if( pContext->pPublishQueue == NULL )
     {
-        status = MQTT_ValidateWillProperties( pWillPropertyBuilder );
+        LogError( ( "Publish queue has not been initialized. "
+                    "Call MQTT_InitPublishQueue first." ) );
+        status = MQTTBadParameter;
+    }
+    else if( priority > MQTTPublishPriorityHigh )
+    {
+        LogError( ( "Invalid publish priority: %d.", ( int ) priority ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* A publish that could never be sent is refused here, where the
+         * producer gets the error. The owner thread assigns a packet ID of 0
+         * when the publish is sent, so any other one passes the checks. The
+         * state records are only read by the owner thread, which drops a
+         * publish it cannot send. */
+        if( checkedPacketId == 0U )
+        {
+            checkedPacketId = 1U;
+        }
+
+        status = validatePublishInfo( pPublishInfo, checkedPacketId );
     }
 
     if( status == MQTTSuccess )
     {
-        if( pBackupPropBuilder != NULL )
+        MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
+
+        /* The element of a publish being sent stays reserved, so that it can
+         * be put back should the send have to be retried. */
+        if( ( ( pContext->publishQueueCount + ( pContext->publishQueueSending ? 1U : 0U ) ) ==
+              pContext->publishQueueLength ) &&
+            ( evictQueuedPublish( pContext, pPublishInfo->qos ) != true ) )
         {
-            bool isRequestProblemInfoSet = false;
-            uint32_t packetMaxSize = UINT32_MAX;
-            status = MQTT_ValidateConnectProperties( pBackupPropBuilder,
-                                                     &isRequestProblemInfoSet,
-                                                     &packetMaxSize );
+            status = MQTTNoMemory;
+        }
+        else
+        {
+            tail = ( pContext->publishQueueHead + pContext->publishQueueCount ) %
+                   pContext->publishQueueLength;
 
-            /* Update the field in the context so that it can be gated on. Note that we
-             * did not intentionally check the result of the above API call as it will be
-             * checked later. Even if the call fails, we will set the variable in the
-             * context incorrectly which is fine. */
-            pContext->connectionProperties.requestProblemInfo = isRequestProblemInfoSet;
+            pContext->pPublishQueue[ tail ].publishInfo = *pPublishInfo;
+            pContext->pPublishQueue[ tail ].pPropertyBuilder = pPropertyBuilder;
+            pContext->pPublishQueue[ tail ].packetId = packetId;
+            pContext->pPublishQueue[ tail ].priority = priority;
+            pContext->publishQueueCount++;
+        }
 
-            if( packetMaxSize > pContext->networkBuffer.size )
-            {
-                LogError( ( "Properties have packet maximum set to %" PRIu32
-                            " whereas the buffer length is %" PRIu32
-                            ". Please make sure that buffer is at least as big as %" PRIu32
-                            " otherwise the server can send a bigger packet which cannot be processed by the coreMQTT library.",
-                            packetMaxSize,
-                            ( uint32_t ) pContext->networkBuffer.size,
-                            packetMaxSize ) );
-                status = MQTTBadParameter;
-            }
+        MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
+
+        if( status == MQTTNoMemory )
+        {
+            LogWarn( ( "Publish queue is full: publishQueueLength=%lu.",
+                       ( unsigned long ) pContext->publishQueueLength ) );
         }
-        else
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t selectQueuedPublish( const MQTTContext_t * pContext,
+                                   size_t pendingCount,
+                                   MQTTPublishPriority_t minPriority )
+{
+    size_t offset = 0U;
+    size_t selected = pendingCount;
+    MQTTPublishPriority_t priority;
+
+    assert( pContext != NULL );
+
+    for( offset = 0U; offset < pendingCount; offset++ )
+    {
+        priority = pContext->pPublishQueue[ ( pContext->publishQueueHead + offset ) %
+                                           pContext->publishQueueLength ].priority;
+
+        /* The first publish of a class is the oldest of that class. */
+        if( ( priority >= minPriority ) &&
+            ( ( selected == pendingCount ) ||
+              ( priority > pContext->pPublishQueue[ ( pContext->publishQueueHead + selected ) %
+                                                    pContext->publishQueueLength ].priority ) ) )
         {
-            uint32_t maxPacketSize;
-            backupPropBuilder.pBuffer = backupPropBuffer;
-            backupPropBuilder.bufferLength = sizeof( backupPropBuffer );
+            selected = offset;
+        }
+    }
 
-            pBackupPropBuilder = &backupPropBuilder;
+    return selected;
+}
+
+/*-----------------------------------------------------------*/
+
+static void removeQueuedPublish( MQTTContext_t * pContext,
+                                 size_t offset )
+{
+    size_t i = offset;
+
+    assert( pContext != NULL );
+
+    /* Move the publishes queued before the removed one up by one element, so
+     * that the queue order of the others is kept. */
+    while( i > 0U )
+    {
+        pContext->pPublishQueue[ ( pContext->publishQueueHead + i ) % pContext->publishQueueLength ] =
+            pContext->pPublishQueue[ ( pContext->publishQueueHead + i - 1U ) % pContext->publishQueueLength ];
+        i--;
+    }
+
+    pContext->publishQueueHead = ( pContext->publishQueueHead + 1U ) %
+                                 pContext->publishQueueLength;
+    pContext->publishQueueCount--;
+}
+
+/*-----------------------------------------------------------*/
+
+static void restoreQueuedPublish( MQTTContext_t * pContext,
+                                  size_t offset,
+                                  const MQTTPublishRequest_t * pRequest )
+{
+    size_t i = 0U;
+    size_t position = offset;
+
+    assert( pContext != NULL );
+    assert( pRequest != NULL );
+    assert( pContext->publishQueueCount < pContext->publishQueueLength );
+
+    /* Publishes queued before this one may have been dropped meanwhile. */
+    if( position > pContext->publishQueueCount )
+    {
+        position = pContext->publishQueueCount;
+    }
+
+    pContext->publishQueueHead = ( pContext->publishQueueHead + pContext->publishQueueLength - 1U ) %
+                                 pContext->publishQueueLength;
 
-            if( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->networkBuffer.size ) )
+    /* Move the publishes queued before it back by one element. */
+    for( i = 0U; i < position; i++ )
+    {
+        pContext->pPublishQueue[ ( pContext->publishQueueHead + i ) % pContext->publishQueueLength ] =
+            pContext->pPublishQueue[ ( pContext->publishQueueHead + i + 1U ) % pContext->publishQueueLength ];
+    }
+
+    pContext->pPublishQueue[ ( pContext->publishQueueHead + position ) % pContext->publishQueueLength ] = *pRequest;
+    pContext->publishQueueCount++;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool evictQueuedPublish( MQTTContext_t * pContext,
+                                MQTTQoS_t qos )
+{
+    size_t offset = 0U;
+    size_t selected = 0U;
+    MQTTQoS_t lowestQoS = qos;
+    bool evicted = false;
+
+    assert( pContext != NULL );
+
+    if( pContext->publishQueueCount == 0U )
+    {
+        /* Only the publish being sent is left, and it cannot be dropped. */
+    }
+    else if( pContext->publishQueuePolicy == MQTTPublishQueueDropOldest )
+    {
+        LogWarn( ( "Publish queue is full, dropping the oldest publish." ) );
+        removeQueuedPublish( pContext, 0U );
+        evicted = true;
+    }
+    else if( pContext->publishQueuePolicy == MQTTPublishQueueDropLowestQoS )
+    {
+        /* The first publish of the lowest QoS is the oldest of that QoS. A
+         * queued publish is only dropped for one of at least its QoS. */
+        selected = pContext->publishQueueCount;
+
+        for( offset = 0U; offset < pContext->publishQueueCount; offset++ )
+        {
+            if( pContext->pPublishQueue[ ( pContext->publishQueueHead + offset ) %
+                                         pContext->publishQueueLength ].publishInfo.qos < lowestQoS )
             {
-                maxPacketSize = 0xFFFFFFFFU;
+                lowestQoS = pContext->pPublishQueue[ ( pContext->publishQueueHead + offset ) %
+                                                     pContext->publishQueueLength ].publishInfo.qos;
+                selected = offset;
+            }
+            else if( ( selected == pContext->publishQueueCount ) &&
+                     ( pContext->pPublishQueue[ ( pContext->publishQueueHead + offset ) %
+                                                pContext->publishQueueLength ].publishInfo.qos == lowestQoS ) )
+            {
+                selected = offset;
             }
             else
             {
-                maxPacketSize = ( uint32_t ) pContext->networkBuffer.size;
+                /* MISRA else. */
             }
+        }
 
-            LogInfo( ( "Application has not set any properties. Adding a property to set the maximum "
-                       "packet size received from the server for the client to be %" PRIu32 ".",
-                       maxPacketSize ) );
-            status = MQTTPropAdd_MaxPacketSize( pBackupPropBuilder,
-                                                maxPacketSize,
-                                                NULL );
+        if( selected < pContext->publishQueueCount )
+        {
+            LogWarn( ( "Publish queue is full, dropping a QoS %u publish.",
+                       ( unsigned int ) lowestQoS ) );
+            removeQueuedPublish( pContext, selected );
+            evicted = true;
         }
     }
-
-    if( status == MQTTSuccess )
+    else
     {
-        /* Get MQTT connect packet size and remaining length. */
-        status = MQTT_GetConnectPacketSize( pConnectInfo,
-                                            pWillInfo,
-                                            pBackupPropBuilder,
-                                            pWillPropertyBuilder,
-                                            &remainingLength,
-                                            &packetSize );
-        /* coverity[sensitive_data_leak] */
-        LogDebug( ( "CONNECT packet size is %lu and remaining length is %lu.",
-                    ( unsigned long ) packetSize,
-                    ( unsigned long ) remainingLength ) );
+        /* The new publish is refused. */
     }
 
-    if( status == MQTTSuccess )
-    {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+    return evicted;
+}
 
-        connectStatus = pContext->connectStatus;
+/*-----------------------------------------------------------*/
 
-        if( connectStatus != MQTTNotConnected )
+static MQTTStatus_t admitPublish( MQTTContext_t * pContext,
+                                  uint32_t packetSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t rate;
+    uint32_t burst;
+    uint32_t now;
+    uint32_t elapsedMs;
+    uint32_t fractionMs;
+    uint32_t refill;
+    uint32_t needed;
+    uint32_t deficit;
+
+    assert( pContext != NULL );
+
+    rate = pContext->rateLimitBytesPerSecond;
+    burst = pContext->rateLimitBurstBytes;
+
+    if( rate > 0U )
+    {
+        now = pContext->getTime();
+        elapsedMs = calculateElapsedTime( now, pContext->rateLimitRefillTime );
+
+        if( ( elapsedMs / 1000U ) > ( burst / rate ) )
         {
-            status = ( connectStatus == MQTTConnected ) ? MQTTStatusConnected : MQTTStatusDisconnectPending;
+            refill = burst;
+            pContext->rateLimitRefillTime = now;
+        }
+        else
+        {
+            /* The time spent on the fraction of a byte not earned yet is
+             * carried over to the next refill. */
+            fractionMs = ( elapsedMs % 1000U ) * rate;
+            refill = ( ( elapsedMs / 1000U ) * rate ) + ( fractionMs / 1000U );
+            pContext->rateLimitRefillTime = now - ( ( fractionMs % 1000U ) / rate );
         }
 
-        if( status == MQTTSuccess )
+        if( refill >= ( burst - pContext->rateLimitTokens ) )
+        {
+            pContext->rateLimitTokens = burst;
+        }
+        else
         {
-            status = sendConnectWithoutCopy( pContext,
-                                             pConnectInfo,
-                                             pWillInfo,
-                                             remainingLength,
-                                             pBackupPropBuilder,
-                                             pWillPropertyBuilder );
+            pContext->rateLimitTokens += refill;
         }
 
-        /* TODO: As part of CONNECT/CONNACK setup, there can be AUTH packets sent.
-         * It is not dealt with currently. */
+        /* A PUBLISH larger than the bucket is sent once the bucket is full. */
+        needed = ( packetSize < burst ) ? packetSize : burst;
 
-        /* Read CONNACK from transport layer. */
-        if( status == MQTTSuccess )
+        if( pContext->rateLimitTokens >= needed )
         {
-            status = receiveConnack( pContext,
-                                     timeoutMs,
-                                     pConnectInfo->cleanSession,
-                                     &incomingPacket,
-                                     pSessionPresent );
+            pContext->rateLimitTokens -= needed;
+            pContext->rateLimitDelayMs = 0U;
         }
-
-        /**
-         * Update the maximum number of concurrent incoming and outgoing PUBLISH records
-         * based on MQTT 5.0 Receive Maximum property :
-         *
-         * - For incoming publishes: Use the minimum between the client's configured receive maximum
-         *   (In the MQTT_Init function) and the receive maximum value sent in CONNECT properties
-         *
-         * - For outgoing publishes: Use the minimum between the client's configured maximum
-         *   (In the MQTT_Init function) and the server's receive maximum value received in CONNACK properties
-         **/
-        if( status == MQTTSuccess )
+        else
         {
-            if( pContext->connectionProperties.receiveMax < pContext->incomingPublishRecordMaxCount )
-            {
-                pContext->incomingPublishRecordMaxCount = pContext->connectionProperties.receiveMax;
-            }
+            /* Round up, so that the bytes have been earned after the wait. */
+            deficit = needed - pContext->rateLimitTokens;
+            pContext->rateLimitDelayMs = ( ( deficit / rate ) * 1000U ) +
+                                         ( ( ( deficit % rate ) * 1000U ) / rate ) + 1U;
+
+            LogDebug( ( "PUBLISH of %lu bytes is rate limited for %lu ms.",
+                        ( unsigned long ) packetSize,
+                        ( unsigned long ) pContext->rateLimitDelayMs ) );
+            status = MQTTRateLimited;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t borrowRecords( MQTTContext_t * pContext,
+                                   bool outgoing )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTRecordPool_t * pPool;
+    MQTTPubAckInfo_t ** ppRecords;
+    size_t * pMaxCount;
+    size_t quota;
+    size_t block;
+
+    assert( pContext != NULL );
+
+    pPool = pContext->pRecordPool;
+
+    if( outgoing == true )
+    {
+        ppRecords = &( pContext->outgoingPublishRecords );
+        pMaxCount = &( pContext->outgoingPublishRecordMaxCount );
+        quota = pContext->outgoingPublishRecordQuota;
+    }
+    else
+    {
+        ppRecords = &( pContext->incomingPublishRecords );
+        pMaxCount = &( pContext->incomingPublishRecordMaxCount );
+        quota = pContext->incomingPublishRecordQuota;
+    }
 
-            if( pContext->connectionProperties.serverReceiveMax < pContext->outgoingPublishRecordMaxCount )
-            {
-                pContext->outgoingPublishRecordMaxCount = pContext->connectionProperties.serverReceiveMax;
-            }
-        }
+    if( ( pPool != NULL ) && ( *ppRecords == NULL ) && ( quota > 0U ) )
+    {
+        MQTT_PRE_RECORD_POOL_HOOK( pPool );
 
-        if( ( status == MQTTSuccess ) && ( *pSessionPresent != true ) )
+        if( pPool->freeBlockCount > 0U )
         {
-            status = handleCleanSession( pContext );
+            pPool->freeBlockCount--;
+            block = pPool->pFreeBlocks[ pPool->freeBlockCount ];
+            *ppRecords = &( pPool->pRecords[ block * pPool->recordsPerBlock ] );
+            *pMaxCount = quota;
         }
-
-        if( status == MQTTSuccess )
+        else
         {
-            pContext->connectStatus = MQTTConnected;
-
-            /**
-             * Initialize the client's keep-alive timer using the Server Keep Alive value
-             * received in the CONNACK.
-             * This value overrides the client's original keep-alive setting,
-             * as per MQTT v5 specification.
-             */
-            pContext->keepAliveIntervalSec = pContext->connectionProperties.serverKeepAlive;
-            pContext->waitingForPingResp = false;
-            pContext->pingReqSendTimeMs = 0U;
+            LogWarn( ( "The record pool has no free block." ) );
+            status = MQTTNoMemory;
         }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        MQTT_POST_RECORD_POOL_HOOK( pPool );
     }
 
-    if( ( status == MQTTSuccess ) && ( *pSessionPresent == true ) )
-    {
-        /* Resend PUBRELs and PUBLISHES when reestablishing a session */
-        status = handleUncleanSessionResumption( pContext );
-    }
+    return status;
+}
 
-    if( status == MQTTSuccess )
-    {
-        LogInfo( ( "MQTT connection established with the broker." ) );
-    }
-    else if( ( status == MQTTStatusConnected ) || ( status == MQTTStatusDisconnectPending ) )
-    {
-        LogInfo( ( "MQTT Connection is either already established or a disconnect is pending, return status = %s.",
-                   MQTT_Status_strerror( status ) ) );
-    }
-    else if( pContext == NULL )
+/*-----------------------------------------------------------*/
+
+static void releaseIdleRecords( MQTTContext_t * pContext )
+{
+    assert( pContext != NULL );
+
+    if( pContext->pRecordPool != NULL )
     {
-        LogError( ( "MQTT connection failed with status = %s.",
-                    MQTT_Status_strerror( status ) ) );
+        releaseBlock( pContext->pRecordPool,
+                      &( pContext->outgoingPublishRecords ),
+                      &( pContext->outgoingPublishRecordMaxCount ) );
+        releaseBlock( pContext->pRecordPool,
+                      &( pContext->incomingPublishRecords ),
+                      &( pContext->incomingPublishRecordMaxCount ) );
     }
-    else
-    {
-        LogError( ( "MQTT connection failed with status = %s.",
-                    MQTT_Status_strerror( status ) ) );
+}
 
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+/*-----------------------------------------------------------*/
 
-        if( pContext->connectStatus == MQTTConnected )
+static void releaseBlock( MQTTRecordPool_t * pPool,
+                          MQTTPubAckInfo_t ** ppRecords,
+                          size_t * pMaxCount )
+{
+    const MQTTPubAckInfo_t * pRecords = *ppRecords;
+    size_t index = 0U;
+
+    assert( pPool != NULL );
+
+    if( pRecords != NULL )
+    {
+        while( ( index < *pMaxCount ) && ( pRecords[ index ].packetId == MQTT_PACKET_ID_INVALID ) )
         {
-            /* This will only be executed if after the connack is received
-             * the retransmits fail for some reason on an unclean session
-             * connection. In this case we need to retry the re-transmits
-             * which can only be done using the connect API and that can only
-             * be done once we are disconnected, hence we ask the user to
-             * call disconnect here */
-            pContext->connectStatus = MQTTDisconnectPending;
+            index++;
         }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
-    }
+        if( index == *pMaxCount )
+        {
+            MQTT_PRE_RECORD_POOL_HOOK( pPool );
+            pPool->pFreeBlocks[ pPool->freeBlockCount ] =
+                ( size_t ) ( pRecords - pPool->pRecords ) / pPool->recordsPerBlock;
+            pPool->freeBlockCount++;
+            MQTT_POST_RECORD_POOL_HOOK( pPool );
 
-    return status;
+            *ppRecords = NULL;
+            *pMaxCount = 0U;
+        }
+    }
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
-                             const MQTTSubscribeInfo_t * pSubscriptionList,
-                             size_t subscriptionCount,
-                             uint16_t packetId,
-                             const MQTTPropBuilder_t * pPropertyBuilder )
+static MQTTStatus_t leaseNetworkBuffer( MQTTContext_t * pContext )
 {
-    MQTTConnectionStatus_t connectStatus;
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
     MQTTStatus_t status = MQTTSuccess;
+    MQTTBufferPool_t * pPool;
+    uint8_t * pBuffer = NULL;
 
-    status = validateSubscribeUnsubscribeParams( pContext,
-                                                 pSubscriptionList,
-                                                 subscriptionCount,
-                                                 packetId,
-                                                 MQTT_TYPE_SUBSCRIBE );
-
-    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
-    {
-        bool isSubscriptionIdAvailable;
-        assert( ( pContext->connectionProperties.isSubscriptionIdAvailable == 0U ) ||
-                ( pContext->connectionProperties.isSubscriptionIdAvailable == 1U ) );
+    assert( pContext != NULL );
+    assert( pContext->pBufferPool != NULL );
 
-        isSubscriptionIdAvailable = ( pContext->connectionProperties.isSubscriptionIdAvailable != 0U );
-        status = MQTT_ValidateSubscribeProperties( isSubscriptionIdAvailable,
-                                                   pPropertyBuilder );
-    }
+    pPool = pContext->pBufferPool;
 
-    if( status == MQTTSuccess )
+    if( pContext->networkBuffer.pBuffer == pContext->stagingBuffer.pBuffer )
     {
-        /* Get the remaining length and packet size. */
-        status = MQTT_GetSubscribePacketSize( pSubscriptionList,
-                                              subscriptionCount,
-                                              pPropertyBuilder,
-                                              &remainingLength,
-                                              &packetSize,
-                                              pContext->connectionProperties.serverMaxPacketSize );
-        LogDebug( ( "SUBSCRIBE packet size is %lu and remaining length is %lu.",
-                    ( unsigned long ) packetSize,
-                    ( unsigned long ) remainingLength ) );
-    }
+        MQTT_PRE_BUFFER_POOL_HOOK( pPool );
 
-    if( status == MQTTSuccess )
-    {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        if( pPool->freeBufferCount > 0U )
+        {
+            pPool->freeBufferCount--;
+            pBuffer = &( pPool->pBuffers[ pPool->pFreeBuffers[ pPool->freeBufferCount ] * pPool->bufferSize ] );
+        }
 
-        connectStatus = pContext->connectStatus;
+        MQTT_POST_BUFFER_POOL_HOOK( pPool );
 
-        if( connectStatus != MQTTConnected )
+        if( pBuffer != NULL )
         {
-            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+            ( void ) memcpy( pBuffer, pContext->stagingBuffer.pBuffer, pContext->index );
+            pContext->networkBuffer.pBuffer = pBuffer;
+            pContext->networkBuffer.size = pPool->bufferSize;
         }
-
-        if( status == MQTTSuccess )
+        else
         {
-            /* Send MQTT SUBSCRIBE packet. */
-            status = sendSubscribeWithoutCopy( pContext,
-                                               pSubscriptionList,
-                                               subscriptionCount,
-                                               packetId,
-                                               remainingLength,
-                                               pPropertyBuilder );
+            LogWarn( ( "The buffer pool has no free buffer." ) );
+            status = MQTTNoMemory;
         }
-
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
     return status;
@@ -4708,145 +8418,221 @@ MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
-                           const MQTTPublishInfo_t * pPublishInfo,
-                           uint16_t packetId,
-                           const MQTTPropBuilder_t * pPropertyBuilder )
+static void releaseNetworkBuffer( MQTTContext_t * pContext )
 {
-    size_t headerSize = 0U;
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
-    MQTTPublishState_t publishStatus = MQTTStateNull;
-    MQTTConnectionStatus_t connectStatus;
-    uint16_t topicAlias = 0U;
+    MQTTBufferPool_t * pPool;
 
-    /* Maximum number of bytes required by the 'fixed' part of the PUBLISH
-     * packet header according to the MQTT specifications.
-     * Header byte           0 + 1 = 1
-     * Length (max)            + 4 = 5
-     * Topic string length     + 2 = 7
-     *
-     * Note that since publish is one of the most common operations in MQTT
-     * connection, we have moved the topic string length to the 'fixed' part of
-     * the header so efficiency. Otherwise, we would need an extra vector and
-     * an extra call to 'send' (in case writev is not defined) to send the
-     * topic length.    */
-    uint8_t mqttHeader[ 7U ];
-    MQTTStatus_t status = MQTTSuccess;
+    assert( pContext != NULL );
 
-    /* Validate arguments. */
-    status = validatePublishParams( pContext, pPublishInfo, packetId );
+    pPool = pContext->pBufferPool;
 
-    /* Validate Publish Properties and extract Topic Alias from the properties. */
-    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    if( ( pPool != NULL ) && ( pContext->index == 0U ) &&
+        ( pContext->networkBuffer.pBuffer != pContext->stagingBuffer.pBuffer ) )
     {
-        status = MQTT_ValidatePublishProperties( pContext->connectionProperties.serverTopicAliasMax,
-                                                 pPropertyBuilder, &topicAlias );
+        ( void ) MQTT_ReturnPoolBuffer( pPool, pContext->networkBuffer.pBuffer );
+        pContext->networkBuffer = pContext->stagingBuffer;
     }
+}
 
-    if( status == MQTTSuccess )
-    {
-        /* Validate Publish Properties with the persistent Connection Properties. */
-        status = MQTT_ValidatePublishParams( pPublishInfo,
-                                             pContext->connectionProperties.retainAvailable,
-                                             pContext->connectionProperties.serverMaxQos,
-                                             topicAlias,
-                                             pContext->connectionProperties.serverMaxPacketSize );
-    }
+/*-----------------------------------------------------------*/
 
-    if( status == MQTTSuccess )
+static void resetNetworkBuffer( MQTTContext_t * pContext )
+{
+    assert( pContext != NULL );
+
+    pContext->index = 0;
+    pContext->pendingPacketLength = 0U;
+    releaseNetworkBuffer( pContext );
+    ( void ) memset( pContext->networkBuffer.pBuffer, 0, pContext->networkBuffer.size );
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t getReceiveBufferSize( const MQTTContext_t * pContext )
+{
+    size_t size;
+
+    assert( pContext != NULL );
+
+    if( pContext->pBufferPool != NULL )
     {
-        /* Get the remaining length and packet size. */
-        status = MQTT_GetPublishPacketSize( pPublishInfo,
-                                            pPropertyBuilder,
-                                            &remainingLength,
-                                            &packetSize,
-                                            pContext->connectionProperties.serverMaxPacketSize );
+        size = pContext->pBufferPool->bufferSize;
     }
-
-    if( status == MQTTSuccess )
+    else
     {
-        status = MQTT_SerializePublishHeaderWithoutTopic( pPublishInfo,
-                                                          remainingLength,
-                                                          mqttHeader,
-                                                          &headerSize );
+        size = pContext->networkBuffer.size;
     }
 
-    if( status == MQTTSuccess )
+    return size;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t processPublishQueue( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTStatus_t flushStatus;
+    MQTTStatus_t droppedStatus = MQTTSuccess;
+    MQTTPublishRequest_t request = { 0 };
+    bool retry = false;
+    MQTTPublishPriority_t minPriority = MQTTPublishPriorityLow;
+    size_t pendingCount = 0U;
+    size_t offset = 0U;
+    uint16_t packetId = 0U;
+
+    #if ( MQTT_PUBLISH_QUEUE_BYTES_PER_CALL > 0U )
+        size_t bytesSent = 0U;
+    #endif
+
+    assert( pContext != NULL );
+    assert( pContext->pPublishQueue != NULL );
+
+    /* Only publishes queued so far are sent, so that producers adding to the
+     * queue cannot keep the owner thread here indefinitely. */
+    MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
+    pendingCount = pContext->publishQueueCount;
+    MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
+
+    beginSendBatch( pContext );
+
+    while( ( pendingCount > 0U ) && ( status == MQTTSuccess ) )
     {
-        assert( headerSize <= 7U );
+        /* Producers may drop queued publishes to make room for new ones, so
+         * the publish to send is taken out of the queue with the hook held. */
+        MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
 
-        /* Take the mutex as multiple send calls are required for sending this
-         * packet. */
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        if( pendingCount > pContext->publishQueueCount )
+        {
+            pendingCount = pContext->publishQueueCount;
+        }
 
-        connectStatus = pContext->connectStatus;
+        offset = selectQueuedPublish( pContext, pendingCount, minPriority );
 
-        if( connectStatus != MQTTConnected )
+        if( offset < pendingCount )
         {
-            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+            request = pContext->pPublishQueue[ ( pContext->publishQueueHead + offset ) %
+                                               pContext->publishQueueLength ];
+            removeQueuedPublish( pContext, offset );
+            pContext->publishQueueSending = true;
         }
 
-        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
+
+        if( offset == pendingCount )
         {
-            /* Set the flag so that the corresponding hook can be called later. */
+            /* The rest of the queue waits for the next call. */
+            pendingCount = 0U;
+        }
+        else
+        {
+            packetId = request.packetId;
 
-            status = MQTT_ReserveState( pContext,
-                                        packetId,
-                                        pPublishInfo->qos );
+            if( ( packetId == 0U ) && ( request.publishInfo.qos > MQTTQoS0 ) )
+            {
+                packetId = MQTT_GetPacketId( pContext );
+            }
 
-            /* State already exists for a duplicate packet.
-             * If a state doesn't exist, it will be handled as a new publish in
-             * state engine. */
-            if( ( status == MQTTStateCollision ) && ( pPublishInfo->dup == true ) )
+            status = publishPacket( pContext,
+                                    &( request.publishInfo ),
+                                    packetId,
+                                    request.pPropertyBuilder,
+                                    NULL,
+                                    0U,
+                                    NULL,
+                                    0U,
+                                    true );
+
+            #if ( MQTT_PUBLISH_QUEUE_BYTES_PER_CALL > 0U )
+                /* Only a publish that was sent uses up the budget. One put
+                 * back for a retry has not. */
+                if( status == MQTTSuccess )
+                {
+                    bytesSent += request.publishInfo.topicNameLength + request.publishInfo.payloadLength;
+
+                    if( request.pPropertyBuilder != NULL )
+                    {
+                        bytesSent += request.pPropertyBuilder->currentIndex;
+                    }
+
+                    /* Once the budget is spent, only high priority publishes
+                     * are sent so that the receive loop gets to send its acks. */
+                    if( bytesSent >= ( size_t ) MQTT_PUBLISH_QUEUE_BYTES_PER_CALL )
+                    {
+                        minPriority = MQTTPublishPriorityHigh;
+                    }
+                }
+            #endif
+
+            MQTT_PRE_PUBLISH_QUEUE_HOOK( pContext );
+
+            /* Put the publish back if it could not be sent yet, so it is
+             * retried on a later call. Its element was kept reserved. */
+            retry = ( ( status == MQTTStatusNotConnected ) ||
+                      ( status == MQTTStatusDisconnectPending ) ||
+                      ( status == MQTTNoMemory ) ||
+                      ( status == MQTTRateLimited ) );
+
+            if( retry == true )
             {
-                status = MQTTSuccess;
+                restoreQueuedPublish( pContext, offset, &request );
             }
-        }
 
-        if( status == MQTTSuccess )
-        {
-            status = sendPublishWithoutCopy( pContext,
-                                             pPublishInfo,
-                                             mqttHeader,
-                                             headerSize,
-                                             packetId,
-                                             pPropertyBuilder );
-        }
+            pContext->publishQueueSending = false;
 
-        if( ( status == MQTTSuccess ) &&
-            ( pPublishInfo->qos > MQTTQoS0 ) )
-        {
-            /* Update state machine after PUBLISH is sent.
-             * Only to be done for QoS1 or QoS2. */
-            status = MQTT_UpdateStatePublish( pContext,
-                                              packetId,
-                                              MQTT_SEND,
-                                              pPublishInfo->qos,
-                                              &publishStatus );
+            MQTT_POST_PUBLISH_QUEUE_HOOK( pContext );
 
-            if( status != MQTTSuccess )
+            /* A publish refused for its own parameters is dropped, and the
+             * publishes queued after it are still sent. */
+            if( ( retry == false ) && ( status != MQTTSuccess ) && ( status != MQTTSendFailed ) )
             {
-                LogError( ( "Update state for publish failed with status %s."
-                            " However PUBLISH packet was sent to the broker."
-                            " Any further handling of ACKs for the packet Id"
-                            " will fail.",
-                            MQTT_Status_strerror( status ) ) );
+                LogWarn( ( "Dropped a queued publish: %s.",
+                           MQTT_Status_strerror( status ) ) );
+
+                if( droppedStatus == MQTTSuccess )
+                {
+                    droppedStatus = status;
+                }
+
+                status = MQTTSuccess;
             }
+
+            pendingCount--;
         }
+    }
+
+    flushStatus = endSendBatch( pContext );
+
+    if( status == MQTTSuccess )
+    {
+        status = flushStatus;
+    }
 
-        /* mutex should be released and not before updating the state
-         * because we need to make sure that the state is updated
-         * after sending the publish packet, before the receive
-         * loop receives ack for this and would want to update its state
-         */
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    if( status == MQTTSuccess )
+    {
+        status = droppedStatus;
     }
 
-    if( status != MQTTSuccess )
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ProcessPublishQueue( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
     {
-        LogError( ( "MQTT PUBLISH failed with status %s.",
-                    MQTT_Status_strerror( status ) ) );
+        LogError( ( "Invalid input parameter: MQTT Context cannot be NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->pPublishQueue != NULL )
+    {
+        status = processPublishQueue( pContext );
+    }
+    else
+    {
+        /* Nothing to send without a publish queue. */
     }
 
     return status;
@@ -4898,44 +8684,47 @@ MQTTStatus_t MQTT_Ping( MQTTContext_t * pContext )
 
     if( status == MQTTSuccess )
     {
-        /* Take the mutex as the send call should not be interrupted in
-         * between. */
-
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
         connectStatus = pContext->connectStatus;
 
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
         if( connectStatus != MQTTConnected )
         {
             status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
         }
+    }
 
-        if( status == MQTTSuccess )
-        {
-            /* Send the serialized PINGREQ packet to transport layer.
-             * Here, we do not use the vectored IO approach for efficiency as the
-             * Ping packet does not have numerous fields which need to be copied
-             * from the user provided buffers. Thus it can be sent directly. */
-            sendResult = sendBuffer( pContext,
-                                     localBuffer.pBuffer,
-                                     packetSize );
+    if( status == MQTTSuccess )
+    {
+        /* Take the mutex as the send call should not be interrupted in
+         * between. */
+        MQTT_PRE_SEND_HOOK( pContext );
 
-            /* It is an error to not send the entire PINGREQ packet. */
-            if( sendResult < ( int32_t ) packetSize )
-            {
-                LogError( ( "Transport send failed for PINGREQ packet." ) );
-                status = MQTTSendFailed;
-            }
-            else
-            {
-                pContext->pingReqSendTimeMs = pContext->lastPacketTxTime;
-                pContext->waitingForPingResp = true;
-                LogDebug( ( "Sent %ld bytes of PINGREQ packet.",
-                            ( long int ) sendResult ) );
-            }
+        /* Send the serialized PINGREQ packet to transport layer.
+         * Here, we do not use the vectored IO approach for efficiency as the
+         * Ping packet does not have numerous fields which need to be copied
+         * from the user provided buffers. Thus it can be sent directly. */
+        sendResult = sendBuffer( pContext,
+                                 localBuffer.pBuffer,
+                                 packetSize );
+
+        /* It is an error to not send the entire PINGREQ packet. */
+        if( sendResult < ( int32_t ) packetSize )
+        {
+            LogError( ( "Transport send failed for PINGREQ packet." ) );
+            status = MQTTSendFailed;
+        }
+        else
+        {
+            pContext->pingReqSendTimeMs = pContext->lastPacketTxTime;
+            pContext->waitingForPingResp = true;
+            LogDebug( ( "Sent %ld bytes of PINGREQ packet.",
+                        ( long int ) sendResult ) );
         }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        releaseSendHook( pContext );
     }
 
     return status;
@@ -4943,6 +8732,8 @@ MQTTStatus_t MQTT_Ping( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
                                const MQTTSubscribeInfo_t * pSubscriptionList,
                                size_t subscriptionCount,
@@ -4982,17 +8773,36 @@ MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
 
     if( status == MQTTSuccess )
     {
-        /* Take the mutex because the below call should not be interrupted. */
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
         connectStatus = pContext->connectStatus;
 
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
         if( connectStatus != MQTTConnected )
         {
             status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
         }
+    }
 
-        if( status == MQTTSuccess )
+    if( status == MQTTSuccess )
+    {
+        /* Take the mutex because the below call should not be interrupted. */
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        if( ( pContext->subscribeBuffer.pBuffer != NULL ) &&
+            ( packetSize <= pContext->subscribeBuffer.size ) )
+        {
+            status = sendSerializedSubscribeUnsubscribe( pContext,
+                                                         pSubscriptionList,
+                                                         subscriptionCount,
+                                                         packetId,
+                                                         remainingLength,
+                                                         packetSize,
+                                                         pPropertyBuilder,
+                                                         MQTT_TYPE_UNSUBSCRIBE );
+        }
+        else
         {
             status = sendUnsubscribeWithoutCopy( pContext,
                                                  pSubscriptionList,
@@ -5002,12 +8812,21 @@ MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
                                                  pPropertyBuilder );
         }
 
+        releaseSendHook( pContext );
+    }
+
+    if( ( status == MQTTSuccess ) && ( pContext->pSubscriptionRecords != NULL ) )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        removeSubscriptions( pContext, pSubscriptionList, subscriptionCount );
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
 /*-----------------------------------------------------------*/
 
 MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
@@ -5070,21 +8889,117 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
             LogInfo( ( "Disconnected from the broker." ) );
             pContext->connectStatus = MQTTNotConnected;
 
-            /* Reset the index and clean the buffer on a successful disconnect. */
-            pContext->index = 0;
-            ( void ) memset( pContext->networkBuffer.pBuffer, 0, pContext->networkBuffer.size );
+            /* The network buffer is guarded by the receive hook, which may be
+             * held by the caller. It is reset by the receive path instead. */
 
             LogInfo( ( "MQTT Connection Disconnected Successfully" ) );
-
-            status = sendDisconnectWithoutCopy( pContext,
-                                                pReasonCode,
-                                                remainingLength,
-                                                pPropertyBuilder );
         }
 
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        status = sendDisconnectWithoutCopy( pContext,
+                                            pReasonCode,
+                                            remainingLength,
+                                            pPropertyBuilder );
+
+        releaseSendHook( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Auth( MQTTContext_t * pContext,
+                        MQTTSuccessFailReasonCode_t reasonCode,
+                        const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    uint32_t packetSize = 0U;
+    uint32_t remainingLength = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTConnectionStatus_t connectStatus;
+    bool connectPending;
+
+    /* Validate arguments. */
+    if( ( pContext == NULL ) || ( pPropertyBuilder == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, pPropertyBuilder=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pPropertyBuilder ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( reasonCode != MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION ) &&
+             ( reasonCode != MQTT_REASON_AUTH_RE_AUTHENTICATE ) )
+    {
+        LogError( ( "A client AUTH packet must continue or start an authentication: "
+                    "reasonCode=%u.",
+                    ( unsigned int ) reasonCode ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+            /* MQTT 3.1.1 has no AUTH packet. */
+            LogError( ( "AUTH is not supported by MQTT 3.1.1." ) );
+            status = MQTTBadParameter;
+        #else
+            status = MQTT_ValidateAuthProperties( pPropertyBuilder );
+        #endif
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_GetAuthPacketSize( pPropertyBuilder,
+                                         &remainingLength,
+                                         &packetSize,
+                                         pContext->connectionProperties.serverMaxPacketSize );
+        LogDebug( ( "MQTT AUTH packet size is %lu.",
+                    ( unsigned long ) packetSize ) );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+        connectPending = pContext->connectPending;
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        /* An authentication exchange may also continue before the CONNACK. */
+        if( ( connectStatus == MQTTNotConnected ) &&
+            ( connectPending == true ) &&
+            ( reasonCode == MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION ) )
+        {
+            LogDebug( ( "Continuing the authentication of the pending CONNECT." ) );
+        }
+        else if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+        else
+        {
+            /* Connected. */
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_SEND_HOOK( pContext );
+
+        status = sendAuthWithoutCopy( pContext,
+                                      reasonCode,
+                                      remainingLength,
+                                      pPropertyBuilder );
+
+        releaseSendHook( pContext );
+    }
+
     return status;
 }
 
@@ -5109,7 +9024,38 @@ MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext )
     else
     {
         pContext->controlPacketSent = false;
-        status = receiveSingleIteration( pContext, true );
+        status = MQTTSuccess;
+
+        if( pContext->pPublishQueue != NULL )
+        {
+            status = processPublishQueue( pContext );
+
+            /* A full outgoing publish record array is not an error here; the
+             * acks received below will make room for the queued publishes.
+             * Publishes refused by the rate limit are sent on a later call,
+             * and a publish refused for its own parameters has been dropped
+             * without affecting the connection. */
+            if( ( status != MQTTSendFailed ) &&
+                ( status != MQTTStatusNotConnected ) &&
+                ( status != MQTTStatusDisconnectPending ) )
+            {
+                status = MQTTSuccess;
+            }
+        }
+
+        if( status == MQTTSuccess )
+        {
+            MQTT_PRE_RECEIVE_HOOK( pContext );
+            status = receiveSingleIteration( pContext, true );
+            MQTT_POST_RECEIVE_HOOK( pContext );
+        }
+
+        if( pContext->pRecordPool != NULL )
+        {
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            releaseIdleRecords( pContext );
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
     }
 
     return status;
@@ -5135,7 +9081,16 @@ MQTTStatus_t MQTT_ReceiveLoop( MQTTContext_t * pContext )
     }
     else
     {
+        MQTT_PRE_RECEIVE_HOOK( pContext );
         status = receiveSingleIteration( pContext, false );
+        MQTT_POST_RECEIVE_HOOK( pContext );
+
+        if( pContext->pRecordPool != NULL )
+        {
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            releaseIdleRecords( pContext );
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
     }
 
     return status;
@@ -5143,26 +9098,158 @@ MQTTStatus_t MQTT_ReceiveLoop( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
-uint16_t MQTT_GetPacketId( MQTTContext_t * pContext )
+MQTTStatus_t MQTT_ProcessKeepAlive( MQTTContext_t * pContext )
 {
-    uint16_t packetId = 0U;
+    MQTTStatus_t status = MQTTBadParameter;
+    MQTTConnectionStatus_t connectStatus;
 
-    if( pContext != NULL )
+    if( pContext == NULL )
+    {
+        LogError( ( "Invalid input parameter: MQTT Context cannot be NULL." ) );
+    }
+    else if( pContext->getTime == NULL )
+    {
+        LogError( ( "Invalid input parameter: MQTT Context must have valid getTime." ) );
+    }
+    else
     {
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        connectStatus = pContext->connectStatus;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
 
-        packetId = pContext->nextPacketId;
-
-        /* A packet ID of zero is not a valid packet ID. When the max ID
-         * is reached the next one should start at 1. */
-        if( pContext->nextPacketId == ( uint16_t ) UINT16_MAX )
+        if( connectStatus == MQTTConnected )
         {
-            pContext->nextPacketId = 1;
+            status = handleKeepAlive( pContext );
         }
         else
         {
-            pContext->nextPacketId++;
+            /* The keep-alive state is stale without a connection. */
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+
+        if( status != MQTTSuccess )
+        {
+            LogError( ( "Handling of keep alive failed. Status=%s",
+                        MQTT_Status_strerror( status ) ) );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t MQTT_GetNextTimeoutMs( MQTTContext_t * pContext )
+{
+    uint32_t timeoutMs = MQTT_NO_TIMEOUT_PENDING;
+    uint32_t now = 0U;
+    uint32_t packetTxTimeoutMs = 0U;
+    uint32_t lastPacketTxTime = 0U;
+    uint32_t remainingMs = 0U;
+    MQTTConnectionStatus_t connectStatus = MQTTNotConnected;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Invalid input parameter: MQTT Context cannot be NULL." ) );
+    }
+    else if( pContext->getTime == NULL )
+    {
+        LogError( ( "Invalid input parameter: MQTT Context must have valid getTime." ) );
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        connectStatus = pContext->connectStatus;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        MQTT_PRE_SEND_HOOK( pContext );
+        lastPacketTxTime = pContext->lastPacketTxTime;
+        MQTT_POST_SEND_HOOK( pContext );
+
+        if( connectStatus == MQTTConnected )
+        {
+            now = pContext->getTime();
+
+            if( pContext->waitingForPingResp == true )
+            {
+                /* handleKeepAlive reports a timeout only once strictly more than
+                 * MQTT_PINGRESP_TIMEOUT_MS have elapsed. */
+                timeoutMs = calculateRemainingTime( calculateElapsedTime( now, pContext->pingReqSendTimeMs ),
+                                                    MQTT_PINGRESP_TIMEOUT_MS + 1U );
+            }
+            else
+            {
+                timeoutMs = calculateRemainingTime( calculateElapsedTime( now, pContext->lastPacketRxTime ),
+                                                    PACKET_RX_TIMEOUT_MS );
+
+                packetTxTimeoutMs = getPacketTxTimeoutMs( pContext );
+
+                if( packetTxTimeoutMs != 0U )
+                {
+                    remainingMs = calculateRemainingTime( calculateElapsedTime( now, lastPacketTxTime ),
+                                                          packetTxTimeoutMs );
+
+                    if( remainingMs < timeoutMs )
+                    {
+                        timeoutMs = remainingMs;
+                    }
+                }
+            }
         }
+    }
+
+    return timeoutMs;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t MQTT_GetRateLimitDelay( MQTTContext_t * pContext )
+{
+    uint32_t delayMs = 0U;
+
+    if( pContext != NULL )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        delayMs = pContext->rateLimitDelayMs;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return delayMs;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t MQTT_GetPacketId( MQTTContext_t * pContext )
+{
+    uint16_t packetId = 0U;
+    size_t attempts = 0U;
+
+    if( pContext != NULL )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        /* Skip the IDs of publishes still awaiting an acknowledgement, so
+         * that the ID handed out does not collide with an in-flight record.
+         * At most outgoingPublishRecordMaxCount IDs can be in use, so a free
+         * one is found within that many attempts plus one. */
+        do
+        {
+            packetId = pContext->nextPacketId;
+
+            /* A packet ID of zero is not a valid packet ID. When the max ID
+             * is reached the next one should start at 1. */
+            if( pContext->nextPacketId == ( uint16_t ) UINT16_MAX )
+            {
+                pContext->nextPacketId = 1;
+            }
+            else
+            {
+                pContext->nextPacketId++;
+            }
+
+            attempts++;
+        } while( ( attempts <= pContext->outgoingPublishRecordMaxCount ) &&
+                 ( isOutgoingPacketIdInUse( pContext, packetId ) == true ) );
 
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
@@ -5288,11 +9375,12 @@ MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
     }
 
     /* A SUBACK must have a remaining length of at least 4 to accommodate the
-     * packet identifier, atleast 1 byte for the property length and at least 1 return code. */
-    else if( pSubackPacket->remainingLength < 4U )
+     * packet identifier, atleast 1 byte for the property length and at least 1 return code.
+     * An MQTT 3.1.1 SUBACK has no property length. */
+    else if( pSubackPacket->remainingLength < ( 3U + MQTT_EMPTY_PROPERTY_LENGTH_SIZE ) )
     {
         LogError( ( "Invalid parameter: Packet remaining length is invalid: "
-                    "Should be greater than or equal to 4 for SUBACK packet: InputRemainingLength=%lu",
+                    "Too short for SUBACK packet: InputRemainingLength=%lu",
                     ( unsigned long ) pSubackPacket->remainingLength ) );
         status = MQTTBadParameter;
     }
@@ -5332,6 +9420,8 @@ MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 MQTTStatus_t MQTT_GetUnsubAckStatusCodes( const MQTTPacketInfo_t * pUnsubackPacket,
                                           uint8_t ** pPayloadStart,
                                           size_t * pPayloadSize )
@@ -5395,6 +9485,8 @@ MQTTStatus_t MQTT_GetUnsubAckStatusCodes( const MQTTPacketInfo_t * pUnsubackPack
     return status;
 }
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
 /*-----------------------------------------------------------*/
 
 const char * MQTT_Status_strerror( MQTTStatus_t status )
@@ -5471,6 +9563,10 @@ const char * MQTT_Status_strerror( MQTTStatus_t status )
             str = "MQTTPublishRetrieveFailed";
             break;
 
+        case MQTTRateLimited:
+            str = "MQTTRateLimited";
+            break;
+
         default:
             str = "Invalid MQTT Status code";
             break;
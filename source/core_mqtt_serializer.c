@@ -72,13 +72,22 @@
  * @brief A PINGRESP packet always has a "Remaining length" of 0. */
 #define MQTT_PACKET_PINGRESP_REMAINING_LENGTH       ( 0U )
 
+#if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+
+/**
+ * @brief The highest Connect Return Code defined by MQTT 3.1.1.
+ */
+    #define MQTT_CONNACK_MAX_RETURN_CODE        ( 5U )
+#else
+
 /**
  * @brief Minimum number of bytes in the CONNACK Packet.
  * CONNECT Acknowledge Flags    0 + 1 = 1
  * CONNECT Reason Code            + 1 = 2
  * Property Length byte (min)     + 1 = 3
  */
-#define MQTT_PACKET_CONNACK_MINIMUM_SIZE            ( 3U )
+    #define MQTT_PACKET_CONNACK_MINIMUM_SIZE    ( 3U )
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
 /*-----------------------------------------------------------*/
 
@@ -191,6 +200,8 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
                                     uint32_t remainingLength,
                                     const MQTTFixedBuffer_t * pFixedBuffer );
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Prints the appropriate message for the CONNACK response code if logs
  * are enabled.
@@ -199,6 +210,8 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
  */
 static void logConnackResponse( uint8_t responseCode );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @brief Retrieve the size of the remaining length if it were to be encoded.
  *
@@ -376,6 +389,8 @@ static MQTTStatus_t deserializePingresp( const MQTTPacketInfo_t * pPingresp );
 static MQTTStatus_t validateConnackParams( const MQTTPacketInfo_t * pIncomingPacket,
                                            bool * pSessionPresent );
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Validate the length and decode the connack properties.
  *
@@ -391,6 +406,10 @@ static MQTTStatus_t deserializeConnackProperties( MQTTConnectionProperties_t * p
                                                   uint8_t * pIndex,
                                                   MQTTPropBuilder_t * pPropBuffer );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Deserialize properties in the SUBACK packet received from the server.
  *
@@ -410,6 +429,8 @@ static MQTTStatus_t deserializeSubUnsubAckProperties( MQTTPropBuilder_t * pPropB
                                                       size_t * pSubackPropertyLength,
                                                       uint32_t remainingLength );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @brief Deserialize an PUBACK, PUBREC, PUBREL, or PUBCOMP packet.
  *
@@ -430,6 +451,8 @@ static MQTTStatus_t deserializePubAcks( const MQTTPacketInfo_t * pAck,
                                         bool requestProblem,
                                         MQTTPropBuilder_t * pPropBuffer );
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Validate the length and decode the publish ack properties.
  *
@@ -444,6 +467,8 @@ static MQTTStatus_t decodePubAckProperties( MQTTPropBuilder_t * pPropBuffer,
                                             uint8_t * pIndex,
                                             uint32_t remainingLength );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @brief Prints the appropriate message for the PUBREL, PUBACK response code if logs
  * are enabled.
@@ -456,6 +481,8 @@ static MQTTStatus_t decodePubAckProperties( MQTTPropBuilder_t * pPropBuffer,
 static MQTTStatus_t logAckResponse( MQTTSuccessFailReasonCode_t reasonCode,
                                     uint16_t packetIdentifier );
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Deserialize properties in the PUBLISH packet received from the server.
  *
@@ -478,6 +505,8 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                                                   uint16_t topicAliasMax,
                                                   uint32_t remainingLength );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @brief Prints and validates the appropriate message for the Disconnect response code if logs
  * are enabled.
@@ -529,6 +558,33 @@ static inline MQTTStatus_t isValidConnackReasonCode( uint8_t reasonCode );
 static MQTTStatus_t validateIncomingDisconnectProperties( uint8_t * pIndex,
                                                           uint32_t disconnectPropertyLength );
 
+/**
+ * @brief Validates the reason code of an AUTH packet.
+ *
+ * @param[in] reasonCode MQTT Verion 5 standard AUTH reason code.
+ * @param[in] incoming To differentiate between outgoing and incoming AUTH.
+ *
+ * @return #MQTTSuccess, #MQTTBadParameter and #MQTTBadResponse.
+ */
+static MQTTStatus_t validateAuthResponse( MQTTSuccessFailReasonCode_t reasonCode,
+                                          bool incoming );
+
+/**
+ * @brief Validate the properties of an AUTH packet.
+ *
+ * @param[in] pIndex Pointer to the start of the properties.
+ * @param[in] authPropertyLength Length of the properties in the AUTH packet.
+ * @param[out] pMethodPresent Whether the Authentication Method is present.
+ *
+ * @return #MQTTSuccess if the properties are valid;
+ * #MQTTBadResponse if a property is malformed, repeated or not allowed in AUTH.
+ */
+static MQTTStatus_t validateAuthProperties( uint8_t * pIndex,
+                                            uint32_t authPropertyLength,
+                                            bool * pMethodPresent );
+
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 /**
  * @brief Tracks which CONNACK properties have been seen during deserialization,
  *        used to detect duplicates.
@@ -632,6 +688,8 @@ static MQTTStatus_t decodeConnackBoolProp( uint8_t * pDest,
                                            MQTTPropBuilder_t * pPropBuffer,
                                            uint8_t bitPos );
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t validateReasonCodeForAck( uint8_t ackPacketType,
@@ -775,12 +833,20 @@ static MQTTStatus_t calculatePublishPacketSize( const MQTTPublishInfo_t * pPubli
         packetSize += 2U;
     }
 
-    packetSize += variableLengthEncodedSize( publishPropertyLength );
+    packetSize += MQTT_PROPERTY_LENGTH_SIZE( publishPropertyLength );
 
     /* Calculate the maximum allowed size of the properties and payload combined for
      * the given parameters. */
     propertyAndPayloadLimit = MQTT_MAX_REMAINING_LENGTH - packetSize;
 
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        if( publishPropertyLength != 0U )
+        {
+            LogError( ( "MQTT 3.1.1 PUBLISH packets cannot carry properties." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
+
     if( publishPropertyLength > propertyAndPayloadLimit )
     {
         LogError( ( "PUBLISH properties length of %lu cannot exceed "
@@ -885,28 +951,40 @@ static MQTTStatus_t deserializePubAcks( const MQTTPacketInfo_t * pAck,
         }
     }
 
-    /* If reason code is success, server can choose to send the reason code or not. */
-    if( ( status == MQTTSuccess ) && ( pAck->remainingLength > 2U ) )
-    {
-        pReasonCode->reasonCode = pIndex;
-        pReasonCode->reasonCodeLength = 1U;
-        pIndex++;
-    }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        ( void ) requestProblem;
+        ( void ) pPropBuffer;
 
-    if( ( status == MQTTSuccess ) && ( pAck->remainingLength > 3U ) )
-    {
-        /* Protocol error to send user property and reason string if client has set request problem to false. */
-        if( requestProblem == false )
+        /* MQTT 3.1.1 acks carry only the packet identifier. */
+        if( ( status == MQTTSuccess ) && ( pAck->remainingLength != MQTT_PACKET_SIMPLE_ACK_REMAINING_LENGTH ) )
         {
-            LogError( ( "User property and reason string not expected in ACK packet when requestProblem is false." ) );
+            LogError( ( "ACK does not have remaining length of 2." ) );
             status = MQTTBadResponse;
         }
-        else
+    #else
+        /* If reason code is success, server can choose to send the reason code or not. */
+        if( ( status == MQTTSuccess ) && ( pAck->remainingLength > 2U ) )
         {
-            /* 3 bytes have been used up by the packet ID (2) and reason code (1). */
-            status = decodePubAckProperties( pPropBuffer, pIndex, pAck->remainingLength - 3U );
+            pReasonCode->reasonCode = pIndex;
+            pReasonCode->reasonCodeLength = 1U;
+            pIndex++;
         }
-    }
+
+        if( ( status == MQTTSuccess ) && ( pAck->remainingLength > 3U ) )
+        {
+            /* Protocol error to send user property and reason string if client has set request problem to false. */
+            if( requestProblem == false )
+            {
+                LogError( ( "User property and reason string not expected in ACK packet when requestProblem is false." ) );
+                status = MQTTBadResponse;
+            }
+            else
+            {
+                /* 3 bytes have been used up by the packet ID (2) and reason code (1). */
+                status = decodePubAckProperties( pPropBuffer, pIndex, pAck->remainingLength - 3U );
+            }
+        }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
     return status;
 }
@@ -1085,7 +1163,7 @@ static void serializePublishCommon( const MQTTPublishInfo_t * pPublishInfo,
     }
 
     /* Properties are added after packet identifier. */
-    pIndex = encodeVariableLength( pIndex, propertyLength );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, propertyLength );
 
     if( propertyLength > 0U )
     {
@@ -1265,25 +1343,42 @@ static bool incomingPacketValid( uint8_t packetType )
         case MQTT_PACKET_TYPE_CONNACK:
         case MQTT_PACKET_TYPE_PUBLISH:
         case MQTT_PACKET_TYPE_PUBACK:
-        case MQTT_PACKET_TYPE_PUBREC:
-        case MQTT_PACKET_TYPE_PUBCOMP:
         case MQTT_PACKET_TYPE_SUBACK:
-        case MQTT_PACKET_TYPE_UNSUBACK:
         case MQTT_PACKET_TYPE_PINGRESP:
-        case MQTT_PACKET_TYPE_DISCONNECT:
-        case MQTT_PACKET_TYPE_AUTH:
             status = true;
             break;
 
-        case ( MQTT_PACKET_TYPE_PUBREL & 0xF0U ):
+        #if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+            case MQTT_PACKET_TYPE_UNSUBACK:
+                status = true;
+                break;
+        #endif
 
-            /* The second bit of a PUBREL must be set. */
-            if( ( packetType & 0x02U ) > 0U )
-            {
+        /* MQTT 3.1.1 servers never send DISCONNECT or AUTH. */
+        #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+            case MQTT_PACKET_TYPE_DISCONNECT:
+            case MQTT_PACKET_TYPE_AUTH:
                 status = true;
-            }
+                break;
+        #endif
 
-            break;
+        /* The QoS 2 acks are only expected when QoS 2 is built in. */
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTT_PACKET_TYPE_PUBREC:
+            case MQTT_PACKET_TYPE_PUBCOMP:
+                status = true;
+                break;
+
+            case ( MQTT_PACKET_TYPE_PUBREL & 0xF0U ):
+
+                /* The second bit of a PUBREL must be set. */
+                if( ( packetType & 0x02U ) > 0U )
+                {
+                    status = true;
+                }
+
+                break;
+        #endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
 
         /* Any other packet type is invalid. */
         default:
@@ -1351,10 +1446,20 @@ static MQTTStatus_t processPublishFlags( uint8_t publishFlags,
 
             status = MQTTBadResponse;
         }
-        else
-        {
-            pPublishInfo->qos = MQTTQoS2;
-        }
+
+        #if ( MQTT_ENABLE_QOS2 == 0 )
+            else
+            {
+                LogError( ( "QoS 2 PUBLISH received but QoS 2 is disabled by MQTT_ENABLE_QOS2." ) );
+
+                status = MQTTBadResponse;
+            }
+        #else
+            else
+            {
+                pPublishInfo->qos = MQTTQoS2;
+            }
+        #endif
     }
     /* Check for QoS 1. */
     else if( UINT8_CHECK_BIT( publishFlags, MQTT_PUBLISH_FLAG_QOS1 ) )
@@ -1387,6 +1492,8 @@ static MQTTStatus_t processPublishFlags( uint8_t publishFlags,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 static void logConnackResponse( uint8_t responseCode )
 {
     /* Log an error based on the CONNACK response code. */
@@ -1490,44 +1597,60 @@ static void logConnackResponse( uint8_t responseCode )
     }
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static inline MQTTStatus_t isValidConnackReasonCode( uint8_t reasonCode )
 {
     MQTTStatus_t status;
 
-    switch( reasonCode )
-    {
-        case ( uint8_t ) MQTT_REASON_CONNACK_SUCCESS:
-        case ( uint8_t ) MQTT_REASON_CONNACK_UNSPECIFIED_ERROR:
-        case ( uint8_t ) MQTT_REASON_CONNACK_MALFORMED_PACKET:
-        case ( uint8_t ) MQTT_REASON_CONNACK_PROTOCOL_ERROR:
-        case ( uint8_t ) MQTT_REASON_CONNACK_IMPLEMENTATION_SPECIFIC_ERROR:
-        case ( uint8_t ) MQTT_REASON_CONNACK_UNSUPPORTED_PROTOCOL_VERSION:
-        case ( uint8_t ) MQTT_REASON_CONNACK_CLIENT_IDENTIFIER_NOT_VALID:
-        case ( uint8_t ) MQTT_REASON_CONNACK_BAD_USER_NAME_OR_PASSWORD:
-        case ( uint8_t ) MQTT_REASON_CONNACK_NOT_AUTHORIZED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_UNAVAILABLE:
-        case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_BUSY:
-        case ( uint8_t ) MQTT_REASON_CONNACK_BANNED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_BAD_AUTHENTICATION_METHOD:
-        case ( uint8_t ) MQTT_REASON_CONNACK_TOPIC_NAME_INVALID:
-        case ( uint8_t ) MQTT_REASON_CONNACK_PACKET_TOO_LARGE:
-        case ( uint8_t ) MQTT_REASON_CONNACK_QUOTA_EXCEEDED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_PAYLOAD_FORMAT_INVALID:
-        case ( uint8_t ) MQTT_REASON_CONNACK_RETAIN_NOT_SUPPORTED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_QOS_NOT_SUPPORTED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_USE_ANOTHER_SERVER:
-        case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_MOVED:
-        case ( uint8_t ) MQTT_REASON_CONNACK_CONNECTION_RATE_EXCEEDED:
-            status = MQTTSuccess;
-            break;
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
 
-        default:
-            LogError( ( "Invalid reason code received." ) );
+        /* MQTT 3.1.1 defines the return codes 0 (accepted) to 5 (not authorized). */
+        if( reasonCode > MQTT_CONNACK_MAX_RETURN_CODE )
+        {
+            LogError( ( "Invalid return code received." ) );
             status = MQTTBadResponse;
-            break;
-    }
+        }
+        else
+        {
+            status = MQTTSuccess;
+        }
+    #else
+        switch( reasonCode )
+        {
+            case ( uint8_t ) MQTT_REASON_CONNACK_SUCCESS:
+            case ( uint8_t ) MQTT_REASON_CONNACK_UNSPECIFIED_ERROR:
+            case ( uint8_t ) MQTT_REASON_CONNACK_MALFORMED_PACKET:
+            case ( uint8_t ) MQTT_REASON_CONNACK_PROTOCOL_ERROR:
+            case ( uint8_t ) MQTT_REASON_CONNACK_IMPLEMENTATION_SPECIFIC_ERROR:
+            case ( uint8_t ) MQTT_REASON_CONNACK_UNSUPPORTED_PROTOCOL_VERSION:
+            case ( uint8_t ) MQTT_REASON_CONNACK_CLIENT_IDENTIFIER_NOT_VALID:
+            case ( uint8_t ) MQTT_REASON_CONNACK_BAD_USER_NAME_OR_PASSWORD:
+            case ( uint8_t ) MQTT_REASON_CONNACK_NOT_AUTHORIZED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_UNAVAILABLE:
+            case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_BUSY:
+            case ( uint8_t ) MQTT_REASON_CONNACK_BANNED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_BAD_AUTHENTICATION_METHOD:
+            case ( uint8_t ) MQTT_REASON_CONNACK_TOPIC_NAME_INVALID:
+            case ( uint8_t ) MQTT_REASON_CONNACK_PACKET_TOO_LARGE:
+            case ( uint8_t ) MQTT_REASON_CONNACK_QUOTA_EXCEEDED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_PAYLOAD_FORMAT_INVALID:
+            case ( uint8_t ) MQTT_REASON_CONNACK_RETAIN_NOT_SUPPORTED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_QOS_NOT_SUPPORTED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_USE_ANOTHER_SERVER:
+            case ( uint8_t ) MQTT_REASON_CONNACK_SERVER_MOVED:
+            case ( uint8_t ) MQTT_REASON_CONNACK_CONNECTION_RATE_EXCEEDED:
+                status = MQTTSuccess;
+                break;
+
+            default:
+                LogError( ( "Invalid reason code received." ) );
+                status = MQTTBadResponse;
+                break;
+        }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
     return status;
 }
@@ -1546,17 +1669,30 @@ static MQTTStatus_t validateConnackParams( const MQTTPacketInfo_t * pIncomingPac
     assert( pIncomingPacket->pRemainingData != NULL );
     assert( pIncomingPacket->type == MQTT_PACKET_TYPE_CONNACK );
 
-    /* Remaining Length of the CONNACK cannot be less than 3.
-     * 1 byte for each of the following:
-     * - Connect Acknowledge Flags
-     * - Connect Reason Code
-     * - Properties (0x00) indicating no trailing properties. */
-    if( pIncomingPacket->remainingLength < MQTT_PACKET_CONNACK_MINIMUM_SIZE )
-    {
-        LogError( ( "Incomplete Connack received" ) );
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
 
-        status = MQTTBadResponse;
-    }
+        /* Remaining Length of an MQTT 3.1.1 CONNACK is always 2: the Connect
+         * Acknowledge Flags and the Connect Return Code. */
+        if( pIncomingPacket->remainingLength != MQTT_PACKET_SIMPLE_ACK_REMAINING_LENGTH )
+        {
+            LogError( ( "CONNACK does not have remaining length of 2." ) );
+
+            status = MQTTBadResponse;
+        }
+    #else
+
+        /* Remaining Length of the CONNACK cannot be less than 3.
+         * 1 byte for each of the following:
+         * - Connect Acknowledge Flags
+         * - Connect Reason Code
+         * - Properties (0x00) indicating no trailing properties. */
+        if( pIncomingPacket->remainingLength < MQTT_PACKET_CONNACK_MINIMUM_SIZE )
+        {
+            LogError( ( "Incomplete Connack received" ) );
+
+            status = MQTTBadResponse;
+        }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
     if( status == MQTTSuccess )
     {
@@ -1610,7 +1746,11 @@ static MQTTStatus_t validateConnackParams( const MQTTPacketInfo_t * pIncomingPac
                 status = MQTTServerRefused;
             }
 
-            logConnackResponse( reasonCode );
+            #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+                LogDebug( ( "CONNACK return code %u.", ( unsigned int ) reasonCode ) );
+            #else
+                logConnackResponse( reasonCode );
+            #endif
         }
     }
 
@@ -1625,50 +1765,60 @@ static MQTTStatus_t deserializeConnack( MQTTConnectionProperties_t * pConnackPro
                                         MQTTPropBuilder_t * pPropBuffer )
 {
     MQTTStatus_t status = MQTTSuccess;
-    uint32_t propertyLength = 0U;
-    uint8_t * pVariableHeader = NULL;
-    MQTTStatus_t statusCopy = MQTTSuccess;
+
+    #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        uint32_t propertyLength = 0U;
+        uint8_t * pVariableHeader = NULL;
+        MQTTStatus_t statusCopy = MQTTSuccess;
+    #endif
 
     /* Validate the arguments. */
     status = validateConnackParams( pIncomingPacket, pSessionPresent );
 
-    if( status == MQTTServerRefused )
-    {
-        statusCopy = status;
-    }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        /* An MQTT 3.1.1 CONNACK has no properties, so the defaults set by
+         * MQTT_InitConnect are kept. */
+        ( void ) pConnackProperties;
+        ( void ) pPropBuffer;
+    #else
+        if( status == MQTTServerRefused )
+        {
+            statusCopy = status;
+        }
 
-    if( ( status == MQTTSuccess ) || ( status == MQTTServerRefused ) )
-    {
-        pVariableHeader = pIncomingPacket->pRemainingData;
+        if( ( status == MQTTSuccess ) || ( status == MQTTServerRefused ) )
+        {
+            pVariableHeader = pIncomingPacket->pRemainingData;
 
-        /* Skip over flags and reason code. */
-        pVariableHeader = &pVariableHeader[ 2U ];
+            /* Skip over flags and reason code. */
+            pVariableHeader = &pVariableHeader[ 2U ];
 
-        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
-        /* coverity[misra_c_2012_rule_10_8_violation] */
-        status = decodeVariableLength( pVariableHeader, ( size_t ) ( pIncomingPacket->remainingLength - 2U ), &propertyLength );
-    }
+            /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+            /* coverity[misra_c_2012_rule_10_8_violation] */
+            status = decodeVariableLength( pVariableHeader, ( size_t ) ( pIncomingPacket->remainingLength - 2U ), &propertyLength );
+        }
 
-    /* Validate the packet size if max packet size is set. */
-    if( status == MQTTSuccess )
-    {
-        /* Validate the remaining length. */
-        if( ( pIncomingPacket->remainingLength ) != ( 2U + propertyLength + variableLengthEncodedSize( propertyLength ) ) )
+        /* Validate the packet size if max packet size is set. */
+        if( status == MQTTSuccess )
         {
-            LogError( ( "Invalid Remaining Length" ) );
-            status = MQTTBadResponse;
+            /* Validate the remaining length. */
+            if( ( pIncomingPacket->remainingLength ) != ( 2U + propertyLength + variableLengthEncodedSize( propertyLength ) ) )
+            {
+                LogError( ( "Invalid Remaining Length" ) );
+                status = MQTTBadResponse;
+            }
+            /* Deserialize the connack properties. */
+            else
+            {
+                status = deserializeConnackProperties( pConnackProperties, propertyLength, pVariableHeader, pPropBuffer );
+            }
         }
-        /* Deserialize the connack properties. */
-        else
+
+        if( status == MQTTSuccess )
         {
-            status = deserializeConnackProperties( pConnackProperties, propertyLength, pVariableHeader, pPropBuffer );
+            status = statusCopy;
         }
-    }
-
-    if( status == MQTTSuccess )
-    {
-        status = statusCopy;
-    }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
     return status;
 }
@@ -1697,7 +1847,15 @@ static MQTTStatus_t calculateSubscriptionPacketSize( const MQTTSubscribeInfo_t *
     packetSize += 2U;
 
     packetSize += subscribePropLen;
-    packetSize += variableLengthEncodedSize( subscribePropLen );
+    packetSize += MQTT_PROPERTY_LENGTH_SIZE( subscribePropLen );
+
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        if( subscribePropLen != 0U )
+        {
+            LogError( ( "MQTT 3.1.1 SUBSCRIBE and UNSUBSCRIBE packets cannot carry properties." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
 
     for( i = 0; i < subscriptionCount; i++ )
     {
@@ -1863,9 +2021,12 @@ static MQTTStatus_t deserializeSubUnsubAck( const MQTTPacketInfo_t * incomingPac
     MQTTStatus_t status = MQTTSuccess;
     uint8_t * pIndex = NULL;
     uint32_t remainingLength = 0U;
-    size_t statusTotalBytes = 0U;
-    const uint8_t * pStatusStart;
-    size_t propertyLength = 0U;
+
+    #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        size_t statusTotalBytes = 0U;
+        const uint8_t * pStatusStart;
+        size_t propertyLength = 0U;
+    #endif
 
     /* Validate input parameters using assert. */
     assert( incomingPacket != NULL );
@@ -1881,11 +2042,24 @@ static MQTTStatus_t deserializeSubUnsubAck( const MQTTPacketInfo_t * incomingPac
         status = MQTTBadParameter;
     }
 
-    if( incomingPacket->remainingLength < 4U )
-    {
-        LogError( ( "Suback Packet Cannot have a remaining Length of less than 4." ) );
-        status = MQTTBadResponse;
-    }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+
+        /* An MQTT 3.1.1 SUBACK has at least one return code after the packet
+         * identifier, and an UNSUBACK has nothing after it. */
+        if( ( ( incomingPacket->type == MQTT_PACKET_TYPE_SUBACK ) && ( remainingLength < 3U ) ) ||
+            ( ( incomingPacket->type == MQTT_PACKET_TYPE_UNSUBACK ) && ( remainingLength != 2U ) ) )
+        {
+            LogError( ( "Invalid remaining length %lu for SUB/UNSUB ack packet.",
+                        ( unsigned long ) remainingLength ) );
+            status = MQTTBadResponse;
+        }
+    #else
+        if( incomingPacket->remainingLength < 4U )
+        {
+            LogError( ( "Suback Packet Cannot have a remaining Length of less than 4." ) );
+            status = MQTTBadResponse;
+        }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
     else
     {
         *pPacketId = UINT16_DECODE( pIndex );
@@ -1900,29 +2074,39 @@ static MQTTStatus_t deserializeSubUnsubAck( const MQTTPacketInfo_t * incomingPac
         }
     }
 
-    if( ( status == MQTTSuccess ) && ( incomingPacket->remainingLength >= 4U ) )
-    {
-        status = deserializeSubUnsubAckProperties( pPropBuffer,
-                                                   pIndex,
-                                                   &propertyLength,
-                                                   incomingPacket->remainingLength );
-    }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        ( void ) pPropBuffer;
 
-    if( status == MQTTSuccess )
-    {
-        uint32_t propertyLengthU32 = ( uint32_t ) propertyLength;
-        /* Total number of bytes used by the properties - the encoded length + the actual properties. */
-        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
-        /* coverity[misra_c_2012_rule_10_8_violation] */
-        size_t totalPropertiesLength = ( size_t ) ( propertyLengthU32 + variableLengthEncodedSize( propertyLengthU32 ) );
+        if( status == MQTTSuccess )
+        {
+            /* Return codes start just after the packet identifier. */
+            status = readSubackStatus( ( size_t ) remainingLength - sizeof( uint16_t ), pIndex, pReasonCodes );
+        }
+    #else
+        if( ( status == MQTTSuccess ) && ( incomingPacket->remainingLength >= 4U ) )
+        {
+            status = deserializeSubUnsubAckProperties( pPropBuffer,
+                                                       pIndex,
+                                                       &propertyLength,
+                                                       incomingPacket->remainingLength );
+        }
 
-        /* Total bytes of status codes = length - packet ID - properties total length. */
-        statusTotalBytes = remainingLength - sizeof( uint16_t ) - totalPropertiesLength;
+        if( status == MQTTSuccess )
+        {
+            uint32_t propertyLengthU32 = ( uint32_t ) propertyLength;
+            /* Total number of bytes used by the properties - the encoded length + the actual properties. */
+            /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+            /* coverity[misra_c_2012_rule_10_8_violation] */
+            size_t totalPropertiesLength = ( size_t ) ( propertyLengthU32 + variableLengthEncodedSize( propertyLengthU32 ) );
 
-        /* Status codes start just after the properties. */
-        pStatusStart = &pIndex[ totalPropertiesLength ];
-        status = readSubackStatus( statusTotalBytes, pStatusStart, pReasonCodes );
-    }
+            /* Total bytes of status codes = length - packet ID - properties total length. */
+            statusTotalBytes = remainingLength - sizeof( uint16_t ) - totalPropertiesLength;
+
+            /* Status codes start just after the properties. */
+            pStatusStart = &pIndex[ totalPropertiesLength ];
+            status = readSubackStatus( statusTotalBytes, pStatusStart, pReasonCodes );
+        }
+    #endif /* if ( MQTT_VERSION_3_1_1_ONLY != 0 ) */
 
     return status;
 }
@@ -2061,7 +2245,7 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
          * identifier in addition to the topic name length and topic name. */
         status = checkPublishRemainingLength( pIncomingPacket->remainingLength,
                                               pPublishInfo->qos,
-                                              4U );
+                                              3U + MQTT_EMPTY_PROPERTY_LENGTH_SIZE );
     }
 
     if( status == MQTTSuccess )
@@ -2075,11 +2259,11 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
          * length must be at least as large as the variable length header:
          *   2 bytes to encode the Topic Length +
          *   length of the topic string +
-         *   1 byte for the property length (when 0 properties).
+         *   1 byte for the property length (when 0 properties, none in MQTT 3.1.1).
          */
         status = checkPublishRemainingLength( pIncomingPacket->remainingLength,
                                               pPublishInfo->qos,
-                                              2U + ( uint32_t ) pPublishInfo->topicNameLength + 1U );
+                                              2U + ( uint32_t ) pPublishInfo->topicNameLength + MQTT_EMPTY_PROPERTY_LENGTH_SIZE );
     }
 
     if( status == MQTTSuccess )
@@ -2114,14 +2298,21 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
         }
     }
 
-    if( status == MQTTSuccess )
-    {
-        status = deserializePublishProperties( pPublishInfo,
-                                               pPropBuffer,
-                                               pIndex,
-                                               topicAliasMax,
-                                               pIncomingPacket->remainingLength );
-    }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        /* An MQTT 3.1.1 PUBLISH has no properties. */
+        ( void ) pPropBuffer;
+        ( void ) topicAliasMax;
+        pPublishInfo->propertyLength = 0U;
+    #else
+        if( status == MQTTSuccess )
+        {
+            status = deserializePublishProperties( pPublishInfo,
+                                                   pPropBuffer,
+                                                   pIndex,
+                                                   topicAliasMax,
+                                                   pIncomingPacket->remainingLength );
+        }
+    #endif
 
     if( status == MQTTSuccess )
     {
@@ -2129,9 +2320,9 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
          * a packet identifier, but QoS 0 PUBLISH packets do not. */
         uint32_t payloadLengthU32 = pIncomingPacket->remainingLength -
                                     ( ( ( uint32_t ) pPublishInfo->topicNameLength ) + 2U ) -
-                                    ( ( ( uint32_t ) pPublishInfo->propertyLength ) + variableLengthEncodedSize( ( uint32_t ) pPublishInfo->propertyLength ) );
+                                    ( ( ( uint32_t ) pPublishInfo->propertyLength ) + MQTT_PROPERTY_LENGTH_SIZE( ( uint32_t ) pPublishInfo->propertyLength ) );
 
-        pIndex = &pIndex[ ( size_t ) variableLengthEncodedSize( ( uint32_t ) pPublishInfo->propertyLength ) ];
+        pIndex = &pIndex[ ( size_t ) MQTT_PROPERTY_LENGTH_SIZE( ( uint32_t ) pPublishInfo->propertyLength ) ];
         pIndex = &pIndex[ pPublishInfo->propertyLength ];
 
         if( CHECK_U32T_OVERFLOWS_SIZE_T( payloadLengthU32 ) )
@@ -2186,6 +2377,8 @@ static MQTTStatus_t deserializePingresp( const MQTTPacketInfo_t * pPingresp )
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 static void setConnackPropBit( MQTTPropBuilder_t * pPropBuffer,
                                uint8_t bitPos )
 {
@@ -2522,6 +2715,8 @@ static MQTTStatus_t deserializeConnackProperties( MQTTConnectionProperties_t * p
     return status;
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t logAckResponse( MQTTSuccessFailReasonCode_t reasonCode,
@@ -2590,6 +2785,8 @@ static MQTTStatus_t logAckResponse( MQTTSuccessFailReasonCode_t reasonCode,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 static MQTTStatus_t deserializeSubUnsubAckProperties( MQTTPropBuilder_t * pPropBuffer,
                                                       uint8_t * pIndex,
                                                       size_t * pSubackPropertyLength,
@@ -2692,6 +2889,8 @@ static MQTTStatus_t deserializeSubUnsubAckProperties( MQTTPropBuilder_t * pPropB
     return status;
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
@@ -2738,7 +2937,7 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
     }
 
     /* Write the properties length into the CONNECT packet. */
-    pIndex = encodeVariableLength( pIndex, connectPropertyLength );
+    pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, connectPropertyLength );
 
     if( connectPropertyLength > 0U )
     {
@@ -2751,25 +2950,30 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
                            pConnectInfo->pClientIdentifier,
                            ( uint16_t ) pConnectInfo->clientIdentifierLength );
 
-    /* Write the will topic name and message into the CONNECT packet if provided. */
-    if( pWillInfo != NULL )
-    {
-        pIndex = encodeVariableLength( pIndex, willPropertyLength );
-
-        if( willPropertyLength > 0U )
+    #if ( MQTT_ENABLE_WILL != 0 )
+        /* Write the will topic name and message into the CONNECT packet if provided. */
+        if( pWillInfo != NULL )
         {
-            ( void ) memcpy( ( void * ) pIndex, ( const void * ) pWillProperties->pBuffer, willPropertyLength );
-            pIndex = &pIndex[ ( size_t ) willPropertyLength ];
-        }
+            pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, willPropertyLength );
+
+            if( willPropertyLength > 0U )
+            {
+                ( void ) memcpy( ( void * ) pIndex, ( const void * ) pWillProperties->pBuffer, willPropertyLength );
+                pIndex = &pIndex[ ( size_t ) willPropertyLength ];
+            }
 
-        pIndex = encodeString( pIndex,
-                               pWillInfo->pTopicName,
-                               ( uint16_t ) pWillInfo->topicNameLength );
+            pIndex = encodeString( pIndex,
+                                   pWillInfo->pTopicName,
+                                   ( uint16_t ) pWillInfo->topicNameLength );
 
-        pIndex = encodeString( pIndex,
-                               pWillInfo->pPayload,
-                               ( uint16_t ) pWillInfo->payloadLength );
-    }
+            pIndex = encodeString( pIndex,
+                                   pWillInfo->pPayload,
+                                   ( uint16_t ) pWillInfo->payloadLength );
+        }
+    #else
+        ( void ) willPropertyLength;
+        ( void ) pWillProperties;
+    #endif
 
     /* Encode the user name if provided. */
     if( pConnectInfo->pUserName != NULL )
@@ -2793,6 +2997,8 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishInfo,
                                                   MQTTPropBuilder_t * pPropBuffer,
                                                   uint8_t * pIndex,
@@ -2997,6 +3203,8 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
     return status;
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 MQTTStatus_t updateContextWithConnectProps( const MQTTPropBuilder_t * pPropBuilder,
@@ -3158,6 +3366,14 @@ MQTTStatus_t MQTT_GetConnectPacketSize( const MQTTConnectInfo_t * pConnectInfo,
         LogError( ( "Password length must be less than 65536 according to MQTT spec." ) );
         status = MQTTBadParameter;
     }
+
+    #if ( MQTT_ENABLE_WILL == 0 )
+        else if( pWillInfo != NULL )
+        {
+            LogError( ( "Will messages are disabled by MQTT_ENABLE_WILL." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
     else if( ( pWillInfo != NULL ) && CHECK_SIZE_T_OVERFLOWS_16BIT( pWillInfo->payloadLength ) )
     {
         /* The MQTTPublishInfo_t is reused for the will message. The payload
@@ -3213,6 +3429,14 @@ MQTTStatus_t MQTT_GetConnectPacketSize( const MQTTConnectInfo_t * pConnectInfo,
         }
     }
 
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        if( ( status == MQTTSuccess ) && ( ( propertyLength != 0U ) || ( willPropertyLength != 0U ) ) )
+        {
+            LogError( ( "MQTT 3.1.1 CONNECT packets cannot carry properties." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
+
     if( status == MQTTSuccess )
     {
         /* Since property length, client ID length, will property length, will topic name length
@@ -3230,19 +3454,23 @@ MQTTStatus_t MQTT_GetConnectPacketSize( const MQTTConnectInfo_t * pConnectInfo,
 
         /* Add the length of the properties. */
         connectPacketSize += propertyLength;
-        connectPacketSize += variableLengthEncodedSize( propertyLength );
+        connectPacketSize += MQTT_PROPERTY_LENGTH_SIZE( propertyLength );
 
         /* Add the length of the client identifier. */
         connectPacketSize += ( uint32_t ) ( pConnectInfo->clientIdentifierLength + sizeof( uint16_t ) );
 
-        /* Add the lengths of the will message, topic name and properties if provided. */
-        if( pWillInfo != NULL )
-        {
-            connectPacketSize += willPropertyLength;
-            connectPacketSize += variableLengthEncodedSize( willPropertyLength );
-            connectPacketSize += ( uint32_t ) ( pWillInfo->topicNameLength + sizeof( uint16_t ) +
-                                                pWillInfo->payloadLength + sizeof( uint16_t ) );
-        }
+        #if ( MQTT_ENABLE_WILL != 0 )
+            /* Add the lengths of the will message, topic name and properties if provided. */
+            if( pWillInfo != NULL )
+            {
+                connectPacketSize += willPropertyLength;
+                connectPacketSize += MQTT_PROPERTY_LENGTH_SIZE( willPropertyLength );
+                connectPacketSize += ( uint32_t ) ( pWillInfo->topicNameLength + sizeof( uint16_t ) +
+                                                    pWillInfo->payloadLength + sizeof( uint16_t ) );
+            }
+        #else
+            ( void ) willPropertyLength;
+        #endif
 
         /* Add the lengths of the user name and password if provided. */
         if( pConnectInfo->pUserName != NULL )
@@ -3287,6 +3515,8 @@ MQTTStatus_t MQTT_GetConnectPacketSize( const MQTTConnectInfo_t * pConnectInfo,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
 static MQTTStatus_t decodePubAckProperties( MQTTPropBuilder_t * pPropBuffer,
                                             uint8_t * pIndex,
                                             uint32_t remainingLength )
@@ -3365,6 +3595,8 @@ static MQTTStatus_t decodePubAckProperties( MQTTPropBuilder_t * pPropBuffer,
     return status;
 }
 
+#endif /* if ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t validateDisconnectResponse( MQTTSuccessFailReasonCode_t reasonCode,
@@ -3442,20 +3674,52 @@ static MQTTStatus_t validateDisconnectResponse( MQTTSuccessFailReasonCode_t reas
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_SerializeConnect( const MQTTConnectInfo_t * pConnectInfo,
-                                    const MQTTPublishInfo_t * pWillInfo,
-                                    const MQTTPropBuilder_t * pConnectProperties,
-                                    const MQTTPropBuilder_t * pWillProperties,
-                                    uint32_t remainingLength,
-                                    const MQTTFixedBuffer_t * pFixedBuffer )
+static MQTTStatus_t validateAuthResponse( MQTTSuccessFailReasonCode_t reasonCode,
+                                          bool incoming )
 {
-    MQTTStatus_t status = MQTTSuccess;
-    uint32_t connectPacketSize = 0;
+    MQTTStatus_t status;
 
-    /* Validate arguments. */
-    if( ( pConnectInfo == NULL ) || ( pFixedBuffer == NULL ) )
+    /* Only the server reports success and only the client starts a
+     * re-authentication. Both sides may continue an exchange. */
+    /* coverity[misra_c_2012_rule_10_5_violation] */
+    switch( reasonCode )
     {
-        LogError( ( "Argument cannot be NULL: pConnectInfo=%p, "
+        case MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION:
+            status = MQTTSuccess;
+            break;
+
+        case MQTT_REASON_AUTH_SUCCESS:
+            status = ( incoming == true ) ? MQTTSuccess : MQTTBadParameter;
+            break;
+
+        case MQTT_REASON_AUTH_RE_AUTHENTICATE:
+            status = ( incoming == true ) ? MQTTBadResponse : MQTTSuccess;
+            break;
+
+        default:
+            status = ( incoming == true ) ? MQTTBadResponse : MQTTBadParameter;
+            break;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_SerializeConnect( const MQTTConnectInfo_t * pConnectInfo,
+                                    const MQTTPublishInfo_t * pWillInfo,
+                                    const MQTTPropBuilder_t * pConnectProperties,
+                                    const MQTTPropBuilder_t * pWillProperties,
+                                    uint32_t remainingLength,
+                                    const MQTTFixedBuffer_t * pFixedBuffer )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t connectPacketSize = 0;
+
+    /* Validate arguments. */
+    if( ( pConnectInfo == NULL ) || ( pFixedBuffer == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pConnectInfo=%p, "
                     "pFixedBuffer=%p.",
                     ( const void * ) pConnectInfo,
                     ( const void * ) pFixedBuffer ) );
@@ -3467,6 +3731,14 @@ MQTTStatus_t MQTT_SerializeConnect( const MQTTConnectInfo_t * pConnectInfo,
         LogError( ( "Argument cannot be NULL: pFixedBuffer->pBuffer is NULL." ) );
         status = MQTTBadParameter;
     }
+
+    #if ( MQTT_ENABLE_WILL == 0 )
+        else if( pWillInfo != NULL )
+        {
+            LogError( ( "Will messages are disabled by MQTT_ENABLE_WILL." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
     else if( ( pWillInfo != NULL ) && ( pWillInfo->pTopicName == NULL ) )
     {
         LogError( ( "pWillInfo->pTopicName cannot be NULL if Will is present." ) );
@@ -3630,7 +3902,7 @@ MQTTStatus_t MQTT_SerializeSubscribe( const MQTTSubscribeInfo_t * pSubscriptionL
                                            pIndex,
                                            packetId );
         /* Serialize properties. */
-        pIndex = encodeVariableLength( pIndex, propertyLength );
+        pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, propertyLength );
 
         if( propertyLength > 0U )
         {
@@ -3710,6 +3982,8 @@ MQTTStatus_t MQTT_SerializeSubscribe( const MQTTSubscribeInfo_t * pSubscriptionL
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 MQTTStatus_t MQTT_GetUnsubscribePacketSize( const MQTTSubscribeInfo_t * pSubscriptionList,
                                             size_t subscriptionCount,
                                             const MQTTPropBuilder_t * pUnsubscribeProperties,
@@ -3776,6 +4050,8 @@ MQTTStatus_t MQTT_GetUnsubscribePacketSize( const MQTTSubscribeInfo_t * pSubscri
     return status;
 }
 
+#endif
+
 /*-----------------------------------------------------------*/
 
 MQTTStatus_t MQTT_ValidateUnsubscribeProperties( const MQTTPropBuilder_t * pPropertyBuilder )
@@ -3834,6 +4110,8 @@ MQTTStatus_t MQTT_ValidateUnsubscribeProperties( const MQTTPropBuilder_t * pProp
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 MQTTStatus_t MQTT_SerializeUnsubscribe( const MQTTSubscribeInfo_t * pSubscriptionList,
                                         size_t subscriptionCount,
                                         const MQTTPropBuilder_t * pUnsubscribeProperties,
@@ -3878,7 +4156,7 @@ MQTTStatus_t MQTT_SerializeUnsubscribe( const MQTTSubscribeInfo_t * pSubscriptio
         pIndex = serializeUnsubscribeHeader( remainingLength, pIndex, packetId );
 
         /* Serialize the properties. */
-        pIndex = encodeVariableLength( pIndex, propertyLength );
+        pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, propertyLength );
 
         if( propertyLength > 0U )
         {
@@ -3901,6 +4179,8 @@ MQTTStatus_t MQTT_SerializeUnsubscribe( const MQTTSubscribeInfo_t * pSubscriptio
     return status;
 }
 
+#endif
+
 /*-----------------------------------------------------------*/
 
 MQTTStatus_t MQTT_GetPublishPacketSize( const MQTTPublishInfo_t * pPublishInfo,
@@ -4310,6 +4590,14 @@ MQTTStatus_t MQTT_SerializeAck( const MQTTFixedBuffer_t * pFixedBuffer,
         LogError( ( "A reason code must be provided if there are properties." ) );
         status = MQTTBadParameter;
     }
+
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        else if( pReasonCode != NULL )
+        {
+            LogError( ( "MQTT 3.1.1 ACK packets cannot carry a reason code." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
     else if( ( pReasonCode != NULL ) && ( validateReasonCodeForAck( packetType, *pReasonCode ) != MQTTSuccess ) )
     {
         LogError( ( "Invalid reason code for the ACK type." ) );
@@ -4377,6 +4665,14 @@ MQTTStatus_t MQTT_GetDisconnectPacketSize( const MQTTPropBuilder_t * pDisconnect
         LogError( ( "Max packet size cannot be zero." ) );
         status = MQTTBadParameter;
     }
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        else if( ( pReasonCode != NULL ) ||
+                 ( ( pDisconnectProperties != NULL ) && ( pDisconnectProperties->currentIndex != 0U ) ) )
+        {
+            LogError( ( "MQTT 3.1.1 DISCONNECT packets cannot carry a reason code or properties." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
     else if( ( pReasonCode != NULL ) && ( validateDisconnectResponse( *pReasonCode, false ) != MQTTSuccess ) )
     {
         LogError( ( "Invalid reason code." ) );
@@ -4420,9 +4716,9 @@ MQTTStatus_t MQTT_GetDisconnectPacketSize( const MQTTPropBuilder_t * pDisconnect
              *
              * Must be less than the maximum allowed remaining length.
              */
-            if( ( propertyLength + variableLengthEncodedSize( propertyLength ) + length ) < MQTT_MAX_REMAINING_LENGTH )
+            if( ( propertyLength + MQTT_PROPERTY_LENGTH_SIZE( propertyLength ) + length ) < MQTT_MAX_REMAINING_LENGTH )
             {
-                length += variableLengthEncodedSize( propertyLength ) + propertyLength;
+                length += MQTT_PROPERTY_LENGTH_SIZE( propertyLength ) + propertyLength;
                 *pRemainingLength = length;
             }
             else
@@ -4530,7 +4826,7 @@ MQTTStatus_t MQTT_SerializeDisconnect( const MQTTPropBuilder_t * pDisconnectProp
                                            pReasonCode,
                                            remainingLength );
 
-        pIndex = encodeVariableLength( pIndex, propertyLength );
+        pIndex = MQTT_ENCODE_PROPERTY_LENGTH( pIndex, propertyLength );
 
         if( propertyLength > 0U )
         {
@@ -4544,6 +4840,170 @@ MQTTStatus_t MQTT_SerializeDisconnect( const MQTTPropBuilder_t * pDisconnectProp
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_GetAuthPacketSize( const MQTTPropBuilder_t * pAuthProperties,
+                                     uint32_t * pRemainingLength,
+                                     uint32_t * pPacketSize,
+                                     uint32_t maxPacketSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t length = 0U;
+    uint32_t packetSize = 0U;
+    uint32_t propertyLength = 0U;
+
+    /* Validate the arguments. */
+    if( ( pRemainingLength == NULL ) || ( pPacketSize == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL:"
+                    "pRemainingLength=%p, pPacketSize=%p.",
+                    ( void * ) pRemainingLength,
+                    ( void * ) pPacketSize ) );
+        status = MQTTBadParameter;
+    }
+    else if( maxPacketSize == 0U )
+    {
+        LogError( ( "Max packet size cannot be zero." ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pAuthProperties != NULL ) && ( pAuthProperties->pBuffer != NULL ) )
+    {
+        if( CHECK_SIZE_T_OVERFLOWS_32BIT( pAuthProperties->currentIndex ) ||
+            ( pAuthProperties->currentIndex > MQTT_MAX_REMAINING_LENGTH ) )
+        {
+            LogError( ( "AUTH properties must be less than 268435456 "
+                        "to be able to fit in a MQTT packet." ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            propertyLength = ( uint32_t ) pAuthProperties->currentIndex;
+        }
+    }
+    else
+    {
+        /* No properties. */
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* The remaining length is the sum of:
+         * Reason code +
+         * Bytes required to encode the properties +
+         * Actual properties. */
+        if( ( propertyLength + variableLengthEncodedSize( propertyLength ) + 1U ) < MQTT_MAX_REMAINING_LENGTH )
+        {
+            length = 1U + variableLengthEncodedSize( propertyLength ) + propertyLength;
+            *pRemainingLength = length;
+        }
+        else
+        {
+            LogError( ( "The properties + reason code cannot fit in MQTT_MAX_REMAINING_LENGTH bytes." ) );
+            status = MQTTBadParameter;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* MQTT AUTH header byte +
+         * Bytes required to encode the remaining length +
+         * The remaining length. */
+        packetSize = 1U + variableLengthEncodedSize( length ) + length;
+
+        if( packetSize > maxPacketSize )
+        {
+            LogError( ( "Packet Size greater than Max Packet Size specified in the CONNACK" ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            *pPacketSize = packetSize;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_SerializeAuth( const MQTTPropBuilder_t * pAuthProperties,
+                                 MQTTSuccessFailReasonCode_t reasonCode,
+                                 uint32_t remainingLength,
+                                 const MQTTFixedBuffer_t * pFixedBuffer )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint8_t * pIndex = NULL;
+    uint32_t packetSize = 0U;
+    uint32_t propertyLength = 0U;
+
+    if( ( pAuthProperties != NULL ) && ( pAuthProperties->pBuffer != NULL ) )
+    {
+        if( CHECK_SIZE_T_OVERFLOWS_32BIT( pAuthProperties->currentIndex ) ||
+            ( pAuthProperties->currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) )
+        {
+            LogError( ( "AUTH properties cannot have a length more than 268435455." ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            propertyLength = ( uint32_t ) pAuthProperties->currentIndex;
+        }
+    }
+
+    /* Validate arguments. */
+    if( status != MQTTSuccess )
+    {
+        /* The properties are invalid. */
+    }
+    else if( ( pFixedBuffer == NULL ) || ( pFixedBuffer->pBuffer == NULL ) )
+    {
+        LogError( ( "pFixedBuffer and pFixedBuffer->pBuffer cannot be NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( validateAuthResponse( reasonCode, false ) != MQTTSuccess )
+    {
+        LogError( ( "Invalid AUTH reason code %u.", ( unsigned int ) reasonCode ) );
+        status = MQTTBadParameter;
+    }
+    else if( remainingLength != ( 1U + variableLengthEncodedSize( propertyLength ) + propertyLength ) )
+    {
+        LogError( ( "Remaining length does not match the AUTH properties." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Length of serialized packet = First byte
+         *                                + Length of encoded remaining length
+         *                                + Remaining length. */
+        packetSize = 1U + variableLengthEncodedSize( remainingLength ) + remainingLength;
+
+        if( pFixedBuffer->size < packetSize )
+        {
+            LogError( ( "Buffer size of %lu is not sufficient to hold "
+                        "serialized AUTH packet of size of %lu.",
+                        ( unsigned long ) pFixedBuffer->size,
+                        ( unsigned long ) packetSize ) );
+            status = MQTTNoMemory;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        pIndex = serializeAuthFixed( pFixedBuffer->pBuffer,
+                                     reasonCode,
+                                     remainingLength );
+
+        pIndex = encodeVariableLength( pIndex, propertyLength );
+
+        if( propertyLength > 0U )
+        {
+            ( void ) memcpy( ( void * ) pIndex, ( const void * ) pAuthProperties->pBuffer, ( size_t ) propertyLength );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_GetPingreqPacketSize( uint32_t * pPacketSize )
 {
     MQTTStatus_t status = MQTTSuccess;
@@ -4819,7 +5279,9 @@ MQTTStatus_t MQTT_DeserializeAck( const MQTTPacketInfo_t * pIncomingPacket,
                 break;
 
             case MQTT_PACKET_TYPE_SUBACK:
-            case MQTT_PACKET_TYPE_UNSUBACK:
+            #if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+                case MQTT_PACKET_TYPE_UNSUBACK:
+            #endif
                 status = deserializeSubUnsubAck( pIncomingPacket, pPacketId, pReasonCode, pPropBuffer );
                 break;
 
@@ -4935,6 +5397,125 @@ MQTTStatus_t MQTT_UpdateDuplicatePublishFlag( uint8_t * pHeader,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_UpdatePublishMessageExpiry( uint8_t * pPublishPacket,
+                                              size_t packetSize,
+                                              uint32_t messageExpiry )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPropBuilder_t propBuffer = { 0 };
+    uint32_t remainingLength = 0U;
+    uint32_t propertyLength = 0U;
+    size_t index = 0U;
+    size_t packetEnd = 0U;
+    size_t propIndex = 0U;
+    uint8_t propertyId = 0U;
+
+    if( ( pPublishPacket == NULL ) || ( packetSize < 2U ) )
+    {
+        LogError( ( "Invalid parameter: pPublishPacket=%p, packetSize=%lu.",
+                    ( void * ) pPublishPacket,
+                    ( unsigned long ) packetSize ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pPublishPacket[ 0 ] & 0xF0U ) != MQTT_PACKET_TYPE_PUBLISH )
+    {
+        LogError( ( "Packet is not a PUBLISH." ) );
+        status = MQTTBadParameter;
+    }
+    else if( decodeVariableLength( &pPublishPacket[ 1 ], packetSize - 1U, &remainingLength ) != MQTTSuccess )
+    {
+        LogError( ( "PUBLISH has an invalid remaining length." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        index = 1U + variableLengthEncodedSize( remainingLength );
+        packetEnd = index + ( size_t ) remainingLength;
+
+        /* The topic name is followed by a packet ID for QoS 1 and 2. */
+        if( ( packetEnd > packetSize ) || ( ( index + 2U ) > packetEnd ) )
+        {
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            const uint8_t * pTopicLength = &pPublishPacket[ index ];
+
+            index += 2U + ( size_t ) UINT16_DECODE( pTopicLength );
+
+            if( ( pPublishPacket[ 0 ] & 0x06U ) != 0U )
+            {
+                index += 2U;
+            }
+
+            if( ( index >= packetEnd ) ||
+                ( decodeVariableLength( &pPublishPacket[ index ], packetEnd - index, &propertyLength ) != MQTTSuccess ) )
+            {
+                status = MQTTBadParameter;
+            }
+        }
+
+        if( status == MQTTSuccess )
+        {
+            index += variableLengthEncodedSize( propertyLength );
+
+            if( ( ( size_t ) propertyLength ) > ( packetEnd - index ) )
+            {
+                status = MQTTBadParameter;
+            }
+        }
+
+        if( status != MQTTSuccess )
+        {
+            LogError( ( "PUBLISH is malformed." ) );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        propBuffer.pBuffer = &pPublishPacket[ index ];
+        propBuffer.bufferLength = propertyLength;
+        propBuffer.currentIndex = propertyLength;
+
+        status = MQTT_GetNextPropertyType( &propBuffer, &propIndex, &propertyId );
+
+        while( ( status == MQTTSuccess ) && ( propertyId != MQTT_MSG_EXPIRY_ID ) )
+        {
+            status = MQTT_SkipNextProperty( &propBuffer, &propIndex );
+
+            if( status == MQTTSuccess )
+            {
+                status = MQTT_GetNextPropertyType( &propBuffer, &propIndex, &propertyId );
+            }
+        }
+
+        if( status == MQTTSuccess )
+        {
+            if( ( propIndex + 5U ) > propBuffer.currentIndex )
+            {
+                status = MQTTBadParameter;
+            }
+            else
+            {
+                WRITE_UINT32( &( propBuffer.pBuffer[ propIndex + 1U ] ), messageExpiry );
+            }
+        }
+        else if( status != MQTTEndOfProperties )
+        {
+            LogError( ( "PUBLISH has malformed properties." ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            /* The PUBLISH does not expire. */
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_ProcessIncomingPacketTypeAndLength( const uint8_t * pBuffer,
                                                       const size_t * pIndex,
                                                       MQTTPacketInfo_t * pIncomingPacket )
@@ -6108,3 +6689,197 @@ static MQTTStatus_t validateIncomingDisconnectProperties( uint8_t * pIndex,
 }
 
 /*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_ValidateAuthProperties( const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    bool methodPresent = false;
+
+    if( ( pPropertyBuilder == NULL ) || ( pPropertyBuilder->pBuffer == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL : pPropertyBuilder=%p.", ( const void * ) pPropertyBuilder ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( CHECK_SIZE_T_OVERFLOWS_32BIT( pPropertyBuilder->currentIndex ) ) ||
+             ( pPropertyBuilder->currentIndex >= MQTT_REMAINING_LENGTH_INVALID ) )
+    {
+        LogError( ( "Property length cannot have more than %" PRIu32 " bytes", MQTT_REMAINING_LENGTH_INVALID ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        status = validateAuthProperties( pPropertyBuilder->pBuffer,
+                                         ( uint32_t ) pPropertyBuilder->currentIndex,
+                                         &methodPresent );
+    }
+
+    if( ( status == MQTTSuccess ) && ( methodPresent == false ) )
+    {
+        LogError( ( "An AUTH packet must carry the Authentication Method." ) );
+        status = MQTTBadParameter;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_DeserializeAuth( const MQTTPacketInfo_t * pPacket,
+                                   uint32_t maxPacketSize,
+                                   MQTTReasonCodeInfo_t * pAuthInfo,
+                                   MQTTPropBuilder_t * pPropBuffer )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint8_t * pIndex = NULL;
+    uint32_t propertyLength = 0U;
+    bool methodPresent = false;
+
+    /* Validate the arguments. */
+    if( ( pPacket == NULL ) || ( pPacket->pRemainingData == NULL ) )
+    {
+        LogError( ( "pPacket and pPacket->pRemainingData must not be NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pAuthInfo == NULL )
+    {
+        LogError( ( "pAuthInfo must not be NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( maxPacketSize == 0U )
+    {
+        LogError( ( "maxPacketSize must not be 0." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pPacket->remainingLength >= MQTT_REMAINING_LENGTH_INVALID )
+    {
+        LogError( ( "pPacket->remainingLength must be less than 268435456." ) );
+        status = MQTTBadResponse;
+    }
+    else if( CHECK_U32T_OVERFLOWS_SIZE_T( pPacket->remainingLength ) )
+    {
+        LogError( ( "pPacket->remainingLength cannot fit in size_t." ) );
+
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-143 */
+        /* coverity[misra_c_2012_rule_14_3_violation] */
+        status = MQTTBadParameter;
+    }
+    else if( ( pPacket->remainingLength + variableLengthEncodedSize( pPacket->remainingLength ) + 1U ) > maxPacketSize )
+    {
+        status = MQTTBadResponse;
+    }
+    else if( pPacket->remainingLength == 0U )
+    {
+        /* A successful authentication with no reason code or properties. */
+        pAuthInfo->reasonCode = NULL;
+        pAuthInfo->reasonCodeLength = 0U;
+    }
+    else
+    {
+        pIndex = pPacket->pRemainingData;
+        pAuthInfo->reasonCode = pIndex;
+        pAuthInfo->reasonCodeLength = 1U;
+        pIndex++;
+
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-105 */
+        /* coverity[misra_c_2012_rule_10_5_violation] */
+        status = validateAuthResponse( ( MQTTSuccessFailReasonCode_t ) ( *pAuthInfo->reasonCode ), true );
+    }
+
+    if( ( status == MQTTSuccess ) && ( pPacket->remainingLength > 1U ) )
+    {
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+        /* coverity[misra_c_2012_rule_10_8_violation] */
+        status = decodeVariableLength( pIndex, ( size_t ) ( pPacket->remainingLength - 1U ), &propertyLength );
+
+        if( status != MQTTSuccess )
+        {
+            LogError( ( "Failed to decode the property length. Malformed packet." ) );
+            status = MQTTBadResponse;
+        }
+        else if( pPacket->remainingLength != ( propertyLength + variableLengthEncodedSize( propertyLength ) + 1U ) )
+        {
+            LogError( ( "Remaining length doesn't match the expected size." ) );
+            status = MQTTBadResponse;
+        }
+        else
+        {
+            pIndex = &pIndex[ ( size_t ) variableLengthEncodedSize( propertyLength ) ];
+
+            if( pPropBuffer != NULL )
+            {
+                pPropBuffer->bufferLength = propertyLength;
+                pPropBuffer->pBuffer = pIndex;
+            }
+
+            status = validateAuthProperties( pIndex, propertyLength, &methodPresent );
+        }
+    }
+
+    /* Every AUTH packet but a bare success carries the Authentication Method. */
+    if( ( status == MQTTSuccess ) &&
+        ( pAuthInfo->reasonCodeLength > 0U ) &&
+        ( *pAuthInfo->reasonCode != ( uint8_t ) MQTT_REASON_AUTH_SUCCESS ) &&
+        ( methodPresent == false ) )
+    {
+        LogError( ( "Incoming AUTH packet does not carry the Authentication Method." ) );
+        status = MQTTBadResponse;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t validateAuthProperties( uint8_t * pIndex,
+                                            uint32_t authPropertyLength,
+                                            bool * pMethodPresent )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint8_t * pLocalIndex = pIndex;
+    uint32_t propertyLength = authPropertyLength;
+    bool authData = false;
+    bool reasonString = false;
+
+    assert( pMethodPresent != NULL );
+
+    *pMethodPresent = false;
+
+    while( ( propertyLength > 0U ) && ( status == MQTTSuccess ) )
+    {
+        /* Decode the property id. */
+        uint8_t propertyId = *pLocalIndex;
+        pLocalIndex = &pLocalIndex[ 1 ];
+        propertyLength -= 1U;
+
+        switch( propertyId )
+        {
+            case MQTT_AUTH_METHOD_ID:
+                status = decodeUtf8( NULL, NULL, &propertyLength, pMethodPresent, &pLocalIndex );
+                break;
+
+            case MQTT_AUTH_DATA_ID:
+                status = decodeUtf8( NULL, NULL, &propertyLength, &authData, &pLocalIndex );
+                break;
+
+            case MQTT_REASON_STRING_ID:
+                status = decodeUtf8( NULL, NULL, &propertyLength, &reasonString, &pLocalIndex );
+                break;
+
+            case MQTT_USER_PROPERTY_ID:
+               {
+                   const char * key, * value;
+                   size_t keyLength, valueLength;
+                   status = decodeUserProp( &key, &keyLength, &value, &valueLength, &propertyLength, &pLocalIndex );
+               }
+               break;
+
+            default:
+                status = MQTTBadResponse;
+                break;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
@@ -43,9 +43,13 @@
 #include "core_mqtt_config_defaults.h"
 
 /**
- * @brief Version 5 has the value 5.
+ * @brief Protocol level sent in CONNECT: 5 for MQTT 5.0, 4 for MQTT 3.1.1.
  */
-#define MQTT_VERSION_5    ( 5U )
+#if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+    #define MQTT_PROTOCOL_LEVEL    ( 4U )
+#else
+    #define MQTT_PROTOCOL_LEVEL    ( 5U )
+#endif
 
 /*-----------------------------------------------------------*/
 
@@ -494,7 +498,7 @@ uint8_t * serializeConnectFixedHeader( uint8_t * pIndex,
 
     /* The MQTT protocol version is the second field of the variable header. */
 
-    *pIndexLocal = MQTT_VERSION_5;
+    *pIndexLocal = MQTT_PROTOCOL_LEVEL;
 
     pIndexLocal++;
 
@@ -577,6 +581,8 @@ uint8_t * serializeSubscribeHeader( uint32_t remainingLength,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 uint8_t * serializeUnsubscribeHeader( uint32_t remainingLength,
                                       uint8_t * pIndex,
                                       uint16_t packetId )
@@ -599,6 +605,8 @@ uint8_t * serializeUnsubscribeHeader( uint32_t remainingLength,
     return pIterator;
 }
 
+#endif
+
 /*-----------------------------------------------------------*/
 
 uint8_t * serializeDisconnectFixed( uint8_t * pIndex,
@@ -627,6 +635,29 @@ uint8_t * serializeDisconnectFixed( uint8_t * pIndex,
 
 /*-----------------------------------------------------------*/
 
+uint8_t * serializeAuthFixed( uint8_t * pIndex,
+                              MQTTSuccessFailReasonCode_t reasonCode,
+                              uint32_t remainingLength )
+{
+    uint8_t * pIndexLocal = pIndex;
+
+    assert( pIndex != NULL );
+    /* The first byte in the AUTH packet is the control packet type. */
+    *pIndexLocal = MQTT_PACKET_TYPE_AUTH;
+    pIndexLocal++;
+
+    /* After the packet type fixed header has remaining length. */
+    pIndexLocal = encodeVariableLength( pIndexLocal, remainingLength );
+
+    /* The reason code is always sent, so that the property length follows. */
+    *pIndexLocal = ( uint8_t ) reasonCode;
+    pIndexLocal++;
+
+    return pIndexLocal;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t decodeSubackPropertyLength( const uint8_t * pIndex,
                                          uint32_t remainingLength,
                                          uint32_t * subackPropertyLength )
@@ -635,11 +666,18 @@ MQTTStatus_t decodeSubackPropertyLength( const uint8_t * pIndex,
     const uint8_t * pLocalIndex = pIndex;
     uint32_t propertyLength = 0U;
 
-    status = decodeVariableLength( pLocalIndex, remainingLength - sizeof( uint16_t ), &propertyLength );
+    #if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+        /* MQTT 3.1.1 acks have no properties before the return codes. */
+        ( void ) pLocalIndex;
+        ( void ) remainingLength;
+        status = MQTTSuccess;
+    #else
+        status = decodeVariableLength( pLocalIndex, remainingLength - sizeof( uint16_t ), &propertyLength );
+    #endif
 
     if( status == MQTTSuccess )
     {
-        *subackPropertyLength = ( propertyLength + variableLengthEncodedSize( propertyLength ) );
+        *subackPropertyLength = ( propertyLength + MQTT_PROPERTY_LENGTH_SIZE( propertyLength ) );
 
         if( *subackPropertyLength > ( remainingLength - sizeof( uint16_t ) ) )
         {
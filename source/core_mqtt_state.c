@@ -69,6 +69,26 @@ static const size_t ZERO_SIZE_T = 0U;
  */
 #define UINT16_CHECK_BIT( x, position )         ( ( ( x ) & ( UINT16_BITMAP_BIT_SET_AT( position ) ) ) == ( UINT16_BITMAP_BIT_SET_AT( position ) ) )
 
+#if ( MQTT_COMPACT_PUBLISH_RECORDS != 0 )
+
+/**
+ * @brief Convert a QoS to the type of #MQTTPubAckInfo_t.qos.
+ *
+ * @param[in] qos The #MQTTQoS_t to store in a record.
+ */
+    #define RECORD_QOS( qos )        ( ( uint8_t ) ( qos ) )
+
+/**
+ * @brief Convert a publish state to the type of #MQTTPubAckInfo_t.publishState.
+ *
+ * @param[in] state The #MQTTPublishState_t to store in a record.
+ */
+    #define RECORD_STATE( state )    ( ( uint8_t ) ( state ) )
+#else
+    #define RECORD_QOS( qos )        ( qos )
+    #define RECORD_STATE( state )    ( state )
+#endif /* if ( MQTT_COMPACT_PUBLISH_RECORDS != 0 ) */
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -260,9 +280,11 @@ static bool validateTransitionPublish( MQTTPublishState_t currentState,
                     isValid = newState == MQTTPubAckPending;
                     break;
 
-                case MQTTQoS2:
-                    isValid = newState == MQTTPubRecPending;
-                    break;
+                #if ( MQTT_ENABLE_QOS2 != 0 )
+                    case MQTTQoS2:
+                        isValid = newState == MQTTPubRecPending;
+                        break;
+                #endif
 
                 default:
                     /* QoS 0 is checked before calling this function. */
@@ -281,13 +303,15 @@ static bool validateTransitionPublish( MQTTPublishState_t currentState,
 
             break;
 
-        case MQTTPubRecPending:
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTTPubRecPending:
 
-            /* When a session is reestablished, outgoing QoS2 publishes in state
-             * #MQTTPubRecPending can be resent. The state remains the same. */
-            isValid = newState == MQTTPubRecPending;
+                /* When a session is reestablished, outgoing QoS2 publishes in state
+                 * #MQTTPubRecPending can be resent. The state remains the same. */
+                isValid = newState == MQTTPubRecPending;
 
-            break;
+                break;
+        #endif
 
         default:
             /* For a PUBLISH, we should not start from any other state. */
@@ -313,84 +337,86 @@ static bool validateTransitionAck( MQTTPublishState_t currentState,
             isValid = newState == MQTTPublishDone;
             break;
 
-        case MQTTPubRecSend:
-            /* Incoming publish, QoS 2. */
-            isValid = newState == MQTTPubRelPending;
-            break;
-
-        case MQTTPubRelPending:
-
-            /* Incoming publish, QoS 2.
-             * There are 2 valid transitions possible.
-             * 1. MQTTPubRelPending -> MQTTPubCompSend : A PUBREL ack is received
-             *    when publish record state is MQTTPubRelPending. This is the
-             *    normal state transition without any connection interruptions.
-             * 2. MQTTPubRelPending -> MQTTPubRelPending : Receiving a duplicate
-             *    QoS2 publish can result in a transition to the same state.
-             *    This can happen in the below state transition.
-             *    1. Incoming publish received.
-             *    2. PUBREC ack sent and state is now MQTTPubRelPending.
-             *    3. TCP connection failure and broker didn't receive the PUBREC.
-             *    4. Reestablished MQTT session.
-             *    5. MQTT broker resent the un-acked publish.
-             *    6. Publish is received when publish record state is in
-             *       MQTTPubRelPending.
-             *    7. Sending out a PUBREC will result in this transition
-             *       to the same state. */
-            isValid = ( newState == MQTTPubCompSend ) ||
-                      ( newState == MQTTPubRelPending );
-            break;
-
-        case MQTTPubCompSend:
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTTPubRecSend:
+                /* Incoming publish, QoS 2. */
+                isValid = newState == MQTTPubRelPending;
+                break;
 
-            /* Incoming publish, QoS 2.
-             * There are 2 valid transitions possible.
-             * 1. MQTTPubCompSend -> MQTTPublishDone : A PUBCOMP ack is sent
-             *    after receiving a PUBREL from broker. This is the
-             *    normal state transition without any connection interruptions.
-             * 2. MQTTPubCompSend -> MQTTPubCompSend : Receiving a duplicate PUBREL
-             *    can result in a transition to the same state.
-             *    This can happen in the below state transition.
-             *    1. A TCP connection failure happened before sending a PUBCOMP
-             *       for an incoming PUBREL.
-             *    2. Reestablished an MQTT session.
-             *    3. MQTT broker resent the un-acked PUBREL.
-             *    4. Receiving the PUBREL again will result in this transition
-             *       to the same state. */
-            isValid = ( newState == MQTTPublishDone ) ||
-                      ( newState == MQTTPubCompSend );
-            break;
+            case MQTTPubRelPending:
+
+                /* Incoming publish, QoS 2.
+                 * There are 2 valid transitions possible.
+                 * 1. MQTTPubRelPending -> MQTTPubCompSend : A PUBREL ack is received
+                 *    when publish record state is MQTTPubRelPending. This is the
+                 *    normal state transition without any connection interruptions.
+                 * 2. MQTTPubRelPending -> MQTTPubRelPending : Receiving a duplicate
+                 *    QoS2 publish can result in a transition to the same state.
+                 *    This can happen in the below state transition.
+                 *    1. Incoming publish received.
+                 *    2. PUBREC ack sent and state is now MQTTPubRelPending.
+                 *    3. TCP connection failure and broker didn't receive the PUBREC.
+                 *    4. Reestablished MQTT session.
+                 *    5. MQTT broker resent the un-acked publish.
+                 *    6. Publish is received when publish record state is in
+                 *       MQTTPubRelPending.
+                 *    7. Sending out a PUBREC will result in this transition
+                 *       to the same state. */
+                isValid = ( newState == MQTTPubCompSend ) ||
+                          ( newState == MQTTPubRelPending );
+                break;
 
-        case MQTTPubRecPending:
-            /* Outgoing publish, Qos 2. */
-            isValid = newState == MQTTPubRelSend;
-            break;
+            case MQTTPubCompSend:
+
+                /* Incoming publish, QoS 2.
+                 * There are 2 valid transitions possible.
+                 * 1. MQTTPubCompSend -> MQTTPublishDone : A PUBCOMP ack is sent
+                 *    after receiving a PUBREL from broker. This is the
+                 *    normal state transition without any connection interruptions.
+                 * 2. MQTTPubCompSend -> MQTTPubCompSend : Receiving a duplicate PUBREL
+                 *    can result in a transition to the same state.
+                 *    This can happen in the below state transition.
+                 *    1. A TCP connection failure happened before sending a PUBCOMP
+                 *       for an incoming PUBREL.
+                 *    2. Reestablished an MQTT session.
+                 *    3. MQTT broker resent the un-acked PUBREL.
+                 *    4. Receiving the PUBREL again will result in this transition
+                 *       to the same state. */
+                isValid = ( newState == MQTTPublishDone ) ||
+                          ( newState == MQTTPubCompSend );
+                break;
 
-        case MQTTPubRelSend:
-            /* Outgoing publish, Qos 2. */
-            isValid = newState == MQTTPubCompPending;
-            break;
+            case MQTTPubRecPending:
+                /* Outgoing publish, Qos 2. */
+                isValid = newState == MQTTPubRelSend;
+                break;
 
-        case MQTTPubCompPending:
+            case MQTTPubRelSend:
+                /* Outgoing publish, Qos 2. */
+                isValid = newState == MQTTPubCompPending;
+                break;
 
-            /* Outgoing publish, Qos 2.
-             * There are 2 valid transitions possible.
-             * 1. MQTTPubCompPending -> MQTTPublishDone : A PUBCOMP is received.
-             *    This marks the complete state transition for the publish packet.
-             *    This is the normal state transition without any connection
-             *    interruptions.
-             * 2. MQTTPubCompPending -> MQTTPubCompPending : Resending a PUBREL for
-             *    packets in state #MQTTPubCompPending can result in this
-             *    transition to the same state.
-             *    This can happen in the below state transition.
-             *    1. A TCP connection failure happened before receiving a PUBCOMP
-             *       for an outgoing PUBREL.
-             *    2. An MQTT session is reestablished.
-             *    3. Resending the un-acked PUBREL results in this transition
-             *       to the same state. */
-            isValid = ( newState == MQTTPublishDone ) ||
-                      ( newState == MQTTPubCompPending );
-            break;
+            case MQTTPubCompPending:
+
+                /* Outgoing publish, Qos 2.
+                 * There are 2 valid transitions possible.
+                 * 1. MQTTPubCompPending -> MQTTPublishDone : A PUBCOMP is received.
+                 *    This marks the complete state transition for the publish packet.
+                 *    This is the normal state transition without any connection
+                 *    interruptions.
+                 * 2. MQTTPubCompPending -> MQTTPubCompPending : Resending a PUBREL for
+                 *    packets in state #MQTTPubCompPending can result in this
+                 *    transition to the same state.
+                 *    This can happen in the below state transition.
+                 *    1. A TCP connection failure happened before receiving a PUBCOMP
+                 *       for an outgoing PUBREL.
+                 *    2. An MQTT session is reestablished.
+                 *    3. Resending the un-acked PUBREL results in this transition
+                 *       to the same state. */
+                isValid = ( newState == MQTTPublishDone ) ||
+                          ( newState == MQTTPubCompPending );
+                break;
+        #endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
 
         default:
 
@@ -453,8 +479,8 @@ static size_t findInRecord( const MQTTPubAckInfo_t * records,
     {
         if( records[ index ].packetId == packetId )
         {
-            *pQos = records[ index ].qos;
-            *pCurrentState = records[ index ].publishState;
+            *pQos = ( MQTTQoS_t ) records[ index ].qos;
+            *pCurrentState = ( MQTTPublishState_t ) records[ index ].publishState;
             break;
         }
     }
@@ -497,10 +523,15 @@ static void compactRecords( MQTTPubAckInfo_t * records,
                 records[ emptyIndex ].qos = records[ index ].qos;
                 records[ emptyIndex ].publishState = records[ index ].publishState;
 
+                #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+                    records[ emptyIndex ].messageExpiry = records[ index ].messageExpiry;
+                    records[ emptyIndex ].publishTimeMs = records[ index ].publishTimeMs;
+                #endif
+
                 /* Mark the record at current non empty index as invalid. */
                 records[ index ].packetId = MQTT_PACKET_ID_INVALID;
-                records[ index ].qos = MQTTQoS0;
-                records[ index ].publishState = MQTTStateNull;
+                records[ index ].qos = RECORD_QOS( MQTTQoS0 );
+                records[ index ].publishState = RECORD_STATE( MQTTStateNull );
 
                 /* Advance the emptyIndex. */
                 emptyIndex++;
@@ -568,8 +599,14 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
     if( availableIndex < recordCount )
     {
         records[ availableIndex ].packetId = packetId;
-        records[ availableIndex ].qos = qos;
-        records[ availableIndex ].publishState = publishState;
+        records[ availableIndex ].qos = RECORD_QOS( qos );
+        records[ availableIndex ].publishState = RECORD_STATE( publishState );
+
+        #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+            records[ availableIndex ].messageExpiry = 0U;
+            records[ availableIndex ].publishTimeMs = 0U;
+        #endif
+
         status = MQTTSuccess;
     }
 
@@ -589,12 +626,12 @@ static void updateRecord( MQTTPubAckInfo_t * records,
     {
         /* Mark the record as invalid. */
         records[ recordIndex ].packetId = MQTT_PACKET_ID_INVALID;
-        records[ recordIndex ].qos = MQTTQoS0;
-        records[ recordIndex ].publishState = MQTTStateNull;
+        records[ recordIndex ].qos = RECORD_QOS( MQTTQoS0 );
+        records[ recordIndex ].publishState = RECORD_STATE( MQTTStateNull );
     }
     else
     {
-        records[ recordIndex ].publishState = newState;
+        records[ recordIndex ].publishState = RECORD_STATE( newState );
     }
 }
 
@@ -656,6 +693,11 @@ MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType,
     /* There are more QoS2 cases than QoS1, so initialize to that. */
     bool qosValid = qos == MQTTQoS2;
 
+    #if ( MQTT_ENABLE_QOS2 == 0 )
+        /* Only PUBACK is left, which completes the flow in both directions. */
+        ( void ) opType;
+    #endif
+
     switch( packetType )
     {
         case MQTTPuback:
@@ -663,23 +705,25 @@ MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType,
             calculatedState = MQTTPublishDone;
             break;
 
-        case MQTTPubrec:
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTTPubrec:
 
-            /* Incoming publish: send PUBREC, PUBREL pending.
-             * Outgoing publish: receive PUBREC, send PUBREL. */
-            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRelPending : MQTTPubRelSend;
-            break;
+                /* Incoming publish: send PUBREC, PUBREL pending.
+                 * Outgoing publish: receive PUBREC, send PUBREL. */
+                calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRelPending : MQTTPubRelSend;
+                break;
 
-        case MQTTPubrel:
+            case MQTTPubrel:
 
-            /* Incoming publish: receive PUBREL, send PUBCOMP.
-             * Outgoing publish: send PUBREL, PUBCOMP pending. */
-            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubCompPending : MQTTPubCompSend;
-            break;
+                /* Incoming publish: receive PUBREL, send PUBCOMP.
+                 * Outgoing publish: send PUBREL, PUBCOMP pending. */
+                calculatedState = ( opType == MQTT_SEND ) ? MQTTPubCompPending : MQTTPubCompSend;
+                break;
 
-        case MQTTPubcomp:
-            calculatedState = MQTTPublishDone;
-            break;
+            case MQTTPubcomp:
+                calculatedState = MQTTPublishDone;
+                break;
+        #endif /* if ( MQTT_ENABLE_QOS2 != 0 ) */
 
         default:
             /* No other ack type. */
@@ -860,9 +904,11 @@ MQTTPublishState_t MQTT_CalculateStatePublish( MQTTStateOperation_t opType,
             calculatedState = ( opType == MQTT_SEND ) ? MQTTPubAckPending : MQTTPubAckSend;
             break;
 
-        case MQTTQoS2:
-            calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRecPending : MQTTPubRecSend;
-            break;
+        #if ( MQTT_ENABLE_QOS2 != 0 )
+            case MQTTQoS2:
+                calculatedState = ( opType == MQTT_SEND ) ? MQTTPubRecPending : MQTTPubRecSend;
+                break;
+        #endif
 
         default:
             /* No other QoS values. */
@@ -996,6 +1042,89 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
+#if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
+MQTTStatus_t MQTT_SetPublishExpiry( const MQTTContext_t * pMqttContext,
+                                    uint16_t packetId,
+                                    uint32_t messageExpiry,
+                                    uint32_t publishTimeMs )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t recordIndex;
+    MQTTPublishState_t currentState;
+    MQTTQoS_t qos = MQTTQoS0;
+
+    if( ( pMqttContext == NULL ) || ( pMqttContext->outgoingPublishRecords == NULL ) ||
+        ( packetId == MQTT_PACKET_ID_INVALID ) )
+    {
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        recordIndex = findInRecord( pMqttContext->outgoingPublishRecords,
+                                    pMqttContext->outgoingPublishRecordMaxCount,
+                                    packetId,
+                                    &qos,
+                                    &currentState );
+
+        if( currentState == MQTTStateNull )
+        {
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            pMqttContext->outgoingPublishRecords[ recordIndex ].messageExpiry = messageExpiry;
+            pMqttContext->outgoingPublishRecords[ recordIndex ].publishTimeMs = publishTimeMs;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_GetPublishExpiry( const MQTTContext_t * pMqttContext,
+                                    uint16_t packetId,
+                                    uint32_t * pMessageExpiry,
+                                    uint32_t * pPublishTimeMs )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t recordIndex;
+    MQTTPublishState_t currentState;
+    MQTTQoS_t qos = MQTTQoS0;
+
+    if( ( pMqttContext == NULL ) || ( pMqttContext->outgoingPublishRecords == NULL ) ||
+        ( packetId == MQTT_PACKET_ID_INVALID ) ||
+        ( pMessageExpiry == NULL ) || ( pPublishTimeMs == NULL ) )
+    {
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        recordIndex = findInRecord( pMqttContext->outgoingPublishRecords,
+                                    pMqttContext->outgoingPublishRecordMaxCount,
+                                    packetId,
+                                    &qos,
+                                    &currentState );
+
+        if( currentState == MQTTStateNull )
+        {
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            *pMessageExpiry = pMqttContext->outgoingPublishRecords[ recordIndex ].messageExpiry;
+            *pPublishTimeMs = pMqttContext->outgoingPublishRecords[ recordIndex ].publishTimeMs;
+        }
+    }
+
+    return status;
+}
+
+#endif /* if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
                                   uint16_t packetId,
                                   MQTTPubAckType_t packetType,
@@ -59,6 +59,13 @@
  */
 #define MQTT_PACKET_ID_INVALID    ( ( uint16_t ) 0U )
 
+/**
+ * @ingroup mqtt_constants
+ * @brief Value returned by #MQTT_GetNextTimeoutMs when no keep-alive timeout
+ * is pending.
+ */
+#define MQTT_NO_TIMEOUT_PENDING    ( UINT32_MAX )
+
 /* Structures defined in this file. */
 struct MQTTPubAckInfo;
 struct MQTTContext;
@@ -212,6 +219,12 @@ typedef bool ( * MQTTStorePacketForRetransmit )( struct MQTTContext * pContext,
  *                  MQTTVec_t. This value should be the same as the one received from MQTT_GetBytesInMQTTVec
  *                  when storing the packet.
  *
+ * @note With #MQTT_ENABLE_MESSAGE_EXPIRY, if the stored PUBLISH carries a
+ * Message Expiry Interval, the library drops it once the interval has elapsed
+ * and otherwise rewrites the interval in the returned buffer to the time the
+ * message has left before resending it. The returned buffer must therefore be
+ * writable.
+ *
  * @return True if the retreive is successful else false.
  */
 /* @[define_mqtt_retransmitretrievepacket] */
@@ -294,11 +307,134 @@ typedef enum MQTTSubAckStatus
  */
 typedef struct MQTTPubAckInfo
 {
-    uint16_t packetId;               /**< @brief The packet ID of the original PUBLISH. */
-    MQTTQoS_t qos;                   /**< @brief The QoS of the original PUBLISH. */
-    MQTTPublishState_t publishState; /**< @brief The current state of the publish process. */
+    uint16_t packetId;                   /**< @brief The packet ID of the original PUBLISH. */
+    #if ( MQTT_COMPACT_PUBLISH_RECORDS != 0 )
+        uint8_t qos;                     /**< @brief The #MQTTQoS_t of the original PUBLISH. */
+        uint8_t publishState;            /**< @brief The current #MQTTPublishState_t of the publish process. */
+    #else
+        MQTTQoS_t qos;                   /**< @brief The QoS of the original PUBLISH. */
+        MQTTPublishState_t publishState; /**< @brief The current state of the publish process. */
+    #endif
+    #if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+        uint32_t messageExpiry;      /**< @brief Message Expiry Interval of an outgoing PUBLISH in seconds, or 0 if it does not expire. */
+        uint32_t publishTimeMs;      /**< @brief Time at which the outgoing PUBLISH was first sent. */
+    #endif
 } MQTTPubAckInfo_t;
 
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A pool of publish records shared by many MQTT contexts.
+ *
+ * The pool is divided into blocks of records. A context set up with
+ * #MQTT_InitStatefulQoSPool borrows one block for outgoing and one for
+ * incoming publishes when it has QoS 1 or QoS 2 traffic, and returns them once
+ * they are empty again. Members of this struct should not be accessed
+ * directly by the application; it is set up with #MQTT_InitRecordPool.
+ */
+typedef struct MQTTRecordPool
+{
+    MQTTPubAckInfo_t * pRecords; /**< @brief The records of all blocks, one block after the other. */
+    size_t recordsPerBlock;      /**< @brief Number of records in a block. */
+    size_t blockCount;           /**< @brief Number of blocks in the pool. */
+    size_t * pFreeBlocks;        /**< @brief Stack of the indexes of the free blocks. */
+    size_t freeBlockCount;       /**< @brief Number of free blocks. */
+} MQTTRecordPool_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A pool of receive buffers shared by many MQTT contexts.
+ *
+ * A context set up with #MQTT_InitNetworkBufferPool receives into its own
+ * small network buffer, and leases a buffer from the pool only while a packet
+ * that does not fit in it is being received. Members of this struct should not
+ * be accessed directly by the application; it is set up with
+ * #MQTT_InitBufferPool.
+ */
+typedef struct MQTTBufferPool
+{
+    uint8_t * pBuffers;      /**< @brief The memory of all buffers, one buffer after the other. */
+    size_t bufferSize;       /**< @brief Size of each buffer in bytes. */
+    size_t bufferCount;      /**< @brief Number of buffers in the pool. */
+    size_t * pFreeBuffers;   /**< @brief Stack of the indexes of the free buffers. */
+    size_t freeBufferCount;  /**< @brief Number of free buffers. */
+} MQTTBufferPool_t;
+
+/**
+ * @ingroup mqtt_enum_types
+ * @brief Priority classes of queued publishes.
+ *
+ * #MQTT_ProcessPublishQueue sends the queued publishes of a higher class
+ * first. Publishes of the same class are sent in the order they were queued.
+ */
+typedef enum MQTTPublishPriority
+{
+    MQTTPublishPriorityLow = 0, /**< @brief Bulk data that may wait for anything else. */
+    MQTTPublishPriorityNormal,  /**< @brief The class used by #MQTT_EnqueuePublish. */
+    MQTTPublishPriorityHigh     /**< @brief Latency critical data, not held back by #MQTT_PUBLISH_QUEUE_BYTES_PER_CALL. */
+} MQTTPublishPriority_t;
+
+/**
+ * @ingroup mqtt_enum_types
+ * @brief What #MQTT_EnqueuePublish does when the publish queue is full.
+ *
+ * The policy is set with #MQTT_SetPublishQueuePolicy.
+ */
+typedef enum MQTTPublishQueuePolicy
+{
+    MQTTPublishQueueDropNewest = 0, /**< @brief Refuse the new publish. This is the default. */
+    MQTTPublishQueueDropOldest,     /**< @brief Drop the oldest queued publish to make room. */
+    MQTTPublishQueueDropLowestQoS   /**< @brief Drop the oldest queued publish of the lowest QoS, unless the new publish has a lower QoS still. */
+} MQTTPublishQueuePolicy_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief An element of the publish queue used by #MQTT_EnqueuePublish.
+ *
+ * The topic, payload and properties referenced by an element are not copied
+ * and must remain valid until the element has been sent by
+ * #MQTT_ProcessPublishQueue.
+ */
+typedef struct MQTTPublishRequest
+{
+    MQTTPublishInfo_t publishInfo;              /**< @brief The parameters of the PUBLISH. */
+    const MQTTPropBuilder_t * pPropertyBuilder; /**< @brief Optional PUBLISH properties, or NULL. */
+    uint16_t packetId;                          /**< @brief Packet ID of the PUBLISH, or 0 to have one assigned when it is sent. */
+    MQTTPublishPriority_t priority;             /**< @brief Priority class of the PUBLISH. */
+} MQTTPublishRequest_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A PUBLISH validated and encoded once by #MQTT_PreparePublish, to be
+ * sent any number of times with #MQTT_PublishPrepared.
+ *
+ * The members are set by #MQTT_PreparePublish and must not be changed by the
+ * application. The topic and properties referenced by them are not copied and
+ * must remain valid while the prepared publish is in use.
+ */
+typedef struct MQTTPreparedPublish
+{
+    MQTTPublishInfo_t publishInfo;              /**< @brief Topic, QoS and retain flag of the PUBLISH, without a payload. */
+    const MQTTPropBuilder_t * pPropertyBuilder; /**< @brief Optional PUBLISH properties, or NULL. */
+    uint32_t remainingLength;                   /**< @brief Remaining length of the PUBLISH without the payload. */
+    uint16_t topicAlias;                        /**< @brief Topic alias in the properties, or 0 if there is none. */
+    uint8_t firstByte;                          /**< @brief Packet type and flags of the PUBLISH, without the DUP flag. */
+} MQTTPreparedPublish_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief An element of the subscription registry used by
+ * #MQTT_InitSubscriptionRegistry.
+ *
+ * The topic filter referenced by an element is not copied and must remain
+ * valid for as long as the subscription is registered.
+ */
+typedef struct MQTTSubscriptionRecord
+{
+    MQTTSubscribeInfo_t subscribeInfo; /**< @brief The topic filter and subscription options. */
+    uint16_t packetId;                 /**< @brief Packet ID of the SUBSCRIBE awaiting its SUBACK, or #MQTT_PACKET_ID_INVALID once granted. */
+    size_t subackIndex;                /**< @brief Position of the topic filter in that SUBSCRIBE. */
+} MQTTSubscriptionRecord_t;
+
 /**
  * @ingroup mqtt_struct_types
  * @brief A struct representing an MQTT connection.
@@ -335,10 +471,13 @@ typedef struct MQTTContext
      */
     MQTTFixedBuffer_t networkBuffer;
 
-    /**
-     * @brief The buffer used to store properties for outgoing ack packets.
-     */
-    MQTTPropBuilder_t ackPropsBuffer;
+    #if ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
+        /**
+         * @brief The buffer used to store properties for outgoing ack packets.
+         */
+        MQTTPropBuilder_t ackPropsBuffer;
+    #endif
 
     /**
      * @brief The next available ID for outgoing MQTT packets.
@@ -376,35 +515,112 @@ typedef struct MQTTContext
      */
     bool controlPacketSent;
 
+    /**
+     * @brief Number of nested operations sending several packets in a row.
+     * The transport is flushed once the outermost one ends.
+     */
+    uint32_t sendBatchDepth;
+
+    /**
+     * @brief Whether bytes were sent during a batch without flushing the
+     * transport.
+     */
+    bool flushPending;
+
+    /**
+     * @brief Whether the packet being sent under the send hook belongs to the
+     * batch of the thread running the batch. Other packets are flushed at once.
+     */
+    bool sendBatched;
+
+    /**
+     * @brief Whether a transport call failed while the send hook was held.
+     * The connection status is updated once the hook is released.
+     */
+    bool sendFailed;
+
     /**
      * @brief Index to keep track of the number of bytes received in network buffer.
      */
     size_t index;
 
+    /**
+     * @brief Fixed header of the packet being received, kept once it has been
+     * decoded so later calls only wait for the rest of the packet.
+     */
+    MQTTPacketInfo_t pendingPacket;
+
+    /**
+     * @brief Total length of @ref pendingPacket, or 0 if no header is kept.
+     */
+    uint32_t pendingPacketLength;
+
     /* Keep alive members. */
     uint16_t keepAliveIntervalSec; /**< @brief Keep Alive interval. */
     uint32_t pingReqSendTimeMs;    /**< @brief Timestamp of the last sent PINGREQ. */
     bool waitingForPingResp;       /**< @brief If the library is currently awaiting a PINGRESP. */
 
+    /* Non-blocking connect members. */
+    bool connectPending;      /**< @brief If a CONNECT sent by #MQTT_ConnectStart awaits its CONNACK. */
+    bool connectCleanSession; /**< @brief Clean session flag of the pending CONNECT. */
+
     /**
      * @brief Persistent Connection Properties, populated in the CONNECT and the CONNACK.
      */
     MQTTConnectionProperties_t connectionProperties;
 
-    /**
-     * @brief User defined API used to store outgoing publishes.
-     */
-    MQTTStorePacketForRetransmit storeFunction;
+    #if ( MQTT_ENABLE_RETRANSMIT != 0 )
+
+        /**
+         * @brief User defined API used to store outgoing publishes.
+         */
+        MQTTStorePacketForRetransmit storeFunction;
+
+        /**
+         * @brief User defined API used to retreive a copied publish for resend operation.
+         */
+        MQTTRetrievePacketForRetransmit retrieveFunction;
+
+        /**
+         * @brief User defined API used to clear a particular copied publish packet.
+         */
+        MQTTClearPacketForRetransmit clearFunction;
+    #endif
+
+    /* Publish queue members. */
+    MQTTPublishRequest_t * pPublishQueue;        /**< @brief Ring buffer of publishes waiting to be sent. */
+    size_t publishQueueLength;                   /**< @brief Number of elements in #MQTTContext_t.pPublishQueue. */
+    size_t publishQueueHead;                     /**< @brief Index of the oldest queued publish. */
+    size_t publishQueueCount;                    /**< @brief Number of queued publishes. */
+    bool publishQueueSending;                    /**< @brief Whether a publish taken from the queue is being sent. Its element stays reserved. */
+    MQTTPublishQueuePolicy_t publishQueuePolicy; /**< @brief What #MQTT_EnqueuePublish does when the queue is full. */
+
+    /* Rate limiter members. */
+    uint32_t rateLimitBytesPerSecond; /**< @brief Rate at which PUBLISH bytes may be sent, or zero when not limited. */
+    uint32_t rateLimitBurstBytes;     /**< @brief Capacity of the token bucket, in bytes. */
+    uint32_t rateLimitTokens;         /**< @brief Bytes that may be sent before the bucket runs dry. */
+    uint32_t rateLimitRefillTime;     /**< @brief Timestamp up to which the bucket has been refilled. */
+    uint32_t rateLimitDelayMs;        /**< @brief Wait before the last refused PUBLISH can be sent. */
 
     /**
-     * @brief User defined API used to retreive a copied publish for resend operation.
+     * @brief Optional buffer into which a complete SUBSCRIBE or UNSUBSCRIBE
+     * packet is serialized, so that it is sent in a single transport call.
      */
-    MQTTRetrievePacketForRetransmit retrieveFunction;
+    MQTTFixedBuffer_t subscribeBuffer;
 
-    /**
-     * @brief User defined API used to clear a particular copied publish packet.
-     */
-    MQTTClearPacketForRetransmit clearFunction;
+    /* Subscription registry members. */
+    MQTTSubscriptionRecord_t * pSubscriptionRecords; /**< @brief Subscriptions replayed when a session is lost. */
+    size_t subscriptionRecordMaxCount;               /**< @brief Number of elements in #MQTTContext_t.pSubscriptionRecords. */
+    size_t subscriptionRecordCount;                  /**< @brief Number of registered subscriptions. */
+
+    /* Record pool members. */
+    MQTTRecordPool_t * pRecordPool;    /**< @brief Pool from which the publish records are borrowed, or NULL. */
+    size_t outgoingPublishRecordQuota; /**< @brief Number of outgoing records used from a borrowed block. */
+    size_t incomingPublishRecordQuota; /**< @brief Number of incoming records used from a borrowed block. */
+
+    /* Buffer pool members. */
+    MQTTBufferPool_t * pBufferPool;  /**< @brief Pool from which receive buffers are leased, or NULL. */
+    MQTTFixedBuffer_t stagingBuffer; /**< @brief The context's own network buffer while a pool buffer is leased. */
 } MQTTContext_t;
 
 /**
@@ -418,6 +634,20 @@ typedef struct MQTTDeserializedInfo
     MQTTPublishInfo_t * pPublishInfo;   /**< @brief Pointer to deserialized publish info. */
     MQTTStatus_t deserializationResult; /**< @brief Return code of deserialization. */
     MQTTReasonCodeInfo_t * pReasonCode; /**< @brief Pointer to deserialized ack info. */
+
+    /**
+     * @brief Buffer leased from the pool set with #MQTT_InitNetworkBufferPool
+     * that holds an incoming PUBLISH, or NULL if the packet cannot be taken.
+     */
+    uint8_t * pPacketBuffer;
+
+    /**
+     * @brief Set to true by the callback to take ownership of @ref pPacketBuffer.
+     *
+     * The payload and topic of the PUBLISH then stay valid after the callback
+     * returns, until the buffer is given back with #MQTT_ReturnPoolBuffer.
+     */
+    bool takePacketBuffer;
 } MQTTDeserializedInfo_t;
 
 /**
@@ -433,6 +663,11 @@ typedef struct MQTTDeserializedInfo
  * to be 0. This will result in loop functions running for a single iteration, and
  * #MQTT_Connect relying on #MQTT_MAX_CONNACK_RECEIVE_RETRY_COUNT to receive the CONNACK packet.
  *
+ * @note The optional members of #TransportInterface_t, such as writev, flush
+ * and sendPayload, are called whenever they are not NULL. The transport
+ * interface must therefore be zero-initialized before the members implemented
+ * by the port are set, so that members added in later versions are NULL.
+ *
  * @param[in] pContext The context to initialize.
  * @param[in] pTransportInterface The transport interface to use with the context.
  * @param[in] getTimeFunction The time utility function which can return the amount of time
@@ -468,7 +703,8 @@ typedef struct MQTTDeserializedInfo
  * int32_t networkRecv( NetworkContext_t * pContext, void * pBuffer, size_t bytes );
  *
  * MQTTContext_t mqttContext;
- * TransportInterface_t transport;
+ * // Optional transport functions which are not implemented stay NULL.
+ * TransportInterface_t transport = { 0 };
  * MQTTFixedBuffer_t fixedBuffer;
  * // Create a globally accessible buffer which remains in scope for the entire duration
  * // of the MQTT context.
@@ -481,7 +717,6 @@ typedef struct MQTTDeserializedInfo
  * transport.pNetworkContext = &someTransportContext;
  * transport.send = networkSend;
  * transport.recv = networkRecv;
- * transport.writev = NULL;
  *
  * // Set buffer members.
  * fixedBuffer.pBuffer = buffer;
@@ -544,7 +779,7 @@ MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
  * int32_t networkRecv( NetworkContext_t * pContext, void * pBuffer, size_t bytes );
  *
  * MQTTContext_t mqttContext;
- * TransportInterface_t transport;
+ * TransportInterface_t transport = { 0 };
  * MQTTFixedBuffer_t fixedBuffer;
  * uint8_t buffer[ 1024 ];
  * const size_t outgoingPublishCount = 30;
@@ -594,6 +829,231 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
                                    size_t ackPropsBufLength );
 /* @[declare_mqtt_initstatefulqos] */
 
+/**
+ * @brief Initialize a pool of publish records that can be shared by many
+ * MQTT contexts.
+ *
+ * Giving every context its own record arrays with #MQTT_InitStatefulQoS sizes
+ * the RAM for publish records by the number of connections times the largest
+ * window any of them may need. With a pool, contexts only hold records while
+ * they have QoS 1 or QoS 2 publishes in flight, so the RAM scales with the
+ * traffic instead. Blocks are taken from and returned to the pool in constant
+ * time.
+ *
+ * When contexts sharing a pool are used from different threads,
+ * #MQTT_PRE_RECORD_POOL_HOOK and #MQTT_POST_RECORD_POOL_HOOK must be defined to
+ * a lock guarding the pool.
+ *
+ * @param[in] pPool The pool to initialize.
+ * @param[in] pRecords Array of @p recordsPerBlock times @p blockCount records.
+ * @param[in] recordsPerBlock The number of records in each block. This is the
+ * largest window a context can have in each direction.
+ * @param[in] blockCount The number of blocks in the pool.
+ * @param[in] pFreeBlocks Array of @p blockCount elements used to track the
+ * free blocks.
+ *
+ * Both arrays must remain valid and in scope for the lifetime of @p pPool and
+ * of every context using it.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // 64 blocks of 8 records, shared by all connections.
+ * MQTTPubAckInfo_t records[ 64 * 8 ];
+ * size_t freeBlocks[ 64 ];
+ * MQTTRecordPool_t pool;
+ *
+ * status = MQTT_InitRecordPool( &pool, records, 8, 64, freeBlocks );
+ * @endcode
+ */
+/* @[declare_mqtt_initrecordpool] */
+MQTTStatus_t MQTT_InitRecordPool( MQTTRecordPool_t * pPool,
+                                  MQTTPubAckInfo_t * pRecords,
+                                  size_t recordsPerBlock,
+                                  size_t blockCount,
+                                  size_t * pFreeBlocks );
+/* @[declare_mqtt_initrecordpool] */
+
+/**
+ * @brief Let an MQTT context borrow its publish records from a shared pool.
+ *
+ * This is used instead of passing record arrays to #MQTT_InitStatefulQoS,
+ * which may still be called with NULL record arrays to set the buffer for ack
+ * properties. A block is taken from the pool when the first QoS 1 or QoS 2
+ * publish is sent or received, and is returned by #MQTT_ProcessLoop and
+ * #MQTT_ReceiveLoop once all of its records are free. Records of a persistent
+ * session are kept across reconnects until the session is cleaned.
+ *
+ * If the pool has no free block, a QoS 1 or QoS 2 publish fails with
+ * #MQTTNoMemory, as it would with a full record array.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pPool Pool initialized with #MQTT_InitRecordPool. It must remain
+ * valid and in scope for the lifetime of @p pContext.
+ * @param[in] outgoingQuota The number of records of a block this context may
+ * use for outgoing publishes; zero disables outgoing QoS 1 and QoS 2 publishes.
+ * @param[in] incomingQuota The number of records of a block this context may
+ * use for incoming publishes; zero disables incoming QoS 1 and QoS 2 publishes.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed, a quota is
+ * larger than the blocks of the pool, or the context already has record
+ * arrays; #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized, and the pool to be
+ * // initialized with blocks of at least 8 records.
+ * MQTTContext_t * pContext;
+ * MQTTRecordPool_t * pPool;
+ *
+ * status = MQTT_InitStatefulQoSPool( pContext, pPool, 8, 4 );
+ * @endcode
+ */
+/* @[declare_mqtt_initstatefulqospool] */
+MQTTStatus_t MQTT_InitStatefulQoSPool( MQTTContext_t * pContext,
+                                       MQTTRecordPool_t * pPool,
+                                       size_t outgoingQuota,
+                                       size_t incomingQuota );
+/* @[declare_mqtt_initstatefulqospool] */
+
+/**
+ * @brief Initialize a pool of receive buffers that can be shared by many MQTT
+ * contexts.
+ *
+ * Each context normally owns a network buffer large enough for the biggest
+ * packet it may receive, for as long as it exists, even though most
+ * connections are idle most of the time. With a pool, a context keeps only a
+ * small buffer for keep-alive traffic and acks, and leases a full size buffer
+ * while a larger packet is received. Buffers are taken from and returned to
+ * the pool in constant time.
+ *
+ * When contexts sharing a pool are used from different threads,
+ * #MQTT_PRE_BUFFER_POOL_HOOK and #MQTT_POST_BUFFER_POOL_HOOK must be defined to
+ * a lock guarding the pool.
+ *
+ * @param[in] pPool The pool to initialize.
+ * @param[in] pBuffers Memory of @p bufferSize times @p bufferCount bytes.
+ * @param[in] bufferSize The size of each buffer. This is the largest packet a
+ * context using the pool can receive.
+ * @param[in] bufferCount The number of buffers in the pool.
+ * @param[in] pFreeBuffers Array of @p bufferCount elements used to track the
+ * free buffers.
+ *
+ * Both arrays must remain valid and in scope for the lifetime of @p pPool and
+ * of every context using it.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // 16 buffers of 4 KB, shared by all connections.
+ * uint8_t buffers[ 16 * 4096 ];
+ * size_t freeBuffers[ 16 ];
+ * MQTTBufferPool_t pool;
+ *
+ * status = MQTT_InitBufferPool( &pool, buffers, 4096, 16, freeBuffers );
+ * @endcode
+ */
+/* @[declare_mqtt_initbufferpool] */
+MQTTStatus_t MQTT_InitBufferPool( MQTTBufferPool_t * pPool,
+                                  uint8_t * pBuffers,
+                                  size_t bufferSize,
+                                  size_t bufferCount,
+                                  size_t * pFreeBuffers );
+/* @[declare_mqtt_initbufferpool] */
+
+/**
+ * @brief Let an MQTT context lease its receive buffer from a shared pool.
+ *
+ * The network buffer given to #MQTT_Init becomes a staging area. Packets that
+ * fit in it, such as PINGRESP and acks, are received there. Once the fixed
+ * header of a larger packet has been read, a buffer is leased from the pool,
+ * the bytes read so far are copied to it, and the packet is received into it.
+ * The buffer is returned once every received byte has been processed, or
+ * when the next connection is started. The maximum packet size announced in
+ * CONNECT is the size of the pool buffers.
+ *
+ * If the pool has no free buffer, #MQTT_ProcessLoop and #MQTT_ReceiveLoop
+ * return #MQTTNoMemory and the packet stays in the transport until a later
+ * call.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init, and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pPool Pool initialized with #MQTT_InitBufferPool. It must remain
+ * valid and in scope for the lifetime of @p pContext.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed, the network
+ * buffer of the context is smaller than the largest fixed header (5 bytes) or
+ * larger than the buffers of the pool, or the context is receiving a packet;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized with a 16 byte network buffer,
+ * // and the pool to be initialized.
+ * MQTTContext_t * pContext;
+ * MQTTBufferPool_t * pPool;
+ *
+ * status = MQTT_InitNetworkBufferPool( pContext, pPool );
+ * @endcode
+ */
+/* @[declare_mqtt_initnetworkbufferpool] */
+MQTTStatus_t MQTT_InitNetworkBufferPool( MQTTContext_t * pContext,
+                                         MQTTBufferPool_t * pPool );
+/* @[declare_mqtt_initnetworkbufferpool] */
+
+/**
+ * @brief Give a buffer taken from an #MQTTEventCallback_t back to its pool.
+ *
+ * When a PUBLISH is received into a buffer leased from the pool, the event
+ * callback sees the buffer in #MQTTDeserializedInfo_t.pPacketBuffer and may set
+ * #MQTTDeserializedInfo_t.takePacketBuffer to keep it, for example to pass the
+ * payload to another task without copying it. The context continues with its
+ * staging buffer and leases a new buffer for the next large packet. The owner
+ * of the buffer must return it with this function once done with it.
+ *
+ * @param[in] pPool The pool the buffer was leased from.
+ * @param[in] pBuffer The buffer to return.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or @p pBuffer is
+ * not a buffer of @p pPool; #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTBufferPool_t pool;
+ * uint8_t * pTakenBuffer;
+ *
+ * // In the event callback, for an incoming PUBLISH.
+ * if( pDeserializedInfo->pPacketBuffer != NULL )
+ * {
+ *     pTakenBuffer = pDeserializedInfo->pPacketBuffer;
+ *     pDeserializedInfo->takePacketBuffer = true;
+ * }
+ *
+ * // Later, once the payload has been consumed.
+ * status = MQTT_ReturnPoolBuffer( &pool, pTakenBuffer );
+ * @endcode
+ */
+/* @[declare_mqtt_returnpoolbuffer] */
+MQTTStatus_t MQTT_ReturnPoolBuffer( MQTTBufferPool_t * pPool,
+                                    uint8_t * pBuffer );
+/* @[declare_mqtt_returnpoolbuffer] */
+
+#if ( MQTT_ENABLE_RETRANSMIT != 0 )
+
 /**
  * @brief Initialize an MQTT context for publish retransmits for QoS > 0.
  *
@@ -641,7 +1101,7 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
  * bool publishClearAllCallback(struct MQTTContext* pContext);
  *
  * MQTTContext_t mqttContext;
- * TransportInterface_t transport;
+ * TransportInterface_t transport = { 0 };
  * MQTTFixedBuffer_t fixedBuffer;
  * uint8_t buffer[ 1024 ];
  * const size_t outgoingPublishCount = 30;
@@ -693,6 +1153,220 @@ MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
                                    MQTTClearPacketForRetransmit clearFunction );
 /* @[declare_mqtt_initretransmits] */
 
+#endif /* if ( MQTT_ENABLE_RETRANSMIT != 0 ) */
+
+/**
+ * @brief Initialize the publish queue of an MQTT context.
+ *
+ * The publish queue lets any number of producer threads hand publishes to the
+ * thread that owns the context, without taking the lock of
+ * #MQTT_PRE_STATE_UPDATE_HOOK and without waiting for a network send. Producers
+ * call #MQTT_EnqueuePublish, and the thread running #MQTT_ProcessLoop sends the
+ * queued publishes at the start of each call, or explicitly through
+ * #MQTT_ProcessPublishQueue.
+ *
+ * Producers only synchronize with each other and, for the short time it takes
+ * to copy an element, with the owner thread. This is done through
+ * #MQTT_PRE_PUBLISH_QUEUE_HOOK and #MQTT_POST_PUBLISH_QUEUE_HOOK, which must be
+ * defined to a lock separate from the state update hooks when the queue is used
+ * from more than one thread.
+ *
+ * Only an in-memory queue is supported. Queued publishes hold pointers to the
+ * topic, payload and properties of the application, so they cannot outlive
+ * that memory, for example across a reboot.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pPublishQueue Array used as a ring buffer for queued publishes.
+ * This array must remain valid and in scope for the lifetime of @p pContext.
+ * @param[in] publishQueueLength The number of elements in @p pPublishQueue.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized.
+ * MQTTContext_t * pContext;
+ * MQTTPublishRequest_t publishQueue[ 16 ];
+ *
+ * status = MQTT_InitPublishQueue( pContext, publishQueue, 16 );
+ * @endcode
+ */
+/* @[declare_mqtt_initpublishqueue] */
+MQTTStatus_t MQTT_InitPublishQueue( MQTTContext_t * pContext,
+                                    MQTTPublishRequest_t * pPublishQueue,
+                                    size_t publishQueueLength );
+/* @[declare_mqtt_initpublishqueue] */
+
+/**
+ * @brief Set what #MQTT_EnqueuePublish does when the publish queue is full.
+ *
+ * Publishes may be queued while the connection is down; they are sent by
+ * #MQTT_Connect right after the CONNACK and any resent packets. When the
+ * connection stays down for long, this policy decides which publishes are
+ * kept. By default, new publishes are refused once the queue is full.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] policy The policy to use.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized with a publish queue.
+ * MQTTContext_t * pContext;
+ *
+ * // Keep the most recent readings while the connection is down.
+ * status = MQTT_SetPublishQueuePolicy( pContext, MQTTPublishQueueDropOldest );
+ * @endcode
+ */
+/* @[declare_mqtt_setpublishqueuepolicy] */
+MQTTStatus_t MQTT_SetPublishQueuePolicy( MQTTContext_t * pContext,
+                                         MQTTPublishQueuePolicy_t policy );
+/* @[declare_mqtt_setpublishqueuepolicy] */
+
+/**
+ * @brief Limit the rate at which PUBLISH packets are sent on a context.
+ *
+ * Bursts of publishes can overflow the buffers of slow links such as cellular
+ * modems, after which every send waits on partial writes until
+ * #MQTT_SEND_TIMEOUT_MS expires. With a rate limit, PUBLISH packets are admitted
+ * through a token bucket that holds up to @p burstBytes bytes and is refilled
+ * at @p bytesPerSecond. A PUBLISH that does not fit in the bucket is not sent;
+ * #MQTT_Publish returns #MQTTRateLimited straight away, before any state record
+ * is reserved, and #MQTT_GetRateLimitDelay gives the number of milliseconds
+ * after which it can be sent. A PUBLISH larger than the bucket is sent once the
+ * bucket is full.
+ *
+ * Only new PUBLISH packets are limited. Acks, PINGREQs, subscriptions and the
+ * publishes resent when a session is resumed are always sent straight away.
+ * Publishes in the publish queue that are refused stay queued, and
+ * #MQTT_ProcessLoop does not treat #MQTTRateLimited as an error.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init. The
+ * bucket starts full.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] bytesPerSecond Rate at which the bucket is refilled, or zero to
+ * remove the limit. It must not be more than UINT32_MAX / 1000.
+ * @param[in] burstBytes Capacity of the bucket. It must be non-zero, not more
+ * than #MQTT_MAX_PACKET_SIZE, and fill up in less than UINT32_MAX / 1000
+ * seconds.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized.
+ * MQTTContext_t * pContext;
+ *
+ * // Send at most 4 KB per second, in bursts of up to 1 KB.
+ * status = MQTT_InitRateLimit( pContext, 4096, 1024 );
+ * @endcode
+ */
+/* @[declare_mqtt_initratelimit] */
+MQTTStatus_t MQTT_InitRateLimit( MQTTContext_t * pContext,
+                                 uint32_t bytesPerSecond,
+                                 uint32_t burstBytes );
+/* @[declare_mqtt_initratelimit] */
+
+/**
+ * @brief Initialize the subscribe buffer of an MQTT context.
+ *
+ * By default, #MQTT_Subscribe and #MQTT_Unsubscribe send the topic filters
+ * straight from the subscription list without copying them, using at most
+ * #MQTT_SUB_UNSUB_MAX_VECTORS vectors per transport call. A packet with many
+ * topic filters is therefore written in many small sends. Once a subscribe
+ * buffer is set, any SUBSCRIBE or UNSUBSCRIBE packet that fits in it is
+ * serialized into the buffer and written with a single send. Larger packets
+ * are still sent from the subscription list.
+ *
+ * The buffer is only accessed while the send hook is held, so it may be shared
+ * by all threads using the context.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pSubscribeBuffer Buffer for serializing SUBSCRIBE and UNSUBSCRIBE
+ * packets. The memory it points to must remain valid and in scope for the
+ * lifetime of @p pContext.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized.
+ * MQTTContext_t * pContext;
+ * MQTTFixedBuffer_t subscribeBuffer;
+ * static uint8_t buffer[ 8192 ];
+ *
+ * subscribeBuffer.pBuffer = buffer;
+ * subscribeBuffer.size = sizeof( buffer );
+ *
+ * status = MQTT_InitSubscribeBuffer( pContext, &subscribeBuffer );
+ * @endcode
+ */
+/* @[declare_mqtt_initsubscribebuffer] */
+MQTTStatus_t MQTT_InitSubscribeBuffer( MQTTContext_t * pContext,
+                                       const MQTTFixedBuffer_t * pSubscribeBuffer );
+/* @[declare_mqtt_initsubscribebuffer] */
+
+/**
+ * @brief Initialize the subscription registry of an MQTT context.
+ *
+ * Once a registry is set, every topic filter passed to #MQTT_Subscribe is
+ * recorded together with its subscription options. A filter is kept once the
+ * server grants it in the SUBACK, and dropped if the server refuses it or it
+ * is passed to #MQTT_Unsubscribe. A topic filter that is subscribed again
+ * replaces its earlier record.
+ *
+ * When #MQTT_Connect establishes a connection and the server reports that no
+ * session is present, all registered subscriptions are re-issued right away.
+ * They are packed #MQTT_RESUBSCRIBE_BATCH_SIZE topic filters per SUBSCRIBE
+ * packet, and the packets are sent back to back without waiting for the
+ * SUBACKs. The SUBACKs are received by #MQTT_ProcessLoop and passed to the
+ * event callback like those of any other SUBSCRIBE.
+ *
+ * @note Properties passed to #MQTT_Subscribe, such as a subscription
+ * identifier, are not stored and are not sent again on replay.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pSubscriptionRecords Array used to store the registered
+ * subscriptions. This array must remain valid and in scope for the lifetime of
+ * @p pContext.
+ * @param[in] subscriptionRecordMaxCount The number of elements in
+ * @p pSubscriptionRecords.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized.
+ * MQTTContext_t * pContext;
+ * MQTTSubscriptionRecord_t subscriptionRecords[ 32 ];
+ *
+ * status = MQTT_InitSubscriptionRegistry( pContext, subscriptionRecords, 32 );
+ * @endcode
+ */
+/* @[declare_mqtt_initsubscriptionregistry] */
+MQTTStatus_t MQTT_InitSubscriptionRegistry( MQTTContext_t * pContext,
+                                            MQTTSubscriptionRecord_t * pSubscriptionRecords,
+                                            size_t subscriptionRecordMaxCount );
+/* @[declare_mqtt_initsubscriptionregistry] */
+
 /**
  * @brief Checks the MQTT connection status with the broker.
  *
@@ -767,6 +1441,11 @@ MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext );
  * coreMQTT cannot handle the packet, neither can it drop it as MQTT protocol doesn't
  * allow it.
  *
+ * @note If a publish queue was set with #MQTT_InitPublishQueue, the publishes
+ * queued while the connection was down are sent right after the CONNACK and
+ * any packets resent for a resumed session, as with #MQTT_ProcessPublishQueue.
+ * Publishes that cannot be sent yet stay queued.
+ *
  * @note This API may spend more time than provided in the timeoutMS parameters in
  * certain conditions as listed below:
  *
@@ -881,18 +1560,122 @@ MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
 /* @[declare_mqtt_connect] */
 
 /**
- * @brief Sends MQTT SUBSCRIBE for the given list of topic filters to
- * the broker.
+ * @brief Send an MQTT CONNECT packet without waiting for the CONNACK.
+ *
+ * This is the non-blocking counterpart of #MQTT_Connect. It validates the
+ * parameters and sends the CONNECT packet in the same way, then returns.
+ * The CONNACK is received by calling #MQTT_ConnectPoll until it returns
+ * something other than #MQTTNoDataAvailable. An application driving many
+ * connections can therefore have all their handshakes in flight at once.
+ *
+ * Calling this function or #MQTT_Connect again before the CONNACK arrives
+ * abandons the pending handshake.
  *
  * @param[in] pContext Initialized MQTT context.
- * @param[in] pSubscriptionList Array of MQTT subscription info.
- * @param[in] subscriptionCount The number of elements in @ pSubscriptionList
- * array.
- * @param[in] packetId Packet ID generated by #MQTT_GetPacketId.
- * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pConnectInfo MQTT CONNECT packet information.
+ * @param[in] pWillInfo Last Will and Testament. Pass NULL if Last Will and
+ * Testament is not used.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pWillPropertyBuilder Will properties to be sent in the outgoing packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSendFailed if transport send failed;<br>
+ * #MQTTStatusConnected if the connection is already established<br>
+ * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
+ * before calling any other API<br>
+ * #MQTTSuccess if the CONNECT packet was sent.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTConnectInfo_t connectInfo = { 0 };
+ * bool sessionPresent;
+ * // This is assumed to have been initialized before calling this function.
+ * MQTTContext_t * pContext;
+ *
+ * connectInfo.cleanSession = true;
+ * connectInfo.pClientIdentifier = "someClientID";
+ * connectInfo.clientIdentifierLength = strlen( connectInfo.pClientIdentifier );
+ * connectInfo.keepAliveSeconds = 60;
+ *
+ * status = MQTT_ConnectStart( pContext, &connectInfo, NULL, NULL, NULL );
+ *
+ * while( status == MQTTSuccess )
+ * {
+ *      // Service the other connections, then check for this CONNACK.
+ *      status = MQTT_ConnectPoll( pContext, &sessionPresent );
+ *
+ *      if( status == MQTTNoDataAvailable )
+ *      {
+ *          // The application enforces its own CONNACK timeout here.
+ *          status = MQTTSuccess;
+ *      }
+ *      else
+ *      {
+ *          break;
+ *      }
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_connectstart] */
+MQTTStatus_t MQTT_ConnectStart( MQTTContext_t * pContext,
+                                const MQTTConnectInfo_t * pConnectInfo,
+                                const MQTTPublishInfo_t * pWillInfo,
+                                MQTTPropBuilder_t * pPropertyBuilder,
+                                const MQTTPropBuilder_t * pWillPropertyBuilder );
+/* @[declare_mqtt_connectstart] */
+
+/**
+ * @brief Check once for the CONNACK of a CONNECT sent by #MQTT_ConnectStart.
+ *
+ * The transport is read once. If no data is available, the function returns
+ * #MQTTNoDataAvailable at once and should be called again later. Otherwise
+ * the CONNACK is received and handled exactly as in #MQTT_Connect: the
+ * application callback is invoked with it and, on success, the session state
+ * is restored or cleaned up. The handshake is over for any other return value.
+ *
+ * The library does not time out a pending handshake; the application decides
+ * how long to keep polling. The transport receive function must return 0 when
+ * no data is available for the call to be non-blocking. Once the first byte of
+ * the CONNACK has arrived, the rest of it is read with the same receive timeout
+ * as #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[out] pSessionPresent This value will be set to true if a previous
+ * session was present; otherwise it will be set to false.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTStatusNotConnected if no CONNECT is waiting for a CONNACK;<br>
+ * #MQTTNoDataAvailable if the CONNACK has not arrived yet;<br>
+ * #MQTTRecvFailed if transport receive failed;<br>
+ * #MQTTBadResponse if an invalid packet is received;<br>
+ * #MQTTServerRefused if the server refused the connection;<br>
+ * #MQTTEventCallbackFailed if the application callback failed;<br>
+ * #MQTTSendFailed if resending the session state failed;<br>
+ * #MQTTSuccess if the connection is established.
+ */
+/* @[declare_mqtt_connectpoll] */
+MQTTStatus_t MQTT_ConnectPoll( MQTTContext_t * pContext,
+                               bool * pSessionPresent );
+/* @[declare_mqtt_connectpoll] */
+
+/**
+ * @brief Sends MQTT SUBSCRIBE for the given list of topic filters to
+ * the broker.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pSubscriptionList Array of MQTT subscription info.
+ * @param[in] subscriptionCount The number of elements in @ pSubscriptionList
+ * array.
+ * @param[in] packetId Packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
  * @return
  * #MQTTBadParameter if invalid parameters are passed;<br>
  * #MQTTBadResponse if there is an error in property parsing;<br>
+ * #MQTTNoMemory if the subscription registry set with
+ * #MQTT_InitSubscriptionRegistry cannot hold the topic filters;<br>
  * #MQTTSendFailed if transport write failed;<br>
  * #MQTTStatusNotConnected if the connection is not established yet<br>
  * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
@@ -971,6 +1754,8 @@ MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
  * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
  * before calling any other API<br>
  * #MQTTNoMemory if the outgoing publish record array is full<br>
+ * #MQTTRateLimited if the PUBLISH exceeds the rate set with
+ * #MQTT_InitRateLimit<br>
  * #MQTTStateCollision if a QoS > 0 publish with the same packet ID already
  * exists in the state records and the duplicate flag is not set<br>
  * #MQTTIllegalState if the state machine update after sending fails<br>
@@ -1032,6 +1817,320 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
                            const MQTTPropBuilder_t * pPropertyBuilder );
 /* @[declare_mqtt_publish] */
 
+/**
+ * @brief Publishes a message whose payload is made of several fragments.
+ *
+ * The fragments are sent in order, each straight from the memory the
+ * application keeps it in, so a payload produced in pieces need not be
+ * assembled into one buffer first. For a QoS > 0 publish, the packet given to
+ * the #MQTTStorePacketForRetransmit function holds the whole payload.
+ *
+ * The @p pPayload and @p payloadLength members of @p pPublishInfo are ignored;
+ * the payload length is the sum of the fragment lengths.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pPayloadFragments Payload fragments, in order. They must stay
+ * valid until the function returns.
+ * @param[in] fragmentCount Number of fragments, at most
+ * #MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS.
+ *
+ * @return #MQTTBadParameter if a fragment has a length but no data or there
+ * are too many fragments; otherwise the status codes of #MQTT_Publish.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * TransportOutVector_t fragments[ 2 ];
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS1;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ *
+ * // A reading header and the samples, each kept in its own buffer.
+ * fragments[ 0 ].iov_base = header;
+ * fragments[ 0 ].iov_len = sizeof( header );
+ * fragments[ 1 ].iov_base = samples;
+ * fragments[ 1 ].iov_len = sampleCount * sizeof( samples[ 0 ] );
+ *
+ * status = MQTT_PublishFragments( pContext, &publishInfo, MQTT_GetPacketId( pContext ),
+ *                                 NULL, fragments, 2 );
+ * @endcode
+ */
+/* @[declare_mqtt_publishfragments] */
+MQTTStatus_t MQTT_PublishFragments( MQTTContext_t * pContext,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    uint16_t packetId,
+                                    const MQTTPropBuilder_t * pPropertyBuilder,
+                                    const TransportOutVector_t * pPayloadFragments,
+                                    size_t fragmentCount );
+/* @[declare_mqtt_publishfragments] */
+
+/**
+ * @brief Publishes a message whose payload is sent by the transport from a
+ * source the application owns, such as a file.
+ *
+ * The packet header is sent with the transport send or writev function, then
+ * the #TransportSendPayload_t function of the transport interface sends
+ * the payload length of @p pPublishInfo bytes of @p pPayloadSource starting at @p payloadOffset.
+ * The library never reads the payload, so a transport can move it from a file
+ * to the socket without copying it through application memory.
+ *
+ * The @p pPayload member of @p pPublishInfo is ignored. Since the payload
+ * cannot be stored, a QoS > 0 publish is refused when a
+ * #MQTTStorePacketForRetransmit function is set.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pPayloadSource Source of the payload, passed unchanged to the
+ * transport.
+ * @param[in] payloadOffset Offset of the payload in @p pPayloadSource.
+ *
+ * @return #MQTTBadParameter if @p pPayloadSource is NULL, the transport has
+ * no sendPayload function, or the publish would have to be stored; otherwise
+ * the status codes of #MQTT_Publish.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * // The transport of this example takes a file descriptor as the source.
+ * int fd = open( "/var/log/readings", O_RDONLY );
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS0;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ * publishInfo.payloadLength = 4096;
+ *
+ * // Send the second block of the file.
+ * status = MQTT_PublishFromSource( pContext, &publishInfo, 0, NULL, &fd, 4096 );
+ * @endcode
+ */
+/* @[declare_mqtt_publishfromsource] */
+MQTTStatus_t MQTT_PublishFromSource( MQTTContext_t * pContext,
+                                     const MQTTPublishInfo_t * pPublishInfo,
+                                     uint16_t packetId,
+                                     const MQTTPropBuilder_t * pPropertyBuilder,
+                                     const void * pPayloadSource,
+                                     size_t payloadOffset );
+/* @[declare_mqtt_publishfromsource] */
+
+/**
+ * @brief Validates and encodes the parts of a PUBLISH that stay the same from
+ * one message to the next, for use with #MQTT_PublishPrepared.
+ *
+ * The topic, QoS, retain flag and properties are checked against the limits
+ * of the server once, and the packet flags and the length of everything but
+ * the payload are computed once. This suits an application that publishes at
+ * a high rate to a fixed set of topics.
+ *
+ * The limits of the server can change with each connection, so a prepared
+ * publish should be prepared again after #MQTT_Connect. #MQTT_PublishPrepared
+ * rejects a prepared publish that no longer fits the limits of the server.
+ *
+ * @param[in] pContext Initialized and connected MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters. The payload and
+ * DUP flag are ignored.
+ * @param[in] pPropertyBuilder Properties to be sent in each PUBLISH, or NULL.
+ * @param[out] pPreparedPublish The prepared publish.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * MQTTPreparedPublish_t preparedPublish;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS1;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ *
+ * status = MQTT_PreparePublish( pContext, &publishInfo, NULL, &preparedPublish );
+ *
+ * while( status == MQTTSuccess )
+ * {
+ *      // Read a sample and publish it.
+ *      sampleLength = readSample( sample, sizeof( sample ) );
+ *      status = MQTT_PublishPrepared( pContext, &preparedPublish, sample, sampleLength,
+ *                                     MQTT_GetPacketId( pContext ), false );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_preparepublish] */
+MQTTStatus_t MQTT_PreparePublish( MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  const MQTTPropBuilder_t * pPropertyBuilder,
+                                  MQTTPreparedPublish_t * pPreparedPublish );
+/* @[declare_mqtt_preparepublish] */
+
+/**
+ * @brief Publishes a message using a PUBLISH prepared by #MQTT_PreparePublish.
+ *
+ * Only the remaining length, the packet ID and the DUP flag are encoded for
+ * each message. The payload and packet ID are checked, and the QoS, retain
+ * flag, topic alias and packet size are checked again against the limits of
+ * the current connection.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPreparedPublish Publish prepared by #MQTT_PreparePublish.
+ * @param[in] pPayload Payload of the message.
+ * @param[in] payloadLength Length of @p pPayload.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId, or 0 for a
+ * QoS 0 publish.
+ * @param[in] dup Whether the message is a resend of an earlier PUBLISH.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or the server
+ * of the current connection does not accept the packet; otherwise the status
+ * codes of #MQTT_Publish.
+ */
+/* @[declare_mqtt_publishprepared] */
+MQTTStatus_t MQTT_PublishPrepared( MQTTContext_t * pContext,
+                                   const MQTTPreparedPublish_t * pPreparedPublish,
+                                   const void * pPayload,
+                                   size_t payloadLength,
+                                   uint16_t packetId,
+                                   bool dup );
+/* @[declare_mqtt_publishprepared] */
+
+/**
+ * @brief Queue a PUBLISH to be sent by the thread that owns the context.
+ *
+ * This function may be called from any thread. It copies @p pPublishInfo into
+ * the publish queue set with #MQTT_InitPublishQueue and returns without
+ * sending anything. The topic name, payload and properties are not copied and
+ * must remain valid until the publish has been sent or dropped.
+ *
+ * The publish parameters are checked as by #MQTT_Publish before the publish is
+ * queued. Checks that depend on the state of the context, such as whether
+ * QoS 1 and 2 publishes have been enabled with #MQTT_InitStatefulQoS, or on
+ * the connection, such as the maximum QoS and topic alias of the server, are
+ * only made when the publish is sent.
+ *
+ * Publishes may also be queued while the connection is down. They are sent
+ * by #MQTT_Connect once the connection is back up.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet ID generated by #MQTT_GetPacketId, or 0 to have
+ * the owner thread assign one when the publish is sent.
+ * @param[in] pPropertyBuilder Property builder containing PUBLISH properties,
+ * or NULL.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no publish
+ * queue has been initialized;
+ * #MQTTNoMemory if the publish queue is full and the policy set with
+ * #MQTT_SetPublishQueuePolicy refuses the publish;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * // This context is assumed to be initialized, with a publish queue.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS1;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ * publishInfo.pPayload = "Hello World!";
+ * publishInfo.payloadLength = strlen( "Hello World!" );
+ *
+ * // The packet ID is assigned by the thread running MQTT_ProcessLoop.
+ * status = MQTT_EnqueuePublish( pContext, &publishInfo, 0, NULL );
+ * @endcode
+ */
+/* @[declare_mqtt_enqueuepublish] */
+MQTTStatus_t MQTT_EnqueuePublish( MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  uint16_t packetId,
+                                  const MQTTPropBuilder_t * pPropertyBuilder );
+/* @[declare_mqtt_enqueuepublish] */
+
+/**
+ * @brief Queue a PUBLISH with a priority class to be sent by the thread that
+ * owns the context.
+ *
+ * Same as #MQTT_EnqueuePublish, which queues with #MQTTPublishPriorityNormal.
+ * #MQTT_ProcessPublishQueue sends the oldest publish of the highest class
+ * first, so a command queued with #MQTTPublishPriorityHigh is not held up
+ * behind bulk data queued with #MQTTPublishPriorityLow.
+ *
+ * @param[in] pContext Initialized MQTT context with a publish queue.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet ID generated by #MQTT_GetPacketId, or 0 to have
+ * the owner thread assign one when the publish is sent.
+ * @param[in] pPropertyBuilder Property builder containing PUBLISH properties,
+ * or NULL.
+ * @param[in] priority Priority class of the publish.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no publish
+ * queue has been initialized;
+ * #MQTTNoMemory if the publish queue is full and the policy set with
+ * #MQTT_SetPublishQueuePolicy refuses the publish;
+ * #MQTTSuccess otherwise.
+ */
+/* @[declare_mqtt_enqueuepublishwithpriority] */
+MQTTStatus_t MQTT_EnqueuePublishWithPriority( MQTTContext_t * pContext,
+                                              const MQTTPublishInfo_t * pPublishInfo,
+                                              uint16_t packetId,
+                                              const MQTTPropBuilder_t * pPropertyBuilder,
+                                              MQTTPublishPriority_t priority );
+/* @[declare_mqtt_enqueuepublishwithpriority] */
+
+/**
+ * @brief Send the publishes waiting in the publish queue.
+ *
+ * This function must only be called by the thread that owns the context. It
+ * is called by #MQTT_ProcessLoop, so applications only need to call it
+ * directly when they use #MQTT_ReceiveLoop or want to flush the queue without
+ * receiving. Only publishes queued before the call are sent, so the call is
+ * bounded even while producers keep adding to the queue.
+ *
+ * Publishes are sent highest #MQTTPublishPriority_t class first, and in queue
+ * order within a class. At most #MQTT_PUBLISH_QUEUE_BYTES_PER_CALL bytes of
+ * publishes below #MQTTPublishPriorityHigh are sent per call.
+ *
+ * A publish that cannot be sent yet because the connection is not established
+ * or the outgoing publish record array is full stays at the head of the queue,
+ * and the function returns. A publish that fails for any other reason is
+ * removed from the queue. The publishes queued after it are still sent unless
+ * the transport failed, and the first such failure is returned.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return #MQTTSuccess if the queue is empty or all queued publishes were sent;
+ * #MQTTBadParameter if context is NULL;
+ * #MQTTNoMemory if the outgoing publish record array is full;
+ * #MQTTStatusNotConnected or #MQTTStatusDisconnectPending if the connection
+ * is not established;
+ * any other status returned by #MQTT_Publish for the first publish that was
+ * dropped.
+ */
+/* @[declare_mqtt_processpublishqueue] */
+MQTTStatus_t MQTT_ProcessPublishQueue( MQTTContext_t * pContext );
+/* @[declare_mqtt_processpublishqueue] */
+
 /**
  * @brief Cancels an outgoing publish callback (only for QoS > QoS0) by
  * removing it from the pending ACK list.
@@ -1071,6 +2170,8 @@ MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
 MQTTStatus_t MQTT_Ping( MQTTContext_t * pContext );
 /* @[declare_mqtt_ping] */
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @brief Sends MQTT UNSUBSCRIBE for the given list of topic filters to
  * the broker.
@@ -1149,6 +2250,8 @@ MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
                                const MQTTPropBuilder_t * pPropertyBuilder );
 /* @[declare_mqtt_unsubscribe] */
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
 /**
  * @brief Sends MQTT DISCONNECT for a given reason code
  *
@@ -1201,6 +2304,63 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
                               const MQTTSuccessFailReasonCode_t * pReasonCode );
 /* @[declare_mqtt_disconnect] */
 
+/**
+ * @brief Send an AUTH packet to continue an enhanced authentication exchange
+ * or to start a re-authentication of an established connection.
+ *
+ * An AUTH packet received from the server is given to the #MQTTEventCallback_t
+ * with its reason code and properties, from #MQTT_Connect, #MQTT_ConnectPoll
+ * or #MQTT_ProcessLoop. The application can answer it by calling this function
+ * from the callback. The outcome of a re-authentication, an AUTH with a
+ * success reason code or a DISCONNECT, arrives through #MQTT_ProcessLoop.
+ *
+ * @note The Authentication Method must be the one sent in the CONNECT packet.
+ * The library does not keep track of it.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] reasonCode #MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION or
+ * #MQTT_REASON_AUTH_RE_AUTHENTICATE.
+ * @param[in] pPropertyBuilder Properties of the AUTH packet. It must contain
+ * the Authentication Method.
+ *
+ * @return
+ * #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSendFailed if transport send failed;<br>
+ * #MQTTStatusNotConnected if the connection is not established yet and no
+ * CONNECT is waiting for its CONNACK;<br>
+ * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
+ * before calling any other API;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ * MQTTPropBuilder_t propertyBuilder;
+ * uint8_t propertyBuffer[ 100 ];
+ * uint8_t packetType = MQTT_PACKET_TYPE_AUTH;
+ *
+ * status = MQTTPropertyBuilder_Init( &propertyBuilder, propertyBuffer, sizeof( propertyBuffer ) );
+ * status = MQTTPropAdd_AuthMethod( &propertyBuilder, "SCRAM-SHA-1", 11, &packetType );
+ * status = MQTTPropAdd_AuthData( &propertyBuilder, pClientFirst, clientFirstLength, &packetType );
+ *
+ * status = MQTT_Auth( pContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propertyBuilder );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // The server's answer is handed to the event callback by MQTT_ProcessLoop.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_auth] */
+MQTTStatus_t MQTT_Auth( MQTTContext_t * pContext,
+                        MQTTSuccessFailReasonCode_t reasonCode,
+                        const MQTTPropBuilder_t * pPropertyBuilder );
+/* @[declare_mqtt_auth] */
+
 /**
  * @brief Loop to receive packets from the transport interface. Handles keep
  * alive.
@@ -1211,6 +2371,11 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
  *
  * @param[in] pContext Initialized and connected MQTT context.
  *
+ * @note If a publish queue was set with #MQTT_InitPublishQueue, the publishes
+ * queued before this call are sent first, as with #MQTT_ProcessPublishQueue.
+ * A queued publish refused for its own parameters is dropped without failing
+ * this call.
+ *
  * @note Calling this function blocks the calling context for a time period that
  * depends on the passed the configuration macros, #MQTT_RECV_POLLING_TIMEOUT_MS
  * and #MQTT_SEND_TIMEOUT_MS, and the underlying transport interface implementation
@@ -1233,7 +2398,8 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
  * #MQTTIllegalState if an incoming QoS 1/2 publish or ack causes an
  * invalid transition for the internal state machine;
  * #MQTTNoMemory if the incoming publish record array is full when
- * receiving a QoS 1/2 publish;
+ * receiving a QoS 1/2 publish, or no buffer can be leased from the pool set
+ * with #MQTT_InitNetworkBufferPool;
  * #MQTTStatusNotConnected if the connection is not established yet and a PING
  * or an ACK is being sent;
  * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
@@ -1300,7 +2466,8 @@ MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext );
  * #MQTTIllegalState if an incoming QoS 1/2 publish or ack causes an
  * invalid transition for the internal state machine;
  * #MQTTNoMemory if the incoming publish record array is full when
- * receiving a QoS 1/2 publish;
+ * receiving a QoS 1/2 publish, or no buffer can be leased from the pool set
+ * with #MQTT_InitNetworkBufferPool;
  * #MQTTStatusNotConnected if the connection is not established yet and an
  * ACK is being sent;
  * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
@@ -1345,9 +2512,143 @@ MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext );
 MQTTStatus_t MQTT_ReceiveLoop( MQTTContext_t * pContext );
 /* @[declare_mqtt_receiveloop] */
 
+/**
+ * @brief Run the keep-alive checks of #MQTT_ProcessLoop without reading from
+ * the transport interface.
+ *
+ * #MQTT_ProcessLoop only checks keep-alive when the transport receive returns
+ * no data. Applications that drive many contexts from one thread with a
+ * readiness-based event loop (for example epoll, kqueue or a select loop) only
+ * call #MQTT_ProcessLoop when the socket is readable, so keep-alive would never
+ * be evaluated on a busy or idle connection. Such applications should instead
+ * call this function when the keep-alive timer of a context expires. It sends
+ * a PINGREQ when the connection has been idle for the keep-alive interval and
+ * reports a missing PINGRESP, without touching the network buffer.
+ *
+ * @param[in] pContext Initialized and connected MQTT context.
+ *
+ * @return #MQTTSuccess if no action was required or a PINGREQ was sent;
+ * #MQTTBadParameter if context is NULL or has no getTime function;
+ * #MQTTKeepAliveTimeout if the server has not sent a PINGRESP before
+ * #MQTT_PINGRESP_TIMEOUT_MS milliseconds;
+ * #MQTTSendFailed if a network error occurs while sending the PINGREQ;
+ * #MQTTStatusNotConnected if the connection is not established yet;
+ * #MQTTStatusDisconnectPending if the user is expected to call MQTT_Disconnect
+ * before calling any other API.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * // This context is assumed to be initialized and connected, and its socket
+ * // registered with the application's event loop.
+ * MQTTContext_t * pContext;
+ *
+ * // Called by the event loop when the socket of pContext is readable.
+ * status = MQTT_ProcessLoop( pContext );
+ *
+ * // Called by the event loop when the keep-alive timer of pContext fires.
+ * status = MQTT_ProcessKeepAlive( pContext );
+ *
+ * if( status == MQTTKeepAliveTimeout )
+ * {
+ *      // The connection is dead. Close the socket and reconnect.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_processkeepalive] */
+MQTTStatus_t MQTT_ProcessKeepAlive( MQTTContext_t * pContext );
+/* @[declare_mqtt_processkeepalive] */
+
+/**
+ * @brief Get the number of milliseconds until the next keep-alive action is
+ * due for a context.
+ *
+ * This is the time after which #MQTT_ProcessKeepAlive (or #MQTT_ProcessLoop)
+ * must be called so that a PINGREQ is sent on an idle connection, or a missing
+ * PINGRESP is detected. It lets an application sleep, or arm a single timer per
+ * connection, instead of polling the context every few milliseconds.
+ *
+ * The deadline is computed from the same values that #MQTT_ProcessKeepAlive
+ * uses, namely #MQTTContext_t.lastPacketTxTime, #MQTTContext_t.lastPacketRxTime
+ * and #MQTTContext_t.pingReqSendTimeMs, so it must be queried again after any
+ * packet has been sent or received.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return 0 if a keep-alive action is already due;
+ * #MQTT_NO_TIMEOUT_PENDING if the context is NULL, has no getTime function, or
+ * is not connected;
+ * the number of milliseconds until the next keep-alive action otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * uint32_t timeoutMs;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * timeoutMs = MQTT_GetNextTimeoutMs( pContext );
+ *
+ * // Wait for the socket to become readable for at most timeoutMs.
+ * if( waitForSocketReadable( timeoutMs ) == true )
+ * {
+ *      status = MQTT_ProcessLoop( pContext );
+ * }
+ * else
+ * {
+ *      status = MQTT_ProcessKeepAlive( pContext );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_getnexttimeoutms] */
+uint32_t MQTT_GetNextTimeoutMs( MQTTContext_t * pContext );
+/* @[declare_mqtt_getnexttimeoutms] */
+
+/**
+ * @brief Get the number of milliseconds after which the last PUBLISH refused
+ * with #MQTTRateLimited can be sent.
+ *
+ * The delay is computed when the PUBLISH is refused, so a smaller PUBLISH may
+ * be sent earlier. It is reset to zero once a PUBLISH is admitted.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return 0 if @p pContext is NULL or no PUBLISH is waiting for the rate
+ * limit; the number of milliseconds to wait otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ * MQTTPublishInfo_t publishInfo;
+ *
+ * status = MQTT_Publish( pContext, &publishInfo, 0, NULL );
+ *
+ * if( status == MQTTRateLimited )
+ * {
+ *      // Keep servicing the connection and try again later.
+ *      retryTimeMs = now + MQTT_GetRateLimitDelay( pContext );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_getratelimitdelay] */
+uint32_t MQTT_GetRateLimitDelay( MQTTContext_t * pContext );
+/* @[declare_mqtt_getratelimitdelay] */
+
 /**
  * @brief Get a packet ID that is valid according to the MQTT 5.0 spec.
  *
+ * IDs held by outgoing QoS 1 and QoS 2 publishes that are still awaiting
+ * their acknowledgement are skipped, so the returned ID does not collide
+ * with an in-flight publish record.
+ *
  * @param[in] pContext Initialized MQTT context.
  *
  * @return A non-zero packet ID, or zero if @p pContext is NULL.
@@ -1508,6 +2809,8 @@ MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
                                         size_t * pPayloadSize );
 /* @[declare_mqtt_getsubackstatuscodes] */
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @brief Parses the payload of an MQTT UNSUBACK packet that contains status codes
  * corresponding to topic filter unsubscribe requests from the original
@@ -1568,6 +2871,8 @@ MQTTStatus_t MQTT_GetUnsubAckStatusCodes( const MQTTPacketInfo_t * pUnsubackPack
                                           size_t * pPayloadSize );
 /* @[declare_mqtt_getunsubackstatuscodes] */
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
 /**
  * @brief Error code to string conversion for MQTT statuses.
  *
@@ -76,6 +76,162 @@
     #define MQTT_SUB_UNSUB_MAX_VECTORS    ( 4U )
 #endif
 
+/**
+ * @ingroup mqtt_constants
+ * @brief Maximum number of payload fragments accepted by #MQTT_PublishFragments.
+ *
+ * Every PUBLISH is sent from an IO vector array on the stack with room for this
+ * many payload fragments, so a larger value costs stack in #MQTT_Publish too.
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `4`
+ */
+#ifndef MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS
+    #define MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS    ( 4U )
+#endif
+
+/**
+ * @brief Build the library for MQTT 3.1.1 brokers only.
+ *
+ * When set to 1, the library speaks the MQTT 3.1.1 wire format: CONNECT
+ * carries protocol level 4, no outgoing packet carries a property length,
+ * incoming packets are parsed without properties and AUTH is not supported.
+ * Property builders passed to the library must be NULL or empty, and
+ * #MQTTContext_t does not reserve a builder for outgoing ack properties.
+ *
+ * @note This macro changes the layout of #MQTTContext_t, so the application
+ * and the library must be compiled with the same value.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_VERSION_3_1_1_ONLY
+    #define MQTT_VERSION_3_1_1_ONLY    ( 0 )
+#endif
+
+/**
+ * @brief Build the QoS 2 flow.
+ *
+ * When set to 0, the PUBREC, PUBREL and PUBCOMP paths are compiled out of the
+ * library. QoS 2 publishes and subscriptions are rejected with
+ * #MQTTBadParameter, and an incoming QoS 2 PUBLISH or PUBREC, PUBREL or PUBCOMP
+ * packet is treated as a malformed packet.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_ENABLE_QOS2
+    #define MQTT_ENABLE_QOS2    ( 1 )
+#endif
+
+/**
+ * @brief Build support for will messages.
+ *
+ * When set to 0, the will serialization code is compiled out and
+ * #MQTT_Connect and #MQTT_GetConnectPacketSize reject a non-NULL will with
+ * #MQTTBadParameter.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_ENABLE_WILL
+    #define MQTT_ENABLE_WILL    ( 1 )
+#endif
+
+/**
+ * @brief Build the retransmit callbacks.
+ *
+ * When set to 0, #MQTT_InitRetransmits and the store, retrieve and clear
+ * callbacks are compiled out. Outgoing publishes are then never copied for
+ * resending when a session is resumed.
+ *
+ * @note This macro changes the layout of #MQTTContext_t and #MQTTPubAckInfo_t,
+ * so the application and the library must be compiled with the same value.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_ENABLE_RETRANSMIT
+    #define MQTT_ENABLE_RETRANSMIT    ( 1 )
+#endif
+
+/**
+ * @brief Apply the Message Expiry Interval of publishes resent when a
+ * session is resumed.
+ *
+ * When set to 1, each outgoing publish record keeps the Message Expiry
+ * Interval and the send time of its PUBLISH, which adds 8 bytes to every
+ * #MQTTPubAckInfo_t. On session resumption, a stored PUBLISH whose interval
+ * has elapsed is dropped instead of resent, and the interval of the others is
+ * rewritten to the time they have left. This has no effect when
+ * #MQTT_ENABLE_RETRANSMIT is 0 or #MQTT_VERSION_3_1_1_ONLY is 1.
+ *
+ * @note The age of a PUBLISH is measured with the #MQTTGetCurrentTimeFunc_t
+ * passed to #MQTT_Init. Its 32-bit millisecond value wraps around after about
+ * 49.7 days, and most implementations restart from zero on reboot. An age
+ * measured across a wrap or a reboot is wrong, so this is only reliable for
+ * publishes resent within 49.7 days on the same boot.
+ *
+ * @note This macro changes the layout of #MQTTPubAckInfo_t, so the application
+ * and the library must be compiled with the same value.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_ENABLE_MESSAGE_EXPIRY
+    #define MQTT_ENABLE_MESSAGE_EXPIRY    ( 0 )
+#endif
+
+/**
+ * @brief Build support for UNSUBSCRIBE.
+ *
+ * When set to 0, #MQTT_Unsubscribe, #MQTT_GetUnsubscribePacketSize and
+ * #MQTT_SerializeUnsubscribe are compiled out and an incoming UNSUBACK is
+ * treated as a malformed packet.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_ENABLE_UNSUBSCRIBE
+    #define MQTT_ENABLE_UNSUBSCRIBE    ( 1 )
+#endif
+
+/**
+ * @brief Build support for shared subscriptions.
+ *
+ * When set to 0, the `$share/` topic filter checks are compiled out and
+ * #MQTT_Subscribe rejects shared subscription topic filters with
+ * #MQTTBadParameter.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_ENABLE_SHARED_SUBSCRIPTIONS
+    #define MQTT_ENABLE_SHARED_SUBSCRIPTIONS    ( 1 )
+#endif
+
+/**
+ * @brief Store the QoS and state of #MQTTPubAckInfo_t records in one byte
+ * each.
+ *
+ * By default, the QoS and publish state of a record are held in enum fields,
+ * which most compilers make as large as an int, so a record takes 12 bytes.
+ * When set to 1, they are held in `uint8_t` fields and a record takes 4 bytes,
+ * which triples the number of records that fit in the same RAM and in each
+ * cache line scanned when a packet ID is looked up. The fields must then be
+ * cast to #MQTTQoS_t and #MQTTPublishState_t when read by the application.
+ *
+ * The 8 bytes of message expiry fields added by #MQTT_ENABLE_MESSAGE_EXPIRY
+ * are not affected. With them, a record takes 20 bytes by default and 12
+ * bytes when set to 1.
+ *
+ * <b>Possible values:</b> `0` or `1` <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_COMPACT_PUBLISH_RECORDS
+    #define MQTT_COMPACT_PUBLISH_RECORDS    ( 0 )
+#endif
+
 /**
  * @brief The number of retries for receiving CONNACK.
  *
@@ -191,6 +347,60 @@
     #define MQTT_SEND_TIMEOUT_MS    ( 20000U )
 #endif
 
+/**
+ * @brief The size of a stack buffer used to join small parts of a packet into
+ * one transport send call, or 0 to send each part on its own.
+ *
+ * A packet is assembled from several parts, such as the fixed header, the
+ * topic name, the properties and the payload. When the transport interface
+ * has no writev function, each part is given to a separate send call. With
+ * this buffer, consecutive parts that fit in it are copied and sent together,
+ * so a PUBLISH with a small payload goes out in a single send call. Parts that
+ * do not fit, such as large payloads, are still sent from their own memory.
+ *
+ * This has no effect if the transport interface implements writev.
+ *
+ * <b>Possible values:</b> Any positive integer up to a size that fits on the
+ * stack of the task calling the library. <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_SEND_COALESCE_BUFFER_SIZE
+    #define MQTT_SEND_COALESCE_BUFFER_SIZE    ( 0U )
+#endif
+
+/**
+ * @brief The maximum number of topic filters carried by one SUBSCRIBE packet
+ * when the subscription registry is replayed after a session was lost.
+ *
+ * The registered subscriptions are copied onto the stack in batches of this
+ * size, and each batch is sent as one SUBSCRIBE packet without waiting for the
+ * SUBACK of the previous one. See #MQTT_InitSubscriptionRegistry.
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `8`
+ */
+#ifndef MQTT_RESUBSCRIBE_BATCH_SIZE
+    #define MQTT_RESUBSCRIBE_BATCH_SIZE    ( 8U )
+#endif
+
+/**
+ * @brief The number of bytes of queued publishes that one call to
+ * #MQTT_ProcessPublishQueue may send, or 0 for no limit.
+ *
+ * Once the budget is spent, only publishes queued with
+ * #MQTTPublishPriorityHigh are sent and the rest wait for the next call. As
+ * #MQTT_ProcessLoop drains the queue before receiving, this lets the acks and
+ * PINGREQs sent while receiving go out between batches of bulk data. The size
+ * of a queued publish is counted as the length of its topic name, payload
+ * and properties.
+ *
+ * <b>Possible values:</b> Any non-negative integer. <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_PUBLISH_QUEUE_BYTES_PER_CALL
+    #define MQTT_PUBLISH_QUEUE_BYTES_PER_CALL    ( 0U )
+#endif
+
 #ifdef MQTT_SEND_RETRY_TIMEOUT_MS
     #error MQTT_SEND_RETRY_TIMEOUT_MS is deprecated. Instead use MQTT_SEND_TIMEOUT_MS.
 #endif
@@ -44,6 +44,9 @@
 
 #include "transport_interface.h"
 
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
 /* MQTT packet types. */
 
 /**
@@ -313,7 +316,9 @@ typedef enum MQTTStatus
                                     has failed. */
     MQTTPublishRetrieveFailed,       /**< User provided API to retrieve the copy of a publish while reconnecting
                                     with an unclean session has failed. */
-    MQTTEventCallbackFailed         /**< Error in the user provided event callback function. */
+    MQTTEventCallbackFailed,        /**< Error in the user provided event callback function. */
+    MQTTRateLimited                 /**< The PUBLISH exceeds the rate set with #MQTT_InitRateLimit;
+                                    it can be sent after #MQTT_GetRateLimitDelay milliseconds. */
 } MQTTStatus_t;
 
 /**
@@ -744,6 +749,11 @@ typedef enum MQTTSuccessFailReasonCode
     MQTT_REASON_DISCONNECT_SUBSCRIPTION_IDENTIFIERS_NOT_SUPPORTED = 0xA1U, /**< Subscription identifiers are not supported. */
     MQTT_REASON_DISCONNECT_WILDCARD_SUBSCRIPTIONS_NOT_SUPPORTED = 0xA2U,    /**< Wildcard subscriptions are not supported. */
 
+    /* AUTH reason codes */
+    MQTT_REASON_AUTH_SUCCESS = 0x00U,                   /**< Authentication is successful. */
+    MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION = 0x18U,   /**< Continue the authentication with another step. */
+    MQTT_REASON_AUTH_RE_AUTHENTICATE = 0x19U,           /**< Initiate a re-authentication. */
+
     MQTT_INVALID_REASON_CODE = 0xFF /**< @brief Invalid reason code. */
 
 } MQTTSuccessFailReasonCode_t;
@@ -1071,6 +1081,8 @@ MQTTStatus_t MQTT_SerializeSubscribe( const MQTTSubscribeInfo_t * pSubscriptionL
                                       const MQTTFixedBuffer_t * pFixedBuffer );
 /* @[declare_mqtt_serializesubscribe] */
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @brief Get packet size and Remaining Length of an MQTT UNSUBSCRIBE packet.
  *
@@ -1219,6 +1231,9 @@ MQTTStatus_t MQTT_SerializeUnsubscribe( const MQTTSubscribeInfo_t * pSubscriptio
                                         const MQTTFixedBuffer_t * pFixedBuffer );
 /* @[declare_mqtt_serializeunsubscribe] */
 
+#endif /* if ( MQTT_ENABLE_UNSUBSCRIBE != 0 ) */
+
+
 /**
  * @brief Get the packet size and remaining length of an MQTT PUBLISH packet.
  *
@@ -1626,6 +1641,108 @@ MQTTStatus_t MQTT_SerializeDisconnect( const MQTTPropBuilder_t * pDisconnectProp
                                        const MQTTFixedBuffer_t * pFixedBuffer );
 /* @[declare_mqtt_serializedisconnect] */
 
+/**
+ * @brief Get the size of an MQTT AUTH packet.
+ *
+ * The packet always carries a reason code and a property length, so that
+ * its size does not depend on the reason code.
+ *
+ * @param[in] pAuthProperties MQTT AUTH properties builder. Pass NULL if not used.
+ * @param[out] pRemainingLength The Remaining Length of the MQTT AUTH packet.
+ * @param[out] pPacketSize The size of the MQTT AUTH packet.
+ * @param[in] maxPacketSize Maximum packet size allowed by the server.
+ *
+ * @return #MQTTSuccess, or #MQTTBadParameter if parameters are invalid.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * uint32_t remainingLength = 0;
+ * uint32_t packetSize = 0;
+ * uint32_t maxPacketSize;
+ * MQTTPropBuilder_t authProperties;
+ *
+ * // Set the authentication method and data. The details are out of scope for this example.
+ * initializePropertyBuilder( &authProperties );
+ *
+ * // Get the size requirement for the AUTH packet.
+ * status = MQTT_GetAuthPacketSize( &authProperties, &remainingLength, &packetSize, maxPacketSize );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Serialize the AUTH packet.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_getauthpacketsize] */
+MQTTStatus_t MQTT_GetAuthPacketSize( const MQTTPropBuilder_t * pAuthProperties,
+                                     uint32_t * pRemainingLength,
+                                     uint32_t * pPacketSize,
+                                     uint32_t maxPacketSize );
+/* @[declare_mqtt_getauthpacketsize] */
+
+/**
+ * @brief Serialize an MQTT AUTH packet into the given buffer.
+ *
+ * The input #MQTTFixedBuffer_t.size must be at least as large as the size
+ * returned by #MQTT_GetAuthPacketSize. This function should only be called
+ * after #MQTT_GetAuthPacketSize to ensure proper buffer sizing.
+ *
+ * @param[in] pAuthProperties MQTT v5.0 properties for the AUTH packet. Can be NULL
+ * if no properties are needed.
+ * @param[in] reasonCode #MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION or
+ * #MQTT_REASON_AUTH_RE_AUTHENTICATE.
+ * @param[in] remainingLength Remaining Length provided by #MQTT_GetAuthPacketSize.
+ * @param[out] pFixedBuffer Buffer for packet serialization.
+ *
+ * @return #MQTTNoMemory if pFixedBuffer is too small to hold the MQTT packet;
+ * #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTFixedBuffer_t fixedBuffer;
+ * MQTTPropBuilder_t authProperties;
+ * uint8_t buffer[ BUFFER_SIZE ];
+ * uint32_t remainingLength = 0, packetSize = 0;
+ *
+ * fixedBuffer.pBuffer = buffer;
+ * fixedBuffer.size = BUFFER_SIZE;
+ *
+ * // Set the authentication method and data. The details are out of scope for this example.
+ * initializePropertyBuilder( &authProperties );
+ *
+ * status = MQTT_GetAuthPacketSize( &authProperties,
+ *                                  &remainingLength,
+ *                                  &packetSize,
+ *                                  MQTT_MAX_REMAINING_LENGTH );
+ * assert( status == MQTTSuccess );
+ * assert( packetSize <= BUFFER_SIZE );
+ *
+ * // Serialize a re-authentication request into the fixed buffer.
+ * status = MQTT_SerializeAuth( &authProperties,
+ *                              MQTT_REASON_AUTH_RE_AUTHENTICATE,
+ *                              remainingLength,
+ *                              &fixedBuffer );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // The AUTH packet can now be sent to the broker.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_serializeauth] */
+MQTTStatus_t MQTT_SerializeAuth( const MQTTPropBuilder_t * pAuthProperties,
+                                 MQTTSuccessFailReasonCode_t reasonCode,
+                                 uint32_t remainingLength,
+                                 const MQTTFixedBuffer_t * pFixedBuffer );
+/* @[declare_mqtt_serializeauth] */
+
 /**
  * @brief Get the size of an MQTT PINGREQ packet.
  *
@@ -1944,6 +2061,26 @@ MQTTStatus_t MQTT_ProcessIncomingPacketTypeAndLength( const uint8_t * pBuffer,
 MQTTStatus_t MQTT_UpdateDuplicatePublishFlag( uint8_t * pHeader, bool set );
 /* @[declare_mqtt_updateduplicatepublishflag] */
 
+/**
+ * @brief Rewrite the Message Expiry Interval property of a serialized PUBLISH.
+ *
+ * Used to update the remaining lifetime of a stored PUBLISH before it is
+ * resent, as required by the MQTT 5.0 specification.
+ *
+ * @param[in,out] pPublishPacket The serialized PUBLISH packet.
+ * @param[in] packetSize Size of @p pPublishPacket in bytes.
+ * @param[in] messageExpiry The new Message Expiry Interval in seconds.
+ *
+ * @return #MQTTSuccess if the property was rewritten,
+ * #MQTTEndOfProperties if the PUBLISH has no Message Expiry Interval,
+ * #MQTTBadParameter for invalid parameters or a malformed PUBLISH.
+ */
+/* @[declare_mqtt_updatepublishmessageexpiry] */
+MQTTStatus_t MQTT_UpdatePublishMessageExpiry( uint8_t * pPublishPacket,
+                                              size_t packetSize,
+                                              uint32_t messageExpiry );
+/* @[declare_mqtt_updatepublishmessageexpiry] */
+
 /**
  * @brief Initialize an MQTTConnectionProperties_t.
  *
@@ -3192,6 +3329,67 @@ MQTTStatus_t MQTT_DeserializeDisconnect( const MQTTPacketInfo_t * pPacket,
                                          MQTTPropBuilder_t * pPropBuffer );
 /* @[declare_mqtt_deserializedisconnect] */
 
+/**
+ * @brief Validates the properties specified for an outgoing MQTT AUTH packet.
+ *
+ * The Authentication Method must be present. Only the Authentication Method,
+ * Authentication Data, Reason String and User Property are allowed.
+ *
+ * @param[in] pPropertyBuilder Pointer to the property builder structure containing AUTH properties.
+ *
+ * @return Returns one of the following:
+ * - #MQTTSuccess , #MQTTBadParameter or #MQTTBadResponse.
+ */
+/* @[declare_mqtt_validateauthproperties] */
+MQTTStatus_t MQTT_ValidateAuthProperties( const MQTTPropBuilder_t * pPropertyBuilder );
+/* @[declare_mqtt_validateauthproperties] */
+
+/**
+ * @brief Deserialize an MQTT AUTH packet.
+ *
+ * A packet with a remaining length of 0 is a successful authentication, and
+ * @p pAuthInfo is then left with a reason code length of 0.
+ *
+ * @param[in] pPacket #MQTTPacketInfo_t containing the buffer.
+ * @param[in] maxPacketSize Maximum packet size allowed by the client.
+ * @param[out] pAuthInfo Struct containing the AUTH reason code.
+ * @param[out] pPropBuffer MQTTPropBuilder_t to store the deserialized properties.
+ *
+ * @return #MQTTBadParameter, #MQTTBadResponse or #MQTTSuccess.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPacketInfo_t incomingPacket;
+ * MQTTReasonCodeInfo_t authInfo = { 0 };
+ * uint32_t maxPacketSize;
+ * MQTTPropBuilder_t propBuffer = { 0 };
+ * // Receive an incoming packet and populate all fields. The details are out of scope
+ * // for this example.
+ * receiveIncomingPacket( &incomingPacket );
+ *
+ * if( incomingPacket.type == MQTT_PACKET_TYPE_AUTH )
+ * {
+ *      status = MQTT_DeserializeAuth( &incomingPacket,
+ *                                     maxPacketSize,
+ *                                     &authInfo,
+ *                                     &propBuffer );
+ *      if( status == MQTTSuccess )
+ *      {
+ *          // The authentication data can be read with MQTTPropGet_AuthData.
+ *      }
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_deserializeauth] */
+MQTTStatus_t MQTT_DeserializeAuth( const MQTTPacketInfo_t * pPacket,
+                                   uint32_t maxPacketSize,
+                                   MQTTReasonCodeInfo_t * pAuthInfo,
+                                   MQTTPropBuilder_t * pPropBuffer );
+/* @[declare_mqtt_deserializeauth] */
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
     }
@@ -144,6 +144,59 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
                                      uint16_t packetId );
 /** @endcond */
 
+#if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 )
+
+/**
+ * @fn MQTTStatus_t MQTT_SetPublishExpiry( const MQTTContext_t * pMqttContext, uint16_t packetId, uint32_t messageExpiry, uint32_t publishTimeMs );
+ * @brief Record the Message Expiry Interval of an outgoing PUBLISH.
+ *
+ * @param[in] pMqttContext Initialized MQTT context.
+ * @param[in] packetId ID of the PUBLISH packet.
+ * @param[in] messageExpiry Message Expiry Interval of the PUBLISH in seconds.
+ * @param[in] publishTimeMs Time at which the PUBLISH was sent.
+ *
+ * @note @p publishTimeMs comes from the 32-bit millisecond time function of
+ * the context. The age computed from it is only correct for less than about
+ * 49.7 days, and not across a reboot that restarts the time from zero.
+ *
+ * @return #MQTTBadParameter or #MQTTSuccess.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+MQTTStatus_t MQTT_SetPublishExpiry( const MQTTContext_t * pMqttContext,
+                                    uint16_t packetId,
+                                    uint32_t messageExpiry,
+                                    uint32_t publishTimeMs );
+/** @endcond */
+
+/**
+ * @fn MQTTStatus_t MQTT_GetPublishExpiry( const MQTTContext_t * pMqttContext, uint16_t packetId, uint32_t * pMessageExpiry, uint32_t * pPublishTimeMs );
+ * @brief Get the Message Expiry Interval recorded for an outgoing PUBLISH.
+ *
+ * @param[in] pMqttContext Initialized MQTT context.
+ * @param[in] packetId ID of the PUBLISH packet.
+ * @param[out] pMessageExpiry Message Expiry Interval in seconds, or 0 if the
+ * PUBLISH does not expire.
+ * @param[out] pPublishTimeMs Time at which the PUBLISH was sent.
+ *
+ * @return #MQTTBadParameter or #MQTTSuccess.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+MQTTStatus_t MQTT_GetPublishExpiry( const MQTTContext_t * pMqttContext,
+                                    uint16_t packetId,
+                                    uint32_t * pMessageExpiry,
+                                    uint32_t * pPublishTimeMs );
+/** @endcond */
+
+#endif /* if ( MQTT_ENABLE_MESSAGE_EXPIRY != 0 ) && ( MQTT_ENABLE_RETRANSMIT != 0 ) && ( MQTT_VERSION_3_1_1_ONLY == 0 ) */
+
 /**
  * @fn MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType, MQTTStateOperation_t opType, MQTTQoS_t qos );
  * @brief Calculate the state from a PUBACK, PUBREC, PUBREL, or PUBCOMP.
@@ -380,6 +380,34 @@
 #define ADDITION_WILL_OVERFLOW_SIZE_T( x, y ) \
     ( ( x ) > ( SIZE_MAX - ( y ) ) )
 
+#if ( MQTT_VERSION_3_1_1_ONLY != 0 )
+    #define MQTT_EMPTY_PROPERTY_LENGTH_SIZE                  ( 0U )
+    #define MQTT_PROPERTY_LENGTH_SIZE( length )              ( ( ( void ) ( length ) ), 0U )
+    #define MQTT_ENCODE_PROPERTY_LENGTH( pIndex, length )    ( ( ( void ) ( length ) ), ( pIndex ) )
+#else
+
+/**
+ * @brief Size of the Property Length field of a packet without properties.
+ */
+    #define MQTT_EMPTY_PROPERTY_LENGTH_SIZE                  ( 1U )
+
+/**
+ * @brief Size of the Property Length field for @p length bytes of properties.
+ *
+ * MQTT 3.1.1 packets have no Property Length field, so this is 0 when the
+ * library is built with #MQTT_VERSION_3_1_1_ONLY.
+ */
+    #define MQTT_PROPERTY_LENGTH_SIZE( length )              variableLengthEncodedSize( length )
+
+/**
+ * @brief Write the Property Length field for @p length bytes of properties
+ * at @p pIndex and evaluate to the byte following it.
+ *
+ * Nothing is written when the library is built with #MQTT_VERSION_3_1_1_ONLY.
+ */
+    #define MQTT_ENCODE_PROPERTY_LENGTH( pIndex, length )    encodeVariableLength( ( pIndex ), ( length ) )
+#endif
+
 /**
  * @fn uint32_t variableLengthEncodedSize( uint32_t length );
  *
@@ -654,6 +682,27 @@ uint8_t * serializeDisconnectFixed( uint8_t * pIndex,
                                     uint32_t remainingLength );
 /** @endcond */
 
+/**
+ * @fn uint8_t * serializeAuthFixed( uint8_t * pIndex, MQTTSuccessFailReasonCode_t reasonCode, uint32_t remainingLength );
+ *
+ * @brief Serialize the fixed size part of the AUTH packet header.
+ *
+ * @param[out] pIndex Pointer to the buffer where the header is to be serialized.
+ * @param[in] reasonCode Reason code for the AUTH packet.
+ * @param[in] remainingLength Remaining length of the AUTH packet.
+ *
+ * @return A pointer to the end of the encoded string.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+uint8_t * serializeAuthFixed( uint8_t * pIndex,
+                              MQTTSuccessFailReasonCode_t reasonCode,
+                              uint32_t remainingLength );
+/** @endcond */
+
 /**
  * @fn uint8_t * serializeConnectFixedHeader( uint8_t * pIndex, const MQTTConnectInfo_t * pConnectInfo, const MQTTPublishInfo_t * pWillInfo, uint32_t remainingLength );
  * @brief Serialize the fixed part of the connect packet header.
@@ -700,6 +749,8 @@ uint8_t * serializeSubscribeHeader( uint32_t remainingLength,
                                     uint16_t packetId );
 /** @endcond */
 
+#if ( MQTT_ENABLE_UNSUBSCRIBE != 0 )
+
 /**
  * @fn uint8_t * serializeUnsubscribeHeader( uint32_t remainingLength, uint8_t * pIndex, uint16_t packetId );
  * @brief Serialize the fixed part of the unsubscribe packet header.
@@ -722,4 +773,6 @@ uint8_t * serializeUnsubscribeHeader( uint32_t remainingLength,
                                       uint16_t packetId );
 /** @endcond */
 
+#endif
+
 #endif /* ifndef CORE_MQTT_SERIALIZER_PRIVATE_H */
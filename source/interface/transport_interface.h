@@ -294,9 +294,69 @@ typedef int32_t ( * TransportWritev_t )( NetworkContext_t * pNetworkContext,
                                          size_t ioVecCount );
 /* @[define_transportwritev] */
 
+/**
+ * @transportcallback
+ * @brief Transport interface function to transmit the bytes held back by
+ * earlier send or writev calls.
+ *
+ * A transport that implements this function may keep the bytes given to send
+ * and writev in its own buffer instead of transmitting them right away, for
+ * example to fill a whole TLS record or TCP segment, or by setting TCP_CORK or
+ * MSG_MORE on a socket. The library calls this function after a packet has
+ * been sent, unless more packets follow right away. This is the case for the
+ * acks sent while processing received packets, the publishes sent from a
+ * publish queue, and the packets resent when a session is resumed, where it is
+ * called once after the last packet. The library never waits for data from
+ * the network while bytes are held back.
+ *
+ * @note This function is optional and must be NULL if it is not implemented.
+ * In that case send and writev must transmit the bytes right away.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ *
+ * @return Zero or a positive value on success, or a negative value to indicate
+ * error.
+ */
+/* @[define_transportflush] */
+typedef int32_t ( * TransportFlush_t )( NetworkContext_t * pNetworkContext );
+/* @[define_transportflush] */
+
+/**
+ * @transportcallback
+ * @brief Transport interface function to send the payload of a publish from a
+ * source the application owns, such as a file.
+ *
+ * The library calls this function from #MQTT_PublishFromSource after the
+ * packet header has been sent, so the payload does not need to be copied into
+ * application memory first. The source is passed through unchanged and its
+ * meaning is defined by the transport. A transport running on a POSIX system
+ * could, for example, take a structure holding a file descriptor and use
+ * sendfile() or splice() to move the bytes to the socket.
+ *
+ * @note This function is optional and must be NULL if it is not implemented.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ * @param[in] pPayloadSource Implementation-defined payload source.
+ * @param[in] offset Offset in @p pPayloadSource of the first byte to send.
+ * @param[in] bytesToSend Number of bytes to send.
+ *
+ * @return The number of bytes sent, which may be less than @p bytesToSend;
+ * zero to retry; or a negative value to indicate error.
+ */
+/* @[define_transportsendpayload] */
+typedef int32_t ( * TransportSendPayload_t )( NetworkContext_t * pNetworkContext,
+                                              const void * pPayloadSource,
+                                              size_t offset,
+                                              size_t bytesToSend );
+/* @[define_transportsendpayload] */
+
 /**
  * @transportstruct
  * @brief The transport layer interface.
+ *
+ * @note The library calls the optional members whenever they are not NULL.
+ * Zero-initialize the structure, for example with `= { 0 }` or memset, before
+ * setting the members a port implements, so that the others are NULL.
  */
 /* @[define_transportinterface] */
 typedef struct TransportInterface
@@ -305,6 +365,8 @@ typedef struct TransportInterface
     TransportSend_t send;               /**< Transport send function pointer. */
     TransportWritev_t writev;           /**< Transport writev function pointer. */
     NetworkContext_t * pNetworkContext; /**< Implementation-defined network context. */
+    TransportFlush_t flush;             /**< Transport flush function pointer, or NULL. */
+    TransportSendPayload_t sendPayload; /**< Transport payload send function pointer, or NULL. */
 } TransportInterface_t;
 /* @[define_transportinterface] */
 
@@ -334,6 +334,8 @@ MQTTContext_t * allocateMqttContext( MQTTContext_t * pContext )
         pTransportInterface->recv = NetworkInterfaceReceiveStub;
         pTransportInterface->send = NetworkInterfaceSendStub;
         pTransportInterface->writev = NULL;
+        pTransportInterface->flush = NULL;
+        pTransportInterface->sendPayload = NULL;
     }
 
     pNetworkBuffer = allocateMqttFixedBuffer( NULL );
@@ -0,0 +1,216 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file core_mqtt_coalesce_utest.c
+ * @brief Unit tests for the MQTT library built with a send coalescing buffer.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "unity.h"
+
+/* Build the library source below with a small coalescing buffer. */
+#define MQTT_SEND_COALESCE_BUFFER_SIZE    ( 16U )
+
+#include "../core_mqtt.c"
+
+/* ========================================================================== */
+
+/**
+ * @brief Number of calls made to #transportSendRecord.
+ */
+static size_t sendCount = 0U;
+
+/**
+ * @brief Bytes given to the calls made to #transportSendRecord.
+ */
+static uint8_t sentBytes[ 64 ];
+
+/**
+ * @brief Length of each call made to #transportSendRecord.
+ */
+static size_t sendLengths[ 4 ];
+
+/* ========================================================================== */
+
+/**
+ * @brief Transport send that accepts and records every byte.
+ */
+static int32_t transportSendRecord( NetworkContext_t * pNetworkContext,
+                                    const void * pBuffer,
+                                    size_t bytesToSend )
+{
+    static size_t sentLength = 0U;
+
+    ( void ) pNetworkContext;
+
+    if( sendCount == 0U )
+    {
+        sentLength = 0U;
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL( sizeof( sentBytes ) - sentLength, bytesToSend );
+    ( void ) memcpy( &( sentBytes[ sentLength ] ), pBuffer, bytesToSend );
+    sentLength += bytesToSend;
+
+    if( sendCount < ( sizeof( sendLengths ) / sizeof( sendLengths[ 0 ] ) ) )
+    {
+        sendLengths[ sendCount ] = bytesToSend;
+    }
+
+    sendCount++;
+
+    return ( int32_t ) bytesToSend;
+}
+
+/**
+ * @brief Transport receive that never has data.
+ */
+static int32_t transportRecvNoData( NetworkContext_t * pNetworkContext,
+                                    void * pBuffer,
+                                    size_t bytesToRecv )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+    ( void ) bytesToRecv;
+
+    return 0;
+}
+
+/**
+ * @brief Time function returning a fixed time.
+ */
+static uint32_t getTime( void )
+{
+    return 0U;
+}
+
+/**
+ * @brief Event callback that accepts every event.
+ */
+static bool eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo,
+                           MQTTSuccessFailReasonCode_t * pReasonCode,
+                           MQTTPropBuilder_t * pSendPropsBuffer,
+                           MQTTPropBuilder_t * pGetPropsBuffer )
+{
+    ( void ) pContext;
+    ( void ) pPacketInfo;
+    ( void ) pDeserializedInfo;
+    ( void ) pReasonCode;
+    ( void ) pSendPropsBuffer;
+    ( void ) pGetPropsBuffer;
+
+    return true;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Connect a context whose transport has no writev function.
+ */
+static void setupContext( MQTTContext_t * pContext,
+                          TransportInterface_t * pTransport,
+                          MQTTFixedBuffer_t * pNetworkBuffer )
+{
+    MQTTStatus_t status;
+
+    pTransport->pNetworkContext = NULL;
+    pTransport->send = transportSendRecord;
+    pTransport->recv = transportRecvNoData;
+    pTransport->writev = NULL;
+
+    status = MQTT_Init( pContext, pTransport, getTime, eventCallback, pNetworkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    pContext->connectStatus = MQTTConnected;
+    pContext->connectionProperties.maxPacketSize = MQTT_MAX_PACKET_SIZE;
+    sendCount = 0U;
+}
+
+/**
+ * @brief A small PUBLISH is sent with a single call to the transport.
+ */
+void test_MQTT_Publish_coalesced( void )
+{
+    MQTTStatus_t status;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    uint8_t buffer[ 16 ] = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { buffer, sizeof( buffer ) };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    const uint8_t expected[] =
+    {
+        0x30, 0x08,              /* PUBLISH QoS 0, remaining length 8. */
+        0x00, 0x03, 'a', '/', 'b',
+        0x00,                    /* No properties. */
+        'h', 'i'
+    };
+
+    setupContext( &context, &transport, &networkBuffer );
+
+    publishInfo.pTopicName = "a/b";
+    publishInfo.topicNameLength = 3U;
+    publishInfo.pPayload = "hi";
+    publishInfo.payloadLength = 2U;
+
+    status = MQTT_Publish( &context, &publishInfo, 0U, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, sendCount );
+    TEST_ASSERT_EQUAL( sizeof( expected ), sendLengths[ 0 ] );
+    TEST_ASSERT_EQUAL_UINT8_ARRAY( expected, sentBytes, sizeof( expected ) );
+}
+
+/**
+ * @brief A payload that does not fit in the buffer is sent from its own memory
+ * after the joined header.
+ */
+void test_MQTT_Publish_coalesced_large_payload( void )
+{
+    MQTTStatus_t status;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    uint8_t buffer[ 16 ] = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { buffer, sizeof( buffer ) };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    const char payload[] = "a payload larger than the buffer";
+
+    setupContext( &context, &transport, &networkBuffer );
+
+    publishInfo.pTopicName = "a/b";
+    publishInfo.topicNameLength = 3U;
+    publishInfo.pPayload = payload;
+    publishInfo.payloadLength = sizeof( payload ) - 1U;
+
+    status = MQTT_Publish( &context, &publishInfo, 0U, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, sendCount );
+    TEST_ASSERT_EQUAL( 8U, sendLengths[ 0 ] );
+    TEST_ASSERT_EQUAL( sizeof( payload ) - 1U, sendLengths[ 1 ] );
+    TEST_ASSERT_EQUAL_UINT8_ARRAY( payload, &( sentBytes[ 8 ] ), sizeof( payload ) - 1U );
+}
@@ -73,4 +73,7 @@
 
 #define MQTT_SEND_TIMEOUT_MS                    ( 200U )
 
+/* The session resumption tests check that expired publishes are dropped. */
+#define MQTT_ENABLE_MESSAGE_EXPIRY              ( 1 )
+
 #endif /* ifndef CORE_MQTT_CONFIG_H_ */
@@ -5468,6 +5468,61 @@ void test_MQTT_UpdateDuplicatePublishFlag_Happy_Path()
     TEST_ASSERT_EQUAL_INT( ( pHeader ) & ( 0x01U << ( 3 ) ), 0 );
 }
 
+/* ==================  Testing MQTT_UpdatePublishMessageExpiry ===================== */
+
+/**
+ * @brief Rewrite the Message Expiry Interval of a stored QoS 1 PUBLISH.
+ */
+void test_MQTT_UpdatePublishMessageExpiry( void )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    uint8_t packet[] =
+    {
+        0x32, 0x0F,                   /* PUBLISH QoS 1, remaining length 15. */
+        0x00, 0x01, 't',              /* Topic name. */
+        0x00, 0x07,                   /* Packet ID. */
+        0x07,                         /* Property length. */
+        MQTT_PAYLOAD_FORMAT_ID, 0x01, /* Payload format indicator. */
+        MQTT_MSG_EXPIRY_ID, 0x00, 0x00, 0x00, 0x3C,
+        'h', 'i'                      /* Payload. */
+    };
+
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, sizeof( packet ), 0x01020304U );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL_UINT8( 0x01, packet[ 11 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0x02, packet[ 12 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0x03, packet[ 13 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0x04, packet[ 14 ] );
+    TEST_ASSERT_EQUAL_UINT8( 'h', packet[ 15 ] );
+
+    /* A PUBLISH without the property is left untouched. */
+    packet[ 7 ] = 0x02;
+    packet[ 1 ] = 0x0A;
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, 12U, 10U );
+    TEST_ASSERT_EQUAL( MQTTEndOfProperties, mqttStatus );
+    TEST_ASSERT_EQUAL_UINT8( 0x01, packet[ 11 ] );
+
+    /* Invalid parameters and malformed packets. */
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( NULL, sizeof( packet ), 10U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, 1U, 10U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    /* The remaining length runs past the end of the buffer. */
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, 8U, 10U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    /* The property length runs past the end of the packet. */
+    packet[ 7 ] = 0x20;
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, 12U, 10U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    packet[ 0 ] = MQTT_PACKET_TYPE_PUBACK;
+    mqttStatus = MQTT_UpdatePublishMessageExpiry( packet, sizeof( packet ), 10U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+}
+
 /* ========================================================================== */
 
 void test_ValidatePublishProperties( void )
@@ -8165,3 +8220,252 @@ void test_MQTT_SkipNextProperty_AllPropertyTypes( void )
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( expectedIndex, currentIndex );
 }
+
+/* ========================================================================== */
+
+void test_MQTT_GetAuthPacketSize( void )
+{
+    MQTTStatus_t status;
+    MQTTPropBuilder_t propBuffer = { 0 };
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    uint8_t buf[ 20 ];
+
+    /* Invalid parameters. */
+    status = MQTT_GetAuthPacketSize( NULL, NULL, &packetSize, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_GetAuthPacketSize( NULL, &remainingLength, NULL, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_GetAuthPacketSize( NULL, &remainingLength, &packetSize, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Reason code and an empty property length. */
+    status = MQTT_GetAuthPacketSize( NULL, &remainingLength, &packetSize, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 2U, remainingLength );
+    TEST_ASSERT_EQUAL_UINT32( 4U, packetSize );
+
+    propBuffer.pBuffer = buf;
+    propBuffer.currentIndex = 10;
+    status = MQTT_GetAuthPacketSize( &propBuffer, &remainingLength, &packetSize, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 12U, remainingLength );
+    TEST_ASSERT_EQUAL_UINT32( 14U, packetSize );
+
+    /* Larger than the server's maximum packet size. */
+    status = MQTT_GetAuthPacketSize( &propBuffer, &remainingLength, &packetSize, 13U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Properties too long for a packet. */
+    propBuffer.currentIndex = MQTT_MAX_REMAINING_LENGTH + 1U;
+    status = MQTT_GetAuthPacketSize( &propBuffer, &remainingLength, &packetSize, UINT32_MAX );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    propBuffer.currentIndex = MQTT_MAX_REMAINING_LENGTH;
+    status = MQTT_GetAuthPacketSize( &propBuffer, &remainingLength, &packetSize, UINT32_MAX );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
+
+void test_MQTT_SerializeAuth( void )
+{
+    MQTTStatus_t status;
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+    uint8_t propBuf[ 10 ];
+    uint8_t buf[ 20 ];
+    uint8_t * pIndex = propBuf;
+
+    pIndex = serializeutf_8( pIndex, MQTT_AUTH_METHOD_ID );
+    propBuffer.pBuffer = propBuf;
+    propBuffer.currentIndex = ( size_t ) ( pIndex - propBuf );
+
+    /* Invalid parameters. */
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 9U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 9U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    fixedBuffer.pBuffer = buf;
+    fixedBuffer.size = sizeof( buf );
+
+    /* Only the server sends a success reason code. */
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_SUCCESS, 9U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The remaining length does not match the properties. */
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 8U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Buffer too small. */
+    fixedBuffer.size = 10U;
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 9U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    fixedBuffer.size = sizeof( buf );
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 9U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_AUTH, buf[ 0 ] );
+    TEST_ASSERT_EQUAL_UINT8( 9U, buf[ 1 ] );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_REASON_AUTH_RE_AUTHENTICATE, buf[ 2 ] );
+    TEST_ASSERT_EQUAL_UINT8( 7U, buf[ 3 ] );
+    TEST_ASSERT_EQUAL_MEMORY( propBuf, &buf[ 4 ], 7U );
+
+    /* Without properties. */
+    status = MQTT_SerializeAuth( NULL, MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, 2U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 2U, buf[ 1 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0U, buf[ 3 ] );
+
+    propBuffer.currentIndex = MQTT_REMAINING_LENGTH_INVALID;
+    status = MQTT_SerializeAuth( &propBuffer, MQTT_REASON_AUTH_RE_AUTHENTICATE, 9U, &fixedBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
+
+void test_MQTT_DeserializeAuth( void )
+{
+    MQTTStatus_t status;
+    MQTTPacketInfo_t packetInfo = { 0 };
+    MQTTReasonCodeInfo_t authInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    uint8_t buffer[ 50 ] = { 0 };
+    uint8_t * pIndex;
+
+    /* Invalid parameters. */
+    status = MQTT_DeserializeAuth( NULL, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    packetInfo.pRemainingData = buffer;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, NULL, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_DeserializeAuth( &packetInfo, 0U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A bare AUTH means success. */
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 0U, authInfo.reasonCodeLength );
+
+    /* Larger than the client's maximum packet size. */
+    packetInfo.remainingLength = 200U;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    packetInfo.remainingLength = MQTT_REMAINING_LENGTH_INVALID;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Success with the reason code alone. */
+    packetInfo.remainingLength = 1U;
+    buffer[ 0 ] = MQTT_REASON_AUTH_SUCCESS;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 1U, authInfo.reasonCodeLength );
+
+    /* Only the client starts a re-authentication. */
+    buffer[ 0 ] = MQTT_REASON_AUTH_RE_AUTHENTICATE;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    buffer[ 0 ] = MQTT_REASON_DISCONNECT_NOT_AUTHORIZED;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Continue without the Authentication Method. */
+    buffer[ 0 ] = MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Continue with method, data, reason string and a user property. */
+    pIndex = &buffer[ 1 ];
+    *pIndex = 34U;
+    pIndex++;
+    pIndex = serializeutf_8( pIndex, MQTT_AUTH_METHOD_ID );
+    pIndex = serializeutf_8( pIndex, MQTT_AUTH_DATA_ID );
+    pIndex = serializeutf_8( pIndex, MQTT_REASON_STRING_ID );
+    pIndex = serializeutf_8pair( pIndex );
+    packetInfo.remainingLength = ( uint32_t ) ( pIndex - buffer );
+    TEST_ASSERT_EQUAL_UINT32( 36U, packetInfo.remainingLength );
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( &buffer[ 2 ], propBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( 34U, propBuffer.bufferLength );
+
+    /* Duplicate Authentication Method. */
+    ( void ) serializeutf_8( &buffer[ 9 ], MQTT_AUTH_METHOD_ID );
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Property not allowed in AUTH. */
+    ( void ) serializeutf_8( &buffer[ 9 ], MQTT_RESPONSE_TOPIC_ID );
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Property length does not match the remaining length. */
+    buffer[ 1 ] = 30U;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Malformed property length. */
+    buffer[ 1 ] = 0x81U;
+    buffer[ 2 ] = 0x80U;
+    buffer[ 3 ] = 0x80U;
+    buffer[ 4 ] = 0x80U;
+    buffer[ 5 ] = 0x80U;
+    status = MQTT_DeserializeAuth( &packetInfo, 100U, &authInfo, &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+}
+
+void test_MQTT_ValidateAuthProperties( void )
+{
+    MQTTStatus_t status;
+    MQTTPropBuilder_t propBuffer = { 0 };
+    uint8_t buf[ 30 ];
+    uint8_t * pIndex = buf;
+
+    status = MQTT_ValidateAuthProperties( NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_ValidateAuthProperties( &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    propBuffer.pBuffer = buf;
+    propBuffer.currentIndex = MQTT_REMAINING_LENGTH_INVALID;
+    status = MQTT_ValidateAuthProperties( &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The Authentication Method is required. */
+    pIndex = serializeutf_8( pIndex, MQTT_AUTH_DATA_ID );
+    propBuffer.currentIndex = ( size_t ) ( pIndex - buf );
+    status = MQTT_ValidateAuthProperties( &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    pIndex = serializeutf_8( pIndex, MQTT_AUTH_METHOD_ID );
+    propBuffer.currentIndex = ( size_t ) ( pIndex - buf );
+    status = MQTT_ValidateAuthProperties( &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Property not allowed in AUTH. */
+    pIndex = serializeuint_32( pIndex, MQTT_SESSION_EXPIRY_ID );
+    propBuffer.currentIndex = ( size_t ) ( pIndex - buf );
+    status = MQTT_ValidateAuthProperties( &propBuffer );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+}
+
+void test_MQTTV5_SerializeAuthFixed( void )
+{
+    uint8_t buf[ 10 ];
+    uint8_t * pIndex;
+
+    pIndex = serializeAuthFixed( buf, MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, 2U );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_AUTH, buf[ 0 ] );
+    TEST_ASSERT_EQUAL_UINT8( 2U, buf[ 1 ] );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, buf[ 2 ] );
+    TEST_ASSERT_EQUAL_PTR( &buf[ 3 ], pIndex );
+}
@@ -372,6 +372,60 @@ void test_MQTT_RemoveStateRecord_RemoveQoS2Record( void )
 
 /* ========================================================================== */
 
+void test_MQTT_PublishExpiry( void )
+{
+    MQTTStatus_t status;
+    MQTTContext_t context;
+    MQTTPubAckInfo_t outgoingRecords[ 5 ];
+    uint32_t messageExpiry = 0U;
+    uint32_t publishTimeMs = 0U;
+
+    memset( &context, 0, sizeof( MQTTContext_t ) );
+    memset( outgoingRecords, 0, sizeof( outgoingRecords ) );
+
+    /* Bad parameters. */
+    status = MQTT_SetPublishExpiry( NULL, 1U, 60U, 1000U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    status = MQTT_GetPublishExpiry( &context, 1U, &messageExpiry, &publishTimeMs );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    context.outgoingPublishRecords = outgoingRecords;
+    context.outgoingPublishRecordMaxCount = 5;
+
+    status = MQTT_GetPublishExpiry( &context, 1U, NULL, &publishTimeMs );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    /* No record for the packet ID. */
+    status = MQTT_SetPublishExpiry( &context, 1U, 60U, 1000U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    /* A new record does not expire. */
+    status = MQTT_ReserveState( &context, 1U, MQTTQoS1 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTT_GetPublishExpiry( &context, 1U, &messageExpiry, &publishTimeMs );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 0U, messageExpiry );
+
+    status = MQTT_SetPublishExpiry( &context, 1U, 60U, 1000U );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTT_GetPublishExpiry( &context, 1U, &messageExpiry, &publishTimeMs );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 60U, messageExpiry );
+    TEST_ASSERT_EQUAL_UINT32( 1000U, publishTimeMs );
+
+    /* The expiry moves with the record when the records are compacted. */
+    outgoingRecords[ 1 ] = outgoingRecords[ 0 ];
+    memset( &outgoingRecords[ 0 ], 0, sizeof( MQTTPubAckInfo_t ) );
+    addToRecord( outgoingRecords, 4, 5U, MQTTQoS1, MQTTPubAckPending );
+    status = MQTT_ReserveState( &context, 6U, MQTTQoS1 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, outgoingRecords[ 0 ].packetId );
+    TEST_ASSERT_EQUAL_UINT32( 60U, outgoingRecords[ 0 ].messageExpiry );
+    TEST_ASSERT_EQUAL_UINT32( 1000U, outgoingRecords[ 0 ].publishTimeMs );
+}
+
+/* ========================================================================== */
+
 void test_MQTT_ReserveState_compactRecords( void )
 {
     MQTTContext_t mqttContext = { 0 };
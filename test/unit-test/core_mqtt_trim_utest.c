@@ -0,0 +1,269 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_trim_utest.c
+ * @brief Unit tests for the library built with every optional feature
+ * disabled and compact publish records.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "unity.h"
+
+/* Build the sources below with every optional feature disabled. */
+#define MQTT_ENABLE_QOS2                    ( 0 )
+#define MQTT_ENABLE_WILL                    ( 0 )
+#define MQTT_ENABLE_RETRANSMIT              ( 0 )
+#define MQTT_ENABLE_UNSUBSCRIBE             ( 0 )
+#define MQTT_ENABLE_SHARED_SUBSCRIPTIONS    ( 0 )
+#define MQTT_COMPACT_PUBLISH_RECORDS        ( 1 )
+
+/* Include paths for public enums, structures, and macros. */
+#include "core_mqtt_serializer.h"
+
+#include "../core_mqtt_serializer.c"
+#include "../core_mqtt_serializer_private.c"
+#include "../core_mqtt_state.c"
+#include "../core_mqtt.c"
+
+/**
+ * @brief Number of bytes given to #transportSendCount.
+ */
+static size_t bytesSent = 0U;
+
+/**
+ * @brief Transport send that counts the bytes it is given.
+ */
+static int32_t transportSendCount( NetworkContext_t * pNetworkContext,
+                                   const void * pBuffer,
+                                   size_t bytesToSend )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+
+    bytesSent += bytesToSend;
+
+    return ( int32_t ) bytesToSend;
+}
+
+/**
+ * @brief Transport receive that never has data.
+ */
+static int32_t transportRecvNoData( NetworkContext_t * pNetworkContext,
+                                    void * pBuffer,
+                                    size_t bytesToRecv )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+    ( void ) bytesToRecv;
+
+    return 0;
+}
+
+/**
+ * @brief Time function returning a fixed time.
+ */
+static uint32_t getTime( void )
+{
+    return 0U;
+}
+
+/**
+ * @brief Event callback that accepts every event.
+ */
+static bool eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo,
+                           MQTTSuccessFailReasonCode_t * pReasonCode,
+                           MQTTPropBuilder_t * pSendPropsBuffer,
+                           MQTTPropBuilder_t * pGetPropsBuffer )
+{
+    ( void ) pContext;
+    ( void ) pPacketInfo;
+    ( void ) pDeserializedInfo;
+    ( void ) pReasonCode;
+    ( void ) pSendPropsBuffer;
+    ( void ) pGetPropsBuffer;
+
+    return true;
+}
+
+
+/* ========================================================================== */
+
+/**
+ * @brief QoS 2 acks and UNSUBACK are rejected as malformed packets.
+ */
+void test_MQTT_ProcessIncomingPacketTypeAndLength_trimmed( void )
+{
+    MQTTStatus_t status;
+    MQTTPacketInfo_t packetInfo = { 0 };
+    uint8_t buffer[ 4 ] = { 0x40, 0x02, 0x00, 0x01 };
+    size_t index = sizeof( buffer );
+
+    status = MQTT_ProcessIncomingPacketTypeAndLength( buffer, &index, &packetInfo );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    buffer[ 0 ] = MQTT_PACKET_TYPE_PUBREC;
+    status = MQTT_ProcessIncomingPacketTypeAndLength( buffer, &index, &packetInfo );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+
+    buffer[ 0 ] = MQTT_PACKET_TYPE_PUBREL;
+    status = MQTT_ProcessIncomingPacketTypeAndLength( buffer, &index, &packetInfo );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+
+    buffer[ 0 ] = MQTT_PACKET_TYPE_UNSUBACK;
+    status = MQTT_ProcessIncomingPacketTypeAndLength( buffer, &index, &packetInfo );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+}
+
+/**
+ * @brief A QoS 2 PUBLISH is rejected when QoS 2 is compiled out.
+ */
+void test_processPublishFlags_QoS2_trimmed( void )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    uint8_t qos2Flags = 0U;
+    uint8_t qos1Flags = 0U;
+
+    UINT8_SET_BIT( qos2Flags, MQTT_PUBLISH_FLAG_QOS2 );
+    UINT8_SET_BIT( qos1Flags, MQTT_PUBLISH_FLAG_QOS1 );
+
+    TEST_ASSERT_EQUAL( MQTTBadResponse,
+                       processPublishFlags( qos2Flags, &publishInfo ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess,
+                       processPublishFlags( qos1Flags, &publishInfo ) );
+    TEST_ASSERT_EQUAL( MQTTQoS1, publishInfo.qos );
+}
+
+/**
+ * @brief A will cannot be serialized when wills are compiled out.
+ */
+void test_MQTT_GetConnectPacketSize_will_trimmed( void )
+{
+    MQTTStatus_t status;
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTPublishInfo_t willInfo = { 0 };
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+
+    connectInfo.pClientIdentifier = "id";
+    connectInfo.clientIdentifierLength = 2U;
+    willInfo.pTopicName = "will";
+    willInfo.topicNameLength = 4U;
+
+    status = MQTT_GetConnectPacketSize( &connectInfo, &willInfo, NULL, NULL,
+                                        &remainingLength, &packetSize );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    status = MQTT_GetConnectPacketSize( &connectInfo, NULL, NULL, NULL,
+                                        &remainingLength, &packetSize );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+}
+
+/**
+ * @brief The state engine has no QoS 2 states when QoS 2 is compiled out.
+ */
+void test_MQTT_CalculateState_QoS2_trimmed( void )
+{
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_CalculateStatePublish( MQTT_SEND, MQTTQoS2 ) );
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_CalculateStateAck( MQTTPubrec, MQTT_RECEIVE, MQTTQoS2 ) );
+    TEST_ASSERT_EQUAL( MQTTPubAckPending, MQTT_CalculateStatePublish( MQTT_SEND, MQTTQoS1 ) );
+    TEST_ASSERT_EQUAL( MQTTPublishDone, MQTT_CalculateStateAck( MQTTPuback, MQTT_RECEIVE, MQTTQoS1 ) );
+}
+
+/**
+ * @brief Compact records hold a packet ID, QoS and state in four bytes and
+ * go through the same state transitions.
+ */
+void test_MQTT_UpdateState_compact_records( void )
+{
+    MQTTContext_t context = { 0 };
+    MQTTPubAckInfo_t records[ 2 ] = { 0 };
+    MQTTPublishState_t state = MQTTStateNull;
+
+    TEST_ASSERT_EQUAL( 4U, sizeof( MQTTPubAckInfo_t ) );
+
+    context.outgoingPublishRecords = records;
+    context.outgoingPublishRecordMaxCount = 2U;
+
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_ReserveState( &context, 7U, MQTTQoS1 ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_UpdateStatePublish( &context, 7U, MQTT_SEND, MQTTQoS1, &state ) );
+    TEST_ASSERT_EQUAL( MQTTPubAckPending, state );
+    TEST_ASSERT_EQUAL_UINT16( 7U, records[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTQoS1, ( MQTTQoS_t ) records[ 0 ].qos );
+    TEST_ASSERT_EQUAL( MQTTPubAckPending, ( MQTTPublishState_t ) records[ 0 ].publishState );
+
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_UpdateStateAck( &context, 7U, MQTTPuback, MQTT_RECEIVE, &state ) );
+    TEST_ASSERT_EQUAL( MQTTPublishDone, state );
+    TEST_ASSERT_EQUAL_UINT16( MQTT_PACKET_ID_INVALID, records[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTStateNull, ( MQTTPublishState_t ) records[ 0 ].publishState );
+}
+
+/**
+ * @brief The library publishes at QoS 0 and 1 and refuses QoS 2 when QoS 2 is
+ * compiled out.
+ */
+void test_MQTT_Publish_trimmed( void )
+{
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTPubAckInfo_t outgoingRecords[ 2 ] = { 0 };
+    MQTTPubAckInfo_t incomingRecords[ 2 ] = { 0 };
+    uint8_t buffer[ 32 ];
+    MQTTFixedBuffer_t networkBuffer = { buffer, sizeof( buffer ) };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTStatus_t status;
+
+    transport.send = transportSendCount;
+    transport.recv = transportRecvNoData;
+    status = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTT_InitStatefulQoS( &context, outgoingRecords, 2U, incomingRecords, 2U, NULL, 0U );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    context.connectStatus = MQTTConnected;
+    context.connectionProperties.serverMaxQos = 1U;
+    context.connectionProperties.serverMaxPacketSize = MQTT_MAX_PACKET_SIZE;
+
+    publishInfo.pTopicName = "topic";
+    publishInfo.topicNameLength = 5U;
+    publishInfo.pPayload = "data";
+    publishInfo.payloadLength = 4U;
+
+    bytesSent = 0U;
+    status = MQTT_Publish( &context, &publishInfo, 0U, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    /* Fixed header, topic, empty property length and payload. */
+    TEST_ASSERT_EQUAL( 2U + 7U + 1U + 4U, bytesSent );
+
+    publishInfo.qos = MQTTQoS1;
+    status = MQTT_Publish( &context, &publishInfo, 1U, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    publishInfo.qos = MQTTQoS2;
+    status = MQTT_Publish( &context, &publishInfo, 2U, NULL );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+}
@@ -344,6 +344,41 @@ static uint32_t getTimeMockBigTimeStep( void )
     return globalEntryTime;
 }
 
+/**
+ * @brief Buffer taken by #eventCallbackTakeBuffer.
+ */
+static uint8_t * pTakenPacketBuffer = NULL;
+
+/**
+ * @brief Mocked MQTT event callback that takes the buffer holding an
+ * incoming PUBLISH.
+ *
+ * @param[in] pContext MQTT context pointer.
+ * @param[in] pPacketInfo Packet Info pointer for the incoming packet.
+ * @param[in] pDeserializedInfo Deserialized information from the incoming packet.
+ * @param[in] pReasonCode Reason code for the incoming packet.
+ * @param[in] pSendPropsBuffer Properties to be sent in the outgoing packet.
+ * @param[in] pGetPropsBuffer Properties to be received in the incoming packet.
+ */
+static bool eventCallbackTakeBuffer( MQTTContext_t * pContext,
+                                     MQTTPacketInfo_t * pPacketInfo,
+                                     MQTTDeserializedInfo_t * pDeserializedInfo,
+                                     MQTTSuccessFailReasonCode_t * pReasonCode,
+                                     MQTTPropBuilder_t * pSendPropsBuffer,
+                                     MQTTPropBuilder_t * pGetPropsBuffer )
+{
+    ( void ) pContext;
+    ( void ) pPacketInfo;
+    ( void ) pReasonCode;
+    ( void ) pSendPropsBuffer;
+    ( void ) pGetPropsBuffer;
+
+    pTakenPacketBuffer = pDeserializedInfo->pPacketBuffer;
+    pDeserializedInfo->takePacketBuffer = true;
+
+    return true;
+}
+
 /**
  * @brief Mocked MQTT event callback.
  *
@@ -747,6 +782,18 @@ static uint8_t * MQTTV5_SerializeDisconnectFixed_cb( uint8_t * pIndex,
     return pIndex;
 }
 
+static uint8_t * serializeAuthFixed_cb( uint8_t * pIndex,
+                                        MQTTSuccessFailReasonCode_t reasonCode,
+                                        uint32_t remainingLength,
+                                        int numcallbacks )
+{
+    ( void ) reasonCode;
+    ( void ) remainingLength;
+    ( void ) numcallbacks;
+
+    return pIndex;
+}
+
 /**
  * @brief Mocked function to retrieve a function while setting the connectStatus to not connected.
  *
@@ -867,6 +914,44 @@ static bool publishStoreCallbackSuccess( struct MQTTContext * pContext,
     return true;
 }
 
+/**
+ * @brief Copy of the last packet given to #publishStoreCallbackCopy.
+ */
+static uint8_t storedPacket[ 64 ];
+
+/**
+ * @brief Length of the packet in #storedPacket.
+ */
+static size_t storedPacketLength = 0U;
+
+/**
+ * @brief Mocked publish store function keeping a copy of the packet.
+ *
+ * @param[in] pContext initialised mqtt context.
+ * @param[in] packetId packet id
+ * @param[in] pMqttVec the packet to store
+ *
+ * @return true if store is successful else false
+ */
+static bool publishStoreCallbackCopy( struct MQTTContext * pContext,
+                                      uint32_t packetId,
+                                      MQTTVec_t * pMqttVec )
+{
+    bool stored = false;
+
+    ( void ) pContext;
+    ( void ) packetId;
+
+    if( ( MQTT_GetBytesInMQTTVec( pMqttVec, &storedPacketLength ) == MQTTSuccess ) &&
+        ( storedPacketLength <= sizeof( storedPacket ) ) )
+    {
+        MQTT_SerializeMQTTVec( storedPacket, pMqttVec );
+        stored = true;
+    }
+
+    return stored;
+}
+
 /**
  * @brief Mocked failed publish store function.
  *
@@ -1445,6 +1530,26 @@ static int32_t transportRecvFailure( NetworkContext_t * pNetworkContext,
     return -1;
 }
 
+/**
+ * @brief Number of bytes requested by the last call to
+ * #transportRecvOneByteCounted.
+ */
+static size_t lastBytesToRead = 0U;
+
+/**
+ * @brief Mocked transport reading one byte at a time and recording how many
+ * bytes were requested.
+ */
+static int32_t transportRecvOneByteCounted( NetworkContext_t * pNetworkContext,
+                                            void * pBuffer,
+                                            size_t bytesToRead )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+    lastBytesToRead = bytesToRead;
+    return 1;
+}
+
 /**
  * @brief Mocked transport reading one byte at a time.
  */
@@ -1459,6 +1564,97 @@ static int32_t transportRecvOneByte( NetworkContext_t * pNetworkContext,
 }
 
 
+/**
+ * @brief Number of calls made to #transportFlushCount.
+ */
+static size_t flushCount = 0U;
+
+/**
+ * @brief Mocked transport flush that counts its calls.
+ */
+static int32_t transportFlushCount( NetworkContext_t * pNetworkContext )
+{
+    ( void ) pNetworkContext;
+    flushCount++;
+    return 0;
+}
+
+/**
+ * @brief Mocked transport flush that fails.
+ */
+static int32_t transportFlushFailure( NetworkContext_t * pNetworkContext )
+{
+    ( void ) pNetworkContext;
+    return -1;
+}
+
+/**
+ * @brief Payload bytes sent by #transportSendPayloadPartial.
+ */
+static size_t sentPayloadBytes = 0U;
+
+/**
+ * @brief Offset given to the last call of #transportSendPayloadPartial.
+ */
+static size_t lastPayloadOffset = 0U;
+
+/**
+ * @brief Mocked transport payload send that sends at most four bytes per call.
+ */
+static int32_t transportSendPayloadPartial( NetworkContext_t * pNetworkContext,
+                                            const void * pPayloadSource,
+                                            size_t offset,
+                                            size_t bytesToSend )
+{
+    size_t bytesSent = ( bytesToSend > 4U ) ? 4U : bytesToSend;
+
+    ( void ) pNetworkContext;
+    ( void ) pPayloadSource;
+    lastPayloadOffset = offset;
+    sentPayloadBytes += bytesSent;
+    return ( int32_t ) bytesSent;
+}
+
+/**
+ * @brief Copy of the first vector given to #transportWritevCaptureHeader.
+ */
+static uint8_t sentHeader[ 8 ];
+
+/**
+ * @brief Length of the first vector given to #transportWritevCaptureHeader.
+ */
+static size_t sentHeaderLength = 0U;
+
+/**
+ * @brief Mocked successful transport writev that keeps a copy of the first
+ * vector.
+ */
+static int32_t transportWritevCaptureHeader( NetworkContext_t * pNetworkContext,
+                                             TransportOutVector_t * pIoVectorIterator,
+                                             size_t vectorsToBeSent )
+{
+    sentHeaderLength = pIoVectorIterator->iov_len;
+    TEST_ASSERT_LESS_OR_EQUAL( sizeof( sentHeader ), sentHeaderLength );
+    memcpy( sentHeader, pIoVectorIterator->iov_base, sentHeaderLength );
+
+    return transportWritevSuccess( pNetworkContext, pIoVectorIterator, vectorsToBeSent );
+}
+
+/**
+ * @brief Mocked transport payload send that fails.
+ */
+static int32_t transportSendPayloadFailure( NetworkContext_t * pNetworkContext,
+                                            const void * pPayloadSource,
+                                            size_t offset,
+                                            size_t bytesToSend )
+{
+    ( void ) pNetworkContext;
+    ( void ) pPayloadSource;
+    ( void ) offset;
+    ( void ) bytesToSend;
+    return -1;
+}
+
 /**
  * @brief Initialize the transport interface with the mocked functions for
  * send and receive.
@@ -3675,6 +3871,7 @@ void test_MQTT_Connect_resendUnAckedPublishes4( void )
     MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( &sessionPresent );
     MQTT_PubrelToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( packetIdentifier );
+    MQTT_GetPublishExpiry_IgnoreAndReturn( MQTTSuccess );
     serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     status = MQTT_Connect( &mqttContext, &connectInfo, NULL, timeout, &sessionPresentResult, NULL, NULL );
@@ -3739,6 +3936,7 @@ void test_MQTT_Connect_resendUnAckedPublishes5( void )
     MQTT_PubrelToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( packetIdentifier );
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
+    MQTT_GetPublishExpiry_IgnoreAndReturn( MQTTSuccess );
     serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     /* Query for any remaining packets pending to ack. */
@@ -3807,6 +4005,7 @@ void test_MQTT_Connect_resendUnAckedPublishes6( void )
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( packetIdentifier );
     /* Second packet. */
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( packetIdentifier + 1 );
+    MQTT_GetPublishExpiry_IgnoreAndReturn( MQTTSuccess );
     serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     status = MQTT_Connect( &mqttContext, &connectInfo, NULL, timeout, &sessionPresent, NULL, NULL );
@@ -3814,6 +4013,125 @@ void test_MQTT_Connect_resendUnAckedPublishes6( void )
     TEST_ASSERT_EQUAL_INT( MQTTDisconnectPending, mqttContext.connectStatus );
 }
 
+/**
+ * @brief Set up a context with a session to resume and one stored publish.
+ */
+static void setupResumedSessionWithStoredPublish( MQTTContext_t * pContext,
+                                                  TransportInterface_t * pTransport,
+                                                  MQTTFixedBuffer_t * pNetworkBuffer,
+                                                  MQTTPubAckInfo_t * pIncomingRecords,
+                                                  MQTTPubAckInfo_t * pOutgoingRecords,
+                                                  MQTTPacketInfo_t * pIncomingPacket,
+                                                  bool * pSessionPresent )
+{
+    static uint8_t ackPropsBuf[ 100 ];
+
+    setupTransportInterface( pTransport );
+    setupNetworkBuffer( pNetworkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( pContext, pTransport, getTime, eventCallback, pNetworkBuffer );
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_InitStatefulQoS( pContext,
+                          pOutgoingRecords, 1,
+                          pIncomingRecords, 1, ackPropsBuf, sizeof( ackPropsBuf ) );
+    MQTT_InitRetransmits( pContext, publishStoreCallbackSuccess,
+                          publishRetrieveCallbackSuccess,
+                          publishClearCallback );
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    pIncomingPacket->type = MQTT_PACKET_TYPE_CONNACK;
+    pIncomingPacket->remainingLength = 2;
+    *pSessionPresent = true;
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( pIncomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( pSessionPresent );
+    MQTT_PubrelToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
+}
+
+/**
+ * @brief Test that an expired publish is dropped instead of being resent.
+ */
+void test_MQTT_Connect_resendUnAckedPublishes_DropsExpiredPublish( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    uint32_t messageExpiry = 10U;
+    uint32_t publishTimeMs = 0U;
+
+    publishCopyBuffer = mqttBuffer;
+    publishCopyBufferSize = 20U;
+
+    setupResumedSessionWithStoredPublish( &mqttContext, &transport, &networkBuffer,
+                                          &incomingRecords, &outgoingRecords,
+                                          &incomingPacket, &sessionPresent );
+
+    /* The publish was sent 10 seconds ago and must not reach the transport. */
+    globalEntryTime = 10000U;
+    mqttContext.transportInterface.send = transportSendFailure;
+
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( 1 );
+    MQTT_GetPublishExpiry_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishExpiry_ReturnThruPtr_pMessageExpiry( &messageExpiry );
+    MQTT_GetPublishExpiry_ReturnThruPtr_pPublishTimeMs( &publishTimeMs );
+    MQTT_RemoveStateRecord_ExpectAndReturn( &mqttContext, 1, MQTTSuccess );
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
+
+    status = MQTT_Connect( &mqttContext, &connectInfo, NULL, 2, &sessionPresent, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+/**
+ * @brief Test that a publish which has not expired is resent with the
+ * remaining Message Expiry Interval.
+ */
+void test_MQTT_Connect_resendUnAckedPublishes_RewritesMessageExpiry( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    uint32_t messageExpiry = 60U;
+    uint32_t publishTimeMs = 0U;
+
+    publishCopyBuffer = mqttBuffer;
+    publishCopyBufferSize = 20U;
+
+    setupResumedSessionWithStoredPublish( &mqttContext, &transport, &networkBuffer,
+                                          &incomingRecords, &outgoingRecords,
+                                          &incomingPacket, &sessionPresent );
+
+    globalEntryTime = 15500U;
+    mqttContext.transportInterface.send = transportSendSuccess;
+
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( 1 );
+    MQTT_GetPublishExpiry_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishExpiry_ReturnThruPtr_pMessageExpiry( &messageExpiry );
+    MQTT_GetPublishExpiry_ReturnThruPtr_pPublishTimeMs( &publishTimeMs );
+    MQTT_UpdatePublishMessageExpiry_ExpectAndReturn( mqttBuffer, 20U, 45U, MQTTSuccess );
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
+
+    status = MQTT_Connect( &mqttContext, &connectInfo, NULL, 2, &sessionPresent, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
 #define MQTT_STATE_ARRAY_MAX_COUNT    1
 
 void test_MQTT_Connect_happy_path1()
@@ -4142,63 +4460,405 @@ void test_MQTT_Connect_happy_path6()
     TEST_ASSERT_FALSE( mqttContext.waitingForPingResp );
 }
 
-/* ========================================================================== */
+/**
+ * @brief Test MQTT_ConnectStart and MQTT_ConnectPoll with invalid parameters.
+ */
+void test_MQTT_ConnectStart_ConnectPoll_Invalid_Params( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+
+    status = MQTT_ConnectStart( NULL, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_ConnectStart( &mqttContext, NULL, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_ConnectPoll( NULL, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_ConnectPoll( &mqttContext, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Nothing to poll for without a pending CONNECT. */
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+}
 
 /**
- * @brief Test that MQTT_Publish works as intended.
+ * @brief Test that MQTT_ConnectStart sends the CONNECT and that
+ * MQTT_ConnectPoll returns at once until the CONNACK is received.
  */
-void test_MQTT_Publish( void )
+void test_MQTT_ConnectStart_ConnectPoll_Happy_Path( void )
 {
     MQTTContext_t mqttContext = { 0 };
-    MQTTPublishInfo_t publishInfo = { 0 };
-    MQTTConnectionProperties_t properties = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = true;
+    MQTTStatus_t status;
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
-    MQTTStatus_t status;
-    MQTTPubAckInfo_t incomingRecords = { 0 };
-    MQTTPubAckInfo_t outgoingRecords = { 0 };
-
-    const uint16_t PACKET_ID = 1;
+    MQTTPacketInfo_t incomingPacket = { 0 };
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.send = transportSendFailure;
-
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
-    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
-    memset( &properties, 0x0, sizeof( properties ) );
 
-    uint8_t ackPropsBuf[ 500 ];
-    size_t ackPropsBufLength = sizeof( ackPropsBuf );
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
-    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
-    status = MQTT_InitStatefulQoS( &mqttContext,
-                                   &outgoingRecords, 4,
-                                   &incomingRecords, 4, ackPropsBuf, ackPropsBufLength );
-    /* Need to set the context prop buffer manually. */
-    mqttContext.ackPropsBuffer.pBuffer = ackPropsBuf;
-    mqttContext.ackPropsBuffer.bufferLength = ackPropsBufLength;
-
-    mqttContext.connectStatus = MQTTConnected;
 
-    MQTTPropBuilder_t propBuilder = { 0 };
-    uint8_t buf[ 500 ];
-    size_t bufLength = sizeof( buf );
-    propBuilder.pBuffer = buf;
-    propBuilder.bufferLength = bufLength;
-    propBuilder.currentIndex = 2;
+    connectInfo.cleanSession = true;
+    incomingPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    incomingPacket.remainingLength = 2;
 
-    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
-    status = MQTT_Publish( &mqttContext, &publishInfo, PACKET_ID, NULL );
+
+    /* Bytes left from the previous connection are dropped. */
+    memset( mqttBuffer, 0xAB, MQTT_TEST_BUFFER_LENGTH );
+    mqttContext.index = 3U;
+    mqttContext.pendingPacketLength = 10U;
+
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
     TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_TRUE( mqttContext.connectPending );
+    TEST_ASSERT_TRUE( mqttContext.connectCleanSession );
+    TEST_ASSERT_EQUAL_INT( MQTTNotConnected, mqttContext.connectStatus );
+    TEST_ASSERT_EQUAL( 0U, mqttContext.index );
+    TEST_ASSERT_EQUAL( 0U, mqttContext.pendingPacketLength );
+    TEST_ASSERT_EACH_EQUAL_UINT8( 0, mqttBuffer, MQTT_TEST_BUFFER_LENGTH );
 
-    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTBadParameter );
-    status = MQTT_Publish( &mqttContext, &publishInfo, PACKET_ID, NULL );
-    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    /* The CONNACK has not arrived yet. */
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNoDataAvailable );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTNoDataAvailable, status );
+    TEST_ASSERT_TRUE( mqttContext.connectPending );
+
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( &( bool ) { false } );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_FALSE( sessionPresent );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+    TEST_ASSERT_EQUAL_INT( MQTTConnected, mqttContext.connectStatus );
+
+    /* The handshake is over. */
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+
+    /* A CONNECT cannot be started on an established connection. */
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusConnected, status );
+}
+
+/**
+ * @brief Test that a refused or failed CONNACK ends the pending handshake.
+ */
+void test_MQTT_ConnectStart_ConnectPoll_Failures( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+
+    incomingPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    incomingPacket.remainingLength = 2;
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    /* A failed send leaves no handshake pending. */
+    mqttContext.transportInterface.send = transportSendFailure;
+    mqttContext.transportInterface.writev = NULL;
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+
+    /* The server refuses the connection. */
+    mqttContext.transportInterface = transport;
+    mqttContext.connectStatus = MQTTNotConnected;
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTServerRefused );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTServerRefused, status );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+    TEST_ASSERT_EQUAL_INT( MQTTNotConnected, mqttContext.connectStatus );
+
+    /* A packet other than CONNACK is a bad response. */
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    incomingPacket.type = MQTT_PACKET_TYPE_PINGRESP;
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+}
+
+/**
+ * @brief Test that AUTH packets received before the CONNACK are given to the
+ * application and keep the handshake pending.
+ */
+void test_MQTT_ConnectPoll_Auth( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTPropBuilder_t propBuilder = { 0 };
+    uint8_t propBuffer[ 10 ];
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+
+    propBuilder.pBuffer = propBuffer;
+    propBuilder.bufferLength = sizeof( propBuffer );
+    propBuilder.currentIndex = 2;
+
+    incomingPacket.type = MQTT_PACKET_TYPE_AUTH;
+    incomingPacket.remainingLength = 2;
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    serializeAuthFixed_Stub( serializeAuthFixed_cb );
+
+    /* Nothing to continue without a pending CONNECT. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* The server challenges the client. */
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeAuth_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTNoDataAvailable, status );
+    TEST_ASSERT_TRUE( mqttContext.connectPending );
+
+    /* The client answers while the CONNECT is pending. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* A re-authentication cannot be started before the CONNACK. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+
+    /* A malformed AUTH ends the handshake. */
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeAuth_ExpectAnyArgsAndReturn( MQTTBadResponse );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+}
+
+/**
+ * @brief Test that MQTT_ConnectPoll returns the buffer leased for a CONNACK
+ * larger than the network buffer to the pool.
+ */
+void test_MQTT_ConnectPoll_BufferPool( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    uint8_t stagingBuffer[ 8 ] = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { stagingBuffer, sizeof( stagingBuffer ) };
+    MQTTBufferPool_t pool = { 0 };
+    uint8_t poolBuffers[ 2 * 64 ] = { 0 };
+    size_t freeBuffers[ 2 ] = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    setupTransportInterface( &transport );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    status = MQTT_InitBufferPool( &pool, poolBuffers, 64U, 2U, freeBuffers );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_InitNetworkBufferPool( &mqttContext, &pool );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    connectInfo.cleanSession = true;
+    incomingPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    incomingPacket.remainingLength = 20U;
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    /* A refused connection returns the buffer. */
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTServerRefused );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTServerRefused, status );
+    TEST_ASSERT_EQUAL( 2U, pool.freeBufferCount );
+    TEST_ASSERT_EQUAL_PTR( stagingBuffer, mqttContext.networkBuffer.pBuffer );
+
+    /* So does an accepted one. */
+    status = MQTT_ConnectStart( &mqttContext, &connectInfo, NULL, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( &( bool ) { false } );
+    status = MQTT_ConnectPoll( &mqttContext, &sessionPresent );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_INT( MQTTConnected, mqttContext.connectStatus );
+    TEST_ASSERT_EQUAL( 2U, pool.freeBufferCount );
+    TEST_ASSERT_EQUAL_PTR( stagingBuffer, mqttContext.networkBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( sizeof( stagingBuffer ), mqttContext.networkBuffer.size );
+}
+
+/**
+ * @brief Test that MQTT_Connect keeps waiting for the CONNACK after an AUTH
+ * packet.
+ */
+void test_MQTT_Connect_Auth_Before_Connack( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    bool sessionPresent = true;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t authPacket = { 0 };
+    MQTTPacketInfo_t connackPacket = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+
+    connectInfo.cleanSession = true;
+    authPacket.type = MQTT_PACKET_TYPE_AUTH;
+    authPacket.remainingLength = 2;
+    connackPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    connackPacket.remainingLength = 2;
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    /* With a zero timeout, AUTH packets do not use up the read retries. */
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNoDataAvailable );
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &authPacket );
+    MQTT_DeserializeAuth_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNoDataAvailable );
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNoDataAvailable );
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &connackPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( &( bool ) { false } );
+
+    status = MQTT_Connect( &mqttContext, &connectInfo, NULL, 0U, &sessionPresent, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_FALSE( mqttContext.connectPending );
+    TEST_ASSERT_EQUAL_INT( MQTTConnected, mqttContext.connectStatus );
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that MQTT_Publish works as intended.
+ */
+void test_MQTT_Publish( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTConnectionProperties_t properties = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+
+    const uint16_t PACKET_ID = 1;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.send = transportSendFailure;
+
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
+    memset( &properties, 0x0, sizeof( properties ) );
+
+    uint8_t ackPropsBuf[ 500 ];
+    size_t ackPropsBufLength = sizeof( ackPropsBuf );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_InitStatefulQoS( &mqttContext,
+                                   &outgoingRecords, 4,
+                                   &incomingRecords, 4, ackPropsBuf, ackPropsBufLength );
+    /* Need to set the context prop buffer manually. */
+    mqttContext.ackPropsBuffer.pBuffer = ackPropsBuf;
+    mqttContext.ackPropsBuffer.bufferLength = ackPropsBufLength;
+
+    mqttContext.connectStatus = MQTTConnected;
+
+    MQTTPropBuilder_t propBuilder = { 0 };
+    uint8_t buf[ 500 ];
+    size_t bufLength = sizeof( buf );
+    propBuilder.pBuffer = buf;
+    propBuilder.bufferLength = bufLength;
+    propBuilder.currentIndex = 2;
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    status = MQTT_Publish( &mqttContext, &publishInfo, PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTBadParameter );
+    status = MQTT_Publish( &mqttContext, &publishInfo, PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
 
 
     publishInfo.qos = 0;
@@ -4412,22 +5072,22 @@ void test_MQTT_Publish_Storing_Publish_Success( void )
     MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
 
     MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
 
-    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
-
     mqttContext.transportInterface.send = transportSendSuccess;
     status = MQTT_Publish( &mqttContext, &publishInfo, 1, NULL );
     TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
 }
 
 /**
- * @brief Test that MQTT_Publish works as intended.
+ * @brief Test that the Message Expiry Interval of a stored publish is recorded
+ * with its state record.
  */
-void test_MQTT_Publish_Storing_Publish_Success_For_Duplicate_Publish( void )
+void test_MQTT_Publish_Storing_Publish_Records_Message_Expiry( void )
 {
     MQTTContext_t mqttContext = { 0 };
     MQTTPublishInfo_t publishInfo = { 0 };
@@ -4439,13 +5099,14 @@ void test_MQTT_Publish_Storing_Publish_Success_For_Duplicate_Publish( void )
     MQTTPublishState_t expectedState = { 0 };
     uint8_t ackPropsBuf[ 500 ];
     size_t ackPropsBufLength = sizeof( ackPropsBuf );
+    MQTTPropBuilder_t propBuilder = { 0 };
+    uint8_t propBuffer[ 5 ] = { MQTT_MSG_EXPIRY_ID, 0x00, 0x00, 0x00, 0x3C };
+    uint8_t propertyId = MQTT_MSG_EXPIRY_ID;
+    uint32_t messageExpiry = 60U;
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.send = transportSendFailure;
 
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
-    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
     MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
@@ -4461,38 +5122,217 @@ void test_MQTT_Publish_Storing_Publish_Success_For_Duplicate_Publish( void )
                           publishClearCallback );
 
     mqttContext.connectStatus = MQTTConnected;
+    mqttContext.transportInterface.send = transportSendSuccess;
+
+    propBuilder.pBuffer = propBuffer;
+    propBuilder.bufferLength = sizeof( propBuffer );
+    propBuilder.currentIndex = sizeof( propBuffer );
+    UINT32_SET_BIT( propBuilder.fieldSet, MQTT_MESSAGE_EXPIRY_INTERVAL_POS );
 
     publishInfo.qos = MQTTQoS1;
-    publishInfo.dup = true;
 
     expectedState = MQTTPublishSend;
+    MQTT_ValidatePublishProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_GetNextPropertyType_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetNextPropertyType_ReturnThruPtr_property( &propertyId );
+    MQTTPropGet_MessageExpiryInterval_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTTPropGet_MessageExpiryInterval_ReturnThruPtr_pMessageExpiry( &messageExpiry );
     MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
-
     MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
+    MQTT_SetPublishExpiry_ExpectAndReturn( &mqttContext, 1, 60U, 0U, MQTTSuccess );
+    MQTT_SetPublishExpiry_IgnoreArg_publishTimeMs();
 
-    mqttContext.transportInterface.send = transportSendSuccess;
-    status = MQTT_Publish( &mqttContext, &publishInfo, 1, NULL );
+    MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_Publish( &mqttContext, &publishInfo, 1, &propBuilder );
     TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
 }
 
 /**
- * @brief Test that MQTT_Publish works as intended.
+ * @brief Test that MQTT_PublishFragments rejects invalid fragments.
  */
-void test_MQTT_Publish_Storing_Publish_Failed( void )
+void test_MQTT_PublishFragments_Invalid_Params( void )
 {
     MQTTContext_t mqttContext = { 0 };
     MQTTPublishInfo_t publishInfo = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
+    TransportOutVector_t fragments[ MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS + 1U ] = { 0 };
     MQTTStatus_t status;
-    MQTTPubAckInfo_t incomingRecords = { 0 };
-    MQTTPubAckInfo_t outgoingRecords = { 0 };
-    uint8_t ackPropsBuf[ 500 ];
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    mqttContext.connectStatus = MQTTConnected;
+
+    status = MQTT_PublishFragments( &mqttContext, NULL, 0U, NULL, fragments, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_PublishFragments( &mqttContext, &publishInfo, 0U, NULL, NULL, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_PublishFragments( &mqttContext, &publishInfo, 0U, NULL, fragments,
+                                    MQTT_PUBLISH_MAX_PAYLOAD_FRAGMENTS + 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A fragment with a length but no data. */
+    fragments[ 1 ].iov_len = 4U;
+    status = MQTT_PublishFragments( &mqttContext, &publishInfo, 0U, NULL, fragments, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The fragments overflow a size_t. */
+    fragments[ 0 ].iov_base = "a";
+    fragments[ 0 ].iov_len = SIZE_MAX;
+    fragments[ 1 ].iov_base = "b";
+    status = MQTT_PublishFragments( &mqttContext, &publishInfo, 0U, NULL, fragments, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The context is validated like for MQTT_Publish. */
+    status = MQTT_PublishFragments( NULL, &publishInfo, 0U, NULL, NULL, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
+
+/**
+ * @brief Test that MQTT_PublishFragments sends and stores every fragment.
+ */
+void test_MQTT_PublishFragments_Happy_Path( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    MQTTPublishState_t expectedState = MQTTPublishSend;
+    TransportOutVector_t fragments[ 3 ];
+    uint8_t ackPropsBuf[ 500 ];
+    size_t ackPropsBufLength = sizeof( ackPropsBuf );
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_InitStatefulQoS( &mqttContext,
+                          &outgoingRecords, 4,
+                          &incomingRecords, 4, ackPropsBuf, ackPropsBufLength );
+    MQTT_InitRetransmits( &mqttContext, publishStoreCallbackCopy,
+                          publishRetrieveCallbackSuccess,
+                          publishClearCallback );
+    mqttContext.connectStatus = MQTTConnected;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.pTopicName = "t";
+    publishInfo.topicNameLength = 1U;
+    /* Ignored in favour of the fragments. */
+    publishInfo.pPayload = "ignored";
+    publishInfo.payloadLength = 7U;
+
+    fragments[ 0 ].iov_base = "abc";
+    fragments[ 0 ].iov_len = 3U;
+    fragments[ 1 ].iov_base = NULL;
+    fragments[ 1 ].iov_len = 0U;
+    fragments[ 2 ].iov_base = "defgh";
+    fragments[ 2 ].iov_len = 5U;
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
+    MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    storedPacketLength = 0U;
+    status = MQTT_PublishFragments( &mqttContext, &publishInfo, 1U, NULL, fragments, 3U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* The stored packet ends with the whole payload: no header bytes were
+     * serialized by the mock, then the topic, packet ID and property length. */
+    TEST_ASSERT_EQUAL( 1U + 2U + 1U + 8U, storedPacketLength );
+    TEST_ASSERT_EQUAL_MEMORY( "abcdefgh", &storedPacket[ storedPacketLength - 8U ], 8U );
+}
+
+/**
+ * @brief Test that MQTT_Publish works as intended.
+ */
+void test_MQTT_Publish_Storing_Publish_Success_For_Duplicate_Publish( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    MQTTPublishState_t expectedState = { 0 };
+    uint8_t ackPropsBuf[ 500 ];
+    size_t ackPropsBufLength = sizeof( ackPropsBuf );
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.send = transportSendFailure;
+
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_InitStatefulQoS( &mqttContext,
+                          &outgoingRecords, 4,
+                          &incomingRecords, 4, ackPropsBuf, ackPropsBufLength );
+    /* Need to set the context prop buffer manually. */
+    mqttContext.ackPropsBuffer.pBuffer = ackPropsBuf;
+    mqttContext.ackPropsBuffer.bufferLength = ackPropsBufLength;
+
+    MQTT_InitRetransmits( &mqttContext, publishStoreCallbackSuccess,
+                          publishRetrieveCallbackSuccess,
+                          publishClearCallback );
+
+    mqttContext.connectStatus = MQTTConnected;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.dup = true;
+
+    expectedState = MQTTPublishSend;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
+
+    mqttContext.transportInterface.send = transportSendSuccess;
+    status = MQTT_Publish( &mqttContext, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+/**
+ * @brief Test that MQTT_Publish works as intended.
+ */
+void test_MQTT_Publish_Storing_Publish_Failed( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    uint8_t ackPropsBuf[ 500 ];
     size_t ackPropsBufLength = sizeof( ackPropsBuf );
 
     setupTransportInterface( &transport );
@@ -4523,6 +5363,7 @@ void test_MQTT_Publish_Storing_Publish_Failed( void )
     MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
 
     MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
 
@@ -4575,6 +5416,7 @@ void test_MQTT_Publish_Storing_Publish_Failed_Due_To_Dup_Flag_Not_Set( void )
     MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
     MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
 
     MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTBadParameter );
 
@@ -4708,126 +5550,1099 @@ void test_MQTT_Publish_not_connected( void )
 }
 
 /**
- * @brief Test that MQTT_Publish works as intended.
+ * @brief Test that MQTT_Publish refuses publishes that exceed the rate limit
+ * and reports when they can be sent.
  */
-void test_MQTT_Publish_DuplicatePublish_UpdateFailed( void )
+void test_MQTT_Publish_RateLimited( void )
 {
     MQTTContext_t mqttContext = { 0 };
     MQTTPublishInfo_t publishInfo = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
     MQTTStatus_t status;
-    MQTTPubAckInfo_t outgoingPublishRecord[ 10 ];
+    uint32_t packetSize = 60U;
+    uint32_t delayMs;
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.send = transportSendFailure;
 
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
-    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
-    mqttContext.connectStatus = MQTTConnected;
-
-    /* Always return success from now on. */
-    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
-    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTStateCollision );
-    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSendFailed );
+    mqttContext.connectStatus = MQTTConnected;
 
-    mqttContext.outgoingPublishRecordMaxCount = 10;
-    mqttContext.outgoingPublishRecords = outgoingPublishRecord;
+    /* Invalid parameters. */
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRateLimit( NULL, 1000U, 100U ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRateLimit( &mqttContext, 1000U, 0U ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRateLimit( &mqttContext, UINT32_MAX, 100U ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRateLimit( &mqttContext, 1U, MQTT_MAX_PACKET_SIZE ) );
+    TEST_ASSERT_EQUAL_UINT32( 0U, MQTT_GetRateLimitDelay( NULL ) );
+
+    /* 1000 bytes per second in bursts of up to 100 bytes. */
+    status = MQTT_InitRateLimit( &mqttContext, 1000U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
 
-    publishInfo.qos = MQTTQoS1;
-    publishInfo.dup = true;
     publishInfo.pPayload = "TestPublish";
     publishInfo.payloadLength = strlen( publishInfo.pPayload );
     publishInfo.pTopicName = "TestTopic";
     publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
 
-    status = MQTT_Publish( &mqttContext, &publishInfo, 10, NULL );
+    /* The first PUBLISH fits in the full bucket. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 0U, MQTT_GetRateLimitDelay( &mqttContext ) );
 
-    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    /* The second one has to wait for about 20 bytes to be earned. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTRateLimited, status );
+    delayMs = MQTT_GetRateLimitDelay( &mqttContext );
+    TEST_ASSERT_TRUE( ( delayMs > 0U ) && ( delayMs <= 21U ) );
+
+    /* It is sent once the delay has passed. */
+    globalEntryTime += delayMs;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 0U, MQTT_GetRateLimitDelay( &mqttContext ) );
+
+    /* A PUBLISH larger than the bucket is sent once the bucket is full. */
+    packetSize = 200U;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTRateLimited, status );
+
+    globalEntryTime += 1000U;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* A rate of zero removes the limit. */
+    status = MQTT_InitRateLimit( &mqttContext, 0U, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
 }
 
 /**
- * @brief Test that MQTT_Publish works as intended.
+ * @brief Test that contexts borrow publish records from a shared pool and
+ * return them once they are free.
  */
-void test_MQTT_Publish_WriteVSendsPartialBytes( void )
+void test_MQTT_Publish_RecordPool( void )
 {
-    MQTTContext_t mqttContext = { 0 };
+    MQTTContext_t contextA = { 0 };
+    MQTTContext_t contextB = { 0 };
     MQTTPublishInfo_t publishInfo = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTRecordPool_t pool = { 0 };
+    MQTTPubAckInfo_t poolRecords[ 4 ];
+    MQTTPubAckInfo_t ownRecords[ 2 ] = { 0 };
+    size_t freeBlocks[ 1 ];
     MQTTStatus_t status;
-    MQTTPubAckInfo_t outgoingPublishRecord[ 10 ];
-    size_t headerLen = 5;
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.writev = transportWritevPartialByte;
-
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
-    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
-    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    transport.recv = transportRecvNoData;
 
-    /* Always return success from now on. */
-    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_SerializePublishHeaderWithoutTopic_ReturnThruPtr_headerSize( &headerLen );
-    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    /* Invalid parameters. */
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( NULL, poolRecords, 4, 1, freeBlocks ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( &pool, NULL, 4, 1, freeBlocks ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( &pool, poolRecords, 4, 1, NULL ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( &pool, poolRecords, 0, 1, freeBlocks ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( &pool, poolRecords, 4, 0, freeBlocks ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitRecordPool( &pool, poolRecords, SIZE_MAX, 2, freeBlocks ) );
+
+    /* One block of four records. */
+    status = MQTT_InitRecordPool( &pool, poolRecords, 4, 1, freeBlocks );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1, pool.freeBlockCount );
 
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &contextA, &transport, getTime, eventCallback, &networkBuffer );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &contextB, &transport, getTime, eventCallback, &networkBuffer );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    contextA.connectStatus = MQTTConnected;
+    contextB.connectStatus = MQTTConnected;
 
-    mqttContext.outgoingPublishRecordMaxCount = 10;
-    mqttContext.outgoingPublishRecords = outgoingPublishRecord;
-    mqttContext.connectStatus = MQTTConnected;
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitStatefulQoSPool( NULL, &pool, 2, 2 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitStatefulQoSPool( &contextA, NULL, 2, 2 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitStatefulQoSPool( &contextA, &pool, 5, 2 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitStatefulQoSPool( &contextA, &pool, 2, 5 ) );
+    contextA.outgoingPublishRecords = ownRecords;
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, MQTT_InitStatefulQoSPool( &contextA, &pool, 2, 2 ) );
+    contextA.outgoingPublishRecords = NULL;
+
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, MQTT_InitStatefulQoSPool( &contextA, &pool, 2, 2 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, MQTT_InitStatefulQoSPool( &contextB, &pool, 2, 0 ) );
+    TEST_ASSERT_NULL( contextA.outgoingPublishRecords );
 
     publishInfo.qos = MQTTQoS1;
-    publishInfo.dup = false;
     publishInfo.pPayload = "TestPublish";
     publishInfo.payloadLength = strlen( publishInfo.pPayload );
     publishInfo.pTopicName = "TestTopic";
     publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
 
-    status = MQTT_Publish( &mqttContext, &publishInfo, 10, NULL );
+    /* The first QoS 1 publish of context A takes the block. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ReserveState_ExpectAndReturn( &contextA, 1, MQTTQoS1, MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &contextA, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( poolRecords, contextA.outgoingPublishRecords );
+    TEST_ASSERT_EQUAL( 2, contextA.outgoingPublishRecordMaxCount );
+    TEST_ASSERT_EQUAL( 0, pool.freeBlockCount );
+
+    /* Context B finds the pool empty. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &contextB, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+    TEST_ASSERT_NULL( contextB.outgoingPublishRecords );
 
+    /* The block is kept while a record is in use. */
+    poolRecords[ 1 ].packetId = 1;
+    contextA.keepAliveIntervalSec = 1;
+    status = MQTT_ReceiveLoop( &contextA );
     TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, pool.freeBlockCount );
+
+    /* Once the publish is acknowledged, the block goes back to the pool. */
+    poolRecords[ 1 ].packetId = MQTT_PACKET_ID_INVALID;
+    status = MQTT_ReceiveLoop( &contextA );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_NULL( contextA.outgoingPublishRecords );
+    TEST_ASSERT_EQUAL( 0, contextA.outgoingPublishRecordMaxCount );
+    TEST_ASSERT_EQUAL( 1, pool.freeBlockCount );
 }
 
-void test_MQTT_Publish7( void )
+/**
+ * @brief Test that MQTT_Publish updates the state record before the PUBLISH
+ * is sent, and does not send it if the update fails.
+ */
+void test_MQTT_Publish_State_Updated_Before_Send( void )
 {
     MQTTContext_t mqttContext = { 0 };
     MQTTPublishInfo_t publishInfo = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+    MQTTPublishState_t expectedState = MQTTPubAckPending;
+    uint8_t ackPropsBuf[ 500 ];
     MQTTStatus_t status;
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.writev = NULL;
     transport.send = transportSendFailure;
+    transport.writev = NULL;
 
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
-    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_InitStatefulQoS( &mqttContext,
+                          &outgoingRecords, 4,
+                          &incomingRecords, 4, ackPropsBuf, sizeof( ackPropsBuf ) );
+
+    mqttContext.connectStatus = MQTTConnected;
+    publishInfo.qos = MQTTQoS1;
+
+    /* The state update fails, so the PUBLISH must not reach the transport. */
     MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
-    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
-
-    mqttContext.connectStatus = MQTTConnected;
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTIllegalState );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTIllegalState, status );
 
-    /* We need sendPacket to be called with at least 1 byte to send, so that
-     * it can return failure. This argument is the output of serializing the
-     * publish header. */
-    publishInfo.pPayload = "Test";
+    /* The send fails after the record has moved to the ack pending state. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ReturnThruPtr_pNewState( &expectedState );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+}
+
+/**
+ * @brief Test that the transport is flushed after each PUBLISH, and only once
+ * after a batch of queued publishes.
+ */
+void test_MQTT_Publish_Flush( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.flush = transportFlushCount;
+    flushCount = 0U;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, flushCount );
+
+    /* A publish from another thread is not held back by the batch of a
+     * receive loop running the event callback. */
+    mqttContext.sendBatchDepth = 1U;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, flushCount );
+    TEST_ASSERT_FALSE( mqttContext.flushPending );
+    mqttContext.sendBatchDepth = 0U;
+
+    /* Two queued publishes are flushed together. */
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 3U, flushCount );
+    TEST_ASSERT_EQUAL( 0U, mqttContext.sendBatchDepth );
+
+    /* A failed flush is a failed send. */
+    mqttContext.transportInterface.flush = transportFlushFailure;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    TEST_ASSERT_EQUAL_INT( MQTTDisconnectPending, mqttContext.connectStatus );
+}
+
+/**
+ * @brief Test that MQTT_PublishFromSource sends the payload with the
+ * transport sendPayload function after the header.
+ */
+void test_MQTT_PublishFromSource( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    int payloadSource = 3;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.flush = transportFlushCount;
+    flushCount = 0U;
+    sentPayloadBytes = 0U;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+
+    publishInfo.payloadLength = 10U;
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    /* The transport has no sendPayload function. */
+    status = MQTT_PublishFromSource( &mqttContext, &publishInfo, 0, NULL, &payloadSource, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    mqttContext.transportInterface.sendPayload = transportSendPayloadPartial;
+
+    status = MQTT_PublishFromSource( &mqttContext, &publishInfo, 0, NULL, NULL, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The payload is sent in pieces and the transport flushed once. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishFromSource( &mqttContext, &publishInfo, 0, NULL, &payloadSource, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 10U, sentPayloadBytes );
+    TEST_ASSERT_EQUAL( 108U, lastPayloadOffset );
+    TEST_ASSERT_EQUAL( 1U, flushCount );
+    TEST_ASSERT_EQUAL( 0U, mqttContext.sendBatchDepth );
+
+    /* A QoS 1 payload cannot be stored for retransmission. */
+    publishInfo.qos = MQTTQoS1;
+    mqttContext.storeFunction = publishStoreCallbackSuccess;
+    status = MQTT_PublishFromSource( &mqttContext, &publishInfo, 1, NULL, &payloadSource, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A failed payload send is a failed send. */
+    publishInfo.qos = MQTTQoS0;
+    mqttContext.transportInterface.sendPayload = transportSendPayloadFailure;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishFromSource( &mqttContext, &publishInfo, 0, NULL, &payloadSource, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    TEST_ASSERT_EQUAL_INT( MQTTDisconnectPending, mqttContext.connectStatus );
+    TEST_ASSERT_EQUAL( 1U, flushCount );
+    TEST_ASSERT_EQUAL( 0U, mqttContext.sendBatchDepth );
+}
+
+/**
+ * @brief Test that a publish prepared by MQTT_PreparePublish is sent by
+ * MQTT_PublishPrepared without serializing the header again.
+ */
+void test_MQTT_PublishPrepared( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPreparedPublish_t preparedPublish = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    uint32_t remainingLength = 12U;
+    uint8_t firstByte = MQTT_PACKET_TYPE_PUBLISH;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.writev = transportWritevCaptureHeader;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+    mqttContext.connectionProperties.serverMaxPacketSize = MQTT_MAX_PACKET_SIZE;
+
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_PreparePublish( NULL, &publishInfo, NULL, &preparedPublish );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_PreparePublish( &mqttContext, &publishInfo, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_PublishPrepared( &mqttContext, NULL, "abc", 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ReturnArrayThruPtr_pBuffer( &firstByte, 1U );
+    status = MQTT_PreparePublish( &mqttContext, &publishInfo, NULL, &preparedPublish );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 12U, preparedPublish.remainingLength );
+
+    /* Each message is sent without serializing the header again. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abc", 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abcdef", 6U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 4U, sentHeaderLength );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PUBLISH, sentHeader[ 0 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0U, sentHeader[ 2 ] );
+    TEST_ASSERT_EQUAL_UINT8( publishInfo.topicNameLength, sentHeader[ 3 ] );
+
+    /* Only a resend updates the DUP flag. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateDuplicatePublishFlag_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abc", 3U, 0, true );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* A prepared publish that the server of the current connection no longer
+     * accepts is rejected. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTBadParameter );
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abc", 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    preparedPublish.topicAlias = 2U;
+    mqttContext.connectionProperties.serverTopicAliasMax = 1U;
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abc", 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    preparedPublish.topicAlias = 0U;
+
+    /* The payload must fit in the packet size the server accepts. */
+    mqttContext.connectionProperties.serverMaxPacketSize = 16U;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, "abc", 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_PublishPrepared( &mqttContext, &preparedPublish, NULL, 3U, 0, false );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
+
+/**
+ * @brief Test MQTT_InitPublishQueue with invalid and valid parameters.
+ */
+void test_MQTT_InitPublishQueue( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTStatus_t status;
+
+    status = MQTT_InitPublishQueue( NULL, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_InitPublishQueue( &mqttContext, NULL, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 0 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    mqttContext.publishQueueCount = 1;
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( publishQueue, mqttContext.pPublishQueue );
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueLength );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+}
+
+/**
+ * @brief Test MQTT_EnqueuePublish with invalid parameters and a full queue.
+ */
+void test_MQTT_EnqueuePublish( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTStatus_t status;
+
+    status = MQTT_EnqueuePublish( NULL, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_EnqueuePublish( &mqttContext, NULL, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Queue has not been initialized. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Start from the end of the ring buffer to cover wrap around. */
+    mqttContext.publishQueueHead = 1;
+
+    /* Publishes that could never be sent are refused when queued. */
+    publishInfo.payloadLength = 1;
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    publishInfo.payloadLength = 0;
+
+    publishInfo.topicNameLength = 65536U;
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+    publishInfo.topicNameLength = 0U;
+
+    /* The state records are left to the owner thread, so a QoS 1 publish is
+     * queued before MQTT_InitStatefulQoS. */
+    publishInfo.qos = MQTTQoS1;
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 5, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 6, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 7, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueCount );
+    TEST_ASSERT_EQUAL( 5, publishQueue[ 1 ].packetId );
+    TEST_ASSERT_EQUAL( 6, publishQueue[ 0 ].packetId );
+    TEST_ASSERT_EQUAL_INT( MQTTQoS1, publishQueue[ 0 ].publishInfo.qos );
+}
+
+/**
+ * @brief Test MQTT_ProcessPublishQueue sends all queued publishes.
+ */
+void test_MQTT_ProcessPublishQueue_Happy_Path( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 4 ];
+    MQTTStatus_t status;
+
+    status = MQTT_ProcessPublishQueue( NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+
+    /* Nothing to do without a queue. */
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueHead );
+}
+
+/**
+ * @brief Test that MQTT_ProcessPublishQueue assigns a packet ID to a queued
+ * QoS 1 publish that was queued without one.
+ */
+void test_MQTT_ProcessPublishQueue_Assigns_PacketId( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTPubAckInfo_t outgoingRecords[ 2 ] = { 0 };
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+    mqttContext.outgoingPublishRecords = outgoingRecords;
+    mqttContext.outgoingPublishRecordMaxCount = 2;
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+    /* MQTT_Init starts packet IDs at 1, so 1 was taken by the publish. */
+    TEST_ASSERT_EQUAL( 2, mqttContext.nextPacketId );
+}
+
+/**
+ * @brief Test that MQTT_ProcessPublishQueue sends higher priority publishes
+ * first and keeps the queue order of the others.
+ */
+void test_MQTT_ProcessPublishQueue_Priority( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 4 ];
+    MQTTPubAckInfo_t outgoingRecords[ 4 ] = { 0 };
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+    mqttContext.outgoingPublishRecords = outgoingRecords;
+    mqttContext.outgoingPublishRecordMaxCount = 4;
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Start near the end of the ring buffer to cover wrap around. */
+    mqttContext.publishQueueHead = 3;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_EnqueuePublishWithPriority( &mqttContext, &publishInfo, 9, NULL,
+                                              ( MQTTPublishPriority_t ) 3 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_EnqueuePublishWithPriority( &mqttContext, &publishInfo, 9, NULL, MQTTPublishPriorityLow );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 8, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublishWithPriority( &mqttContext, &publishInfo, 7, NULL, MQTTPublishPriorityHigh );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublishWithPriority( &mqttContext, &publishInfo, 10, NULL, MQTTPublishPriorityLow );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* The high priority publish is sent first, then the normal one, which
+     * cannot be sent yet as the outgoing records are full. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ReserveState_ExpectAndReturn( &mqttContext, 7, MQTTQoS1, MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ReserveState_ExpectAndReturn( &mqttContext, 8, MQTTQoS1, MQTTNoMemory );
+
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+    TEST_ASSERT_EQUAL( 3, mqttContext.publishQueueCount );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueHead );
+    TEST_ASSERT_EQUAL( 9, publishQueue[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( 8, publishQueue[ 1 ].packetId );
+    TEST_ASSERT_EQUAL( 10, publishQueue[ 2 ].packetId );
+}
+
+/**
+ * @brief Test that MQTT_ProcessPublishQueue keeps publishes that cannot be
+ * sent yet, and drops publishes that failed.
+ */
+void test_MQTT_ProcessPublishQueue_Error_Paths( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.writev = NULL;
+    transport.send = transportSendFailure;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.pPayload = "Test";
+    publishInfo.payloadLength = 4;
+
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Not connected: the publish stays queued. */
+    mqttContext.connectStatus = MQTTNotConnected;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueCount );
+
+    /* Send failure: the publish is dropped and the queue stops. */
+    mqttContext.connectStatus = MQTTConnected;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    status = MQTT_ProcessPublishQueue( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    TEST_ASSERT_EQUAL( 1, mqttContext.publishQueueCount );
+}
+
+/**
+ * @brief Test the policies applied by MQTT_EnqueuePublish when the publish
+ * queue is full.
+ */
+void test_MQTT_EnqueuePublish_QueuePolicy( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTPubAckInfo_t outgoingRecords[ 2 ] = { 0 };
+    MQTTStatus_t status;
+
+    mqttContext.outgoingPublishRecords = outgoingRecords;
+    mqttContext.outgoingPublishRecordMaxCount = 2;
+
+    status = MQTT_SetPublishQueuePolicy( NULL, MQTTPublishQueueDropOldest );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_SetPublishQueuePolicy( &mqttContext, ( MQTTPublishQueuePolicy_t ) 3 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.qos = MQTTQoS1;
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 1, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 2, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* By default the new publish is refused. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 3, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    /* The oldest publish makes room. */
+    publishInfo.qos = MQTTQoS0;
+    status = MQTT_SetPublishQueuePolicy( &mqttContext, MQTTPublishQueueDropOldest );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueCount );
+    TEST_ASSERT_EQUAL( 2, publishQueue[ mqttContext.publishQueueHead ].packetId );
+
+    /* The QoS 0 publish makes room for a QoS 1 publish... */
+    publishInfo.qos = MQTTQoS1;
+    status = MQTT_SetPublishQueuePolicy( &mqttContext, MQTTPublishQueueDropLowestQoS );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 4, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2, publishQueue[ mqttContext.publishQueueHead ].packetId );
+    TEST_ASSERT_EQUAL( 4, publishQueue[ ( mqttContext.publishQueueHead + 1U ) % 2U ].packetId );
+
+    /* ...but no QoS 1 publish makes room for a QoS 0 publish. */
+    publishInfo.qos = MQTTQoS0;
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+    TEST_ASSERT_EQUAL( 2, mqttContext.publishQueueCount );
+}
+
+/**
+ * @brief Test that MQTT_Connect sends the publishes queued while the
+ * connection was down.
+ */
+void test_MQTT_Connect_DrainsPublishQueue( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    bool sessionPresent = false;
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.pPayload = "Test";
+    publishInfo.payloadLength = 4;
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    /* Queued while not connected. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    incomingPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    incomingPacket.remainingLength = 2;
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_IgnoreAndReturn( MQTTSuccess );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Connect( &mqttContext, &connectInfo, NULL, 2U, &sessionPresent, NULL, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+    TEST_ASSERT_FALSE( mqttContext.publishQueueSending );
+}
+
+/**
+ * @brief Test that MQTT_ProcessLoop sends queued publishes before receiving.
+ */
+void test_MQTT_ProcessLoop_Sends_Publish_Queue( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPublishRequest_t publishQueue[ 2 ];
+    MQTTPubAckInfo_t outgoingRecords[ 2 ] = { 0 };
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    transport.recv = transportRecvNoData;
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttContext.connectStatus = MQTTConnected;
+    mqttContext.outgoingPublishRecords = outgoingRecords;
+    mqttContext.outgoingPublishRecordMaxCount = 2;
+
+    status = MQTT_InitPublishQueue( &mqttContext, publishQueue, 2 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessLoop( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+
+    /* A publish that cannot be sent yet does not stop the receive. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    mqttContext.pPublishQueue[ mqttContext.publishQueueHead ].publishInfo.qos = MQTTQoS1;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTNoMemory );
+
+    status = MQTT_ProcessLoop( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1, mqttContext.publishQueueCount );
+
+    /* A publish refused for its own parameters is dropped, the one queued
+     * after it is still sent and the receive goes on. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    mqttContext.pPublishQueue[ mqttContext.publishQueueHead ].publishInfo.qos = MQTTQoS0;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTBadParameter );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessLoop( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+
+    /* A transport failure is returned without receiving. */
+    status = MQTT_EnqueuePublish( &mqttContext, &publishInfo, 0, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    mqttContext.transportInterface.send = transportSendFailure;
+    mqttContext.transportInterface.writev = NULL;
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    status = MQTT_ProcessLoop( &mqttContext );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+    TEST_ASSERT_EQUAL( 0, mqttContext.publishQueueCount );
+    TEST_ASSERT_EQUAL_INT( MQTTDisconnectPending, mqttContext.connectStatus );
+}
+
+/**
+ * @brief Test that MQTT_Publish works as intended.
+ */
+void test_MQTT_Publish_DuplicatePublish_UpdateFailed( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t outgoingPublishRecord[ 10 ];
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.send = transportSendFailure;
+
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    mqttContext.connectStatus = MQTTConnected;
+
+    /* Always return success from now on. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTStateCollision );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSendFailed );
+
+    mqttContext.outgoingPublishRecordMaxCount = 10;
+    mqttContext.outgoingPublishRecords = outgoingPublishRecord;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.dup = true;
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_Publish( &mqttContext, &publishInfo, 10, NULL );
+
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
+}
+
+/**
+ * @brief Test that MQTT_Publish works as intended.
+ */
+void test_MQTT_Publish_WriteVSendsPartialBytes( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+    MQTTPubAckInfo_t outgoingPublishRecord[ 10 ];
+    size_t headerLen = 5;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.writev = transportWritevPartialByte;
+
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+
+    /* Always return success from now on. */
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ReturnThruPtr_headerSize( &headerLen );
+    MQTT_ReserveState_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    mqttContext.outgoingPublishRecordMaxCount = 10;
+    mqttContext.outgoingPublishRecords = outgoingPublishRecord;
+    mqttContext.connectStatus = MQTTConnected;
+
+    publishInfo.qos = MQTTQoS1;
+    publishInfo.dup = false;
+    publishInfo.pPayload = "TestPublish";
+    publishInfo.payloadLength = strlen( publishInfo.pPayload );
+    publishInfo.pTopicName = "TestTopic";
+    publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+
+    status = MQTT_Publish( &mqttContext, &publishInfo, 10, NULL );
+
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+void test_MQTT_Publish7( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTStatus_t status;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.writev = NULL;
+    transport.send = transportSendFailure;
+
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &publishInfo, 0x0, sizeof( publishInfo ) );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    MQTT_ValidatePublishParams_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPublishPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_SerializePublishHeaderWithoutTopic_ExpectAnyArgsAndReturn( MQTTSuccess );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+
+    mqttContext.connectStatus = MQTTConnected;
+
+    /* We need sendPacket to be called with at least 1 byte to send, so that
+     * it can return failure. This argument is the output of serializing the
+     * publish header. */
+    publishInfo.pPayload = "Test";
     publishInfo.payloadLength = 4;
     status = MQTT_Publish( &mqttContext, &publishInfo, 0, NULL );
     TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
@@ -5338,6 +7153,7 @@ void test_MQTT_Disconnect4( void )
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
     mqttContext.connectStatus = MQTTConnected;
+    mqttContext.index = 3U;
 
     /* Successful send. */
     mqttContext.transportInterface.send = mockSend;
@@ -5359,8 +7175,9 @@ void test_MQTT_Disconnect4( void )
 
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTNotConnected, mqttContext.connectStatus );
-    /* At disconnect, the buffer is cleared of any pending packets. */
-    TEST_ASSERT_EACH_EQUAL_UINT8( 0, mqttBuffer, MQTT_TEST_BUFFER_LENGTH );
+    /* The network buffer is left to the receive path, which may be using it. */
+    TEST_ASSERT_EQUAL( 3U, mqttContext.index );
+    TEST_ASSERT_EQUAL_UINT8( 0xAB, mqttBuffer[ 1 ] );
 }
 
 /**
@@ -5388,26 +7205,110 @@ void test_MQTT_Disconnect4_status_disconnect_pending( void )
     transport.send = transportSendFailure;
     transport.writev = NULL;
 
-    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    memset( &mqttContext, 0x0, sizeof( mqttContext ) );
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
+    mqttContext.connectStatus = MQTTDisconnectPending;
+    mqttContext.index = 3U;
+
+    /* Successful send. */
+    mqttContext.transportInterface.send = mockSend;
+    MQTT_GetDisconnectPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetDisconnectPacketSize_ReturnThruPtr_pPacketSize( &disconnectSize );
+    serializeDisconnectFixed_Stub( MQTTV5_SerializeDisconnectFixed_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    /* Write a disconnect packet into the buffer. */
+    mqttBuffer[ 0 ] = MQTT_PACKET_TYPE_DISCONNECT;
+
+    status = MQTT_Disconnect( &mqttContext, NULL, 0 );
+
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( MQTTNotConnected, mqttContext.connectStatus );
+    /* The network buffer is left to the receive path, which may be using it. */
+    TEST_ASSERT_EQUAL( 3U, mqttContext.index );
+    TEST_ASSERT_EQUAL_UINT8( 0xAB, mqttBuffer[ 1 ] );
+}
+
+/**
+ * @brief Test that MQTT_Auth works as intended.
+ */
+void test_MQTT_Auth( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTStatus_t status;
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPropBuilder_t propBuilder = { 0 };
+    uint8_t propBuffer[ 10 ];
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTT_Init( &mqttContext, &transport, getTime, eventCallback, &networkBuffer );
-    mqttContext.connectStatus = MQTTDisconnectPending;
 
-    /* Successful send. */
-    mqttContext.transportInterface.send = mockSend;
-    MQTT_GetDisconnectPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetDisconnectPacketSize_ReturnThruPtr_pPacketSize( &disconnectSize );
-    serializeDisconnectFixed_Stub( MQTTV5_SerializeDisconnectFixed_cb );
+    propBuilder.pBuffer = propBuffer;
+    propBuilder.bufferLength = sizeof( propBuffer );
+    propBuilder.currentIndex = 2;
+
+    serializeAuthFixed_Stub( serializeAuthFixed_cb );
     encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
-    /* Write a disconnect packet into the buffer. */
-    mqttBuffer[ 0 ] = MQTT_PACKET_TYPE_DISCONNECT;
 
-    status = MQTT_Disconnect( &mqttContext, NULL, 0 );
+    /* Invalid parameters. */
+    status = MQTT_Auth( NULL, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
 
-    TEST_ASSERT_EQUAL( MQTTSuccess, status );
-    TEST_ASSERT_EQUAL( MQTTNotConnected, mqttContext.connectStatus );
-    /* At disconnect, the buffer is cleared of any pending packets. */
-    TEST_ASSERT_EACH_EQUAL_UINT8( 0, mqttBuffer, MQTT_TEST_BUFFER_LENGTH );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Only the server sends an AUTH with a success reason code. */
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_SUCCESS, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The Authentication Method is missing. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTBadParameter );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The packet exceeds the server's maximum packet size. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTBadParameter );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Not connected. */
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
+
+    mqttContext.connectStatus = MQTTDisconnectPending;
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTStatusDisconnectPending, status );
+
+    /* Successful re-authentication request. */
+    mqttContext.connectStatus = MQTTConnected;
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Continue an exchange with empty properties. */
+    propBuilder.currentIndex = 0;
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_CONTINUE_AUTHENTICATION, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Send failure. */
+    mqttContext.transportInterface.send = transportSendFailure;
+    mqttContext.transportInterface.writev = NULL;
+    MQTT_ValidateAuthProperties_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetAuthPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Auth( &mqttContext, MQTT_REASON_AUTH_RE_AUTHENTICATE, &propBuilder );
+    TEST_ASSERT_EQUAL_INT( MQTTSendFailed, status );
 }
 
 /**
@@ -7059,157 +8960,386 @@ void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths2( void )
  * handleKeepAlive(...),
  * that result in the process loop returning an error.
  */
-void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths3( void )
+void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths3( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    ProcessLoopReturns_t expectParams = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.recv = transportRecvNoData;
+
+    modifyIncomingPacketStatus = MQTTNoDataAvailable;
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
+
+    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    context.connectStatus = MQTTConnected;
+
+    globalEntryTime = PACKET_RX_TIMEOUT_MS + 1;
+    context.keepAliveIntervalSec = 0;
+    context.lastPacketTxTime = 0;
+    context.lastPacketRxTime = 0;
+    context.pingReqSendTimeMs = 0;
+    context.waitingForPingResp = false;
+    /* Set expected return values in the loop. */
+    resetProcessLoopParams( &expectParams );
+    uint32_t packetSize = MQTT_PACKET_PINGREQ_SIZE;
+    MQTT_GetPingreqPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPingreqPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePingreq_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    mqttStatus = MQTT_ProcessLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+}
+
+/**
+ * @brief This test case covers all calls to the private method,
+ * handleKeepAlive(...),
+ * that result in the process loop returning an error.
+ */
+void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths4( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    ProcessLoopReturns_t expectParams = { 0 };
+    uint32_t packetSize = MQTT_PACKET_PINGREQ_SIZE;
+
+    setupTransportInterface( &transport );
+    transport.recv = transportRecvNoData;
+
+    setupNetworkBuffer( &networkBuffer );
+
+    modifyIncomingPacketStatus = MQTTNoDataAvailable;
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
+
+    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    context.connectStatus = MQTTConnected;
+
+    globalEntryTime = PACKET_RX_TIMEOUT_MS + 1;
+    context.keepAliveIntervalSec = ( PACKET_TX_TIMEOUT_MS / 1000 ) + 1U;
+    context.lastPacketTxTime = 0;
+    context.lastPacketRxTime = 0;
+    context.pingReqSendTimeMs = 0;
+    context.waitingForPingResp = false;
+
+    /* Set the index to non-zero value to show that there is some data in the buffer
+     * to be processed. */
+    context.index = 12;
+
+    /* Set expected return values in the loop. */
+    resetProcessLoopParams( &expectParams );
+
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    /* Modify incoming packet depending on type to be tested. */
+    currentPacketType = MQTT_PACKET_TYPE_PINGRESP;
+    incomingPacket.type = currentPacketType;
+    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_GetPingreqPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPingreqPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_SerializePingreq_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    mqttStatus = MQTT_ProcessLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+}
+
+/**
+ * @brief This test case covers all calls to the private method,
+ * handleKeepAlive(...),
+ * that result in the process loop returning an error.
+ */
+void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths5( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    ProcessLoopReturns_t expectParams = { 0 };
+
+    setupTransportInterface( &transport );
+    transport.recv = transportRecvNoData;
+
+    setupNetworkBuffer( &networkBuffer );
+
+    modifyIncomingPacketStatus = MQTTNoDataAvailable;
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
+
+    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    globalEntryTime = PACKET_RX_TIMEOUT_MS - 1U;
+    context.keepAliveIntervalSec = ( PACKET_TX_TIMEOUT_MS / 1000 ) + 1U;
+    context.lastPacketTxTime = 0;
+    context.lastPacketRxTime = 0;
+    context.pingReqSendTimeMs = 0;
+    context.waitingForPingResp = false;
+
+    /* Set the index to non-zero value to show that there is some data in the buffer
+     * to be processed. */
+    context.index = 12;
+
+    /* Set expected return values in the loop. */
+    resetProcessLoopParams( &expectParams );
+
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    /* Modify incoming packet depending on type to be tested. */
+    currentPacketType = MQTT_PACKET_TYPE_PINGRESP;
+    incomingPacket.type = currentPacketType;
+    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+
+    mqttStatus = MQTT_ProcessLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+}
+
+/**
+ * @brief Test that MQTT_ProcessKeepAlive rejects invalid parameters.
+ */
+void test_MQTT_ProcessKeepAlive_Invalid_Params( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+
+    mqttStatus = MQTT_ProcessKeepAlive( NULL );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    context.getTime = NULL;
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+}
+
+/**
+ * @brief Test that MQTT_ProcessKeepAlive sends a PINGREQ without reading
+ * from the network once the keep alive interval has expired.
+ */
+void test_MQTT_ProcessKeepAlive_Sends_Ping( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    uint32_t pingreqSize = MQTT_PACKET_PINGREQ_SIZE;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* The transport receive must not be invoked. */
+    context.transportInterface.recv = NULL;
+    context.connectStatus = MQTTConnected;
+    context.waitingForPingResp = false;
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.lastPacketTxTime = 0;
+    globalEntryTime = MQTT_ONE_SECOND_TO_MS;
+
+    MQTT_GetPingreqPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetPingreqPacketSize_ReturnThruPtr_pPacketSize( &pingreqSize );
+    MQTT_SerializePingreq_ExpectAnyArgsAndReturn( MQTTSuccess );
+
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_TRUE( context.waitingForPingResp );
+}
+
+/**
+ * @brief Test that MQTT_ProcessKeepAlive does nothing while the keep alive
+ * interval has not expired.
+ */
+void test_MQTT_ProcessKeepAlive_Not_Due( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    context.connectStatus = MQTTConnected;
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.lastPacketTxTime = MQTT_ONE_SECOND_TO_MS;
+    context.lastPacketRxTime = MQTT_ONE_SECOND_TO_MS;
+    globalEntryTime = MQTT_ONE_SECOND_TO_MS + 1U;
+
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_FALSE( context.waitingForPingResp );
+}
+
+/**
+ * @brief Test that MQTT_ProcessKeepAlive reports a missing PINGRESP.
+ */
+void test_MQTT_ProcessKeepAlive_PingResp_Timeout( void )
 {
     MQTTStatus_t mqttStatus;
     MQTTContext_t context = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
-    ProcessLoopReturns_t expectParams = { 0 };
 
     setupTransportInterface( &transport );
     setupNetworkBuffer( &networkBuffer );
-    transport.recv = transportRecvNoData;
-
-    modifyIncomingPacketStatus = MQTTNoDataAvailable;
-    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
 
-    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
     TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
 
     context.connectStatus = MQTTConnected;
-
-    globalEntryTime = PACKET_RX_TIMEOUT_MS + 1;
-    context.keepAliveIntervalSec = 0;
-    context.lastPacketTxTime = 0;
-    context.lastPacketRxTime = 0;
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.waitingForPingResp = true;
     context.pingReqSendTimeMs = 0;
-    context.waitingForPingResp = false;
-    /* Set expected return values in the loop. */
-    resetProcessLoopParams( &expectParams );
-    uint32_t packetSize = MQTT_PACKET_PINGREQ_SIZE;
-    MQTT_GetPingreqPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetPingreqPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
-    MQTT_SerializePingreq_ExpectAnyArgsAndReturn( MQTTSuccess );
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1U;
 
-    mqttStatus = MQTT_ProcessLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTKeepAliveTimeout, mqttStatus );
 }
 
 /**
- * @brief This test case covers all calls to the private method,
- * handleKeepAlive(...),
- * that result in the process loop returning an error.
+ * @brief Test that MQTT_ProcessKeepAlive neither sends a PINGREQ nor reports a
+ * missing PINGRESP without an established connection.
  */
-void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths4( void )
+void test_MQTT_ProcessKeepAlive_Not_Connected( void )
 {
     MQTTStatus_t mqttStatus;
     MQTTContext_t context = { 0 };
     TransportInterface_t transport = { 0 };
     MQTTFixedBuffer_t networkBuffer = { 0 };
-    ProcessLoopReturns_t expectParams = { 0 };
-    uint32_t packetSize = MQTT_PACKET_PINGREQ_SIZE;
 
     setupTransportInterface( &transport );
-    transport.recv = transportRecvNoData;
-
     setupNetworkBuffer( &networkBuffer );
 
-    modifyIncomingPacketStatus = MQTTNoDataAvailable;
-    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
-
-    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
     MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
     TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
 
-    context.connectStatus = MQTTConnected;
+    /* The PINGREQ of the previous connection was never answered. */
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.waitingForPingResp = true;
+    context.pingReqSendTimeMs = 0;
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1U;
 
-    globalEntryTime = PACKET_RX_TIMEOUT_MS + 1;
-    context.keepAliveIntervalSec = ( PACKET_TX_TIMEOUT_MS / 1000 ) + 1U;
+    context.connectStatus = MQTTNotConnected;
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTStatusNotConnected, mqttStatus );
+
+    context.connectStatus = MQTTDisconnectPending;
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTStatusDisconnectPending, mqttStatus );
+
+    /* The status is reported when no PINGREQ is due either. */
+    context.waitingForPingResp = false;
     context.lastPacketTxTime = 0;
     context.lastPacketRxTime = 0;
-    context.pingReqSendTimeMs = 0;
-    context.waitingForPingResp = false;
+    globalEntryTime = MQTT_ONE_SECOND_TO_MS;
 
-    /* Set the index to non-zero value to show that there is some data in the buffer
-     * to be processed. */
-    context.index = 12;
+    context.connectStatus = MQTTNotConnected;
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTStatusNotConnected, mqttStatus );
 
-    /* Set expected return values in the loop. */
-    resetProcessLoopParams( &expectParams );
+    context.connectStatus = MQTTDisconnectPending;
+    mqttStatus = MQTT_ProcessKeepAlive( &context );
+    TEST_ASSERT_EQUAL( MQTTStatusDisconnectPending, mqttStatus );
+    TEST_ASSERT_FALSE( context.waitingForPingResp );
+}
 
-    MQTTPacketInfo_t incomingPacket = { 0 };
-    /* Modify incoming packet depending on type to be tested. */
-    currentPacketType = MQTT_PACKET_TYPE_PINGRESP;
-    incomingPacket.type = currentPacketType;
-    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
-    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+/**
+ * @brief Test MQTT_GetNextTimeoutMs with invalid parameters and when the
+ * context is not connected.
+ */
+void test_MQTT_GetNextTimeoutMs_No_Timeout_Pending( void )
+{
+    MQTTContext_t context = { 0 };
 
-    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
-    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
-    MQTT_GetPingreqPacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
-    MQTT_GetPingreqPacketSize_ReturnThruPtr_pPacketSize( &packetSize );
-    MQTT_SerializePingreq_ExpectAnyArgsAndReturn( MQTTSuccess );
+    TEST_ASSERT_EQUAL_UINT32( MQTT_NO_TIMEOUT_PENDING, MQTT_GetNextTimeoutMs( NULL ) );
 
-    mqttStatus = MQTT_ProcessLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    context.getTime = NULL;
+    context.connectStatus = MQTTConnected;
+    TEST_ASSERT_EQUAL_UINT32( MQTT_NO_TIMEOUT_PENDING, MQTT_GetNextTimeoutMs( &context ) );
+
+    context.getTime = getTime;
+    context.connectStatus = MQTTNotConnected;
+    TEST_ASSERT_EQUAL_UINT32( MQTT_NO_TIMEOUT_PENDING, MQTT_GetNextTimeoutMs( &context ) );
 }
 
 /**
- * @brief This test case covers all calls to the private method,
- * handleKeepAlive(...),
- * that result in the process loop returning an error.
+ * @brief Test MQTT_GetNextTimeoutMs returns the time until a PINGREQ is due.
  */
-void test_MQTT_ProcessLoop_handleKeepAlive_Error_Paths5( void )
+void test_MQTT_GetNextTimeoutMs_Keep_Alive( void )
 {
-    MQTTStatus_t mqttStatus;
     MQTTContext_t context = { 0 };
-    TransportInterface_t transport = { 0 };
-    MQTTFixedBuffer_t networkBuffer = { 0 };
-    ProcessLoopReturns_t expectParams = { 0 };
-
-    setupTransportInterface( &transport );
-    transport.recv = transportRecvNoData;
 
-    setupNetworkBuffer( &networkBuffer );
+    context.getTime = getTime;
+    context.connectStatus = MQTTConnected;
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.lastPacketTxTime = 100U;
+    context.lastPacketRxTime = 100U;
 
-    modifyIncomingPacketStatus = MQTTNoDataAvailable;
-    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1;
+    /* Interval has not expired. */
+    globalEntryTime = 400U;
+    TEST_ASSERT_EQUAL_UINT32( MQTT_ONE_SECOND_TO_MS - 300U, MQTT_GetNextTimeoutMs( &context ) );
 
-    /* Coverage for the branch path where PINGRESP timeout interval has expired. */
-    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
-    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
-    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    /* Interval has expired. */
+    globalEntryTime = 100U + MQTT_ONE_SECOND_TO_MS;
+    TEST_ASSERT_EQUAL_UINT32( 0U, MQTT_GetNextTimeoutMs( &context ) );
 
-    globalEntryTime = PACKET_RX_TIMEOUT_MS - 1U;
-    context.keepAliveIntervalSec = ( PACKET_TX_TIMEOUT_MS / 1000 ) + 1U;
-    context.lastPacketTxTime = 0;
-    context.lastPacketRxTime = 0;
-    context.pingReqSendTimeMs = 0;
-    context.waitingForPingResp = false;
+    /* Keep alive is disabled, only the receive timeout applies. */
+    context.keepAliveIntervalSec = 0U;
+    globalEntryTime = 400U;
+    TEST_ASSERT_EQUAL_UINT32( PACKET_RX_TIMEOUT_MS - 300U, MQTT_GetNextTimeoutMs( &context ) );
 
-    /* Set the index to non-zero value to show that there is some data in the buffer
-     * to be processed. */
-    context.index = 12;
+    /* The earlier of the two timeouts is returned. */
+    context.keepAliveIntervalSec = ( PACKET_TX_TIMEOUT_MS / 1000U ) + 1U;
+    context.lastPacketTxTime = 300U;
+    globalEntryTime = 400U;
+    TEST_ASSERT_EQUAL_UINT32( PACKET_RX_TIMEOUT_MS - 300U, MQTT_GetNextTimeoutMs( &context ) );
+}
 
-    /* Set expected return values in the loop. */
-    resetProcessLoopParams( &expectParams );
+/**
+ * @brief Test MQTT_GetNextTimeoutMs returns the time until a missing PINGRESP
+ * is reported.
+ */
+void test_MQTT_GetNextTimeoutMs_PingResp( void )
+{
+    MQTTContext_t context = { 0 };
 
-    MQTTPacketInfo_t incomingPacket = { 0 };
-    /* Modify incoming packet depending on type to be tested. */
-    currentPacketType = MQTT_PACKET_TYPE_PINGRESP;
-    incomingPacket.type = currentPacketType;
-    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
-    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    context.getTime = getTime;
+    context.connectStatus = MQTTConnected;
+    context.keepAliveIntervalSec = MQTT_SAMPLE_KEEPALIVE_INTERVAL_S;
+    context.waitingForPingResp = true;
+    context.pingReqSendTimeMs = 0U;
 
-    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
-    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS;
+    TEST_ASSERT_EQUAL_UINT32( 1U, MQTT_GetNextTimeoutMs( &context ) );
 
-    mqttStatus = MQTT_ProcessLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    globalEntryTime = MQTT_PINGRESP_TIMEOUT_MS + 1U;
+    TEST_ASSERT_EQUAL_UINT32( 0U, MQTT_GetNextTimeoutMs( &context ) );
 }
 
 /**
@@ -7363,36 +9493,246 @@ void test_MQTT_ReceiveLoop( void )
     TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
     setupNetworkBuffer( &( context.networkBuffer ) );
 
-    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTBadResponse );
-    /* Error case, for branch coverage. */
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTBadResponse );
+    /* Error case, for branch coverage. */
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, mqttStatus );
+
+    /* This will cover the case when there is data available in the buffer to be processed but
+     * no additional bytes have been received by the transport interface. */
+    context.transportInterface.recv = transportRecvNoData;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTBadResponse );
+    /* Error case, for branch coverage. */
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, mqttStatus );
+
+    /* Reset the index to clear the buffer of any remaining data. */
+    context.index = 0;
+    /* Keep Alive should not trigger.*/
+    context.keepAliveIntervalSec = 1;
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_FALSE( context.controlPacketSent );
+
+    /* Test with a dummy getTime to ensure there's no infinite loops. */
+    context.getTime = getTimeDummy;
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    context.getTime = getTime;
+
+    /* Receive a PINGRESP. */
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+}
+
+/**
+ * @brief Test that a packet too big for the network buffer is received into a
+ * buffer leased from the buffer pool, and that the buffer is returned once the
+ * packet has been processed.
+ */
+void test_MQTT_ReceiveLoop_BufferPool( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    uint8_t stagingBuffer[ 8 ] = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { stagingBuffer, sizeof( stagingBuffer ) };
+    MQTTBufferPool_t pool = { 0 };
+    uint8_t poolBuffers[ 2 * 64 ] = { 0 };
+    size_t freeBuffers[ 2 ] = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    setupTransportInterface( &transport );
+    transport.recv = transportRecvOneByte;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* Invalid parameters. */
+    mqttStatus = MQTT_InitBufferPool( NULL, poolBuffers, 64U, 2U, freeBuffers );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+    mqttStatus = MQTT_InitBufferPool( &pool, poolBuffers, 4U, 2U, freeBuffers );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+    mqttStatus = MQTT_InitBufferPool( &pool, poolBuffers, 64U, 0U, freeBuffers );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitBufferPool( &pool, poolBuffers, 64U, 2U, freeBuffers );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 2U, pool.freeBufferCount );
+
+    mqttStatus = MQTT_InitNetworkBufferPool( NULL, &pool );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    /* The network buffer cannot be larger than the pool buffers. */
+    pool.bufferSize = 4U;
+    mqttStatus = MQTT_InitNetworkBufferPool( &context, &pool );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+    pool.bufferSize = 64U;
+
+    mqttStatus = MQTT_InitNetworkBufferPool( &context, &pool );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* The pool cannot be set twice. */
+    mqttStatus = MQTT_InitNetworkBufferPool( &context, &pool );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    /* The fixed header announces a packet larger than the network buffer, so
+     * a buffer is leased and the received byte is kept. */
+    stagingBuffer[ 0 ] = MQTT_PACKET_TYPE_PUBLISH;
+    incomingPacket.type = MQTT_PACKET_TYPE_PUBLISH;
+    incomingPacket.remainingLength = 20U;
+    incomingPacket.headerLength = 2U;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    TEST_ASSERT_EQUAL( 1U, pool.freeBufferCount );
+    TEST_ASSERT_EQUAL_PTR( &poolBuffers[ 64 ], context.networkBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( 64U, context.networkBuffer.size );
+    TEST_ASSERT_EQUAL( 1U, context.index );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PUBLISH, poolBuffers[ 64 ] );
+
+    /* The buffer is returned to the pool once no received bytes are left. */
+    context.index = 0U;
+    context.transportInterface.recv = transportRecvNoData;
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 2U, pool.freeBufferCount );
+    TEST_ASSERT_EQUAL_PTR( stagingBuffer, context.networkBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( sizeof( stagingBuffer ), context.networkBuffer.size );
+
+    /* No buffer can be leased from an empty pool. */
+    pool.freeBufferCount = 0U;
+    context.transportInterface.recv = transportRecvOneByte;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNoMemory, mqttStatus );
+    TEST_ASSERT_EQUAL_PTR( stagingBuffer, context.networkBuffer.pBuffer );
+}
+
+/**
+ * @brief Test that the fixed header of a partially received packet is decoded
+ * once, and that later calls only read the bytes still missing from it.
+ */
+void test_MQTT_ReceiveLoop_PartialPacket( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    transport.recv = transportRecvOneByteCounted;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* The first byte of a 22 byte packet arrives. */
+    incomingPacket.type = MQTT_PACKET_TYPE_PUBLISH;
+    incomingPacket.remainingLength = 20U;
+    incomingPacket.headerLength = 2U;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    TEST_ASSERT_EQUAL( MQTT_TEST_BUFFER_LENGTH, lastBytesToRead );
+    TEST_ASSERT_EQUAL( 22U, context.pendingPacketLength );
+
+    /* The next call does not decode the header again and asks only for the
+     * rest of the packet. */
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    TEST_ASSERT_EQUAL( 21U, lastBytesToRead );
+    TEST_ASSERT_EQUAL( 2U, context.index );
+
+    /* Emptying the buffer drops the kept header. */
+    context.index = 0U;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
+    mqttStatus = MQTT_ReceiveLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    TEST_ASSERT_EQUAL( MQTT_TEST_BUFFER_LENGTH, lastBytesToRead );
+    TEST_ASSERT_EQUAL( 0U, context.pendingPacketLength );
+}
+
+/**
+ * @brief Test that the event callback can take the leased buffer holding an
+ * incoming PUBLISH and give it back to the pool later.
+ */
+void test_MQTT_ReceiveLoop_BufferPoolTake( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    uint8_t stagingBuffer[ 8 ] = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { stagingBuffer, sizeof( stagingBuffer ) };
+    MQTTBufferPool_t pool = { 0 };
+    uint8_t poolBuffers[ 2 * 64 ] = { 0 };
+    size_t freeBuffers[ 2 ] = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+
+    setupTransportInterface( &transport );
+    transport.recv = transportRecvOneByte;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallbackTakeBuffer, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    mqttStatus = MQTT_InitBufferPool( &pool, poolBuffers, 64U, 2U, freeBuffers );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    mqttStatus = MQTT_InitNetworkBufferPool( &context, &pool );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* Lease a buffer for a 22 byte PUBLISH. */
+    incomingPacket.type = MQTT_PACKET_TYPE_PUBLISH;
+    incomingPacket.remainingLength = 20U;
+    incomingPacket.headerLength = 2U;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
     mqttStatus = MQTT_ReceiveLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTBadResponse, mqttStatus );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
+    TEST_ASSERT_EQUAL_PTR( &poolBuffers[ 64 ], context.networkBuffer.pBuffer );
 
-    /* This will cover the case when there is data available in the buffer to be processed but
-     * no additional bytes have been received by the transport interface. */
+    /* The whole PUBLISH and three bytes of the next packet have arrived. The
+     * header decoded by the previous call is reused. */
+    context.index = 25U;
+    poolBuffers[ 64 + 22 ] = MQTT_PACKET_TYPE_PINGRESP;
     context.transportInterface.recv = transportRecvNoData;
-    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTBadResponse );
-    /* Error case, for branch coverage. */
+    MQTT_DeserializePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializePublish_ReturnThruPtr_pPublishInfo( &publishInfo );
+    MQTT_UpdateStatePublish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTNeedMoreBytes );
     mqttStatus = MQTT_ReceiveLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTBadResponse, mqttStatus );
+    TEST_ASSERT_EQUAL( MQTTNeedMoreBytes, mqttStatus );
 
-    /* Reset the index to clear the buffer of any remaining data. */
-    context.index = 0;
-    /* Keep Alive should not trigger.*/
-    context.keepAliveIntervalSec = 1;
-    mqttStatus = MQTT_ReceiveLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
-    TEST_ASSERT_FALSE( context.controlPacketSent );
+    /* The application owns the buffer and the context is back on its staging
+     * buffer with the bytes of the next packet. */
+    TEST_ASSERT_EQUAL_PTR( &poolBuffers[ 64 ], pTakenPacketBuffer );
+    TEST_ASSERT_EQUAL( 1U, pool.freeBufferCount );
+    TEST_ASSERT_EQUAL_PTR( stagingBuffer, context.networkBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( 3U, context.index );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PINGRESP, stagingBuffer[ 0 ] );
 
-    /* Test with a dummy getTime to ensure there's no infinite loops. */
-    context.getTime = getTimeDummy;
-    mqttStatus = MQTT_ReceiveLoop( &context );
-    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
-    context.getTime = getTime;
+    /* Only buffers of the pool can be returned to it. */
+    mqttStatus = MQTT_ReturnPoolBuffer( NULL, pTakenPacketBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+    mqttStatus = MQTT_ReturnPoolBuffer( &pool, &poolBuffers[ 65 ] );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+    mqttStatus = MQTT_ReturnPoolBuffer( &pool, stagingBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
 
-    /* Receive a PINGRESP. */
-    mqttStatus = MQTT_ReceiveLoop( &context );
+    mqttStatus = MQTT_ReturnPoolBuffer( &pool, pTakenPacketBuffer );
     TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 2U, pool.freeBufferCount );
+
+    /* A buffer cannot be returned twice. */
+    mqttStatus = MQTT_ReturnPoolBuffer( &pool, pTakenPacketBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
 }
 
 void test_MQTT_ProcessLoop_handleIncomingAck_Error_Paths1( void )
@@ -8172,6 +10512,49 @@ void test_MQTT_ProcessLoop_handleIncomingDisconnect( void )
     TEST_ASSERT_EQUAL_INT( MQTTStatusNotConnected, status );
 }
 
+/**
+ * @brief Test that an AUTH packet received by MQTT_ProcessLoop is given to the
+ * application callback.
+ */
+void test_MQTT_ProcessLoop_handleIncomingAuth( void )
+{
+    MQTTStatus_t status;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTPubAckInfo_t incomingRecords = { 0 };
+    MQTTPubAckInfo_t outgoingRecords = { 0 };
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    uint8_t ackPropsBuf[ 500 ];
+    size_t ackPropsBufLength = sizeof( ackPropsBuf );
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    MQTTPropertyBuilder_Init_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_InitStatefulQoS( &context,
+                                   &outgoingRecords, 4,
+                                   &incomingRecords, 4, ackPropsBuf, ackPropsBufLength );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    context.connectStatus = MQTTConnected;
+    incomingPacket.type = MQTT_PACKET_TYPE_AUTH;
+    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+
+    modifyIncomingPacketStatus = MQTTSuccess;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeAuth_ExpectAnyArgsAndReturn( MQTTSuccess );
+    status = MQTT_ProcessLoop( &context );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_INT( MQTTConnected, context.connectStatus );
+}
+
 void test_incoming_disconnect_failsSendingDisconnect( void )
 {
     MQTTStatus_t status;
@@ -9488,6 +11871,255 @@ void test_MQTT_Unsubscribe_not_connected( void )
     TEST_ASSERT_EQUAL( MQTTStatusDisconnectPending, mqttStatus );
 }
 
+/**
+ * @brief Test MQTT_InitSubscribeBuffer with invalid and valid parameters.
+ */
+void test_MQTT_InitSubscribeBuffer( void )
+{
+    MQTTContext_t context = { 0 };
+    MQTTFixedBuffer_t subscribeBuffer = { 0 };
+    uint8_t buffer[ 100 ];
+    MQTTStatus_t mqttStatus;
+
+    mqttStatus = MQTT_InitSubscribeBuffer( NULL, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, NULL );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    subscribeBuffer.pBuffer = buffer;
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    subscribeBuffer.size = sizeof( buffer );
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL_PTR( buffer, context.subscribeBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( sizeof( buffer ), context.subscribeBuffer.size );
+}
+
+/**
+ * @brief Test that SUBSCRIBE and UNSUBSCRIBE packets which fit in the subscribe
+ * buffer are serialized into it and sent with a single send call, and that
+ * larger packets are still sent from the subscription list.
+ */
+void test_MQTT_Subscribe_Unsubscribe_With_Subscribe_Buffer( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTFixedBuffer_t subscribeBuffer = { 0 };
+    MQTTSubscribeInfo_t subscribeInfo = { 0 };
+    uint8_t buffer[ MQTT_SAMPLE_REMAINING_LENGTH + 10U ];
+    uint32_t remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    uint32_t packetSize = MQTT_SAMPLE_REMAINING_LENGTH;
+    uint32_t largePacketSize = sizeof( buffer ) + 1U;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    setupSubscriptionInfo( &subscribeInfo );
+    subscribeInfo.qos = MQTTQoS0;
+
+    /* Vectored sends fail, so only the single buffer send can succeed. */
+    transport.writev = transportWritevError;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    subscribeBuffer.pBuffer = buffer;
+    subscribeBuffer.size = sizeof( buffer );
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    context.connectStatus = MQTTConnected;
+
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeSubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Subscribe( &context, &subscribeInfo, 1, MQTT_FIRST_VALID_PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    MQTT_GetUnsubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeUnsubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Unsubscribe( &context, &subscribeInfo, 1, MQTT_FIRST_VALID_PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    /* A serialization error is returned without sending anything. */
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeSubscribe_ExpectAnyArgsAndReturn( MQTTNoMemory );
+    mqttStatus = MQTT_Subscribe( &context, &subscribeInfo, 1, MQTT_FIRST_VALID_PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL( MQTTNoMemory, mqttStatus );
+
+    /* A failed send is reported. */
+    context.transportInterface.send = transportSendFailure;
+    MQTT_GetUnsubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeUnsubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Unsubscribe( &context, &subscribeInfo, 1, MQTT_FIRST_VALID_PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL( MQTTSendFailed, mqttStatus );
+
+    /* A packet larger than the buffer falls back to the vectored send. */
+    context.transportInterface.send = transportSendSuccess;
+    context.connectStatus = MQTTConnected;
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pPacketSize( &largePacketSize );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    serializeSubscribeHeader_Stub( MQTTV5_SerializeSubscribedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    mqttStatus = MQTT_Subscribe( &context, &subscribeInfo, 1, MQTT_FIRST_VALID_PACKET_ID, NULL );
+    TEST_ASSERT_EQUAL( MQTTSendFailed, mqttStatus );
+}
+
+
+/**
+ * @brief Test MQTT_InitSubscriptionRegistry with invalid and valid parameters.
+ */
+void test_MQTT_InitSubscriptionRegistry( void )
+{
+    MQTTContext_t context = { 0 };
+    MQTTSubscriptionRecord_t records[ 2 ];
+    MQTTStatus_t mqttStatus;
+
+    mqttStatus = MQTT_InitSubscriptionRegistry( NULL, records, 2U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitSubscriptionRegistry( &context, NULL, 2U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitSubscriptionRegistry( &context, records, 0U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    context.subscriptionRecordCount = 1U;
+    mqttStatus = MQTT_InitSubscriptionRegistry( &context, records, 2U );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL_PTR( records, context.pSubscriptionRecords );
+    TEST_ASSERT_EQUAL( 2U, context.subscriptionRecordMaxCount );
+    TEST_ASSERT_EQUAL( 0U, context.subscriptionRecordCount );
+}
+
+/**
+ * @brief Test that the subscription registry follows SUBSCRIBE, SUBACK and
+ * UNSUBSCRIBE, and that it is replayed when a CONNACK reports no session.
+ */
+void test_MQTT_Subscription_Registry( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTContext_t context = { 0 };
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTFixedBuffer_t subscribeBuffer = { 0 };
+    MQTTSubscribeInfo_t subscribeInfo[ 3 ];
+    MQTTSubscriptionRecord_t records[ 2 ];
+    MQTTConnectInfo_t connectInfo = { 0 };
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTReasonCodeInfo_t ackInfo = { 0 };
+    const uint8_t subackCodes[ 2 ] = { MQTTSubAckSuccessQos0, MQTTSubAckFailure };
+    uint16_t packetId = MQTT_FIRST_VALID_PACKET_ID;
+    bool sessionPresent = false;
+    uint8_t buffer[ MQTT_SAMPLE_REMAINING_LENGTH + 10U ];
+    uint32_t remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    uint32_t packetSize = MQTT_SAMPLE_REMAINING_LENGTH;
+
+    setupTransportInterface( &transport );
+    setupNetworkBuffer( &networkBuffer );
+    setupSubscriptionInfo( &subscribeInfo[ 0 ] );
+    subscribeInfo[ 0 ].qos = MQTTQoS0;
+    subscribeInfo[ 1 ] = subscribeInfo[ 0 ];
+    subscribeInfo[ 1 ].pTopicFilter = "other/filter";
+    subscribeInfo[ 1 ].topicFilterLength = 12U;
+    subscribeInfo[ 2 ] = subscribeInfo[ 0 ];
+    subscribeInfo[ 2 ].pTopicFilter = "third/filter";
+    subscribeInfo[ 2 ].topicFilterLength = 12U;
+
+    MQTT_InitConnect_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    subscribeBuffer.pBuffer = buffer;
+    subscribeBuffer.size = sizeof( buffer );
+    mqttStatus = MQTT_InitSubscribeBuffer( &context, &subscribeBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    mqttStatus = MQTT_InitSubscriptionRegistry( &context, records, 2U );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+
+    context.connectStatus = MQTTConnected;
+
+    /* Both filters are recorded as waiting for the SUBACK. */
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeSubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Subscribe( &context, subscribeInfo, 2U, packetId, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 2U, context.subscriptionRecordCount );
+    TEST_ASSERT_EQUAL( packetId, records[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( 1U, records[ 1 ].subackIndex );
+
+    /* A new filter does not fit in the full registry. */
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Subscribe( &context, &subscribeInfo[ 2 ], 1U, packetId + 1U, NULL );
+    TEST_ASSERT_EQUAL( MQTTNoMemory, mqttStatus );
+    TEST_ASSERT_EQUAL( 2U, context.subscriptionRecordCount );
+
+    /* The SUBACK grants the first filter and refuses the second. */
+    incomingPacket.type = MQTT_PACKET_TYPE_SUBACK;
+    incomingPacket.remainingLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    incomingPacket.headerLength = MQTT_SAMPLE_REMAINING_LENGTH;
+    ackInfo.reasonCode = subackCodes;
+    ackInfo.reasonCodeLength = 2U;
+    modifyIncomingPacketStatus = MQTTSuccess;
+    MQTT_ProcessIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_ProcessIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_DeserializeAck_ReturnThruPtr_pPacketId( &packetId );
+    MQTT_DeserializeAck_ReturnThruPtr_pReasonCode( &ackInfo );
+    mqttStatus = MQTT_ProcessLoop( &context );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 1U, context.subscriptionRecordCount );
+    TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, records[ 0 ].packetId );
+    TEST_ASSERT_EQUAL_PTR( subscribeInfo[ 0 ].pTopicFilter, records[ 0 ].subscribeInfo.pTopicFilter );
+
+    /* The granted filter is replayed when the server has no session. */
+    context.connectStatus = MQTTNotConnected;
+    incomingPacket.type = MQTT_PACKET_TYPE_CONNACK;
+    incomingPacket.remainingLength = 2;
+    MQTTPropAdd_MaxPacketSize_IgnoreAndReturn( MQTTSuccess );
+    MQTT_GetConnectPacketSize_IgnoreAndReturn( MQTTSuccess );
+    serializeConnectFixedHeader_Stub( serializeConnectFixedHeader_cb );
+    encodeVariableLength_Stub( encodeVariableLength_cb_1bytelength );
+    MQTT_GetIncomingPacketTypeAndLength_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetIncomingPacketTypeAndLength_ReturnThruPtr_pIncomingPacket( &incomingPacket );
+    MQTT_DeserializeConnAck_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetSubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeSubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Connect( &context, &connectInfo, NULL, 0U, &sessionPresent, NULL, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 1U, context.subscriptionRecordCount );
+    TEST_ASSERT_NOT_EQUAL( MQTT_PACKET_ID_INVALID, records[ 0 ].packetId );
+
+    /* Unsubscribing removes the filter from the registry. */
+    MQTT_GetUnsubscribePacketSize_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pPacketSize( &packetSize );
+    MQTT_GetUnsubscribePacketSize_ReturnThruPtr_pRemainingLength( &remainingLength );
+    MQTT_SerializeUnsubscribe_ExpectAnyArgsAndReturn( MQTTSuccess );
+    mqttStatus = MQTT_Unsubscribe( &context, subscribeInfo, 1U, packetId + 2U, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 0U, context.subscriptionRecordCount );
+}
+
 
 void test_MQTT_Ping_invalid_params( void )
 {
@@ -10447,6 +13079,10 @@ void test_MQTT_Status_strerror( void )
     status = MQTTNeedMoreBytes + 1;
     str = MQTT_Status_strerror( status );
     TEST_ASSERT_EQUAL_STRING( "Invalid MQTT Status code", str );
+
+    status = MQTTRateLimited;
+    str = MQTT_Status_strerror( status );
+    TEST_ASSERT_EQUAL_STRING( "MQTTRateLimited", str );
 }
 
 /* ========================================================================== */
@@ -10488,6 +13124,36 @@ void test_MQTT_GetPacketId_happy_path_uint16_max( void )
 }
 /* ========================================================================== */
 
+void test_MQTT_GetPacketId_skips_in_flight_ids( void )
+{
+    uint16_t packetId = 0U;
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPubAckInfo_t outgoingRecords[ 3 ] = { 0 };
+
+    mqttContext.outgoingPublishRecords = outgoingRecords;
+    mqttContext.outgoingPublishRecordMaxCount = 3;
+    outgoingRecords[ 0 ].packetId = 5;
+    outgoingRecords[ 2 ].packetId = 6;
+
+    mqttContext.nextPacketId = 5;
+
+    packetId = MQTT_GetPacketId( &mqttContext );
+
+    TEST_ASSERT_EQUAL( 7, packetId );
+    TEST_ASSERT_EQUAL( 8, mqttContext.nextPacketId );
+
+    /* The IDs wrap around to 1 while skipping the ones in use. */
+    outgoingRecords[ 1 ].packetId = UINT16_MAX;
+    outgoingRecords[ 2 ].packetId = 1;
+    mqttContext.nextPacketId = UINT16_MAX;
+
+    packetId = MQTT_GetPacketId( &mqttContext );
+
+    TEST_ASSERT_EQUAL( 2, packetId );
+    TEST_ASSERT_EQUAL( 3, mqttContext.nextPacketId );
+}
+/* ========================================================================== */
+
 void test_MQTT_CancelCallback_null_context( void )
 {
     uint16_t packetId = 0U;
@@ -10795,6 +13461,7 @@ void test_ResendUnackedPublishesWithNotConnected( void )
     MQTT_DeserializeConnAck_ReturnThruPtr_pSessionPresent( &sessionPresent );
     MQTT_PubrelToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_TYPE_INVALID );
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( packetIdentifier );
+    MQTT_GetPublishExpiry_IgnoreAndReturn( MQTTSuccess );
 
     mqttContext.retrieveFunction = retrieveFunctionNotConnected;
 
@@ -11048,6 +13715,10 @@ void test_eventCallbackFailed3( void )
     MQTT_DeserializeDisconnect_ExpectAnyArgsAndReturn( MQTTSuccess );
     status = MQTT_ProcessLoop( &mqttContext );
     TEST_ASSERT_EQUAL( MQTTEventCallbackFailed, status );
+    TEST_ASSERT_EQUAL_INT( MQTTNotConnected, mqttContext.connectStatus );
+
+    /* Nothing received with or after the DISCONNECT is kept. */
+    TEST_ASSERT_EQUAL( 0U, mqttContext.index );
 }
 
 /**
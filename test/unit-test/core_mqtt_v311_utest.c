@@ -0,0 +1,180 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_v311_utest.c
+ * @brief Unit tests for the serializer built with MQTT_VERSION_3_1_1_ONLY.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "unity.h"
+
+/* Build the serializer sources below as the MQTT 3.1.1 only profile. */
+#define MQTT_VERSION_3_1_1_ONLY    ( 1 )
+
+/* Include paths for public enums, structures, and macros. */
+#include "core_mqtt_serializer.h"
+
+#include "../core_mqtt_serializer.c"
+#include "../core_mqtt_serializer_private.c"
+
+/* ========================================================================== */
+
+/**
+ * @brief CONNECT carries protocol level 4 and no property length.
+ */
+void test_MQTT_SerializeConnect_v311( void )
+{
+    MQTTStatus_t status;
+    MQTTConnectInfo_t connectInfo = { 0 };
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    uint8_t buffer[ 32 ] = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { buffer, sizeof( buffer ) };
+    const uint8_t expected[] =
+    {
+        0x10, 0x0E,                   /* CONNECT, remaining length 14. */
+        0x00, 0x04, 'M', 'Q', 'T', 'T',
+        0x04,                         /* Protocol level 4. */
+        0x02,                         /* Clean session. */
+        0x00, 0x3C,                   /* Keep alive 60 seconds. */
+        0x00, 0x02, 'i', 'd'          /* Client identifier, no properties. */
+    };
+
+    connectInfo.cleanSession = true;
+    connectInfo.keepAliveSeconds = 60U;
+    connectInfo.pClientIdentifier = "id";
+    connectInfo.clientIdentifierLength = 2U;
+
+    status = MQTT_GetConnectPacketSize( &connectInfo, NULL, NULL, NULL,
+                                        &remainingLength, &packetSize );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( sizeof( expected ), packetSize );
+
+    status = MQTT_SerializeConnect( &connectInfo, NULL, NULL, NULL,
+                                    remainingLength, &fixedBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8_ARRAY( expected, buffer, sizeof( expected ) );
+}
+
+/**
+ * @brief A two byte CONNACK is accepted and v3.1.1 return codes are mapped.
+ */
+void test_MQTT_DeserializeConnAck_v311( void )
+{
+    MQTTStatus_t status;
+    MQTTPacketInfo_t packetInfo = { 0 };
+    MQTTConnectionProperties_t properties = { 0 };
+    bool sessionPresent = false;
+    uint8_t buffer[ 3 ] = { 0x01, 0x00, 0x00 };
+
+    properties.maxPacketSize = MQTT_MAX_PACKET_SIZE;
+    packetInfo.type = MQTT_PACKET_TYPE_CONNACK;
+    packetInfo.pRemainingData = buffer;
+    packetInfo.remainingLength = 2U;
+
+    status = MQTT_DeserializeConnAck( &packetInfo, &sessionPresent, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_TRUE( sessionPresent );
+
+    /* Return code 5 (not authorized) is a refusal, not a malformed packet. */
+    buffer[ 0 ] = 0x00;
+    buffer[ 1 ] = 0x05;
+    status = MQTT_DeserializeConnAck( &packetInfo, &sessionPresent, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTServerRefused, status );
+
+    /* Return codes above 5 do not exist in MQTT 3.1.1. */
+    buffer[ 1 ] = 0x87;
+    status = MQTT_DeserializeConnAck( &packetInfo, &sessionPresent, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+
+    /* A CONNACK with a property length is malformed. */
+    buffer[ 1 ] = 0x00;
+    packetInfo.remainingLength = 3U;
+    status = MQTT_DeserializeConnAck( &packetInfo, &sessionPresent, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+}
+
+/**
+ * @brief SUBACK, UNSUBACK and PUBACK carry no property length.
+ */
+void test_MQTT_DeserializeAck_v311( void )
+{
+    MQTTStatus_t status;
+    MQTTPacketInfo_t packetInfo = { 0 };
+    MQTTConnectionProperties_t properties = { 0 };
+    MQTTReasonCodeInfo_t reasonCodes = { 0 };
+    uint16_t packetId = 0U;
+    uint8_t suback[] = { 0x00, 0x01, 0x01 };
+    uint8_t ack[] = { 0x00, 0x02 };
+
+    properties.maxPacketSize = MQTT_MAX_PACKET_SIZE;
+    packetInfo.type = MQTT_PACKET_TYPE_SUBACK;
+    packetInfo.pRemainingData = suback;
+    packetInfo.remainingLength = sizeof( suback );
+    status = MQTT_DeserializeAck( &packetInfo, &packetId, &reasonCodes, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT16( 1U, packetId );
+    TEST_ASSERT_EQUAL( 1U, reasonCodes.reasonCodeLength );
+    TEST_ASSERT_EQUAL_UINT8( 0x01, reasonCodes.reasonCode[ 0 ] );
+
+    packetInfo.type = MQTT_PACKET_TYPE_UNSUBACK;
+    packetInfo.pRemainingData = ack;
+    packetInfo.remainingLength = sizeof( ack );
+    status = MQTT_DeserializeAck( &packetInfo, &packetId, &reasonCodes, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT16( 2U, packetId );
+
+    packetInfo.type = MQTT_PACKET_TYPE_PUBACK;
+    status = MQTT_DeserializeAck( &packetInfo, &packetId, &reasonCodes, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT16( 2U, packetId );
+
+    /* A PUBACK with a reason code is a v5 packet. */
+    packetInfo.pRemainingData = suback;
+    packetInfo.remainingLength = sizeof( suback );
+    status = MQTT_DeserializeAck( &packetInfo, &packetId, &reasonCodes, NULL, &properties );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+}
+
+/**
+ * @brief Reason codes cannot be attached to outgoing acks.
+ */
+void test_MQTT_SerializeAck_v311( void )
+{
+    MQTTStatus_t status;
+    uint8_t buffer[ 8 ] = { 0 };
+    MQTTFixedBuffer_t fixedBuffer = { buffer, sizeof( buffer ) };
+    MQTTSuccessFailReasonCode_t reasonCode = MQTT_REASON_PUBACK_SUCCESS;
+
+    status = MQTT_SerializeAck( &fixedBuffer, MQTT_PACKET_TYPE_PUBACK, 1U, NULL, &reasonCode );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    status = MQTT_SerializeAck( &fixedBuffer, MQTT_PACKET_TYPE_PUBACK, 1U, NULL, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0x40, buffer[ 0 ] );
+    TEST_ASSERT_EQUAL_UINT8( 0x02, buffer[ 1 ] );
+}